@@ -0,0 +1,89 @@
+#ifndef APPEND_GUARD
+
+#define APPEND_GUARD
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "driver.h"
+
+//  Appending to compressed files (--append): the new data of a growing file
+// (a log, after a rotation) is compressed as a frame of its own, a whole
+// compressed file of the original or framed format, which is written at the
+// end of the compressed file, so the work is on the new data only and the
+// frames before it are never read again. Every frame is followed by a
+// footer that records where it is:
+//
+//  > The offset of the frame in the file, its length and the size of its
+//   original data (8 bytes each).
+//  > Where the footer before it ends, 0 for the first frame (8 bytes).
+//  > The number of frames up to this one (8 bytes).
+//  > The XXH64 checksum of the above (8 bytes).
+//  > The magic number "FG19ap" in ASCII.
+//
+//  The footers are chained from the last one back to that of the first
+// frame, so an append writes only its own footer. The first frame is the
+// file that was appended to, at offset 0. Every append writes its frame
+// after the last footer, then its footer after the frame, both synced to
+// the disk before the next step, so the file always has a valid footer. If
+// an append is interrupted, the last valid one is that of the append before
+// it, and the next append searches for it and cuts the file after it
+// (appending an empty file only does that). Until then, decompression finds
+// it only if the append was cut in its footer, which points to it; cut in
+// its frame, the file reads as its first frame.
+//
+//  Decompression follows the chain from the footer at the end of the file
+// (or the one a cut footer points to) and decompresses the frames one after
+// the other, each of them read through a stream that ends where the frame
+// does, so they are decompressed as the files they are (with their
+// checksums and checkpoints, and only the frames a range overlaps are
+// read).
+//
+//  With --reuse-codes, data appended to a frame of the original format is
+// coded with the code lengths of that frame, in a single pass without
+// counting the bytes first, unless it has a byte they give no code to (then
+// it is compressed as usual). The lengths are still written, every frame
+// can be decompressed on its own.
+
+// appendFrameT: The entry of a frame in its footer.
+typedef struct {
+    uint64_t offset, compLen, origSize;
+} appendFrameT;
+
+// appendIndexT: The frames of an appended file.
+typedef struct {
+    appendFrameT *frames;
+    uint64_t frameTotal;
+
+    // fileSize: Where the last footer ends.
+    uint64_t fileSize;
+} appendIndexT;
+
+//  appendFile(): Compresses srcPath to a new frame at the end of destPath,
+// which is created if it does not exist. If srcPath is empty, no frame is
+// added, destPath is only repaired.
+//   Assumptions:
+//    > All arguements != NULL
+int appendFile(const char *srcPath, const char *destPath,
+               const optionsT *opts);
+
+//  appendReadIndex(): Reads the footers of src from the one at its end, or
+// from the one before it if src ends with a footer that an interrupted
+// append cut. Only the end of src is read, files that were never appended
+// to are not searched. Returns 1 if there is one, 0 if there is not (or src
+// can not seek), -1 on errors. Leaves the position of src as it was.
+//   Assumptions:
+//    > All arguements != NULL
+int appendReadIndex(FILE *src, appendIndexT *indexPtr);
+
+void appendFreeIndex(appendIndexT *indexPtr);
+
+//  appendDecompress(): Decompresses the frames of src one after the other
+// to dest, only those a range overlaps if opts->range is set.
+//   Assumptions:
+//    > src, opts, indexPtr != NULL
+//    > dest != NULL, unless opts->verify is set
+int appendDecompress(FILE *src, FILE *dest, const optionsT *opts,
+                     const appendIndexT *indexPtr);
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef ARCHIVE_GUARD
+
+#define ARCHIVE_GUARD
+
+#include <stdio.h>
+
+//  Archives of many files, compressed with Huffman coding without going
+// through tar first. The files are compressed in groups: a file of its own,
+// or, with solid grouping, a run of small files that share a code table
+// (which would otherwise cost more than their data). Every group is a
+// single stream of the original format, with the EOF symbol after its last
+// file, and a central index at the end records where the code of the first
+// byte of every file begins, so any file can be extracted on its own. The
+// index also records the directories with nothing under them, which are
+// made again on extraction (the others are made for their files).
+//  Groups are independent, so both archiving and extraction process them
+// on all the threads.
+//
+//  The format of archives is:
+//
+//  > The magic number "FG19ar" in ASCII.
+//  > The groups, each one being:
+//          1. The code lengths of the SYM_NUM symbols (1 byte each).
+//          2. The compressed data of its files, in the order of the index.
+//  > The index:
+//          1. The entries, one per file, then one per empty directory:
+//                  > The length of the path (2 bytes) and the path, which
+//                   is relative and has no ".." components.
+//                  > The size of the file (8 bytes), 0 for a directory.
+//                  > The permission bits of the file (4 bytes).
+//                  > The group of the file (4 bytes), 0xFFFFFFFF for a
+//                   directory.
+//                  > The offset in bits of its first code within the
+//                   compressed data of the group (8 bytes).
+//          2. The groups, each one being the offset of its code lengths in
+//            the archive (8 bytes) and the number of compressed data bytes
+//            (8 bytes).
+//  > The footer: the offset of the index (8 bytes), the number of entries
+//   (8 bytes) and the number of groups (8 bytes).
+
+// Files smaller than this are grouped, with solid grouping
+#define ARCHIVE_SOLID_FILE_SIZE (64 * 1024)
+
+// Size at which a solid group is closed
+#define ARCHIVE_SOLID_GROUP_SIZE (1024 * 1024)
+
+// archiveCreate(): Archives the regular files of paths (and of the
+//  directories among them, recursively, with those left empty) to
+//  archivePath, using up to threads threads.
+//   Assumptions:
+//    > All arguements != NULL
+//    > 1 <= threads <= MAX_THREADS
+int archiveCreate(const char *archivePath, char *const paths[], int pathTotal,
+                  int solid, int threads);
+
+// archiveList(): Prints the size and path of every file of the archive,
+//  and the paths of its empty directories, ending with "/".
+//   Assumptions:
+//    > All arguements != NULL
+int archiveList(const char *archivePath, FILE *out);
+
+// archiveExtract(): Extracts the files of the archive under outDir, or
+//  only name (a file, or a directory and the files under it) if it is not
+//  NULL.
+//   Assumptions:
+//    > archivePath, outDir != NULL
+//    > 1 <= threads <= MAX_THREADS
+int archiveExtract(const char *archivePath, const char *outDir,
+                   const char *name, int threads);
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef AUTO_GUARD
+
+#define AUTO_GUARD
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "driver.h"
+
+//  Automatic selection (--auto): the method and its parameters are chosen
+// for each file instead of being given, against a target of speed (the best
+// ratio of those that compress at least as fast as the target, store
+// included, or the fastest if none does) or of ratio
+// (the best ratio of those that take at most so many times as long as the
+// fastest one that shrinks the data).
+//
+//  A sample of the file, AUTO_SAMPLE_PIECES pieces of AUTO_PIECE_SIZE bytes
+// spread over it (or all of it, if it is smaller), is measured first: the
+// entropy of its bytes, and how much of it is runs and repeats. Data that
+// looks random is stored as it is without trying anything. Otherwise every
+// candidate (store, huffman, tans, pairs, lz at levels 1, 5 and 9, order1
+// and bwt) compresses the sample on a single thread, and its size and time
+// decide.
+// bwt splits the input into blocks that are compressed at the same time, so
+// its speed is counted as that of the sample times the threads, and it is
+// given the fewest threads that meet a speed target.
+//
+//  The choice is what the frame header records (the method, the filter and
+// the parameters of the method), so decompression needs nothing more.
+//
+//  Estimation (--estimate): the same sample tells, without coding anything,
+// what Huffman coding the file would give (from the exact code lengths of
+// the histogram of the sample), and whether the file is already compressed
+// (it begins with the magic number of a compressed format, or looks
+// random), for deciding whether compressing it is worth the time.
+
+#define AUTO_PIECE_SIZE (64 * 1024)
+#define AUTO_SAMPLE_PIECES 4
+
+// Least estimated ratio for compression to be worth it
+#define AUTO_MIN_RATIO 1.1
+
+// estimateT: What Huffman coding a file would give.
+typedef struct {
+    // size: Of the file, and estSize: Of the file Huffman coded.
+    uint64_t size, estSize;
+
+    //  confidence: From 0 to 1, 1 if the sample is all of the file, else 1
+    // minus the relative standard deviation of the bits per byte of its
+    // pieces.
+    double confidence;
+
+    // compressed: The file looks already compressed.
+    int compressed;
+} estimateT;
+
+//  autoSelect(): Sets the method, its parameters and the threads of opts for
+// src and opts->autoTarget, and resolves FILTER_AUTO. Prints the
+// measurements and the choice to stderr if opts->stats is set. Leaves the
+// position of src as it was.
+//   Assumptions:
+//    > All arguements != NULL
+//    > opts->autoTarget.kind != AUTO_NONE
+int autoSelect(FILE *src, optionsT *opts);
+
+//  autoEstimate(): Estimates what Huffman coding src would give, from its
+// sample. Leaves the position of src as it was.
+//   Assumptions:
+//    > All arguements != NULL
+int autoEstimate(FILE *src, estimateT *estPtr);
+
+#endif
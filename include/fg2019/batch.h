@@ -0,0 +1,53 @@
+#ifndef BATCH_GUARD
+
+#define BATCH_GUARD
+
+#include "driver.h"
+
+//  Batch mode: (de)compression of many files by a single process, instead
+// of one process per file, each file being a job of compressFile() or
+// decompressFile() as in the single file mode.
+//  The jobs are run by a work-stealing pool: they are sorted by size and
+// dealt to the threads, each one taking the largest of its own jobs first,
+// and a thread with none left steals the half of the jobs of another one
+// that would be done last, so a few huge files among many tiny ones do not
+// leave the other threads idle. Every thread has its own stdio buffers,
+// which are reused by all of its jobs, and the number of threads is limited
+// so that the files open at the same time fit within RLIMIT_NOFILE.
+
+// Suffix of compressed files, when not given
+#define BATCH_DEFAULT_SUFFIX ".fg"
+
+// Suffix of decompressed files whose names do not end with the suffix
+#define BATCH_OUT_SUFFIX ".out"
+
+// batchParamsT: The inputs of a batch and the naming of its outputs.
+typedef struct {
+    // source: A directory, whose files (recursively) matching pattern are
+    //  the inputs, or else a file listing the inputs one per line ("-" for
+    //  the standard input).
+    const char *source;
+    const char *pattern;
+
+    //  outDir: Where the outputs are written, under the paths of their
+    // inputs, or NULL for next to the inputs.
+    const char *outDir;
+
+    //  suffix: Appended to the paths of the inputs when compressing, and
+    // removed from them when decompressing.
+    const char *suffix;
+} batchParamsT;
+
+// initBatchParams(): Sets the default parameters, with no source.
+void initBatchParams(batchParamsT *paramsPtr);
+
+//  batchRun(): Compresses (or decompresses, or verifies if opts->verify is
+// set) every input with opts, going on after a failed one. Returns -1 if
+// any failed.
+//   Assumptions:
+//    > All arguements != NULL
+//    > paramsPtr->source != NULL
+int batchRun(const batchParamsT *paramsPtr, int decompress,
+             const optionsT *opts);
+
+#endif
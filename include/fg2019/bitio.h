@@ -0,0 +1,129 @@
+#ifndef BITIO_GUARD
+
+#define BITIO_GUARD
+
+#include <stdint.h>
+#include <string.h>
+
+// Bit level reading and writing of prefix codes, shared by every encoder
+// and decoder. Bits are packed MSB first, which is the order compress()
+// has always used, so the streams produced here are identical to the
+// ones of older versions of the program.
+
+// bitWriterT: State of a bit writer, the bits that do not yet fill a whole
+//  byte are kept in acc, so that the writer can be moved between output
+//  buffers without losing anything.
+typedef struct {
+    // ptr: Where the next whole byte will be stored.
+    unsigned char *ptr;
+
+    // acc: Pending bits, right aligned.
+    uint64_t acc;
+
+    // count: Number of pending bits in acc (always < 8 between calls).
+    int count;
+} bitWriterT;
+
+// bitReaderT: State of a bit reader, the bits of acc are left aligned,
+//  so that the next MAX_CODELEN bits are acc >> (64 - MAX_CODELEN).
+typedef struct {
+    const unsigned char *ptr;
+    const unsigned char *end;
+    uint64_t acc;
+
+    // count: Number of valid bits in acc, the bits after them are 0,
+    //  which is the padding used once the input is exhausted.
+    int count;
+} bitReaderT;
+
+// loadBE64(): Loads 8 bytes as a big endian integer.
+static inline uint64_t loadBE64(const unsigned char *ptr) {
+    uint64_t val;
+
+    memcpy(&val, ptr, sizeof(val));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    val = __builtin_bswap64(val);
+#endif
+    return val;
+}
+
+static inline void bitWriterInit(bitWriterT *bw, unsigned char *out) {
+    bw->ptr = out;
+    bw->acc = 0;
+    bw->count = 0;
+}
+
+// putBits(): Appends the len LSBs of val to the stream.
+//  Assumptions:
+//   > len <= 32
+//   > There is room for (len + 7) / 8 bytes at bw->ptr.
+static inline void putBits(bitWriterT *bw, uint32_t val, int len) {
+    bw->acc = (bw->acc << len) | val;
+    bw->count += len;
+
+    while (bw->count >= 8) {
+        bw->count -= 8;
+        *bw->ptr++ = bw->acc >> bw->count;
+    }
+}
+
+// flushBits(): Writes the pending bits as a last byte, padded with 0s.
+static inline void flushBits(bitWriterT *bw) {
+    if (bw->count > 0) {
+        *bw->ptr++ = bw->acc << (8 - bw->count);
+        bw->count = 0;
+    }
+    bw->acc = 0;
+}
+
+static inline void bitReaderInit(bitReaderT *br) {
+    br->ptr = br->end = NULL;
+    br->acc = 0;
+    br->count = 0;
+}
+
+// bitReaderFeed(): Gives the reader a new piece of the stream, the state
+//  of the previous piece (the bits already in acc) is kept.
+static inline void bitReaderFeed(bitReaderT *br, const unsigned char *in,
+                                 size_t len) {
+    br->ptr = in;
+    br->end = in + len;
+}
+
+// refill(): Fills acc with at least 56 bits, or with whatever is left of
+//  the current piece of the stream.
+static inline void refill(bitReaderT *br) {
+    if (br->end - br->ptr >= 8) {
+        br->acc |= loadBE64(br->ptr) >> br->count;
+        br->ptr += (63 - br->count) >> 3;
+        br->count |= 56;
+        return;
+    }
+
+    while (br->count <= 56 && br->ptr < br->end) {
+        br->acc |= (uint64_t) *br->ptr++ << (56 - br->count);
+        br->count += 8;
+    }
+}
+
+static inline uint32_t peekBits(const bitReaderT *br, int len) {
+    return br->acc >> (64 - len);
+}
+
+static inline void skipBits(bitReaderT *br, int len) {
+    br->acc <<= len;
+    br->count -= len;
+}
+
+// getBits(): Reads len bits, refill() must have been called so that
+//  count >= len.
+//  Assumptions:
+//   > 0 < len <= 32
+static inline uint32_t getBits(bitReaderT *br, int len) {
+    uint32_t val = peekBits(br, len);
+
+    skipBits(br, len);
+    return val;
+}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef BWT_GUARD
+
+#define BWT_GUARD
+
+#include <stdint.h>
+#include <stdio.h>
+
+//  BWT method: every block of the input goes through the Burrows-Wheeler
+// transform (its suffixes sorted with SA-IS, see sais.h), then move-to-front
+// coding, which turns the runs of the transform into runs of 0s, and those
+// are written as bijective base 2 numbers of two symbols (as in bzip2).
+// The result is Huffman coded with a table per block. Blocks are independent,
+// so several of them are (de)compressed at the same time, one per thread.
+//
+//  The data of the method (after the frame header, see file.h) is a number
+// of blocks, of BWT_BLOCK_SIZE input bytes except for the last one (the
+// frame header has the total), each one containing:
+//
+//          1. The rows of the sorted rotations that begin at the starts of
+//            the BWT_CHAINS equal parts of the block (4 bytes each), the
+//            first one is the row of the whole block, whose last column
+//            entry is the end of block marker, left out of the transform.
+//          2. The code lengths of the BWT_SYM_NUM symbols (1 byte each).
+//          3. The number of bytes of encoded data (4 bytes).
+//          4. The encoded data, ending with BWT_EOB.
+//
+//  The starting rows let the inverse transform follow BWT_CHAINS chains at
+// once: every step of a chain is a random access to the block, and the
+// accesses of separate chains overlap instead of waiting for each other.
+
+//  Bytes per block, the inverse transform keeps a row and a byte in 32 bits,
+// so the rows must fit in 24 bits.
+#define BWT_BLOCK_SIZE (4 << 20)
+
+#define BWT_CHAINS 4
+
+//  The symbols coded: two for the digits of the runs of 0s, one for every
+// other move-to-front index (1 to 255, as BWT_MTF_BASE + index - 1) and
+// the end of block.
+#define BWT_RUN_A 0
+#define BWT_RUN_B 1
+#define BWT_MTF_BASE 2
+#define BWT_EOB 257
+#define BWT_SYM_NUM 258
+
+// bwtCompress(): Compresses src to dest, with up to threads blocks at a
+//  time.
+//   Assumptions:
+//    > All arguements != NULL
+//    > threads >= 1
+int bwtCompress(FILE *src, FILE *dest, int threads);
+
+// bwtCompressMem(): The least memory bwtCompress() needs, for one block.
+size_t bwtCompressMem(void);
+
+// bwtDecompress(): Decompresses the data written by bwtCompress(), which
+//  must be origSize bytes, with up to threads blocks at a time.
+//   Assumptions:
+//    > All arguements != NULL
+//    > threads >= 1
+int bwtDecompress(FILE *src, FILE *dest, uint64_t origSize, int threads);
+
+#endif
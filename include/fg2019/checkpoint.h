@@ -0,0 +1,66 @@
+#ifndef CHECKPOINT_GUARD
+
+#define CHECKPOINT_GUARD
+
+#include <stdint.h>
+#include <stdio.h>
+
+//  Huffman coding with checkpoints: the same bitstream as the original
+// format, plus a trailer recording, every interval bytes of input, where
+// the code of that byte begins. Decoding can start at any checkpoint, so a
+// range of the original file is read by seeking to the checkpoint before
+// it, instead of decoding everything from the start.
+//
+//  Such files are framed files of METHOD_HUFFMAN with FRAME_FLAG_CHECKPOINTS
+// set, and the data after the frame header is:
+//
+//  > The code lengths of the SYM_NUM symbols (1 byte each).
+//  > The number of compressed data bytes (8 bytes).
+//  > The compressed data, ending with the EOF symbol as in the original
+//   format.
+//  > The trailer:
+//          1. The interval in bytes (8 bytes).
+//          2. The number of checkpoints (8 bytes).
+//          3. The checkpoints, in order, each one being the offset in bits
+//            within the compressed data (8 bytes) and the position in the
+//            original file (8 bytes), which for the k-th checkpoint is
+//            k * interval, so the one needed for a position is found
+//            without a search.
+//
+//  The same format without checkpoints (and without a trailer) is used for
+// plain Huffman coding in framed files, such as those with a checksum.
+
+// Interval between checkpoints in KiB, when not given
+#define CKPT_DEFAULT_KIB 64
+#define CKPT_MAX_KIB (1 << 22)
+
+// ckptCompress(): Compresses src to dest, with a checkpoint every interval
+//  bytes, or none if interval is 0.
+//   Assumptions:
+//    > All arguements != NULL
+int ckptCompress(FILE *src, FILE *dest, uint64_t interval);
+
+// ckptDecompress(): Decompresses the whole data written by ckptCompress().
+//   Assumptions:
+//    > All arguements != NULL
+int ckptDecompress(FILE *src, FILE *dest);
+
+// ckptDecompressRange(): Decompresses the bytes [offset, offset + len) of
+//  the data written by ckptCompress(), out of the origSize bytes of the
+//  original file, starting from the nearest checkpoint. The range is cut
+//  at the end of the file.
+//   Assumptions:
+//    > All arguements != NULL
+//    > src is seekable.
+int ckptDecompressRange(FILE *src, FILE *dest, uint64_t origSize,
+                        uint64_t offset, uint64_t len);
+
+// legacyDecompressRange(): Same as ckptDecompressRange(), for a file of the
+//  original format (after its magic number), which has no checkpoints, so
+//  decoding starts from its beginning.
+//   Assumptions:
+//    > All arguements != NULL
+int legacyDecompressRange(FILE *src, FILE *dest, uint64_t offset,
+                          uint64_t len);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef CHECKSUM_GUARD
+
+#define CHECKSUM_GUARD
+
+#include <stddef.h> // For size_t
+#include <stdint.h>
+#include <stdio.h>
+
+//  Checksums of the original data, using XXH64, a fast non-cryptographic
+// hash whose 4 independent lanes of 8 bytes keep the processor busy (the
+// compiler is free to vectorize them).
+//  Framed files with FRAME_FLAG_CHECKSUM set end with the checksum of the
+// original file (8 bytes), after the data of their method. The hash is not
+// computed in a pass of its own: the file is read by the methods, and the
+// decompressed data written by them, through streams that hash the bytes as
+// they go by, whatever the method.
+
+// xxh64T: The state of a hash computed a piece at a time.
+typedef struct {
+    uint64_t total;
+    uint64_t lanes[4];
+    unsigned char buf[32];
+    size_t bufLen;
+} xxh64T;
+
+void xxh64Init(xxh64T *statePtr);
+
+void xxh64Update(xxh64T *statePtr, const void *data, size_t len);
+
+uint64_t xxh64Digest(const xxh64T *statePtr);
+
+// hashReader(): A stream reading src, which hashes every byte of src once,
+//  in order, however the stream is read again after seeking back. Closing
+//  it leaves src open.
+//   Assumptions:
+//    > All arguements != NULL
+FILE *hashReader(FILE *src, xxh64T *statePtr);
+
+// hashWriter(): A stream that hashes the bytes written to it, and writes
+//  them to dest, or discards them if dest is NULL. Closing it leaves dest
+//  open.
+//   Assumptions:
+//    > statePtr != NULL
+FILE *hashWriter(FILE *dest, xxh64T *statePtr);
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef CLIENT_GUARD
+
+#define CLIENT_GUARD
+
+#include <stdint.h>
+
+//  The client side of the daemon (see serve.h), for programs that would
+// otherwise run fg2019 for every file. A request passes the descriptors of
+// the files themselves over the Unix domain socket (SCM_RIGHTS), so the
+// daemon reads and writes them directly and no data goes through the
+// socket, only the request and its status.
+//
+//  The protocol, over a connection that carries any number of requests one
+// after the other:
+//
+//  > The client sends a serveRequestT, with the descriptor of the source
+//   and, unless verifying, of the destination attached.
+//  > The daemon replies with the status (4 bytes), 0 for success and -1 for
+//   failure, once it has (de)compressed the source to the destination.
+//
+//  A connection holds a thread of the daemon while it is open, so the daemon
+// closes those that send no request for SERVE_IDLE_SECS seconds, and a
+// client that waits longer between requests connects again.
+
+// Seconds a connection may wait for its next request
+#define SERVE_IDLE_SECS 10
+
+// The operations of requests
+enum { SERVE_OP_COMPRESS, SERVE_OP_DECOMPRESS, SERVE_OP_VERIFY, SERVE_OP_TOTAL };
+
+// serveRequestT: A request, with the options of the operation (see
+//  optionsT in driver.h).
+typedef struct {
+    int32_t op;
+    int32_t method;
+    int32_t pipeline;
+    int32_t windowLog, level;
+    int32_t groups;
+    int32_t checkpointKiB;
+    int32_t checksum;
+    int32_t filter, filterWidth;
+
+    // dict: Use the dictionary the daemon was started with.
+    int32_t dict;
+
+    //  autoKind, autoValue: The target of --auto (see autoTargetT in
+    // driver.h), and stats: print what it chose, to the stderr of the daemon.
+    int32_t autoKind;
+    double autoValue;
+    int32_t stats;
+
+    // range: Decompress only rangeLen bytes, starting at rangeOffset.
+    int32_t range;
+    uint64_t rangeOffset, rangeLen;
+} serveRequestT;
+
+// clientConnect(): Connects to the daemon listening at sockPath, returns
+//  the socket or -1.
+//   Assumptions:
+//    > sockPath != NULL
+int clientConnect(const char *sockPath);
+
+// clientRequest(): Sends a request to the daemon and waits for its status.
+//  destFd is not sent when verifying. Returns -1 if the request could not be
+//  sent or failed.
+//   Assumptions:
+//    > reqPtr != NULL
+int clientRequest(int sock, const serveRequestT *reqPtr, int srcFd,
+                  int destFd);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef CODER_GUARD
+
+#define CODER_GUARD
+
+#include <limits.h>
+#include <stddef.h> // For size_t
+
+#include "bitio.h"
+#include "codes.h"
+
+// Encoding and decoding of whole buffers of symbols with the lookup tables
+// of codes.h. Both keep their state in a bitWriterT/bitReaderT, so the
+// same stream can be processed in pieces of any size, which is what allows
+// compress()/decompress() and the stages of the pipeline to share them.
+
+// ENCODE_BOUND(): Maximum number of bytes produced by encoding n symbols.
+#define ENCODE_BOUND(n) (((n) * MAX_CODELEN + 7) / CHAR_BIT + 1)
+
+// encodeSyms(): Encodes n bytes of in to the stream of bw.
+//  Assumptions:
+//   > There is room for ENCODE_BOUND(n) bytes at bw->ptr.
+void encodeSyms(bitWriterT *bw, const compTableT *compTablePtr,
+                const unsigned char *in, size_t n);
+
+// encodeEOF(): Encodes the EOF symbol and pads the stream to a whole byte.
+//  Assumptions:
+//   > There is room for ENCODE_BOUND(1) bytes at bw->ptr.
+void encodeEOF(bitWriterT *bw, const compTableT *compTablePtr);
+
+// decodeSyms(): Decodes symbols to out until either outCap bytes are
+//  written, the EOF symbol is decoded (*donePtr is set), or the current
+//  piece of the stream fed to br runs out. When final is set, the piece
+//  is the last one and the missing bits of its last code are taken to be
+//  0, so fewer than outCap bytes without the EOF symbol means that the
+//  stream is malformed.
+//  Returns the number of bytes written to out.
+//   The table (see initDecompressionTable()) has a valid entry for every
+//  bit pattern, and the fast path only runs with 8 bytes of input and 4 of
+//  output to spare, so no input, however malformed, makes it read or write
+//  out of bounds, without a check per symbol.
+size_t decodeSyms(bitReaderT *br, const decompTableT *decompTablePtr,
+                  unsigned char *out, size_t outCap, int final,
+                  int *donePtr);
+
+#endif
@@ -9,6 +9,11 @@
 #define MAX_CODELEN 12                 // Max length of prefix codes
 #define DECOMP_SIZE (1 << MAX_CODELEN) // Size of lookup array (2^max)
 
+// The largest alphabet the tables can be built for. The byte alphabet of
+// plain Huffman coding has SYM_NUM symbols, other methods (such as LZ77,
+// see lz.h) extend it.
+#define MAX_SYM_NUM 512
+
 // prefixNodeT: Huffman tree node
 struct huffmanNode {
     // freq: The frequency of the symbol corresponding to the node
@@ -28,8 +33,8 @@ typedef struct huffmanNode huffmanNodeT;
 //       (val, len) code pair for every byte of the original file.
 typedef struct {
     // Vals, lens are indexed by symbol numeric value
-    unsigned int vals[SYM_NUM];
-    int lens[SYM_NUM]; // in bits
+    unsigned int vals[MAX_SYM_NUM];
+    int lens[MAX_SYM_NUM]; // in bits
 } compTableT;
 
 // decompTableT: Lookup table used in decompression, as described in
@@ -44,17 +49,32 @@ typedef struct {
 //  Input:
 //       > compTablePtr: Pointer to the compression table
 //       > freqs: Array containing the appearance frequency of all the symbols
+//       > symNum: The number of symbols of the alphabet (SYM_NUM for bytes)
 //      Output:
-//       >
-//       >
+//       > The codes of the symbols with freq != 0, the rest get length 0.
 //  Assumptions:
 //   > compTablePtr != NULL
-int initCompressionTable(compTableT *compTablePtr, size_t freqs[SYM_NUM]);
+//   > symNum <= MAX_SYM_NUM
+int initCompressionTable(compTableT *compTablePtr, const size_t *freqs,
+                         int symNum);
+
+// initCompressionTableFromLens(): Initialize the lookup table used in
+//  compression from code lengths given by initCompressionTable() before,
+//  giving the same codes.
+//  Assumptions:
+//   > compTablePtr != NULL
+//   > symNum <= MAX_SYM_NUM
+int initCompressionTableFromLens(compTableT *compTablePtr,
+                                 const unsigned char *codeLens, int symNum);
 
 // initDecompressionTable(): Initialize the lookup table used in decompression.
+//  Fails on code lengths over MAX_CODELEN or that break Kraft's inequality.
+//  Every entry of the table is set, those of no code (of an incomplete code)
+//  to symNum - 1 with length MAX_CODELEN.
 //  Assumptions:
 //   > decompTablePtr != NULL
-
-int initDecompressionTable(decompTableT *decompTablePtr, int codeLens[SYM_NUM]);
+//   > symNum <= MAX_SYM_NUM
+int initDecompressionTable(decompTableT *decompTablePtr, const int *codeLens,
+                           int symNum);
 
 #endif
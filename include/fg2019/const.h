@@ -7,6 +7,15 @@
 // special EOF symbol, defined to make decompression easier.
 #define SYM_NUM 257
 
+//   The numerical value of the EOF symbol, used to simplify the
+//  decoding process, as once an EOF symbol is decoded, no more
+//  bits of the compressed file contain data of the original and
+//  decoding can stop.
+#define EOF_VAL 256
+
+// The most threads a single (de)compression may use.
+#define MAX_THREADS 64
+
 // Size of an integer in bits.
 #define INT_SIZE sizeof(int) * 8
 
@@ -0,0 +1,42 @@
+#ifndef CONTEXT_GUARD
+
+#define CONTEXT_GUARD
+
+#include <stdint.h>
+#include <stdio.h>
+
+//  Order-1 method: every byte is coded with a code chosen by the byte
+// before it (its context). Giving each of the 256 contexts its own code
+// would cost too much header space and table memory, so the contexts are
+// clustered into a few groups of similar statistics, and every group
+// gets a canonical Huffman code.
+//
+//  The data of the method (after the frame header, see file.h) is:
+//
+//  > The number of groups (1 byte).
+//  > The group of every context (CTX_NUM bytes).
+//  > The code lengths of the SYM_NUM symbols, for every group.
+//  > The number of compressed data bytes (8 bytes).
+//  > The compressed data, ending with the EOF symbol as in the original
+//   format. The context of the first byte is 0.
+
+// Number of contexts (previous byte values)
+#define CTX_NUM 256
+
+#define CTX_MAX_GROUPS 16
+#define CTX_DEFAULT_GROUPS 8
+
+// ctxCompress(): Compresses src to dest, clustering the contexts into at
+//  most groupTotal groups.
+//   Assumptions:
+//    > All arguements != NULL
+//    > 1 <= groupTotal <= CTX_MAX_GROUPS
+int ctxCompress(FILE *src, FILE *dest, int groupTotal);
+
+// ctxDecompress(): Decompresses the data written by ctxCompress(), which
+//  must be origSize bytes.
+//   Assumptions:
+//    > All arguements != NULL
+int ctxDecompress(FILE *src, FILE *dest, uint64_t origSize);
+
+#endif
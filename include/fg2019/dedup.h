@@ -0,0 +1,53 @@
+#ifndef DEDUP_GUARD
+
+#define DEDUP_GUARD
+
+#include <stdint.h>
+#include <stdio.h>
+
+//  Dedup method: the input is cut into chunks at content-defined boundaries
+// (FastCDC: a Gear rolling hash, with a harder cut condition below the
+// average chunk size and an easier one above it), so that a run of bytes
+// repeated anywhere in the file is cut into the same chunks wherever it is,
+// even after insertions before it. Every chunk is looked up by its XXH64
+// fingerprint in a table of the chunks seen, and one found (and equal byte
+// for byte, the earlier one is read again to check) is stored as a
+// reference. Only the unique chunks are Huffman coded, with a single table
+// built from their bytes, so the repeats of files such as VM images,
+// rotated logs or backups cost neither space nor encoding time.
+//
+//  The data of the method (after the frame header, see file.h) is:
+//
+//          1. The code lengths of all SYM_NUM symbols (1 byte each).
+//          2. The number of chunks (8 bytes).
+//          3. Every chunk: its length (4 bytes), with DEDUP_REF_FLAG set for
+//            references, which are followed by the offset of the repeated
+//            chunk in the unique data (8 bytes).
+//          4. The number of bytes of encoded data (8 bytes).
+//          5. The encoded unique chunks, one after the other, and EOF.
+//
+//  References reach back at most DEDUP_WINDOW bytes of unique data, which
+// is all the decompressor keeps.
+
+// Chunk sizes of the chunker
+#define DEDUP_MIN_CHUNK (2 * 1024)
+#define DEDUP_AVG_CHUNK_LOG 13
+#define DEDUP_MAX_CHUNK (64 * 1024)
+
+// Unique data kept for references
+#define DEDUP_WINDOW (128 << 20)
+
+#define DEDUP_REF_FLAG 0x80000000u
+
+// dedupCompress(): Compresses src to dest.
+//   Assumptions:
+//    > All arguements != NULL
+int dedupCompress(FILE *src, FILE *dest);
+
+// dedupDecompress(): Decompresses the data written by dedupCompress(),
+//  which must be origSize bytes.
+//   Assumptions:
+//    > All arguements != NULL
+int dedupDecompress(FILE *src, FILE *dest, uint64_t origSize);
+
+#endif
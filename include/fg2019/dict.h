@@ -0,0 +1,63 @@
+#ifndef DICT_GUARD
+
+#define DICT_GUARD
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "codes.h"
+
+//  Dictionaries: code tables trained once on a sample of a workload, and
+// shared by all of its messages. A message that is only a few hundred bytes
+// long gives poor codes, and the SYM_NUM code lengths of the original
+// format cost more than they save, so with a dictionary the message only
+// refers to the table by its ID.
+//
+//  The format of dictionary files is:
+//
+//  > The magic number "FG19dc" in ASCII.
+//  > The ID (4 bytes), a hash of the code lengths.
+//  > The code lengths of the SYM_NUM symbols (1 byte each), none being 0,
+//   so that every byte can be encoded, seen in the samples or not.
+//
+//  Files compressed with a dictionary are framed files of METHOD_HUFFMAN
+// with FRAME_FLAG_DICT set, and the data after the frame header is the ID of
+// the dictionary (4 bytes), then the compressed data, which ends with the
+// EOF symbol as in the original format.
+
+// dictT: A loaded dictionary, with both tables built once, to be shared by
+//  every file (de)compressed with it.
+typedef struct {
+    uint32_t id;
+    compTableT compTable;
+    decompTableT decompTable;
+} dictT;
+
+// dictTrain(): Builds a dictionary from the symbol frequencies of the
+//  sample files and writes it to dictPath.
+//   Assumptions:
+//    > All arguements != NULL
+int dictTrain(const char *dictPath, char *const samplePaths[],
+              int sampleTotal);
+
+// dictLoad(): Reads a dictionary and builds its tables, or returns NULL.
+//   Assumptions:
+//    > dictPath != NULL
+dictT *dictLoad(const char *dictPath);
+
+void dictFree(dictT *dictPtr);
+
+// dictCompress(): Compresses src to dest with the table of the dictionary,
+//  in a single pass.
+//   Assumptions:
+//    > All arguements != NULL
+int dictCompress(FILE *src, FILE *dest, const dictT *dictPtr);
+
+// dictDecompress(): Decompresses the data written by dictCompress(), whose
+//  original size is origSize, checking that it refers to the dictionary.
+//   Assumptions:
+//    > All arguements != NULL
+int dictDecompress(FILE *src, FILE *dest, const dictT *dictPtr,
+                   uint64_t origSize);
+
+#endif
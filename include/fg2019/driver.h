@@ -0,0 +1,120 @@
+#ifndef DRIVER_GUARD
+
+#define DRIVER_GUARD
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "dict.h"
+#include "file.h"
+#include "filter.h"
+#include "lz.h"
+
+//  The top level of compression and decompression: the steps needed to
+// (de)compress a whole file with the chosen method and options, which are
+// the same whether the program is run for a single file from the command
+// line or for many of them.
+
+// The names of the methods, indexed by METHOD_*
+extern const char *const methodNames[METHOD_TOTAL];
+
+// The targets of --auto (see auto.h)
+enum { AUTO_NONE, AUTO_SPEED, AUTO_RATIO };
+
+// autoTargetT: What the method and parameters are chosen for.
+typedef struct {
+    //  kind: AUTO_SPEED for the best ratio at value MB/s or more, AUTO_RATIO
+    // for the best ratio within value times the time of the fastest method.
+    int kind;
+    double value;
+} autoTargetT;
+
+// optionsT: The options of (de)compression.
+typedef struct {
+    // method: One of METHOD_* (see file.h), plain Huffman coding
+    //  produces files of the original (not framed) format.
+    int method;
+
+    // pipeline: Run every stage of (de)compression on its own thread.
+    int pipeline;
+
+    // lz: Parameters of METHOD_LZ.
+    lzParamsT lz;
+
+    // groups: Maximum number of context groups of METHOD_ORDER1.
+    int groups;
+
+    // threads: Number of blocks (de)compressed at the same time by the
+    //  methods that split the input into independent blocks (METHOD_BWT),
+    //  and of the chunks of a single Huffman stream decoded at the same
+    //  time (see specdec.h).
+    int threads;
+
+    // checkpointKiB: Interval of the checkpoints of METHOD_HUFFMAN in KiB,
+    //  0 for none (and a file of the original format).
+    int checkpointKiB;
+
+    // checksum: End framed files with the checksum of the original file.
+    int checksum;
+
+    // verify: Decompress without writing the decompressed data, only
+    //  checking it.
+    int verify;
+
+    // filter: The filter of the input (see filter.h), or FILTER_AUTO.
+    filterT filter;
+
+    // dict: The dictionary of METHOD_HUFFMAN, NULL for none.
+    const dictT *dict;
+
+    // solid: Group the small files of archives (see archive.h).
+    int solid;
+
+    // stream: (De)compress as a flushable stream (see stream.h).
+    int stream;
+
+    //  maxMemory: The memory budget of the process in bytes, 0 for none,
+    // and hugePages: Use transparent huge pages for big buffers (see mem.h).
+    size_t maxMemory;
+    int hugePages;
+
+    //  autoTarget: Choose the method and its parameters for the target
+    // (kind AUTO_NONE to take them from the options).
+    autoTargetT autoTarget;
+
+    //  reuseCodes: Code the data appended to a file with the code lengths of
+    // its last frame, if they can code it (see append.h).
+    int reuseCodes;
+
+    // stats: Print the settings, sizes and speed to stderr.
+    int stats;
+
+    // range: Decompress only rangeLen bytes, starting at rangeOffset.
+    int range;
+    uint64_t rangeOffset, rangeLen;
+} optionsT;
+
+// initOptions(): Sets the default options.
+void initOptions(optionsT *opts);
+
+// compressFile(): Compresses src to dest.
+//   Assumptions:
+//    > All arguements != NULL
+int compressFile(FILE *src, FILE *dest, const optionsT *opts);
+
+// decompressFile(): Decompresses src to dest, the format and method are
+//  found from the header of src. The checksum, if any, is checked.
+//   Assumptions:
+//    > src, opts != NULL
+//    > dest != NULL, unless opts->verify is set (dest is not used then).
+int decompressFile(FILE *src, FILE *dest, const optionsT *opts);
+
+//  decompressSingle(): Decompresses src to dest as decompressFile() does,
+// but as a single file of either format, without looking for the frames of
+// an appended file (for those frames, and files known to have none).
+//   Assumptions:
+//    > src, opts != NULL
+//    > dest != NULL, unless opts->verify is set (dest is not used then).
+int decompressSingle(FILE *src, FILE *dest, const optionsT *opts);
+
+#endif
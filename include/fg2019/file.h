@@ -3,6 +3,7 @@
 #define FILE_GUARD
 
 #include <stddef.h> // For size_t
+#include <stdint.h>
 #include <stdio.h>
 
 #include "codes.h"
@@ -28,6 +29,51 @@
 //    (so the last bits do not fill a whole byte). Once the EOF symbol is
 //    decoded, no more bits are to be processed, so those "padding" bits are
 //    ignored.
+//
+//  Methods other than plain Huffman coding use framed files, which begin
+// with a frame header instead:
+//
+//          1. The magic number "FG19v2" in ASCII.
+//          2. The method used (1 byte, one of METHOD_*).
+//          3. Flags (1 byte, options of the methods, FRAME_FLAG_*).
+//          4. The size of the original file (8 bytes).
+//
+//  What follows depends on the method, see the header of each method
+// (lz.h for METHOD_LZ, context.h for METHOD_ORDER1, tans.h for METHOD_TANS,
+// bwt.h for METHOD_BWT, dedup.h for METHOD_DEDUP, pairs.h for
+// METHOD_PAIRS), METHOD_STORE is the
+// original data as it is. METHOD_HUFFMAN is framed only with checkpoints
+// (checkpoint.h), a dictionary (dict.h) or a checksum. With
+// FRAME_FLAG_CHECKSUM, the file ends with the checksum of the original file
+// (see checksum.h), after the data of the method. With FRAME_FLAG_FILTER,
+// the filter of the original file (see filter.h) comes before it. With
+// FRAME_FLAG_SPARSE, the data extents of the original file (see sparse.h)
+// come before the filter, and the size is that of the data in them.
+//
+//  A file of either format that was appended to is followed by more frames,
+// each one a file of either format with a footer indexing it (see
+// append.h).
+
+// The formats of compressed files, told apart by their magic numbers.
+enum { FORMAT_LEGACY, FORMAT_FRAME, FORMAT_ARCHIVE, FORMAT_STREAM };
+
+// The methods of framed files.
+enum { METHOD_HUFFMAN, METHOD_LZ, METHOD_ORDER1, METHOD_TANS, METHOD_BWT,
+       METHOD_DEDUP, METHOD_STORE, METHOD_PAIRS, METHOD_TOTAL };
+
+// Flags of the frame header
+#define FRAME_FLAG_CHECKPOINTS 0x01
+#define FRAME_FLAG_DICT 0x02
+#define FRAME_FLAG_CHECKSUM 0x04
+#define FRAME_FLAG_FILTER 0x08
+#define FRAME_FLAG_SPARSE 0x10
+
+// frameHeaderT: The contents of a frame header.
+typedef struct {
+    int method;
+    int flags;
+    uint64_t origSize;
+} frameHeaderT;
 
 // isEmpty(): Checks if the file is empty.
 int isEmpty(FILE *fptr);
@@ -48,14 +94,68 @@ int compress(FILE *src, FILE *dest, compTableT *compTablePtr);
 //      and writes the decompressed data to dest.
 //       Assumptions:
 //    > All arguements != NULL
-int decompress(FILE *src, FILE *dest, decompTableT decompTable, size_t compSize);
+int decompress(FILE *src, FILE *dest, const decompTableT *decompTablePtr,
+               size_t compSize);
+
+// decompressRange(): Decodes, from the compressed data that begins at the
+//  file position of src and is compSize bytes long, len bytes, after
+//  skipping skip bytes, starting at the code that begins at bit bitOffset.
+//  Stops early at the EOF symbol.
+//       Assumptions:
+//    > All arguements != NULL
+int decompressRange(FILE *src, FILE *dest, const decompTableT *decompTablePtr,
+                    uint64_t compSize, uint64_t bitOffset, uint64_t skip,
+                    uint64_t len);
+
+// writeBytes(): Writes len bytes to dest, reporting any error.
+int writeBytes(FILE *dest, const void *buf, size_t len);
+
+// readBytes(): Reads exactly len bytes from src, reporting any error, and
+//  a malformed file if there are fewer left.
+int readBytes(FILE *src, void *buf, size_t len);
+
+// writeCodeLens(): Writes the code lengths of the first symNum symbols of a
+//  table, one byte each.
+int writeCodeLens(FILE *dest, const compTableT *compTablePtr, int symNum);
+
+// readCodeLens(): Reads symNum code lengths written by writeCodeLens(),
+//  and checks that they form a valid prefix code (no length over
+//  MAX_CODELEN, Kraft's inequality holds), so that the decompression table
+//  can be built from them safely.
+int readCodeLens(FILE *src, int *codeLens, int symNum);
+
+// fileSize(): Finds the size of the (seekable) file, leaving the file
+//  position as it was.
+int fileSize(FILE *fptr, uint64_t *sizePtr);
+
+// readMagic(): Reads the magic number that begins every compressed file,
+//  and returns the format it indicates (one of FORMAT_*), or -1.
+int readMagic(FILE *src);
+
+// writeStreamMagic(): Writes the magic number of streams (see stream.h).
+int writeStreamMagic(FILE *dest);
+
+// writeArchiveMagic(): Writes the magic number of archives (see archive.h).
+int writeArchiveMagic(FILE *dest);
+
+// writeFrameHeader(): Writes the frame header (magic number included).
+int writeFrameHeader(FILE *dest, const frameHeaderT *frameHeaderPtr);
+
+// readFrameHeader(): Reads the rest of the frame header, after the magic
+//  number.
+int readFrameHeader(FILE *src, frameHeaderT *frameHeaderPtr);
 
 // writeHeader(): Writes information necessary for decompression
 // (the compression header) to the file pointed to by dest.
 int writeHeader(FILE *dest, compTableT *compTablePtr, size_t freqs[SYM_NUM]);
 
-// readHeader(): Reads the compression header, and stores the
-//  necessary information (code lengths and compressed data size).
+// makeParents(): Creates the directories of path (all but its last
+//  component) that do not exist.
+int makeParents(char *path);
+
+// readHeader(): Reads the rest of the compression header, after the magic
+//  number (see readMagic()), and stores the necessary information (code
+//  lengths and compressed data size).
 int readHeader(FILE *src, int codeLens[SYM_NUM], size_t *compSizePtr);
 
 #endif
@@ -0,0 +1,92 @@
+#ifndef FILTER_GUARD
+
+#define FILTER_GUARD
+
+#include <stddef.h> // For size_t
+#include <stdint.h>
+#include <stdio.h>
+
+//  Filters: reversible transforms of the input that run before the method
+// sees it (countSyms() included), and are inverted on the data the method
+// decompresses, for data whose bytes look random one by one but not as
+// numbers or instructions:
+//
+//  > delta: Every byte minus the one width bytes before it, which turns the
+//   slowly changing values of arrays of width byte elements (samples, time
+//   series, counters) into bytes close to 0.
+//  > stride: The bytes of arrays of width byte records split into planes,
+//   the first byte of every record, then the second one, and so on, so
+//   that alike bytes are next to each other. It does not change the byte
+//   frequencies, so it helps the methods with contexts or matches (lz,
+//   order1, bwt), not the order-0 ones.
+//  > x86: The relative targets of x86 call and jump (E8/E9) instructions
+//   turned into absolute ones, which repeat for every call of a function.
+//
+//  The data is filtered in blocks of FILTER_BLOCK_SIZE bytes, each one on
+// its own (delta starts over, stride splits the records of the block), so a
+// block can be filtered again after any seek, and the streams doing the
+// work need no memory but their block.
+//
+//  Framed files with FRAME_FLAG_FILTER set have, right after the frame
+// header, the filter (1 byte, one of FILTER_*) and its width (1 byte).
+
+// The filters, FILTER_AUTO is only an option, files have the one it chose
+enum { FILTER_NONE, FILTER_DELTA, FILTER_STRIDE, FILTER_X86, FILTER_TOTAL };
+#define FILTER_AUTO (-1)
+
+#define FILTER_BLOCK_SIZE (64 * 1024)
+
+// Widths of delta and stride
+#define FILTER_MAX_WIDTH 64
+#define FILTER_DEFAULT_DELTA_WIDTH 1
+#define FILTER_DEFAULT_STRIDE_WIDTH 4
+
+// The names of the filters, indexed by FILTER_*
+extern const char *const filterNames[FILTER_TOTAL];
+
+// filterT: A filter and its width (0 for x86 and none).
+typedef struct {
+    int type;
+    int width;
+} filterT;
+
+// checkFilter(): Checks that a filter (not FILTER_AUTO) is valid.
+int checkFilter(const filterT *filterPtr);
+
+// filterBlock(): Filters the len bytes of a block, which begins at byte
+//  pos of the input, in place.
+//   Assumptions:
+//    > len <= FILTER_BLOCK_SIZE
+//    > tmp has room for len bytes.
+void filterBlock(const filterT *filterPtr, unsigned char *block, size_t len,
+                 uint64_t pos, unsigned char *tmp);
+
+// unfilterBlock(): Undoes filterBlock().
+void unfilterBlock(const filterT *filterPtr, unsigned char *block, size_t len,
+                   uint64_t pos, unsigned char *tmp);
+
+//  filterDetect(): Chooses the filter for the file from its first blocks:
+// x86 for x86 executables, else the delta that lowers the entropy of the
+// bytes the most, if it does by enough, else none. Leaves the position of
+// src as it was.
+//   Assumptions:
+//    > All arguements != NULL
+int filterDetect(FILE *src, filterT *filterPtr);
+
+// writeFilter(), readFilter(): The filter of a framed file.
+int writeFilter(FILE *dest, const filterT *filterPtr);
+int readFilter(FILE *src, filterT *filterPtr);
+
+// filterReader(): A stream reading src from its position on, filtered,
+//  which can be seeked. Closing it leaves src open.
+//   Assumptions:
+//    > All arguements != NULL
+FILE *filterReader(FILE *src, const filterT *filterPtr);
+
+// filterWriter(): A stream that unfilters the bytes written to it and writes
+//  them to dest. Closing it writes the last block and leaves dest open.
+//   Assumptions:
+//    > All arguements != NULL
+FILE *filterWriter(FILE *dest, const filterT *filterPtr);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef GREP_GUARD
+
+#define GREP_GUARD
+
+#include <stdio.h>
+
+#include "driver.h"
+
+//  Searching compressed files (--grep): every file is decompressed into a
+// stream whose writes are searched as they come, a buffer of GREP_BUF_SIZE
+// bytes at a time that stays in the cache, instead of being written out, so
+// no decompressed data reaches the file system. The patterns are literal
+// strings, found with memmem(), and a line is printed (once, with the offset
+// of its first byte in the original file) if it holds any of them. The part
+// of a line at the end of a buffer is carried over to the next one, so
+// matches across the writes of the method are found. For a line longer
+// than the buffer, the buffer grows until the line holds a pattern (or
+// ends): its start is printed then, and the rest of it as it comes, so it
+// is printed whole and once, with only the part before the first match
+// held in memory.
+
+#define GREP_BUF_SIZE (256 * 1024)
+#define GREP_MAX_PATTERNS 16
+#define GREP_MAX_PATTERN_LEN 1024
+
+//  grepFiles(): Prints to out the lines of the decompressed paths that hold
+// any of the patterns, as [path:]offset:line, the path only if there are
+// several files (with -r, only the range is searched). Returns 1 if a line
+// matched, 0 if none did, -1 on errors (after searching the other files).
+//   Assumptions:
+//    > All arguements != NULL
+//    > 1 <= patternTotal <= GREP_MAX_PATTERNS, and the patterns are not
+//     empty and at most GREP_MAX_PATTERN_LEN bytes long.
+int grepFiles(const char *const patterns[], int patternTotal,
+              char *const paths[], int pathTotal, const optionsT *opts,
+              FILE *out);
+
+#endif
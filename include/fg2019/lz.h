@@ -0,0 +1,76 @@
+#ifndef LZ_GUARD
+
+#define LZ_GUARD
+
+#include <stdint.h>
+#include <stdio.h>
+
+//  LZ77 method: the input is parsed into literals and (length, distance)
+// matches with a hash chain match finder, and the parse is entropy coded
+// with the canonical Huffman codes of codes.h, extended past the SYM_NUM
+// byte alphabet.
+//
+//  The data of the method (after the frame header, see file.h) is:
+//
+//  > The window size log2 and the level used (1 byte each).
+//
+//  > A number of blocks, each one containing:
+//          1. The number of input bytes of the block (4 bytes), 0 for the
+//            block that ends the data.
+//          2. The code lengths of the literal/length alphabet (LZ_LL_SYM_NUM
+//            bytes) and of the distance alphabet (LZ_DIST_SYM_NUM bytes).
+//          3. The number of bytes of encoded data (4 bytes).
+//          4. The encoded data. Every token is a literal/length code, with
+//            the codes >= LZ_LEN_BASE standing for matches, followed by the
+//            extra bits of the length, the distance code and the extra bits
+//            of the distance.
+//
+//  Matches may reach back to data of previous blocks, up to the window size.
+
+#define LZ_MIN_WINDOW_LOG 10
+#define LZ_MAX_WINDOW_LOG 24
+#define LZ_DEFAULT_WINDOW_LOG 20
+
+#define LZ_MIN_LEVEL 1
+#define LZ_MAX_LEVEL 9
+#define LZ_DEFAULT_LEVEL 5
+
+// Shortest and longest match lengths
+#define LZ_MIN_MATCH 4
+#define LZ_LEN_BITS 12
+#define LZ_MAX_MATCH (LZ_MIN_MATCH + (1 << LZ_LEN_BITS) - 1)
+
+//  Lengths and distances are coded as a bucket code followed by extra bits
+// (see bucketCode() in lz.c), a value of n bits needs one of 2 * n codes.
+#define LZ_LEN_BASE 256
+#define LZ_LL_SYM_NUM (LZ_LEN_BASE + 2 * LZ_LEN_BITS)
+#define LZ_DIST_SYM_NUM (2 * LZ_MAX_WINDOW_LOG)
+
+// lzParamsT: Parameters of the match finder.
+typedef struct {
+    // windowLog: log2 of the maximum match distance
+    int windowLog;
+
+    // level: Effort spent searching for matches, from LZ_MIN_LEVEL (fastest)
+    //  to LZ_MAX_LEVEL (best ratio).
+    int level;
+} lzParamsT;
+
+// lzCompress(): Compresses src to dest, starting with the window size and
+//  level, and ending with the empty block.
+//   Assumptions:
+//    > All arguements != NULL
+//    > The parameters are within their limits.
+int lzCompress(FILE *src, FILE *dest, const lzParamsT *params);
+
+// lzCompressMem(): The least memory lzCompress() needs, with the smallest
+//  window.
+size_t lzCompressMem(void);
+
+// lzDecompress(): Decompresses the data written by lzCompress(), which
+//  should amount to origSize bytes.
+//   Assumptions:
+//    > All arguements != NULL
+int lzDecompress(FILE *src, FILE *dest, uint64_t origSize);
+
+#endif
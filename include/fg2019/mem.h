@@ -0,0 +1,52 @@
+#ifndef MEM_GUARD
+
+#define MEM_GUARD
+
+#include <stddef.h> // For size_t
+
+//  The memory of the process: all the scratch memory of (de)compression
+// (I/O buffers, tables, windows, the state of every thread) is allocated by
+// memAlloc() and friends instead of malloc(), from a single budget that is
+// set once at startup by memInit(). An allocation that would go over it
+// fails like malloc() does, with errno set to ENOMEM, and every caller
+// already fails cleanly on that, so a process under a cgroup limit stops
+// with an error instead of being killed. The methods that can do with less
+// (more threads, bigger windows) ask memAvail() and scale down first.
+//
+//  Blocks of MEM_HUGE_MIN bytes or more are mapped on their own, and with
+// huge pages on, transparent huge pages are asked for them, which saves TLB
+// misses on the big tables and windows of bwt, lz and dedup.
+
+#define MEM_HUGE_MIN (2 * 1024 * 1024)
+
+// memInit(): Sets the budget, cap bytes (0 for none), and whether huge
+//  pages are used. Called before any other thread is started.
+void memInit(size_t cap, int hugePages);
+
+// memAlloc(), memCalloc(), memRealloc(), memFree(): malloc(), calloc(),
+//  realloc() and free(), counted against the budget.
+void *memAlloc(size_t size);
+void *memCalloc(size_t num, size_t size);
+void *memRealloc(void *ptr, size_t size);
+void memFree(void *ptr);
+
+// memAvail(): The bytes that can still be allocated.
+size_t memAvail(void);
+
+//  memFitThreads(): The most threads (threads at most, 1 at least) that can
+// each allocate perThread bytes within what is left of the budget.
+int memFitThreads(int threads, size_t perThread);
+
+//  memCheck(): Fails, with a message naming what needs the memory, if need
+// bytes do not fit within what is left of the budget. For the methods that
+// can not do with less than some amount, to check it before anything is
+// written.
+int memCheck(size_t need, const char *name);
+
+// memPeak(): The most memory that was allocated at any time.
+size_t memPeak(void);
+
+// memReport(): Prints the peak usage and the budget to stderr.
+void memReport(void);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef PAIRS_GUARD
+
+#define PAIRS_GUARD
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "codes.h"
+
+//  Byte pair method: the alphabet of Huffman coding is extended with the
+// byte pairs (digrams) that are the most frequent in the file, such as "e ",
+// "th" or "\r\n" in text, and every such pair is coded as a single symbol.
+// The pairs are counted in a first pass, then the bytes are turned into
+// symbols greedily, from left to right, a byte and the one after it being a
+// single symbol whenever they are one of the pairs, and if that does not
+// code smaller than the bytes alone, there are no pairs. Decoding takes a
+// single table lookup per symbol, which gives one or two bytes.
+//
+//  The symbols are the 256 byte values, the EOF symbol, then the pairs. The
+// data of the method (after the frame header, see file.h) is:
+//
+//  > The number of pairs (1 byte, PAIRS_MAX at most).
+//  > The pairs, in the order of their symbols (2 bytes each, first byte
+//   first).
+//  > The code lengths of the SYM_NUM + number of pairs symbols.
+//  > The number of compressed data bytes (8 bytes).
+//  > The compressed data, ending with the EOF symbol as in the original
+//   format.
+
+#define PAIRS_MAX (MAX_SYM_NUM - SYM_NUM)
+
+// Least number of times a pair is seen for it to get a symbol
+#define PAIRS_MIN_COUNT 32
+
+// pairsCompress(): Compresses src to dest.
+//   Assumptions:
+//    > All arguements != NULL
+int pairsCompress(FILE *src, FILE *dest);
+
+// pairsDecompress(): Decompresses the data written by pairsCompress(),
+//  which must be origSize bytes.
+//   Assumptions:
+//    > All arguements != NULL
+int pairsDecompress(FILE *src, FILE *dest, uint64_t origSize);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef PIPELINE_GUARD
+
+#define PIPELINE_GUARD
+
+#include <stddef.h> // For size_t
+#include <stdio.h>
+
+#include "codes.h"
+#include "const.h"
+
+//  Pipelined versions of countSyms(), compress() and decompress(), where
+// every stage (reading, counting, encoding or decoding, writing) runs on
+// its own thread, so that the stages of a single stream overlap.
+//  The stages pass fixed size buffers to each other through the lock-free
+// rings of ring.h. All of the buffers are allocated before the threads
+// start, so nothing is allocated while data flows.
+//  The files produced and accepted are the same as those of the serial
+// versions.
+
+// countSymsPipelined(): Same as countSyms(), reading on one thread and
+//  counting on another.
+//   Assumptions:
+//    > src != NULL
+int countSymsPipelined(FILE *src, size_t freqs[SYM_NUM]);
+
+// compressPipelined(): Same as compress(), with the read, encode and write
+//  stages on separate threads.
+//   Assumptions:
+//    > All arguements != NULL
+int compressPipelined(FILE *src, FILE *dest, const compTableT *compTablePtr);
+
+// decompressPipelined(): Same as decompress(), with the read, decode and
+//  write stages on separate threads.
+//   Assumptions:
+//    > All arguements != NULL
+int decompressPipelined(FILE *src, FILE *dest,
+                        const decompTableT *decompTablePtr, size_t compSize);
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef RING_GUARD
+
+#define RING_GUARD
+
+#include <stdatomic.h>
+#include <stddef.h> // For size_t
+
+// Lock-free queues and buffer pools used to connect the stages of the
+// pipeline (pipeline.c). Every queue has exactly one producer and one
+// consumer thread, so a pair of atomic counters is all the synchronization
+// needed.
+
+// Size of a cache line, the counters of a ring are kept in separate lines
+// so that the producer and the consumer do not invalidate each other's.
+#define CACHE_LINE 64
+
+// ringT: Single producer/single consumer ring of pointers.
+typedef struct {
+    void **slots;
+
+    // mask: Capacity - 1, the capacity is a power of two.
+    size_t mask;
+
+    // head: Number of items popped so far, only written by the consumer.
+    _Alignas(CACHE_LINE) _Atomic size_t head;
+
+    // tail: Number of items pushed so far, only written by the producer.
+    _Alignas(CACHE_LINE) _Atomic size_t tail;
+} ringT;
+
+// pipeBufT: A buffer passed between two stages.
+typedef struct {
+    unsigned char *data;
+
+    // len: Number of bytes of data in use.
+    size_t len;
+
+    // last: Set on the last buffer of the stream.
+    int last;
+} pipeBufT;
+
+// pipeLinkT: Connection between two stages. All of its buffers are
+//  allocated by pipeLinkInit(), afterwards they circulate between the
+//  two rings: the producer takes empty buffers from freeRing and pushes
+//  them to fullRing once filled, the consumer does the opposite.
+//  Both rings can hold all of the buffers, so a push never fails.
+typedef struct {
+    pipeBufT *bufs;
+    unsigned char *mem;
+    size_t bufSize;
+    ringT freeRing;
+    ringT fullRing;
+} pipeLinkT;
+
+// ringInit(): Initializes an empty ring that can hold at least
+//  capacity items.
+//   Assumptions:
+//    > ringPtr != NULL
+//    > capacity > 0
+int ringInit(ringT *ringPtr, size_t capacity);
+
+// ringFree(): Frees the slots of the ring.
+void ringFree(ringT *ringPtr);
+
+// ringPush(): Pushes item to the ring, returns 0 if the ring is full.
+//  Must only be called by the producer.
+static inline int ringPush(ringT *ringPtr, void *item) {
+    size_t tail = atomic_load_explicit(&ringPtr->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ringPtr->head, memory_order_acquire);
+
+    if (tail - head > ringPtr->mask)
+        return 0;
+
+    ringPtr->slots[tail & ringPtr->mask] = item;
+    atomic_store_explicit(&ringPtr->tail, tail + 1, memory_order_release);
+
+    return 1;
+}
+
+// ringPop(): Pops the oldest item of the ring, returns NULL if it is empty.
+//  Must only be called by the consumer.
+static inline void *ringPop(ringT *ringPtr) {
+    size_t head = atomic_load_explicit(&ringPtr->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ringPtr->tail, memory_order_acquire);
+    void *item;
+
+    if (head == tail)
+        return NULL;
+
+    item = ringPtr->slots[head & ringPtr->mask];
+    atomic_store_explicit(&ringPtr->head, head + 1, memory_order_release);
+
+    return item;
+}
+
+// pipeLinkInit(): Allocates bufTotal buffers of bufSize bytes, and puts
+//  all of them in the free ring.
+//   Assumptions:
+//    > linkPtr != NULL
+//    > bufTotal > 0, bufSize > 0
+int pipeLinkInit(pipeLinkT *linkPtr, int bufTotal, size_t bufSize);
+
+// pipeLinkFree(): Frees the buffers and the rings of the link.
+void pipeLinkFree(pipeLinkT *linkPtr);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef SAIS_GUARD
+
+#define SAIS_GUARD
+
+#include <stdint.h>
+
+// Suffix array construction in linear time with induced sorting (SA-IS,
+// Nong, Zhang and Chan, "Two Efficient Algorithms for Linear Time Suffix
+// Array Construction").
+
+// saisBytes(): Sorts the suffixes of text[0..n-1] followed by a sentinel
+//  smaller than every byte, so sa gets n + 1 entries, sa[0] being n (the
+//  suffix made of the sentinel alone). Returns -1 if out of memory.
+//   Assumptions:
+//    > All arguements != NULL
+//    > n < INT32_MAX
+int saisBytes(const unsigned char *text, int32_t *sa, int32_t n);
+
+#endif
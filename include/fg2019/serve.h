@@ -0,0 +1,22 @@
+#ifndef SERVE_GUARD
+
+#define SERVE_GUARD
+
+#include "driver.h"
+
+//  The daemon: a process that stays up and (de)compresses files for others,
+// sparing each of them the startup of a process and the loading of a
+// dictionary. It listens on a Unix domain socket, and a pool of threads,
+// each with its own stdio buffers kept from request to request, takes the
+// connections and serves their requests (see client.h for the protocol).
+// A dictionary given when it is started is loaded once, and its tables are
+// shared by all the requests that ask for it.
+
+// serveRun(): Serves requests at sockPath with opts->threads threads, until
+//  the process is stopped. Options that requests do not carry (the
+//  threads, the dictionary) are taken from opts.
+//   Assumptions:
+//    > All arguements != NULL
+int serveRun(const char *sockPath, const optionsT *opts);
+
+#endif
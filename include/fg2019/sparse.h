@@ -0,0 +1,88 @@
+#ifndef SPARSE_GUARD
+
+#define SPARSE_GUARD
+
+#include <stddef.h> // For size_t
+#include <stdint.h>
+#include <stdio.h>
+
+//  Sparse files: files with holes (VM disk images, database files), whose
+// data extents are found with SEEK_DATA and SEEK_HOLE, so that only they
+// are read and compressed, the holes are never read. Decompression seeks
+// over the holes and sets the size of the file at the end, so they are
+// holes again, and only zeros are written when the output can not seek (a
+// pipe).
+//
+//  The method of a framed file with FRAME_FLAG_SPARSE set sees the data
+// extents one after the other (so origSize is the sum of their lengths, and
+// the checksum is of them), and right after the frame header come:
+//  > The size of the original file (8 bytes)
+//  > The number of extents (8 bytes)
+//  > For every extent, in order of offset: its offset and length (8 bytes
+//   each).
+//  Holes shorter than SPARSE_MIN_HOLE are kept in the extents, they are not
+// worth an extent of their own.
+
+#define SPARSE_MIN_HOLE (64 * 1024)
+
+// sparseExtentT: A part of the file with data.
+typedef struct {
+    uint64_t offset, len;
+
+    // packed: Where it begins in the data the method sees.
+    uint64_t packed;
+} sparseExtentT;
+
+// sparseMapT: The data extents of a file.
+typedef struct {
+    // size: The size of the file, holes included.
+    uint64_t size;
+
+    // dataSize: The sum of the lengths of the extents.
+    uint64_t dataSize;
+
+    sparseExtentT *extents;
+    size_t extentTotal, extentCap;
+} sparseMapT;
+
+//  sparseDetect(): Finds the extents of src, leaving extentTotal 0 if it has
+// no holes worth skipping (or can not tell, for pipes and file systems
+// without SEEK_HOLE). Leaves the position of src as it was.
+//   Assumptions:
+//    > All arguements != NULL
+int sparseDetect(FILE *src, sparseMapT *mapPtr);
+
+void sparseFree(sparseMapT *mapPtr);
+
+// writeSparseMap(), readSparseMap(): The extents of a framed file,
+//  readSparseMap() checks that they hold dataSize bytes.
+int writeSparseMap(FILE *dest, const sparseMapT *mapPtr);
+int readSparseMap(FILE *src, sparseMapT *mapPtr, uint64_t dataSize);
+
+// sparseReader(): A stream reading the extents of src one after the other,
+//  which can be seeked. Closing it leaves src open.
+//   Assumptions:
+//    > All arguements != NULL
+//    > The map outlives the stream.
+FILE *sparseReader(FILE *src, const sparseMapT *mapPtr);
+
+//  sparseWriter(): A stream that writes the bytes written to it to the
+// extents of dest, from its position on. Closing it gives dest the size of
+// the file, and leaves it open.
+//   Assumptions:
+//    > All arguements != NULL
+//    > The map outlives the stream.
+FILE *sparseWriter(FILE *dest, const sparseMapT *mapPtr);
+
+// sparseRangeFnT: Writes len bytes of the data of the extents, from packed on.
+typedef int (*sparseRangeFnT)(void *arg, uint64_t packed, uint64_t len);
+
+//  sparseRange(): Writes len bytes of the file from offset on (fewer past
+// its end) to dest, zeros for the holes and the data through rangeFn, so
+// ranges are of the file and not of the data the method sees.
+//   Assumptions:
+//    > mapPtr, dest, rangeFn != NULL
+int sparseRange(const sparseMapT *mapPtr, FILE *dest, uint64_t offset,
+                uint64_t len, sparseRangeFnT rangeFn, void *arg);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef SPECDEC_GUARD
+
+#define SPECDEC_GUARD
+
+#include <stddef.h> // For size_t
+#include <stdio.h>
+
+#include "codes.h"
+
+//  Parallel decoding of a single Huffman bitstream, such as the data of the
+// original format, which has no block boundaries to split it at.
+//  The stream is cut into chunks at byte boundaries, and every chunk is
+// decoded on its own thread from its first bit, as if a code began there.
+// That guess is usually wrong, but canonical Huffman codes resynchronize
+// quickly: a decoder started at the wrong bit soon lands on a code boundary
+// of the true decoding, and from there on both decode the same symbols.
+//  So once the threads are done, the chunks are stitched in order: the true
+// decoding continues serially from where the previous chunk ended, only
+// until it reaches a code boundary that the thread of the chunk also went
+// through, and the rest of the output of that thread is used as it is. If
+// they never meet, the chunk is decoded serially, so the output is always
+// the same as that of decompress().
+//  The chunks are processed in rounds of one chunk per thread, so the
+// memory used does not depend on the size of the file.
+
+// Compressed bytes per chunk
+#define SPEC_CHUNK_SIZE (1 << 20)
+
+// specDecompress(): Same as decompress(), decoding with up to threads
+//  threads.
+//   Assumptions:
+//    > All arguements != NULL
+//    > 1 <= threads <= MAX_THREADS
+//    > src is seekable.
+int specDecompress(FILE *src, FILE *dest, const decompTableT *decompTablePtr,
+                   size_t compSize, int threads);
+
+#endif
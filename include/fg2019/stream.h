@@ -0,0 +1,111 @@
+#ifndef STREAM_GUARD
+
+#define STREAM_GUARD
+
+#include <stddef.h> // For size_t
+#include <stdio.h>
+
+#include "coder.h"
+#include "codes.h"
+#include "const.h"
+
+//  Flushable streams, for data that arrives a message at a time (RPC,
+// replication) and must be sent on as soon as it does, which compress()
+// can not do, as it needs all of its input for countSyms() first.
+//  A stream is a sequence of segments, each one ended by a flush: the EOF
+// symbol, followed by the padding of its last byte, so every flush point is
+// byte aligned and the bytes before it decode on their own. The code of a
+// segment is built from the symbols of the segments before it (the first
+// one has every symbol equally likely), which the decoder has seen too, so
+// it builds the same tables and no code lengths are ever sent. Messages too
+// small to be compressed on their own get the code learned from all those
+// before them.
+//  The statistics are halved once they go over STREAM_HISTORY symbols, so
+// that the code follows the data as it changes, and the tables are only
+// rebuilt at flushes that come STREAM_REBUILD_BYTES bytes after the last
+// rebuild, which keeps the cost of a flush low for tiny messages.
+//
+//  Files written by streamCompressFile() are the magic number "FG19st",
+// then the segments.
+
+#define STREAM_HISTORY (64 * 1024)
+#define STREAM_REBUILD_BYTES 256
+
+// STREAM_DECODE_BOUND(): Maximum number of bytes produced by decoding n
+//  bytes, every code being at least 1 bit long, with up to 64 bits left
+//  over from before.
+#define STREAM_DECODE_BOUND(n) (8 * (n) + 64)
+
+// streamModelT: The statistics of the data seen so far and their code.
+typedef struct {
+    size_t freqs[SYM_NUM];
+    size_t total;
+
+    // sinceBuild: Bytes since the code was last built.
+    size_t sinceBuild;
+    compTableT compTable;
+} streamModelT;
+
+// streamEncT: The state of the encoder of a stream.
+typedef struct {
+    streamModelT model;
+
+    // bw: Holds the bits of the segment that do not fill a byte yet.
+    bitWriterT bw;
+} streamEncT;
+
+// streamDecT: The state of the decoder of a stream.
+typedef struct {
+    streamModelT model;
+    decompTableT decompTable;
+    bitReaderT br;
+
+    // midSegment: Some of the current segment has been decoded.
+    int midSegment;
+} streamDecT;
+
+int streamEncInit(streamEncT *enc);
+
+// streamEncode(): Encodes n bytes, which are added to the current segment,
+//  to out, returning the number of bytes written.
+//   Assumptions:
+//    > There is room for ENCODE_BOUND(n) bytes at out.
+size_t streamEncode(streamEncT *enc, const unsigned char *in, size_t n,
+                    unsigned char *out);
+
+// streamFlush(): Ends the current segment, writing its last bytes to out,
+//  and sets *outLenPtr to their number.
+//   Assumptions:
+//    > There is room for ENCODE_BOUND(1) bytes at out.
+int streamFlush(streamEncT *enc, unsigned char *out, size_t *outLenPtr);
+
+int streamDecInit(streamDecT *dec);
+
+//  streamDecode(): Decodes the next n bytes of a stream, split anywhere, to
+// out, and sets *outLenPtr to the number of bytes decoded. The bytes of a
+// segment are all decoded once the ones of its flush are given.
+//   Assumptions:
+//    > There is room for STREAM_DECODE_BOUND(n) bytes at out.
+int streamDecode(streamDecT *dec, const unsigned char *in, size_t n,
+                 unsigned char *out, size_t *outLenPtr);
+
+// streamDecEnd(): Checks that the stream did not end in the middle of a
+//  segment.
+int streamDecEnd(const streamDecT *dec);
+
+//  streamCompressFile(): Compresses src to dest as it arrives, each read of
+// src (a pipe, a socket, a terminal) being a segment written and flushed
+// at once.
+//   Assumptions:
+//    > All arguements != NULL
+//    > Nothing has been read from src.
+int streamCompressFile(FILE *src, FILE *dest);
+
+// streamDecompressFile(): Decompresses a file written by
+//  streamCompressFile(), writing each segment out as soon as it arrives.
+//   Assumptions:
+//    > All arguements != NULL
+//    > Nothing has been read from src.
+int streamDecompressFile(FILE *src, FILE *dest);
+
+#endif
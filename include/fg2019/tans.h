@@ -0,0 +1,47 @@
+#ifndef TANS_GUARD
+
+#define TANS_GUARD
+
+#include <stdint.h>
+#include <stdio.h>
+
+//  tANS method: the bytes are coded with a table based asymmetric numeral
+// system instead of a prefix code. The symbol frequencies (from
+// countSyms()) are normalized so that they add up to a power of two, and
+// every symbol costs close to log2(TANS_TABLE_SIZE / freq) bits instead of
+// a whole number of bits, which matters most for skewed data. Decoding
+// takes a single table lookup per symbol, as with decompTableT.
+//
+//  The data of the method (after the frame header, see file.h) is:
+//
+//  > The normalized frequency of each of the 256 byte values, as 1 byte
+//   when < 128, else as 2 bytes (the 7 LSBs with the MSB set, then the
+//   rest).
+//
+//  > A number of blocks, of TANS_BLOCK_SIZE input bytes except for the
+//   last one (the frame header has the total), each one containing:
+//          1. The number of bytes of encoded data (4 bytes).
+//          2. The encoded data. The encoder goes through the block
+//            backwards and the decoder reads the bits backwards, starting
+//            from the final state of the encoder (TANS_TABLE_LOG bits),
+//            so the data ends with that state, followed by a 1 bit and
+//            the 0 bits that pad the last byte.
+
+#define TANS_TABLE_LOG 12
+#define TANS_TABLE_SIZE (1 << TANS_TABLE_LOG)
+
+// Number of input bytes of a block
+#define TANS_BLOCK_SIZE (128 * 1024)
+
+// tansCompress(): Compresses src to dest.
+//   Assumptions:
+//    > All arguements != NULL
+int tansCompress(FILE *src, FILE *dest);
+
+// tansDecompress(): Decompresses the data written by tansCompress(), which
+//  must be origSize bytes.
+//   Assumptions:
+//    > All arguements != NULL
+int tansDecompress(FILE *src, FILE *dest, uint64_t origSize);
+
+#endif
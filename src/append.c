@@ -0,0 +1,777 @@
+// For fopencookie()
+#define _GNU_SOURCE
+
+#include "fg2019/append.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "fg2019/bitio.h"
+#include "fg2019/checksum.h"
+#include "fg2019/coder.h"
+#include "fg2019/codes.h"
+#include "fg2019/const.h"
+#include "fg2019/error.h"
+#include "fg2019/file.h"
+#include "fg2019/mem.h"
+
+#define APPEND_MAGIC_NUM "FG19ap"
+#define APPEND_MAGIC_LEN 6
+
+//  Size (in bytes) of a footer: the entry of its frame, the end of the
+// footer before it, the number of frames, the checksum and the magic number
+#define APPEND_FOOTER_SIZE \
+    (sizeof(appendFrameT) + 3 * sizeof(uint64_t) + APPEND_MAGIC_LEN)
+
+//  Size (in bytes) of the buffers of the frame streams, of the search for a
+// footer and of coding with the code lengths of the last frame
+#define APPEND_BUF_SIZE (64 * 1024)
+
+// windowStreamT: A stream reading a part of a file, a frame.
+typedef struct {
+    FILE *fptr;
+    off_t base;
+
+    // len: Of the part, and pos: the position in it.
+    uint64_t len, pos;
+} windowStreamT;
+
+static ssize_t windowRead(void *cookie, char *buf, size_t size) {
+    windowStreamT *stream = cookie;
+    size_t bytesRead;
+
+    if (stream->pos >= stream->len)
+        return 0;
+    if (size > stream->len - stream->pos)
+        size = stream->len - stream->pos;
+
+    bytesRead = fread(buf, 1, size, stream->fptr);
+    if (ferror(stream->fptr))
+        return -1;
+
+    stream->pos += bytesRead;
+    return bytesRead;
+}
+
+// windowSeek(): Seeks within the part, SEEK_END is its end.
+static int windowSeek(void *cookie, off64_t *offsetPtr, int whence) {
+    windowStreamT *stream = cookie;
+    off64_t pos;
+
+    switch (whence) {
+    case SEEK_SET:
+        pos = *offsetPtr;
+        break;
+    case SEEK_CUR:
+        pos = stream->pos + *offsetPtr;
+        break;
+    case SEEK_END:
+        pos = stream->len + *offsetPtr;
+        break;
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (pos < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (fseeko(stream->fptr, stream->base + pos, SEEK_SET) == -1)
+        return -1;
+
+    *offsetPtr = stream->pos = pos;
+    return 0;
+}
+
+static int windowClose(void *cookie) {
+    memFree(cookie);
+    return 0;
+}
+
+//  windowReader(): A stream reading the len bytes of fptr from offset on,
+// which can be seeked. Closing it leaves fptr open.
+static FILE *windowReader(FILE *fptr, uint64_t offset, uint64_t len) {
+    cookie_io_functions_t funcs = {windowRead, NULL, windowSeek, windowClose};
+    windowStreamT *stream = memAlloc(sizeof(*stream));
+    FILE *windowFptr;
+
+    if (!stream) {
+        reportError("malloc");
+        return NULL;
+    }
+
+    stream->fptr = fptr;
+    stream->base = offset;
+    stream->len = len;
+    stream->pos = 0;
+
+    if (fseeko(fptr, offset, SEEK_SET) == -1) {
+        reportError("fseeko");
+        memFree(stream);
+        return NULL;
+    }
+
+    windowFptr = fopencookie(stream, "rb", funcs);
+    if (!windowFptr) {
+        reportError("fopencookie");
+        memFree(stream);
+        return NULL;
+    }
+
+    setvbuf(windowFptr, NULL, _IOFBF, APPEND_BUF_SIZE);
+
+    return windowFptr;
+}
+
+// footerT: A footer, without its magic number.
+typedef struct {
+    appendFrameT frame;
+
+    // prevEnd: Where the footer before it ends (0 for that of the first
+    // frame), frameTotal: the number of frames up to its own.
+    uint64_t prevEnd, frameTotal, checksum;
+} footerT;
+
+// footerChecksum(): The checksum of the footer, up to the checksum.
+static uint64_t footerChecksum(const footerT *footerPtr) {
+    xxh64T hashState;
+
+    xxh64Init(&hashState);
+    xxh64Update(&hashState, footerPtr, offsetof(footerT, checksum));
+
+    return xxh64Digest(&hashState);
+}
+
+//  readLink(): Reads the footer that ends at end, if it is a valid one on
+// its own. Returns 1 if it is, 0 if not.
+static int readLink(FILE *fptr, uint64_t end, footerT *footerPtr) {
+    unsigned char buf[APPEND_FOOTER_SIZE];
+    uint64_t footerStart;
+
+    if (end < APPEND_FOOTER_SIZE + 1)
+        return 0;
+    footerStart = end - APPEND_FOOTER_SIZE;
+
+    if (fseeko(fptr, footerStart, SEEK_SET) == -1) {
+        reportError("fseeko");
+        return -1;
+    }
+    if (readBytes(fptr, buf, sizeof(buf)) < 0)
+        return -1;
+
+    if (memcmp(buf + sizeof(*footerPtr), APPEND_MAGIC_NUM,
+               APPEND_MAGIC_LEN) != 0)
+        return 0;
+    memcpy(footerPtr, buf, sizeof(*footerPtr));
+
+    if (footerChecksum(footerPtr) != footerPtr->checksum)
+        return 0;
+
+    //  The frame is right after the footer before it and right before its
+    // own, so that a footer copied into the data of a frame (a stored
+    // appended file) is not taken for one of the file
+    if (footerPtr->frameTotal == 0 ||
+        (footerPtr->frameTotal == 1) != (footerPtr->prevEnd == 0) ||
+        footerPtr->frame.offset != footerPtr->prevEnd ||
+        footerPtr->frame.compLen == 0 ||
+        footerPtr->frame.compLen != footerStart - footerPtr->frame.offset)
+        return 0;
+
+    return 1;
+}
+
+//  readFooter(): Reads the footer that ends at end, and those before it, if
+// they are all valid. Returns 1 if they are, 0 if not.
+static int readFooter(FILE *fptr, uint64_t end, appendIndexT *indexPtr) {
+    footerT footer;
+    appendFrameT *frames;
+    uint64_t frameTotal, linkEnd = end;
+    int ret;
+
+    ret = readLink(fptr, end, &footer);
+    if (ret <= 0)
+        return ret;
+
+    // Every frame has at least a byte and a footer
+    frameTotal = footer.frameTotal;
+    if (frameTotal > end / (APPEND_FOOTER_SIZE + 1))
+        return 0;
+
+    frames = memAlloc(frameTotal * sizeof(*frames));
+    if (!frames) {
+        reportError("malloc");
+        return -1;
+    }
+
+    // The footers are read from the last one back to that of the first frame
+    for (uint64_t k = frameTotal; k-- > 0;) {
+        if (k < frameTotal - 1) {
+            ret = readLink(fptr, linkEnd, &footer);
+            if (ret < 0)
+                goto fail;
+            if (ret == 0 || footer.frameTotal != k + 1) {
+                memFree(frames);
+                return 0;
+            }
+        }
+
+        frames[k] = footer.frame;
+        linkEnd = footer.prevEnd;
+    }
+
+    indexPtr->frames = frames;
+    indexPtr->frameTotal = frameTotal;
+    indexPtr->fileSize = end;
+
+    return 1;
+
+fail:
+    memFree(frames);
+    return -1;
+}
+
+//  findFooter(): Finds the last valid footer of fptr that ends before end,
+// searching for its magic number a buffer at a time from the end. Returns 1
+// if there is one, 0 if not.
+static int findFooter(FILE *fptr, uint64_t end, appendIndexT *indexPtr) {
+    unsigned char buf[APPEND_BUF_SIZE];
+    uint64_t start, stop = end;
+    size_t len;
+    int ret;
+
+    while (stop >= APPEND_FOOTER_SIZE) {
+        start = stop > APPEND_BUF_SIZE ? stop - APPEND_BUF_SIZE : 0;
+        len = stop - start;
+
+        if (fseeko(fptr, start, SEEK_SET) == -1) {
+            reportError("fseeko");
+            return -1;
+        }
+        if (readBytes(fptr, buf, len) < 0)
+            return -1;
+
+        // Most buffers have no magic number at all
+        if (!memmem(buf, len, APPEND_MAGIC_NUM, APPEND_MAGIC_LEN))
+            len = 0;
+
+        for (size_t k = len; k >= APPEND_MAGIC_LEN; k--) {
+            if (memcmp(buf + k - APPEND_MAGIC_LEN, APPEND_MAGIC_NUM,
+                       APPEND_MAGIC_LEN) != 0 ||
+                start + k >= end)
+                continue;
+
+            ret = readFooter(fptr, start + k, indexPtr);
+            if (ret != 0)
+                return ret;
+        }
+
+        if (start == 0)
+            break;
+
+        // The buffers overlap, for the magic numbers across them
+        stop = start + APPEND_MAGIC_LEN - 1;
+    }
+
+    return 0;
+}
+
+//  readTorn(): Reads the footers of fptr if it ends with the start of a
+// footer (at least the offset of its frame) that was cut while it was
+// written, after a frame and a valid footer. Returns 1 if it does, 0 if not.
+static int readTorn(FILE *fptr, uint64_t end, appendIndexT *indexPtr) {
+    unsigned char buf[APPEND_FOOTER_SIZE - 1];
+    size_t len = end < sizeof(buf) ? end : sizeof(buf);
+    appendFrameT frame;
+    uint64_t footerStart;
+    int ret;
+
+    if (fseeko(fptr, end - len, SEEK_SET) == -1) {
+        reportError("fseeko");
+        return -1;
+    }
+    if (readBytes(fptr, buf, len) < 0)
+        return -1;
+
+    // cut: The number of bytes of the footer that were written
+    for (size_t cut = sizeof(frame.offset); cut <= len; cut++) {
+        memset(&frame, 0, sizeof(frame));
+        memcpy(&frame, buf + len - cut,
+               cut < sizeof(frame) ? cut : sizeof(frame));
+        footerStart = end - cut;
+
+        //  The frame is right after the footer before it and, if its length
+        // was written, right before the cut footer
+        if (frame.offset == 0 || frame.offset >= footerStart ||
+            (cut >= offsetof(appendFrameT, origSize) &&
+             frame.compLen != footerStart - frame.offset))
+            continue;
+
+        ret = readFooter(fptr, frame.offset, indexPtr);
+        if (ret != 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+// syncFile(): Writes what is written to fptr to the disk.
+static int syncFile(FILE *fptr) {
+    if (fflush(fptr) == EOF || fsync(fileno(fptr)) == -1) {
+        reportError("fsync");
+        return -1;
+    }
+
+    return 0;
+}
+
+//  writeFooter(): Writes the footer of the last frame of the index at the
+// end of fptr, with a single write, and syncs it.
+static int writeFooter(FILE *fptr, appendIndexT *indexPtr) {
+    unsigned char buf[APPEND_FOOTER_SIZE];
+    footerT footer = {0};
+    off_t footerStart;
+
+    if (fseeko(fptr, 0, SEEK_END) == -1 ||
+        (footerStart = ftello(fptr)) == -1) {
+        reportError("fseeko");
+        return -1;
+    }
+
+    footer.frame = indexPtr->frames[indexPtr->frameTotal - 1];
+    footer.prevEnd = indexPtr->fileSize;
+    footer.frameTotal = indexPtr->frameTotal;
+    footer.checksum = footerChecksum(&footer);
+
+    memcpy(buf, &footer, sizeof(footer));
+    memcpy(buf + sizeof(footer), APPEND_MAGIC_NUM, APPEND_MAGIC_LEN);
+
+    if (writeBytes(fptr, buf, sizeof(buf)) < 0 || syncFile(fptr) < 0)
+        return -1;
+
+    indexPtr->fileSize = footerStart + APPEND_FOOTER_SIZE;
+    return 0;
+}
+
+// addFrame(): Adds a frame after the last one of the index.
+static int addFrame(appendIndexT *indexPtr, uint64_t offset, uint64_t compLen,
+                    uint64_t origSize) {
+    appendFrameT *frames;
+
+    frames = memRealloc(indexPtr->frames,
+                        (indexPtr->frameTotal + 1) * sizeof(*frames));
+    if (!frames) {
+        reportError("realloc");
+        return -1;
+    }
+
+    frames[indexPtr->frameTotal].offset = offset;
+    frames[indexPtr->frameTotal].compLen = compLen;
+    frames[indexPtr->frameTotal].origSize = origSize;
+    indexPtr->frames = frames;
+    indexPtr->frameTotal++;
+
+    return 0;
+}
+
+//  plainSize(): The size of the original data of fptr, a compressed file
+// without a footer, from its frame header, or by decompressing it (once, the
+// first time it is appended to).
+static int plainSize(FILE *fptr, const optionsT *opts, uint64_t *sizePtr) {
+    frameHeaderT frameHeader;
+    optionsT countOpts = *opts;
+    xxh64T hashState;
+    FILE *countDest;
+    int format, ret;
+
+    if (fseeko(fptr, 0, SEEK_SET) == -1) {
+        reportError("fseeko");
+        return -1;
+    }
+
+    format = readMagic(fptr);
+    if (format < 0)
+        return -1;
+
+    if (format != FORMAT_LEGACY && format != FORMAT_FRAME) {
+        fprintf(stderr, "Only compressed files of the original or framed "
+                        "format can be appended to.\n");
+        return -1;
+    }
+
+    if (format == FORMAT_FRAME) {
+        if (readFrameHeader(fptr, &frameHeader) < 0)
+            return -1;
+
+        // The size of sparse files is that of their extents
+        if (!(frameHeader.flags & FRAME_FLAG_SPARSE)) {
+            *sizePtr = frameHeader.origSize;
+            return 0;
+        }
+    }
+
+    if (fseeko(fptr, 0, SEEK_SET) == -1) {
+        reportError("fseeko");
+        return -1;
+    }
+
+    // The decompressed bytes are only counted
+    countOpts.verify = countOpts.range = 0;
+    xxh64Init(&hashState);
+    countDest = hashWriter(NULL, &hashState);
+    if (!countDest)
+        return -1;
+
+    ret = decompressSingle(fptr, countDest, &countOpts);
+    fclose(countDest);
+    *sizePtr = hashState.total;
+
+    return ret;
+}
+
+//  loadIndex(): Reads the index of fptr, after cutting what an interrupted
+// append left after the last footer, or makes one of the whole file, if it
+// has none (or an empty one, if the file is empty).
+static int loadIndex(FILE *fptr, const optionsT *opts,
+                     appendIndexT *indexPtr) {
+    uint64_t size, origSize;
+    int ret;
+
+    memset(indexPtr, 0, sizeof(*indexPtr));
+
+    if (fileSize(fptr, &size) < 0)
+        return -1;
+    if (size == 0)
+        return 0;
+
+    ret = readFooter(fptr, size, indexPtr);
+    if (ret != 0)
+        return ret < 0 ? -1 : 0;
+
+    ret = findFooter(fptr, size, indexPtr);
+    if (ret < 0)
+        return -1;
+
+    if (ret) {
+        fprintf(stderr, "Removing the %llu bytes of an interrupted append.\n",
+                (unsigned long long) (size - indexPtr->fileSize));
+
+        if (fflush(fptr) == EOF ||
+            ftruncate(fileno(fptr), indexPtr->fileSize) == -1) {
+            reportError("ftruncate");
+            return -1;
+        }
+
+        return 0;
+    }
+
+    //  The footer of the file as it is is written first, so that there is
+    // always one to go back to
+    if (plainSize(fptr, opts, &origSize) < 0 ||
+        addFrame(indexPtr, 0, size, origSize) < 0)
+        return -1;
+
+    return writeFooter(fptr, indexPtr);
+}
+
+//  reuseCompress(): Codes src to a frame of the original format at the end
+// of dest, with the code lengths of the frame of the original format at
+// prevOffset, in a single pass: the number of compressed data bytes is
+// written once they are coded. Returns 1, having written part of the frame,
+// if src has a byte they give no code to, or the frame is not of the
+// original format.
+static int reuseCompress(FILE *src, FILE *dest, off_t prevOffset) {
+    unsigned char readBuf[APPEND_BUF_SIZE];
+    unsigned char writeBuf[ENCODE_BOUND(APPEND_BUF_SIZE)], lens[SYM_NUM];
+    int codeLens[SYM_NUM];
+    size_t freqs[SYM_NUM] = {0}, compSize = 0, bytesRead, wLen;
+    compTableT compTable;
+    decompTableT decompTable;
+    bitWriterT bw;
+    off_t sizePos;
+    int format;
+
+    if (fseeko(dest, prevOffset, SEEK_SET) == -1) {
+        reportError("fseeko");
+        return -1;
+    }
+
+    // A framed file has no code lengths to reuse
+    format = readMagic(dest);
+    if (format < 0)
+        return -1;
+    if (format != FORMAT_LEGACY)
+        return 1;
+
+    if (readHeader(dest, codeLens, &compSize) < 0 ||
+        initDecompressionTable(&decompTable, codeLens, SYM_NUM) < 0)
+        return -1;
+
+    for (int k = 0; k < SYM_NUM; k++)
+        lens[k] = codeLens[k];
+
+    if (initCompressionTableFromLens(&compTable, lens, SYM_NUM) < 0)
+        return -1;
+
+    //  The header is written with no compressed data bytes (freqs are 0),
+    // their number is written at the end
+    if (fseeko(dest, 0, SEEK_END) == -1) {
+        reportError("fseeko");
+        return -1;
+    }
+    if (writeHeader(dest, &compTable, freqs) < 0)
+        return -1;
+
+    sizePos = ftello(dest);
+    if (sizePos == -1) {
+        reportError("ftello");
+        return -1;
+    }
+    sizePos -= SYM_NUM + sizeof(compSize);
+
+    compSize = 0;
+    bitWriterInit(&bw, writeBuf);
+
+    do {
+        bytesRead = fread(readBuf, 1, APPEND_BUF_SIZE, src);
+        if (ferror(src)) {
+            reportError("fread");
+            return -1;
+        }
+
+        for (size_t k = 0; k < bytesRead; k++)
+            if (!compTable.lens[readBuf[k]])
+                return 1;
+
+        encodeSyms(&bw, &compTable, readBuf, bytesRead);
+        if (feof(src))
+            encodeEOF(&bw, &compTable);
+
+        wLen = bw.ptr - writeBuf;
+        if (writeBytes(dest, writeBuf, wLen) < 0)
+            return -1;
+        compSize += wLen;
+        bw.ptr = writeBuf;
+    } while (!feof(src));
+
+    if (fseeko(dest, sizePos, SEEK_SET) == -1) {
+        reportError("fseeko");
+        return -1;
+    }
+    if (writeBytes(dest, &compSize, sizeof(compSize)) < 0)
+        return -1;
+
+    if (fseeko(dest, 0, SEEK_END) == -1) {
+        reportError("fseeko");
+        return -1;
+    }
+
+    return 0;
+}
+
+//  compressFrame(): Compresses src to a new frame at frameStart, the end of
+// dest.
+static int compressFrame(FILE *src, FILE *dest, const optionsT *opts,
+                         const appendIndexT *indexPtr, off_t frameStart) {
+    int ret;
+
+    //  Only plain Huffman coding gives frames of the original format,
+    // whose lengths can be reused
+    if (opts->reuseCodes && indexPtr->frameTotal > 0 &&
+        opts->method == METHOD_HUFFMAN && !opts->checkpointKiB &&
+        !opts->dict && !opts->checksum && opts->filter.type == FILTER_NONE &&
+        opts->autoTarget.kind == AUTO_NONE) {
+        ret = reuseCompress(src, dest,
+                            indexPtr->frames[indexPtr->frameTotal - 1].offset);
+        if (ret <= 0)
+            return ret;
+
+        // The frame is compressed again, with a code for every byte
+        if (fflush(dest) == EOF ||
+            ftruncate(fileno(dest), frameStart) == -1) {
+            reportError("ftruncate");
+            return -1;
+        }
+        if (fseeko(dest, frameStart, SEEK_SET) == -1 ||
+            fseeko(src, 0, SEEK_SET) == -1) {
+            reportError("fseeko");
+            return -1;
+        }
+    }
+
+    return compressFile(src, dest, opts);
+}
+
+int appendFile(const char *srcPath, const char *destPath,
+               const optionsT *opts) {
+    appendIndexT index = {0};
+    uint64_t origSize;
+    off_t frameStart, frameEnd;
+    FILE *src, *dest;
+    int ret = -1;
+
+    assert(srcPath != NULL);
+    assert(destPath != NULL);
+    assert(opts != NULL);
+
+    src = fopen(srcPath, "rb");
+    if (!src) {
+        reportError("fopen");
+        return -1;
+    }
+
+    if (fileSize(src, &origSize) < 0) {
+        fclose(src);
+        return -1;
+    }
+
+    dest = fopen(destPath, "r+b");
+    if (!dest && errno == ENOENT && origSize > 0)
+        dest = fopen(destPath, "w+b");
+    if (!dest) {
+        reportError("fopen");
+        fclose(src);
+        return -1;
+    }
+
+    if (loadIndex(dest, opts, &index) < 0)
+        goto out;
+
+    // Nothing to append, the file is only repaired
+    if (origSize == 0) {
+        ret = 0;
+        goto out;
+    }
+
+    if (fseeko(dest, 0, SEEK_END) == -1 ||
+        (frameStart = ftello(dest)) == -1) {
+        reportError("fseeko");
+        goto out;
+    }
+
+    // The frame is on the disk before the footer that points to it is
+    if (compressFrame(src, dest, opts, &index, frameStart) < 0 ||
+        syncFile(dest) < 0)
+        goto out;
+
+    frameEnd = ftello(dest);
+    if (frameEnd == -1) {
+        reportError("ftello");
+        goto out;
+    }
+
+    if (addFrame(&index, frameStart, frameEnd - frameStart, origSize) < 0 ||
+        writeFooter(dest, &index) < 0)
+        goto out;
+
+    ret = 0;
+out:
+    appendFreeIndex(&index);
+    fclose(src);
+    if (fclose(dest) == EOF && ret == 0) {
+        reportError("fclose");
+        ret = -1;
+    }
+
+    return ret;
+}
+
+int appendReadIndex(FILE *src, appendIndexT *indexPtr) {
+    off_t pos, end;
+    int ret;
+
+    assert(src != NULL);
+    assert(indexPtr != NULL);
+
+    // Files that can not seek (pipes) are read as they come
+    pos = ftello(src);
+    if (pos == -1 || fseeko(src, 0, SEEK_END) == -1)
+        return 0;
+
+    end = ftello(src);
+    ret = end == -1 ? 0 : readFooter(src, end, indexPtr);
+
+    //  After an append interrupted while writing its footer, the frames are
+    // those of the footer before it, the bytes after that are not a frame
+    if (ret == 0 && end != -1) {
+        ret = readTorn(src, end, indexPtr);
+        if (ret == 1)
+            fprintf(stderr, "Ignoring the %llu bytes of an interrupted "
+                            "append.\n",
+                    (unsigned long long) (end - indexPtr->fileSize));
+    }
+
+    if (fseeko(src, pos, SEEK_SET) == -1) {
+        reportError("fseeko");
+        if (ret == 1)
+            appendFreeIndex(indexPtr);
+        return -1;
+    }
+
+    return ret;
+}
+
+void appendFreeIndex(appendIndexT *indexPtr) {
+    assert(indexPtr != NULL);
+
+    memFree(indexPtr->frames);
+    indexPtr->frames = NULL;
+    indexPtr->frameTotal = 0;
+}
+
+int appendDecompress(FILE *src, FILE *dest, const optionsT *opts,
+                     const appendIndexT *indexPtr) {
+    const appendFrameT *frame;
+    optionsT frameOpts = *opts;
+    // start, end: Of the original data of the frame, and of the range.
+    uint64_t start = 0, end, rangeEnd = UINT64_MAX, from, to;
+    FILE *frameSrc;
+    int ret;
+
+    assert(src != NULL);
+    assert(opts != NULL);
+    assert(indexPtr != NULL);
+    assert(dest != NULL || opts->verify);
+
+    if (opts->range && opts->rangeLen < UINT64_MAX - opts->rangeOffset)
+        rangeEnd = opts->rangeOffset + opts->rangeLen;
+
+    for (uint64_t k = 0; k < indexPtr->frameTotal; k++, start = end) {
+        frame = &indexPtr->frames[k];
+        end = start + frame->origSize;
+
+        if (opts->range) {
+            if (end <= opts->rangeOffset || start >= rangeEnd)
+                continue;
+
+            //  The part of the range in the frame, which is decompressed
+            // whole if the range covers it, whatever its method
+            from = opts->rangeOffset > start ? opts->rangeOffset : start;
+            to = rangeEnd < end ? rangeEnd : end;
+            frameOpts.range = from > start || to < end;
+            frameOpts.rangeOffset = from - start;
+            frameOpts.rangeLen = to - from;
+        }
+
+        frameSrc = windowReader(src, frame->offset, frame->compLen);
+        if (!frameSrc)
+            return -1;
+
+        ret = decompressSingle(frameSrc, dest, &frameOpts);
+        fclose(frameSrc);
+
+        if (ret < 0) {
+            fprintf(stderr, "Frame %llu of %llu failed.\n",
+                    (unsigned long long) k + 1,
+                    (unsigned long long) indexPtr->frameTotal);
+            return -1;
+        }
+    }
+
+    return 0;
+}
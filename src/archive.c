@@ -0,0 +1,1013 @@
+#include "fg2019/archive.h"
+
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "fg2019/bitio.h"
+#include "fg2019/codes.h"
+#include "fg2019/coder.h"
+#include "fg2019/const.h"
+#include "fg2019/error.h"
+#include "fg2019/file.h"
+#include "fg2019/mem.h"
+
+// Size (in bytes) of the read and write buffers
+#define ARCHIVE_BUF_SIZE (64 * 1024)
+
+// Size of the footer, and of an entry (without its path) and a group of
+// the index
+#define FOOTER_SIZE (3 * sizeof(uint64_t))
+#define ENTRY_SIZE (sizeof(uint16_t) + 2 * sizeof(uint64_t) + \
+                    2 * sizeof(uint32_t))
+#define GROUP_SIZE (2 * sizeof(uint64_t))
+
+// The group of the entries of empty directories, which have no data
+#define DIR_GROUP UINT32_MAX
+
+// entryT: A file of the archive.
+typedef struct {
+    // path: The path stored in the index.
+    char *path;
+
+    // srcPath: The path the file is read from, when archiving.
+    char *srcPath;
+
+    uint64_t size;
+    uint32_t mode;
+    uint32_t group;
+    uint64_t bitOffset;
+} entryT;
+
+// groupT: A group of files, which are entries [first, first + total).
+typedef struct {
+    uint64_t offset, compSize;
+    size_t first, total;
+
+    // lens: The code lengths of the group, when archiving.
+    unsigned char lens[SYM_NUM];
+} groupT;
+
+//  archiveT: The entries of the files, then those of the empty directories
+// (from fileTotal on).
+typedef struct {
+    entryT *entries;
+    size_t entryTotal, entryCap, fileTotal;
+    groupT *groups;
+    size_t groupTotal;
+} archiveT;
+
+//  poolT: The groups are processed by a pool of threads, each one taking
+// the next group not taken yet, so the threads stay busy however uneven
+// the groups are.
+typedef struct poolS {
+    // func: Processes a group.
+    int (*func)(struct poolS *, size_t);
+
+    archiveT *arcPtr;
+    const char *archivePath;
+
+    // outDir, name: The arguements of archiveExtract().
+    const char *outDir, *name;
+
+    atomic_size_t next;
+    atomic_int failed;
+} poolT;
+
+static void *poolWorker(void *arg) {
+    poolT *pool = arg;
+    size_t group;
+
+    while (!atomic_load(&pool->failed)) {
+        group = atomic_fetch_add(&pool->next, 1);
+        if (group >= pool->arcPtr->groupTotal)
+            break;
+
+        if (pool->func(pool, group) < 0)
+            atomic_store(&pool->failed, 1);
+    }
+
+    return NULL;
+}
+
+//  runPool(): Runs pool->func on every group, with up to threads threads
+// (the calling one included).
+static int runPool(poolT *pool, int threads) {
+    pthread_t threadIds[MAX_THREADS];
+    int started = 0;
+
+    atomic_init(&pool->next, 0);
+    atomic_init(&pool->failed, 0);
+
+    if ((size_t) threads > pool->arcPtr->groupTotal)
+        threads = pool->arcPtr->groupTotal;
+
+    for (int k = 0; k < threads - 1; k++) {
+        errno = pthread_create(&threadIds[started], NULL, poolWorker, pool);
+        if (!errno)
+            started++;
+    }
+
+    poolWorker(pool);
+
+    for (int k = 0; k < started; k++)
+        pthread_join(threadIds[k], NULL);
+
+    return atomic_load(&pool->failed) ? -1 : 0;
+}
+
+static void freeArchive(archiveT *arcPtr) {
+    for (size_t k = 0; k < arcPtr->entryTotal; k++) {
+        free(arcPtr->entries[k].path);
+        free(arcPtr->entries[k].srcPath);
+    }
+    free(arcPtr->entries);
+    free(arcPtr->groups);
+}
+
+static char *copyString(const char *str) {
+    char *copy = malloc(strlen(str) + 1);
+
+    if (!copy) {
+        reportError("malloc");
+        return NULL;
+    }
+
+    return strcpy(copy, str);
+}
+
+//  isSafePath(): Whether a path stays under the directory it is extracted
+// to: it is relative and has no ".." components.
+static int isSafePath(const char *path) {
+    const char *comp = path;
+    size_t len;
+
+    if (*path == '/' || *path == '\0')
+        return 0;
+
+    while (*comp) {
+        len = strcspn(comp, "/");
+        if (len == 2 && !strncmp(comp, "..", 2))
+            return 0;
+
+        comp += len;
+        if (*comp == '/')
+            comp++;
+    }
+
+    return 1;
+}
+
+// storedPath(): The path stored for a file, without leading "/", "./" or
+//  "../".
+static const char *storedPath(const char *path) {
+    for (;;) {
+        if (*path == '/')
+            path++;
+        else if (!strncmp(path, "./", 2))
+            path += 2;
+        else if (!strncmp(path, "../", 3))
+            path += 3;
+        else
+            return path;
+    }
+}
+
+static int addEntry(archiveT *arcPtr, const char *srcPath,
+                    const struct stat *statPtr) {
+    const char *path = storedPath(srcPath);
+    entryT *entries, *entry;
+
+    if (!isSafePath(path) || strlen(path) > UINT16_MAX) {
+        fprintf(stderr, "%s can not be archived, its path is not a relative "
+                        "one without .. components.\n",
+                srcPath);
+        return -1;
+    }
+
+    if (arcPtr->entryTotal == arcPtr->entryCap) {
+        arcPtr->entryCap = arcPtr->entryCap ? 2 * arcPtr->entryCap : 1024;
+        entries =
+          realloc(arcPtr->entries, sizeof(*entries) * arcPtr->entryCap);
+        if (!entries) {
+            reportError("realloc");
+            return -1;
+        }
+        arcPtr->entries = entries;
+    }
+
+    entry = &arcPtr->entries[arcPtr->entryTotal];
+    memset(entry, 0, sizeof(*entry));
+    if (S_ISDIR(statPtr->st_mode))
+        entry->group = DIR_GROUP;
+    else
+        entry->size = statPtr->st_size;
+    entry->mode = statPtr->st_mode & 07777;
+    arcPtr->entryTotal++;
+
+    entry->path = copyString(path);
+    entry->srcPath = copyString(srcPath);
+    if (!entry->path || !entry->srcPath)
+        return -1;
+
+    // "dir/" is stored as "dir"
+    for (size_t len = strlen(entry->path);
+         len > 1 && entry->path[len - 1] == '/'; len--)
+        entry->path[len - 1] = '\0';
+
+    return 0;
+}
+
+//  walk(): Adds the regular files of path, recursively and in the order of
+// their names, and the directories that end up with nothing under them, so
+// that they are not lost, skipping the archive itself (archiveStatPtr).
+static int walk(archiveT *arcPtr, const char *path,
+                const struct stat *archiveStatPtr) {
+    struct dirent **names;
+    struct stat st;
+    size_t pathLen = strlen(path), entryTotal = arcPtr->entryTotal;
+    char *child;
+    int nameTotal, k, ret = -1;
+
+    if (lstat(path, &st) == -1) {
+        reportError("lstat");
+        return -1;
+    }
+
+    if (st.st_dev == archiveStatPtr->st_dev &&
+        st.st_ino == archiveStatPtr->st_ino)
+        return 0;
+
+    if (S_ISREG(st.st_mode))
+        return addEntry(arcPtr, path, &st);
+
+    if (!S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "Skipping %s, which is not a regular file or a "
+                        "directory.\n",
+                path);
+        return 0;
+    }
+
+    nameTotal = scandir(path, &names, NULL, alphasort);
+    if (nameTotal == -1) {
+        reportError("scandir");
+        return -1;
+    }
+
+    for (k = 0; k < nameTotal; k++) {
+        if (!strcmp(names[k]->d_name, ".") || !strcmp(names[k]->d_name, ".."))
+            continue;
+
+        child = malloc(pathLen + strlen(names[k]->d_name) + 2);
+        if (!child) {
+            reportError("malloc");
+            goto out;
+        }
+
+        strcpy(child, path);
+        if (pathLen == 0 || path[pathLen - 1] != '/')
+            strcat(child, "/");
+        strcat(child, names[k]->d_name);
+
+        if (walk(arcPtr, child, archiveStatPtr) < 0) {
+            free(child);
+            goto out;
+        }
+        free(child);
+    }
+
+    // Directories with entries under them are made for those entries
+    ret = arcPtr->entryTotal == entryTotal ? addEntry(arcPtr, path, &st) : 0;
+out:
+    for (k = 0; k < nameTotal; k++)
+        free(names[k]);
+    free(names);
+
+    return ret;
+}
+
+//  sortDirs(): Moves the entries of the directories after those of the
+// files, keeping the order of both.
+static int sortDirs(archiveT *arcPtr) {
+    entryT *entries = malloc(sizeof(*entries) * (arcPtr->entryTotal + 1));
+    size_t total = 0;
+
+    if (!entries) {
+        reportError("malloc");
+        return -1;
+    }
+
+    for (int dirs = 0; dirs < 2; dirs++)
+        for (size_t k = 0; k < arcPtr->entryTotal; k++)
+            if ((arcPtr->entries[k].group == DIR_GROUP) == dirs) {
+                if (!dirs)
+                    arcPtr->fileTotal++;
+                entries[total++] = arcPtr->entries[k];
+            }
+
+    free(arcPtr->entries);
+    arcPtr->entries = entries;
+    arcPtr->entryCap = arcPtr->entryTotal + 1;
+
+    return 0;
+}
+
+//  formGroups(): Gives every file a group of its own, or, when solid is set,
+// puts runs of small files in groups of up to ARCHIVE_SOLID_GROUP_SIZE
+// bytes.
+static int formGroups(archiveT *arcPtr, int solid) {
+    uint64_t groupBytes = 0;
+    groupT *group = NULL;
+    int small, open = 0;
+
+    arcPtr->groups = calloc(arcPtr->entryTotal, sizeof(*arcPtr->groups));
+    if (!arcPtr->groups) {
+        reportError("calloc");
+        return -1;
+    }
+
+    for (size_t k = 0; k < arcPtr->fileTotal; k++) {
+        small = solid && arcPtr->entries[k].size < ARCHIVE_SOLID_FILE_SIZE;
+
+        if (!small || !open || groupBytes >= ARCHIVE_SOLID_GROUP_SIZE) {
+            group = &arcPtr->groups[arcPtr->groupTotal++];
+            group->first = k;
+            open = small;
+            groupBytes = 0;
+        }
+
+        groupBytes += arcPtr->entries[k].size;
+        arcPtr->entries[k].group = arcPtr->groupTotal - 1;
+        group->total++;
+    }
+
+    return 0;
+}
+
+//  scanGroup(): Counts the symbols of the files of a group, and finds its
+// code lengths and compressed size.
+static int scanGroup(poolT *pool, size_t g) {
+    groupT *group = &pool->arcPtr->groups[g];
+    unsigned char buf[ARCHIVE_BUF_SIZE];
+    size_t freqs[SYM_NUM] = {0}, bytesRead;
+    compTableT compTable;
+    uint64_t bits = 0;
+    entryT *entry;
+    FILE *src;
+
+    for (size_t k = 0; k < group->total; k++) {
+        entry = &pool->arcPtr->entries[group->first + k];
+
+        src = fopen(entry->srcPath, "rb");
+        if (!src) {
+            reportError("fopen");
+            return -1;
+        }
+
+        // The size is the one read, in case the file changed since the walk
+        entry->size = 0;
+        while ((bytesRead = fread(buf, 1, sizeof(buf), src)) > 0) {
+            for (size_t j = 0; j < bytesRead; j++)
+                freqs[buf[j]]++;
+            entry->size += bytesRead;
+        }
+
+        if (ferror(src)) {
+            reportError("fread");
+            fclose(src);
+            return -1;
+        }
+        fclose(src);
+    }
+
+    freqs[EOF_VAL] = 1;
+    if (initCompressionTable(&compTable, freqs, SYM_NUM) < 0)
+        return -1;
+
+    for (int s = 0; s < SYM_NUM; s++) {
+        group->lens[s] = compTable.lens[s];
+        bits += freqs[s] * compTable.lens[s];
+    }
+    group->compSize = (bits + CHAR_BIT - 1) / CHAR_BIT;
+
+    return 0;
+}
+
+static int changedError(const char *path) {
+    fprintf(stderr, "%s changed while being archived.\n", path);
+    return -1;
+}
+
+//  encodeFile(): Encodes a file of a group to dest, continuing the stream
+// of bw, whose whole bytes have been written to writeBuf.
+static int encodeFile(FILE *dest, bitWriterT *bw, unsigned char *writeBuf,
+                      const compTableT *compTablePtr, entryT *entry,
+                      uint64_t *flushedPtr) {
+    unsigned char readBuf[ARCHIVE_BUF_SIZE];
+    uint64_t size = 0;
+    size_t bytesRead, wLen;
+    FILE *src;
+    int ret = -1;
+
+    entry->bitOffset = *flushedPtr * CHAR_BIT + bw->count;
+
+    src = fopen(entry->srcPath, "rb");
+    if (!src) {
+        reportError("fopen");
+        return -1;
+    }
+
+    while ((bytesRead = fread(readBuf, 1, sizeof(readBuf), src)) > 0) {
+        size += bytesRead;
+        if (size > entry->size) {
+            changedError(entry->srcPath);
+            goto out;
+        }
+
+        encodeSyms(bw, compTablePtr, readBuf, bytesRead);
+
+        wLen = bw->ptr - writeBuf;
+        if (writeBytes(dest, writeBuf, wLen) < 0)
+            goto out;
+        *flushedPtr += wLen;
+        bw->ptr = writeBuf;
+    }
+
+    if (ferror(src)) {
+        reportError("fread");
+        goto out;
+    }
+
+    if (size != entry->size) {
+        changedError(entry->srcPath);
+        goto out;
+    }
+
+    ret = 0;
+out:
+    fclose(src);
+
+    return ret;
+}
+
+//  encodeGroup(): Writes a group at its offset, through a FILE of its own,
+// so that groups are written at the same time.
+static int encodeGroup(poolT *pool, size_t g) {
+    groupT *group = &pool->arcPtr->groups[g];
+    unsigned char writeBuf[ENCODE_BOUND(ARCHIVE_BUF_SIZE)];
+    compTableT compTable;
+    uint64_t flushed = 0;
+    bitWriterT bw;
+    FILE *dest;
+    int ret = -1;
+
+    if (initCompressionTableFromLens(&compTable, group->lens, SYM_NUM) < 0)
+        return -1;
+
+    dest = fopen(pool->archivePath, "r+b");
+    if (!dest) {
+        reportError("fopen");
+        return -1;
+    }
+
+    if (fseeko(dest, group->offset, SEEK_SET) == -1) {
+        reportError("fseeko");
+        goto out;
+    }
+
+    if (writeCodeLens(dest, &compTable, SYM_NUM) < 0)
+        goto out;
+
+    bitWriterInit(&bw, writeBuf);
+
+    for (size_t k = 0; k < group->total; k++)
+        if (encodeFile(dest, &bw, writeBuf, &compTable,
+                       &pool->arcPtr->entries[group->first + k],
+                       &flushed) < 0)
+            goto out;
+
+    encodeEOF(&bw, &compTable);
+    if (writeBytes(dest, writeBuf, bw.ptr - writeBuf) < 0)
+        goto out;
+    flushed += bw.ptr - writeBuf;
+
+    // The contents changed, even if the sizes did not
+    if (flushed != group->compSize) {
+        changedError(pool->arcPtr->entries[group->first].srcPath);
+        goto out;
+    }
+
+    ret = 0;
+out:
+    if (fclose(dest) == EOF && ret == 0) {
+        reportError("fclose");
+        ret = -1;
+    }
+
+    return ret;
+}
+
+static int writeIndex(FILE *dest, const archiveT *arcPtr,
+                      uint64_t indexOffset) {
+    uint64_t footer[3];
+    uint16_t pathLen;
+
+    for (size_t k = 0; k < arcPtr->entryTotal; k++) {
+        const entryT *entry = &arcPtr->entries[k];
+
+        pathLen = strlen(entry->path);
+        if (writeBytes(dest, &pathLen, sizeof(pathLen)) < 0 ||
+            writeBytes(dest, entry->path, pathLen) < 0 ||
+            writeBytes(dest, &entry->size, sizeof(entry->size)) < 0 ||
+            writeBytes(dest, &entry->mode, sizeof(entry->mode)) < 0 ||
+            writeBytes(dest, &entry->group, sizeof(entry->group)) < 0 ||
+            writeBytes(dest, &entry->bitOffset, sizeof(entry->bitOffset)) < 0)
+            return -1;
+    }
+
+    for (size_t k = 0; k < arcPtr->groupTotal; k++)
+        if (writeBytes(dest, &arcPtr->groups[k].offset, sizeof(uint64_t)) < 0 ||
+            writeBytes(dest, &arcPtr->groups[k].compSize, sizeof(uint64_t)) <
+              0)
+            return -1;
+
+    footer[0] = indexOffset;
+    footer[1] = arcPtr->entryTotal;
+    footer[2] = arcPtr->groupTotal;
+
+    return writeBytes(dest, footer, sizeof(footer));
+}
+
+int archiveCreate(const char *archivePath, char *const paths[], int pathTotal,
+                  int solid, int threads) {
+    archiveT arc = {0};
+    struct stat archiveStat;
+    poolT pool = {0};
+    off_t pos;
+    FILE *dest;
+    int ret = -1;
+
+    assert(archivePath != NULL);
+    assert(paths != NULL);
+    assert(threads >= 1 && threads <= MAX_THREADS);
+
+    dest = fopen(archivePath, "wb");
+    if (!dest) {
+        reportError("fopen");
+        return -1;
+    }
+
+    if (writeArchiveMagic(dest) < 0)
+        goto out;
+
+    if (fflush(dest) == EOF || fstat(fileno(dest), &archiveStat) == -1) {
+        reportError("fstat");
+        goto out;
+    }
+
+    for (int k = 0; k < pathTotal; k++)
+        if (walk(&arc, paths[k], &archiveStat) < 0)
+            goto out;
+
+    if (arc.entryTotal == 0) {
+        fprintf(stderr, "There are no files to archive.\n");
+        goto out;
+    }
+
+    if (sortDirs(&arc) < 0 || formGroups(&arc, solid) < 0)
+        goto out;
+
+    pool.arcPtr = &arc;
+    pool.archivePath = archivePath;
+
+    // Every group is scanned first, as its size is needed for the offsets
+    // of the groups after it
+    pool.func = scanGroup;
+    if (runPool(&pool, threads) < 0)
+        goto out;
+
+    pos = ftello(dest);
+    if (pos == -1) {
+        reportError("ftello");
+        goto out;
+    }
+
+    for (size_t k = 0; k < arc.groupTotal; k++) {
+        arc.groups[k].offset = pos;
+        pos += SYM_NUM + arc.groups[k].compSize;
+    }
+
+    pool.func = encodeGroup;
+    if (runPool(&pool, threads) < 0)
+        goto out;
+
+    if (fseeko(dest, pos, SEEK_SET) == -1) {
+        reportError("fseeko");
+        goto out;
+    }
+
+    if (writeIndex(dest, &arc, pos) < 0)
+        goto out;
+
+    ret = 0;
+out:
+    if (fclose(dest) == EOF && ret == 0) {
+        reportError("fclose");
+        ret = -1;
+    }
+    freeArchive(&arc);
+
+    return ret;
+}
+
+static int malformed(void) {
+    fprintf(stderr, "%s:%d: Malformed archive index.\n", __FILE__, __LINE__);
+    return -1;
+}
+
+// take(): Takes len bytes from the index being parsed.
+static int take(const unsigned char **ptrPtr, const unsigned char *end,
+                void *val, size_t len) {
+    if ((size_t) (end - *ptrPtr) < len)
+        return -1;
+
+    memcpy(val, *ptrPtr, len);
+    *ptrPtr += len;
+    return 0;
+}
+
+//  parseIndex(): Fills the archive from the index, checking that everything
+// it points at is within the groups.
+static int parseIndex(archiveT *arcPtr, const unsigned char *ptr,
+                      const unsigned char *end, uint64_t dataStart,
+                      uint64_t indexOffset) {
+    uint16_t pathLen;
+    entryT *entry;
+    groupT *group;
+
+    for (size_t k = 0; k < arcPtr->entryTotal; k++) {
+        entry = &arcPtr->entries[k];
+
+        if (take(&ptr, end, &pathLen, sizeof(pathLen)) < 0 ||
+            (size_t) (end - ptr) < pathLen)
+            return malformed();
+
+        entry->path = malloc(pathLen + 1);
+        if (!entry->path) {
+            reportError("malloc");
+            return -1;
+        }
+        memcpy(entry->path, ptr, pathLen);
+        entry->path[pathLen] = '\0';
+        ptr += pathLen;
+
+        if (strlen(entry->path) != pathLen || !isSafePath(entry->path))
+            return malformed();
+
+        if (take(&ptr, end, &entry->size, sizeof(entry->size)) < 0 ||
+            take(&ptr, end, &entry->mode, sizeof(entry->mode)) < 0 ||
+            take(&ptr, end, &entry->group, sizeof(entry->group)) < 0 ||
+            take(&ptr, end, &entry->bitOffset, sizeof(entry->bitOffset)) < 0)
+            return malformed();
+
+        //  The entries of a group are consecutive, and those of the
+        // directories come last
+        if (entry->group == DIR_GROUP) {
+            if (entry->size)
+                return malformed();
+            continue;
+        }
+        if (entry->group >= arcPtr->groupTotal ||
+            (k > 0 && entry->group < arcPtr->entries[k - 1].group))
+            return malformed();
+        arcPtr->fileTotal++;
+
+        group = &arcPtr->groups[entry->group];
+        if (group->total++ == 0)
+            group->first = k;
+    }
+
+    for (size_t k = 0; k < arcPtr->groupTotal; k++) {
+        group = &arcPtr->groups[k];
+
+        if (take(&ptr, end, &group->offset, sizeof(uint64_t)) < 0 ||
+            take(&ptr, end, &group->compSize, sizeof(uint64_t)) < 0)
+            return malformed();
+
+        if (group->offset < dataStart || group->offset > indexOffset ||
+            indexOffset - group->offset < SYM_NUM ||
+            indexOffset - group->offset - SYM_NUM < group->compSize)
+            return malformed();
+    }
+
+    return ptr == end ? 0 : malformed();
+}
+
+// readIndex(): Reads the index of an archive.
+static int readIndex(FILE *src, archiveT *arcPtr) {
+    uint64_t size, footer[3], indexLen;
+    unsigned char *buf = NULL;
+    off_t dataStart;
+    int ret = -1;
+
+    switch (readMagic(src)) {
+    case FORMAT_ARCHIVE:
+        break;
+    case -1:
+        return -1;
+    default:
+        fprintf(stderr, "The file is not an archive.\n");
+        return -1;
+    }
+
+    dataStart = ftello(src);
+    if (dataStart == -1 || fileSize(src, &size) < 0)
+        return -1;
+
+    if (size < dataStart + FOOTER_SIZE)
+        return malformed();
+
+    if (fseeko(src, size - FOOTER_SIZE, SEEK_SET) == -1) {
+        reportError("fseeko");
+        return -1;
+    }
+
+    if (readBytes(src, footer, sizeof(footer)) < 0)
+        return -1;
+
+    if (footer[0] < (uint64_t) dataStart || footer[0] > size - FOOTER_SIZE)
+        return malformed();
+    indexLen = size - FOOTER_SIZE - footer[0];
+
+    if (footer[1] == 0 || footer[1] > indexLen / ENTRY_SIZE ||
+        footer[2] > footer[1])
+        return malformed();
+
+    arcPtr->entryTotal = footer[1];
+    arcPtr->groupTotal = footer[2];
+    arcPtr->entries = calloc(arcPtr->entryTotal, sizeof(*arcPtr->entries));
+    arcPtr->groups = calloc(arcPtr->groupTotal + 1, sizeof(*arcPtr->groups));
+    buf = memAlloc(indexLen);
+    if (!arcPtr->entries || !arcPtr->groups || !buf) {
+        reportError("malloc");
+        goto out;
+    }
+
+    if (fseeko(src, footer[0], SEEK_SET) == -1) {
+        reportError("fseeko");
+        goto out;
+    }
+
+    if (readBytes(src, buf, indexLen) < 0)
+        goto out;
+
+    ret = parseIndex(arcPtr, buf, buf + indexLen, dataStart, footer[0]);
+out:
+    memFree(buf);
+
+    return ret;
+}
+
+// openArchive(): Opens an archive and reads its index.
+static FILE *openArchive(const char *archivePath, archiveT *arcPtr) {
+    FILE *src = fopen(archivePath, "rb");
+
+    if (!src) {
+        reportError("fopen");
+        return NULL;
+    }
+
+    if (readIndex(src, arcPtr) < 0) {
+        fclose(src);
+        return NULL;
+    }
+
+    return src;
+}
+
+int archiveList(const char *archivePath, FILE *out) {
+    archiveT arc = {0};
+    FILE *src;
+
+    assert(archivePath != NULL);
+    assert(out != NULL);
+
+    src = openArchive(archivePath, &arc);
+    if (!src) {
+        freeArchive(&arc);
+        return -1;
+    }
+    fclose(src);
+
+    for (size_t k = 0; k < arc.entryTotal; k++)
+        fprintf(out, "%12" PRIu64 "  %s%s\n", arc.entries[k].size,
+                arc.entries[k].path, k < arc.fileTotal ? "" : "/");
+
+    freeArchive(&arc);
+
+    return 0;
+}
+
+// isSelected(): Whether path is name, or is under the directory name.
+static int isSelected(const char *path, const char *name) {
+    size_t len;
+
+    if (!name)
+        return 1;
+
+    len = strlen(name);
+    while (len > 0 && name[len - 1] == '/')
+        len--;
+
+    return !strncmp(path, name, len) && (path[len] == '\0' || path[len] == '/');
+}
+
+// extractFile(): Decodes a file of a group to its path under outDir.
+static int extractFile(poolT *pool, FILE *src, const groupT *group,
+                       const decompTableT *decompTablePtr,
+                       const entryT *entry) {
+    size_t outLen = strlen(pool->outDir) + strlen(entry->path) + 2;
+    char *outPath = malloc(outLen);
+    FILE *dest = NULL;
+    off_t written;
+    int ret = -1;
+
+    if (!outPath) {
+        reportError("malloc");
+        return -1;
+    }
+    snprintf(outPath, outLen, "%s/%s", pool->outDir, entry->path);
+
+    if (makeParents(outPath) < 0)
+        goto out;
+
+    dest = fopen(outPath, "wb");
+    if (!dest) {
+        reportError("fopen");
+        goto out;
+    }
+
+    if (entry->size) {
+        if (fseeko(src, group->offset + SYM_NUM, SEEK_SET) == -1) {
+            reportError("fseeko");
+            goto out;
+        }
+
+        if (decompressRange(src, dest, decompTablePtr, group->compSize,
+                            entry->bitOffset, 0, entry->size) < 0)
+            goto out;
+    }
+
+    // The EOF symbol came first
+    written = ftello(dest);
+    if (written == -1 || (uint64_t) written != entry->size) {
+        fprintf(stderr, "%s:%d: Malformed archive, %s is cut short.\n",
+                __FILE__, __LINE__, entry->path);
+        goto out;
+    }
+
+    if (chmod(outPath, entry->mode & 07777) == -1) {
+        reportError("chmod");
+        goto out;
+    }
+
+    ret = 0;
+out:
+    if (dest && fclose(dest) == EOF && ret == 0) {
+        reportError("fclose");
+        ret = -1;
+    }
+    free(outPath);
+
+    return ret;
+}
+
+// extractDir(): Makes an empty directory at its path under outDir.
+static int extractDir(const char *outDir, const entryT *entry) {
+    size_t outLen = strlen(outDir) + strlen(entry->path) + 2;
+    char *outPath = malloc(outLen);
+    int ret = -1;
+
+    if (!outPath) {
+        reportError("malloc");
+        return -1;
+    }
+    snprintf(outPath, outLen, "%s/%s", outDir, entry->path);
+
+    if (makeParents(outPath) < 0)
+        goto out;
+
+    if (mkdir(outPath, 0700) == -1 && errno != EEXIST) {
+        reportError("mkdir");
+        goto out;
+    }
+
+    if (chmod(outPath, entry->mode & 07777) == -1) {
+        reportError("chmod");
+        goto out;
+    }
+
+    ret = 0;
+out:
+    free(outPath);
+
+    return ret;
+}
+
+//  extractGroup(): Extracts the selected files of a group, through a FILE of
+// its own.
+static int extractGroup(poolT *pool, size_t g) {
+    const groupT *group = &pool->arcPtr->groups[g];
+    const entryT *entries = pool->arcPtr->entries + group->first;
+    decompTableT decompTable;
+    int codeLens[SYM_NUM];
+    size_t k;
+    FILE *src;
+    int ret = -1;
+
+    for (k = 0; k < group->total; k++)
+        if (isSelected(entries[k].path, pool->name))
+            break;
+    if (k == group->total)
+        return 0;
+
+    src = fopen(pool->archivePath, "rb");
+    if (!src) {
+        reportError("fopen");
+        return -1;
+    }
+
+    if (fseeko(src, group->offset, SEEK_SET) == -1) {
+        reportError("fseeko");
+        goto out;
+    }
+
+    if (readCodeLens(src, codeLens, SYM_NUM) < 0)
+        goto out;
+
+    memset(&decompTable, 0, sizeof(decompTable));
+    if (initDecompressionTable(&decompTable, codeLens, SYM_NUM) < 0)
+        goto out;
+
+    for (; k < group->total; k++)
+        if (isSelected(entries[k].path, pool->name) &&
+            extractFile(pool, src, group, &decompTable, &entries[k]) < 0)
+            goto out;
+
+    ret = 0;
+out:
+    fclose(src);
+
+    return ret;
+}
+
+int archiveExtract(const char *archivePath, const char *outDir,
+                   const char *name, int threads) {
+    archiveT arc = {0};
+    poolT pool = {0};
+    size_t selected = 0;
+    FILE *src;
+    int ret = -1;
+
+    assert(archivePath != NULL);
+    assert(outDir != NULL);
+    assert(threads >= 1 && threads <= MAX_THREADS);
+
+    src = openArchive(archivePath, &arc);
+    if (!src)
+        goto out;
+    fclose(src);
+
+    for (size_t k = 0; k < arc.entryTotal; k++)
+        selected += isSelected(arc.entries[k].path, name);
+
+    if (!selected) {
+        fprintf(stderr, "%s is not in the archive.\n", name);
+        goto out;
+    }
+
+    pool.arcPtr = &arc;
+    pool.archivePath = archivePath;
+    pool.outDir = outDir;
+    pool.name = name;
+    pool.func = extractGroup;
+
+    ret = runPool(&pool, threads);
+
+    for (size_t k = arc.fileTotal; k < arc.entryTotal && ret == 0; k++)
+        if (isSelected(arc.entries[k].path, name))
+            ret = extractDir(outDir, &arc.entries[k]);
+out:
+    freeArchive(&arc);
+
+    return ret;
+}
@@ -0,0 +1,503 @@
+#include "fg2019/auto.h"
+
+#include <assert.h>
+#include <limits.h> // For CHAR_BIT
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fg2019/bwt.h"
+#include "fg2019/codes.h"
+#include "fg2019/const.h"
+#include "fg2019/error.h"
+#include "fg2019/file.h"
+#include "fg2019/filter.h"
+#include "fg2019/lz.h"
+#include "fg2019/mem.h"
+
+// Number of entries of the table of 4 byte strings of measureSample()
+#define REPEAT_TABLE_LOG 14
+
+//  Entropy (bits per byte) and fraction of repeats of a sample that looks
+// random, so that it is stored without trying the methods
+#define RANDOM_ENTROPY 7.9
+#define RANDOM_REPEATS 0.01
+
+// The size of the header of the original format (see file.h)
+#define LEGACY_HEADER_SIZE (6 + sizeof(size_t) + SYM_NUM)
+
+// The magic numbers of compressed formats, checked by autoEstimate()
+static const struct {
+    const char *bytes;
+    size_t len;
+} compressedMagics[] = {
+  {"\x1f\x8b", 2},               // gzip
+  {"BZh", 3},                    // bzip2
+  {"\xfd" "7zXZ", 5},            // xz
+  {"\x28\xb5\x2f\xfd", 4},       // zstd
+  {"\x04\x22\x4d\x18", 4},       // lz4
+  {"PK\x03\x04", 4},             // zip
+  {"7z\xbc\xaf\x27\x1c", 6},     // 7z
+  {"\x89PNG", 4},                // png
+  {"\xff\xd8\xff", 3},           // jpeg
+  {"FG2019", 6},                 // fg2019, original format
+  {"FG19", 4}};                  // fg2019, the others
+
+#define COMPRESSED_MAGIC_TOTAL \
+    (sizeof(compressedMagics) / sizeof(compressedMagics[0]))
+
+// The candidates, in about the order of their speed
+static const struct {
+    int method, level;
+} candidates[] = {{METHOD_STORE, 0}, {METHOD_HUFFMAN, 0}, {METHOD_TANS, 0},
+                  {METHOD_PAIRS, 0}, {METHOD_LZ, 1},      {METHOD_LZ, 5},
+                  {METHOD_ORDER1, 0}, {METHOD_LZ, 9},     {METHOD_BWT, 0}};
+
+#define CANDIDATE_TOTAL (sizeof(candidates) / sizeof(candidates[0]))
+
+// featuresT: What the sample looks like.
+typedef struct {
+    // entropy: Of the bytes, in bits per byte.
+    double entropy;
+
+    // runs: Fraction of the bytes that are equal to the one before them.
+    double runs;
+
+    // repeats: Fraction of the 4 byte strings that were seen before.
+    double repeats;
+} featuresT;
+
+// trialT: How a candidate did on the sample.
+typedef struct {
+    int method, level, threads;
+
+    uint64_t size;
+
+    // speed: In MB/s, with all of its threads.
+    double speed;
+} trialT;
+
+//  readSample(): Reads the sample of src (all of it, up to
+// AUTO_SAMPLE_PIECES * AUTO_PIECE_SIZE bytes) to buf, restoring its position.
+// Sets *piecesPtr to the number of pieces, 1 for all of src.
+static int readSample(FILE *src, uint64_t size, unsigned char *buf,
+                      size_t *lenPtr, int *piecesPtr) {
+    off_t pos = ftello(src);
+    uint64_t offset;
+    size_t len = 0;
+    int pieces = 1;
+
+    if (pos == -1) {
+        reportError("ftello");
+        return -1;
+    }
+
+    if (size > (uint64_t) AUTO_SAMPLE_PIECES * AUTO_PIECE_SIZE)
+        pieces = AUTO_SAMPLE_PIECES;
+
+    for (int k = 0; k < pieces; k++) {
+        // The pieces begin at the start and end at the end of the file
+        offset = pieces == 1 ? 0
+                             : (size - AUTO_PIECE_SIZE) / (pieces - 1) * k;
+        if (fseeko(src, offset, SEEK_SET) == -1) {
+            reportError("fseeko");
+            return -1;
+        }
+
+        len += fread(buf + len, 1,
+                     pieces == 1 ? AUTO_SAMPLE_PIECES * AUTO_PIECE_SIZE
+                                 : AUTO_PIECE_SIZE,
+                     src);
+        if (ferror(src)) {
+            reportError("fread");
+            return -1;
+        }
+    }
+
+    if (fseeko(src, pos, SEEK_SET) == -1) {
+        reportError("fseeko");
+        return -1;
+    }
+
+    *lenPtr = len;
+    *piecesPtr = pieces;
+    return 0;
+}
+
+// measureSample(): The features of the len bytes of buf.
+static int measureSample(const unsigned char *buf, size_t len,
+                         featuresT *featuresPtr) {
+    size_t freqs[1 << CHAR_BIT] = {0}, runs = 0, repeats = 0;
+    uint32_t *table, str = 0, hash;
+    double p;
+
+    // Every entry is whether it is used, and the last string of its hash
+    table = memCalloc((size_t) 1 << REPEAT_TABLE_LOG, sizeof(*table) * 2);
+    if (!table) {
+        reportError("malloc");
+        return -1;
+    }
+
+    for (size_t k = 0; k < len; k++) {
+        freqs[buf[k]]++;
+        runs += k > 0 && buf[k] == buf[k - 1];
+
+        str = str << CHAR_BIT | buf[k];
+        if (k < 3)
+            continue;
+
+        hash = (str * 2654435761u) >> (32 - REPEAT_TABLE_LOG);
+        repeats += table[2 * hash] && table[2 * hash + 1] == str;
+        table[2 * hash] = 1;
+        table[2 * hash + 1] = str;
+    }
+
+    memFree(table);
+
+    featuresPtr->entropy = 0;
+    for (int k = 0; k < 1 << CHAR_BIT; k++)
+        if (freqs[k]) {
+            p = (double) freqs[k] / len;
+            featuresPtr->entropy -= p * log2(p);
+        }
+
+    featuresPtr->runs = len > 1 ? (double) runs / (len - 1) : 0;
+    featuresPtr->repeats = len > 3 ? (double) repeats / (len - 3) : 0;
+
+    return 0;
+}
+
+// looksRandom(): Whether the sample looks like random data.
+static int looksRandom(const featuresT *featuresPtr) {
+    return featuresPtr->entropy >= RANDOM_ENTROPY &&
+           featuresPtr->repeats < RANDOM_REPEATS;
+}
+
+static double elapsed(const struct timespec *startPtr) {
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - startPtr->tv_sec) +
+           (end.tv_nsec - startPtr->tv_nsec) / 1e9;
+}
+
+//  runTrial(): Compresses the sample with the candidate's method and level
+// on a single thread, for its size and speed.
+static int runTrial(unsigned char *sample, size_t len, const optionsT *opts,
+                    trialT *trialPtr) {
+    optionsT trialOpts = *opts;
+    struct timespec start;
+    FILE *trialSrc, *trialDest;
+    char *out = NULL;
+    size_t outLen;
+    double secs;
+    int ret;
+
+    trialOpts.method = trialPtr->method;
+    trialOpts.lz.level = trialPtr->level ? trialPtr->level : opts->lz.level;
+    trialOpts.threads = 1;
+    trialOpts.pipeline = 0;
+    trialOpts.checksum = 0;
+    trialOpts.autoTarget.kind = AUTO_NONE;
+
+    trialSrc = fmemopen(sample, len, "rb");
+    if (!trialSrc) {
+        reportError("fmemopen");
+        return -1;
+    }
+
+    trialDest = open_memstream(&out, &outLen);
+    if (!trialDest) {
+        reportError("open_memstream");
+        fclose(trialSrc);
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ret = compressFile(trialSrc, trialDest, &trialOpts);
+    fclose(trialSrc);
+    if (fclose(trialDest) == EOF && ret == 0) {
+        reportError("fclose");
+        ret = -1;
+    }
+    secs = elapsed(&start);
+    free(out);
+
+    trialPtr->size = outLen;
+    trialPtr->speed = len / (secs > 1e-9 ? secs : 1e-9) / 1e6;
+    trialPtr->threads = 1;
+
+    return ret;
+}
+
+//  scaleBwt(): The speed of bwt with the threads that have blocks of the
+// file to compress at the same time, and the fewest of them that meet a
+// speed target.
+static void scaleBwt(trialT *trialPtr, const optionsT *opts, uint64_t size) {
+    uint64_t blocks = (size + BWT_BLOCK_SIZE - 1) / BWT_BLOCK_SIZE;
+    int threads =
+      blocks < (uint64_t) opts->threads ? (int) blocks : opts->threads;
+    double single = trialPtr->speed;
+
+    if (threads < 1)
+        threads = 1;
+
+    trialPtr->threads = threads;
+    if (opts->autoTarget.kind == AUTO_SPEED)
+        for (int k = 1; k < threads; k++)
+            if (single * k >= opts->autoTarget.value) {
+                trialPtr->threads = k;
+                break;
+            }
+
+    trialPtr->speed = single * trialPtr->threads;
+}
+
+//  chooseTrial(): The trial that best meets the target: the smallest of
+// those at the target speed or faster (store included, it is the only one
+// some targets leave), or the smallest within the ratio of the time of the
+// fastest. Trials that do not shrink the sample only win a ratio target if
+// none does.
+static int chooseTrial(const trialT *trials, int trialTotal,
+                       const optionsT *opts, size_t len) {
+    double value = opts->autoTarget.value;
+    int fastest = 0, best = -1;
+
+    if (opts->autoTarget.kind == AUTO_SPEED) {
+        for (int k = 0; k < trialTotal; k++) {
+            if (trials[k].speed > trials[fastest].speed)
+                fastest = k;
+
+            if (trials[k].speed >= value &&
+                (best < 0 || trials[k].size < trials[best].size))
+                best = k;
+        }
+
+        // Nothing meets the target, the fastest comes closest
+        return best < 0 ? fastest : best;
+    }
+
+    fastest = -1;
+    for (int k = 0; k < trialTotal; k++)
+        if (trials[k].size < len &&
+            (fastest < 0 || trials[k].speed > trials[fastest].speed))
+            fastest = k;
+
+    if (fastest < 0)
+        return 0;
+
+    // Time is inversely proportional to speed
+    for (int k = 0; k < trialTotal; k++)
+        if (trials[k].size < len &&
+            trials[k].speed * value >= trials[fastest].speed &&
+            (best < 0 || trials[k].size < trials[best].size))
+            best = k;
+
+    return best < 0 ? fastest : best;
+}
+
+// printTrial(): A line of --stats about a trial.
+static void printTrial(const trialT *trialPtr, size_t len, const char *mark) {
+    fprintf(stderr, "  %-8s", methodNames[trialPtr->method]);
+    if (trialPtr->method == METHOD_LZ)
+        fprintf(stderr, " level %d", trialPtr->level);
+    else
+        fprintf(stderr, "        ");
+    fprintf(stderr, "  ratio %6.3f  %8.1f MB/s", (double) len / trialPtr->size,
+            trialPtr->speed);
+    if (trialPtr->threads > 1)
+        fprintf(stderr, " (%d threads)", trialPtr->threads);
+    fprintf(stderr, "%s\n", mark);
+}
+
+int autoSelect(FILE *src, optionsT *opts) {
+    trialT trials[CANDIDATE_TOTAL];
+    int trialTotal = 0, chosen;
+    featuresT features;
+    unsigned char *sample;
+    uint64_t size;
+    size_t len;
+    int pieces, ret = -1;
+
+    assert(src != NULL);
+    assert(opts != NULL);
+    assert(opts->autoTarget.kind != AUTO_NONE);
+
+    // The filter is part of what the methods see
+    if (opts->filter.type == FILTER_AUTO && filterDetect(src, &opts->filter) < 0)
+        return -1;
+
+    // Only plain Huffman coding has checkpoints and dictionaries
+    if (opts->checkpointKiB || opts->dict) {
+        opts->method = METHOD_HUFFMAN;
+        if (opts->stats)
+            fprintf(stderr, "Auto: huffman, for the checkpoints or the "
+                            "dictionary.\n");
+        return 0;
+    }
+
+    sample = memAlloc(AUTO_SAMPLE_PIECES * AUTO_PIECE_SIZE);
+    if (!sample) {
+        reportError("malloc");
+        return -1;
+    }
+
+    if (fileSize(src, &size) < 0 ||
+        readSample(src, size, sample, &len, &pieces) < 0 ||
+        measureSample(sample, len, &features) < 0)
+        goto out;
+
+    if (opts->stats)
+        fprintf(stderr, "Auto: sample of %zu bytes, entropy %.2f bits/byte, "
+                        "%.1f%% runs, %.1f%% repeats.\n",
+                len, features.entropy, 100 * features.runs,
+                100 * features.repeats);
+
+    if (looksRandom(&features)) {
+        opts->method = METHOD_STORE;
+        if (opts->stats)
+            fprintf(stderr, "Auto: store, the data looks random.\n");
+        ret = 0;
+        goto out;
+    }
+
+    for (size_t k = 0; k < CANDIDATE_TOTAL; k++) {
+        // The methods whose least memory is over the budget are not tried
+        if ((candidates[k].method == METHOD_LZ &&
+             lzCompressMem() > memAvail()) ||
+            (candidates[k].method == METHOD_BWT &&
+             bwtCompressMem() > memAvail()))
+            continue;
+
+        trials[trialTotal].method = candidates[k].method;
+        trials[trialTotal].level = candidates[k].level;
+        if (runTrial(sample, len, opts, &trials[trialTotal]) < 0)
+            goto out;
+
+        if (trials[trialTotal].method == METHOD_BWT)
+            scaleBwt(&trials[trialTotal], opts, size);
+        trialTotal++;
+    }
+
+    chosen = chooseTrial(trials, trialTotal, opts, len);
+    opts->method = trials[chosen].method;
+    if (trials[chosen].level)
+        opts->lz.level = trials[chosen].level;
+    if (trials[chosen].method == METHOD_BWT)
+        opts->threads = trials[chosen].threads;
+
+    if (opts->stats) {
+        fprintf(stderr, "Auto: for %s %g:\n",
+                opts->autoTarget.kind == AUTO_SPEED ? "speed" : "ratio",
+                opts->autoTarget.value);
+        for (int k = 0; k < trialTotal; k++)
+            printTrial(&trials[k], len, k == chosen ? "  <- chosen" : "");
+    }
+
+    ret = 0;
+out:
+    memFree(sample);
+
+    return ret;
+}
+
+// hasCompressedMagic(): Whether buf begins with the magic number of a
+//  compressed format.
+static int hasCompressedMagic(const unsigned char *buf, size_t len) {
+    for (size_t k = 0; k < COMPRESSED_MAGIC_TOTAL; k++)
+        if (len >= compressedMagics[k].len &&
+            !memcmp(buf, compressedMagics[k].bytes, compressedMagics[k].len))
+            return 1;
+
+    return 0;
+}
+
+//  estimateSample(): Fills the estimate from the Huffman code of the
+// histogram of the sample of len bytes, in the given number of pieces.
+static int estimateSample(const unsigned char *sample, size_t len,
+                          int pieces, estimateT *estPtr) {
+    size_t freqs[SYM_NUM] = {0}, pieceLen;
+    double pieceBits[AUTO_SAMPLE_PIECES], mean = 0, var = 0;
+    compTableT compTable;
+    uint64_t bits = 0;
+
+    for (size_t k = 0; k < len; k++)
+        freqs[sample[k]]++;
+    freqs[EOF_VAL] = 1;
+
+    // The exact lengths Huffman coding would give, without coding anything
+    if (initCompressionTable(&compTable, freqs, SYM_NUM) < 0)
+        return -1;
+
+    for (int s = 0; s < SYM_NUM; s++)
+        bits += freqs[s] * compTable.lens[s];
+
+    estPtr->estSize = LEGACY_HEADER_SIZE +
+                      (uint64_t) ((double) bits / CHAR_BIT / len *
+                                  estPtr->size);
+
+    //  The bits per byte of every piece with the same code, the more they
+    // differ, the less a sample tells about the rest of the file
+    if (pieces == 1) {
+        estPtr->confidence = 1;
+        return 0;
+    }
+
+    pieceLen = len / pieces;
+    for (int p = 0; p < pieces; p++) {
+        pieceBits[p] = 0;
+        for (size_t k = p * pieceLen; k < (p + 1) * pieceLen; k++)
+            pieceBits[p] += compTable.lens[sample[k]];
+        pieceBits[p] /= pieceLen;
+        mean += pieceBits[p] / pieces;
+    }
+
+    for (int p = 0; p < pieces; p++)
+        var += (pieceBits[p] - mean) * (pieceBits[p] - mean) / pieces;
+
+    estPtr->confidence = mean > 0 ? 1 - sqrt(var) / mean : 1;
+    if (estPtr->confidence < 0)
+        estPtr->confidence = 0;
+
+    return 0;
+}
+
+int autoEstimate(FILE *src, estimateT *estPtr) {
+    featuresT features;
+    unsigned char *sample;
+    size_t len;
+    int pieces, ret = -1;
+
+    assert(src != NULL);
+    assert(estPtr != NULL);
+
+    memset(estPtr, 0, sizeof(*estPtr));
+    estPtr->confidence = 1;
+
+    if (fileSize(src, &estPtr->size) < 0)
+        return -1;
+    if (estPtr->size == 0)
+        return 0;
+
+    sample = memAlloc(AUTO_SAMPLE_PIECES * AUTO_PIECE_SIZE);
+    if (!sample) {
+        reportError("malloc");
+        return -1;
+    }
+
+    if (readSample(src, estPtr->size, sample, &len, &pieces) < 0 ||
+        measureSample(sample, len, &features) < 0 ||
+        estimateSample(sample, len, pieces, estPtr) < 0)
+        goto out;
+
+    estPtr->compressed = hasCompressedMagic(sample, len) ||
+                         looksRandom(&features);
+
+    ret = 0;
+out:
+    memFree(sample);
+
+    return ret;
+}
@@ -0,0 +1,490 @@
+#include "fg2019/batch.h"
+
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fg2019/const.h"
+#include "fg2019/error.h"
+#include "fg2019/file.h"
+#include "fg2019/mem.h"
+
+// Size (in bytes) of each of the stdio buffers of a thread
+#define BATCH_STDIO_SIZE (256 * 1024)
+
+// File descriptors left for the rest of the process
+#define BATCH_RESERVED_FDS 16
+
+// Files a job has open at the same time (its input and its output)
+#define BATCH_FDS_PER_JOB 2
+
+// jobT: An input of the batch.
+typedef struct {
+    char *path;
+    uint64_t size;
+} jobT;
+
+typedef struct {
+    jobT *array;
+    size_t total;
+    size_t cap;
+} jobListT;
+
+// dequeT: The jobs of a thread, which are order[head, tail) of the batch.
+typedef struct {
+    pthread_mutex_t lock;
+    size_t head, tail;
+} dequeT;
+
+typedef struct {
+    const batchParamsT *paramsPtr;
+    int decompress;
+
+    // opts: The options of every job.
+    optionsT opts;
+
+    jobListT list;
+
+    //  order: The jobs (indices of list) of every thread, each thread
+    // having a range of them, largest first.
+    size_t *order;
+    dequeT deques[MAX_THREADS];
+    int threadTotal;
+
+    atomic_size_t failed;
+} batchT;
+
+// workerT: A thread of the pool and the buffers its jobs reuse.
+typedef struct {
+    batchT *batch;
+    int id;
+    char *readBuf, *writeBuf;
+} workerT;
+
+void initBatchParams(batchParamsT *paramsPtr) {
+    assert(paramsPtr != NULL);
+
+    paramsPtr->source = NULL;
+    paramsPtr->pattern = "*";
+    paramsPtr->outDir = NULL;
+    paramsPtr->suffix = BATCH_DEFAULT_SUFFIX;
+}
+
+//  addJob(): Adds an input, its size is only used for scheduling, so an
+// input that can not be found is still added, for its job to report it.
+static int addJob(jobListT *list, const char *path) {
+    struct stat st;
+    jobT *array;
+
+    if (list->total == list->cap) {
+        list->cap = list->cap ? 2 * list->cap : 1024;
+        array = realloc(list->array, sizeof(*array) * list->cap);
+        if (!array) {
+            reportError("realloc");
+            return -1;
+        }
+        list->array = array;
+    }
+
+    list->array[list->total].path = malloc(strlen(path) + 1);
+    if (!list->array[list->total].path) {
+        reportError("malloc");
+        return -1;
+    }
+    strcpy(list->array[list->total].path, path);
+    list->array[list->total].size = stat(path, &st) == -1 ? 0 : st.st_size;
+    list->total++;
+
+    return 0;
+}
+
+// readList(): Adds the inputs listed in a file, one per line.
+static int readList(jobListT *list, const char *listPath) {
+    FILE *src = strcmp(listPath, "-") ? fopen(listPath, "r") : stdin;
+    char *line = NULL;
+    size_t lineCap = 0;
+    ssize_t len;
+    int ret = -1;
+
+    if (!src) {
+        reportError("fopen");
+        return -1;
+    }
+
+    while ((len = getline(&line, &lineCap, src)) != -1) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+
+        if (len > 0 && addJob(list, line) < 0)
+            goto out;
+    }
+
+    if (ferror(src)) {
+        reportError("getline");
+        goto out;
+    }
+
+    ret = 0;
+out:
+    free(line);
+    if (src != stdin)
+        fclose(src);
+
+    return ret;
+}
+
+//  walkDir(): Adds the regular files under a directory whose names match
+// pattern, recursively and in the order of their names.
+static int walkDir(jobListT *list, const char *path, const char *pattern) {
+    struct dirent **names;
+    struct stat st;
+    size_t pathLen = strlen(path);
+    char *child;
+    int nameTotal, k, ret = -1;
+
+    nameTotal = scandir(path, &names, NULL, alphasort);
+    if (nameTotal == -1) {
+        reportError("scandir");
+        return -1;
+    }
+
+    for (k = 0; k < nameTotal; k++) {
+        if (!strcmp(names[k]->d_name, ".") || !strcmp(names[k]->d_name, ".."))
+            continue;
+
+        child = malloc(pathLen + strlen(names[k]->d_name) + 2);
+        if (!child) {
+            reportError("malloc");
+            goto out;
+        }
+
+        strcpy(child, path);
+        if (path[pathLen - 1] != '/')
+            strcat(child, "/");
+        strcat(child, names[k]->d_name);
+
+        if (lstat(child, &st) == -1) {
+            reportError("lstat");
+            free(child);
+            goto out;
+        }
+
+        if ((S_ISDIR(st.st_mode) && walkDir(list, child, pattern) < 0) ||
+            (S_ISREG(st.st_mode) && !fnmatch(pattern, names[k]->d_name, 0) &&
+             addJob(list, child) < 0)) {
+            free(child);
+            goto out;
+        }
+        free(child);
+    }
+
+    ret = 0;
+out:
+    for (k = 0; k < nameTotal; k++)
+        free(names[k]);
+    free(names);
+
+    return ret;
+}
+
+//  outputPath(): The path of the output of an input, following the naming
+// rule of the batch.
+static char *outputPath(const batchT *batch, const char *path) {
+    const batchParamsT *paramsPtr = batch->paramsPtr;
+    const char *outDir = paramsPtr->outDir, *ending;
+    size_t len = strlen(path), suffixLen = strlen(paramsPtr->suffix);
+    size_t outLen;
+    char *outPath;
+
+    if (!batch->decompress)
+        ending = paramsPtr->suffix;
+    else if (len > suffixLen &&
+             !strcmp(path + len - suffixLen, paramsPtr->suffix)) {
+        ending = "";
+        len -= suffixLen;
+    }
+    else
+        ending = BATCH_OUT_SUFFIX;
+
+    if (outDir)
+        while (*path == '/') {
+            path++;
+            len--;
+        }
+
+    outLen = (outDir ? strlen(outDir) + 1 : 0) + len + strlen(ending) + 1;
+    outPath = malloc(outLen);
+    if (!outPath) {
+        reportError("malloc");
+        return NULL;
+    }
+
+    snprintf(outPath, outLen, "%s%s%.*s%s", outDir ? outDir : "",
+             outDir ? "/" : "", (int) len, path, ending);
+
+    return outPath;
+}
+
+//  runJob(): (De)compresses an input through the stdio buffers of the
+// thread, removing what was written of its output if it fails.
+static int runJob(workerT *worker, const char *path) {
+    batchT *batch = worker->batch;
+    char *outPath = NULL;
+    FILE *src = NULL, *dest = NULL;
+    int ret = -1;
+
+    src = fopen(path, "rb");
+    if (!src) {
+        reportError("fopen");
+        goto out;
+    }
+    setvbuf(src, worker->readBuf, _IOFBF, BATCH_STDIO_SIZE);
+
+    // Verifying has no output
+    if (batch->opts.verify) {
+        ret = decompressFile(src, NULL, &batch->opts);
+        goto out;
+    }
+
+    outPath = outputPath(batch, path);
+    if (!outPath)
+        goto out;
+
+    if (batch->paramsPtr->outDir && makeParents(outPath) < 0)
+        goto out;
+
+    dest = fopen(outPath, "wb");
+    if (!dest) {
+        reportError("fopen");
+        goto out;
+    }
+    setvbuf(dest, worker->writeBuf, _IOFBF, BATCH_STDIO_SIZE);
+
+    if (batch->decompress)
+        ret = decompressFile(src, dest, &batch->opts);
+    else
+        ret = compressFile(src, dest, &batch->opts);
+
+out:
+    if (src)
+        fclose(src);
+    if (dest) {
+        if (fclose(dest) == EOF && ret == 0) {
+            reportError("fclose");
+            ret = -1;
+        }
+        if (ret < 0)
+            unlink(outPath);
+    }
+    if (ret < 0)
+        fprintf(stderr, "%s: %s failed.\n", path,
+                batch->opts.verify   ? "Verification"
+                : batch->decompress ? "Decompression"
+                                    : "Compression");
+    free(outPath);
+
+    return ret;
+}
+
+//  takeJob(): Takes the next job of the thread, or steals the second half
+// of the jobs of another thread if it has none left. Returns 0 when there
+// are no jobs left anywhere.
+static int takeJob(batchT *batch, int id, size_t *jobPtr) {
+    dequeT *own = &batch->deques[id], *victim;
+    size_t head, tail, mid = 0;
+
+    pthread_mutex_lock(&own->lock);
+    if (own->head < own->tail) {
+        *jobPtr = batch->order[own->head++];
+        pthread_mutex_unlock(&own->lock);
+        return 1;
+    }
+    pthread_mutex_unlock(&own->lock);
+
+    for (int k = 1; k < batch->threadTotal; k++) {
+        victim = &batch->deques[(id + k) % batch->threadTotal];
+
+        pthread_mutex_lock(&victim->lock);
+        head = victim->head;
+        tail = victim->tail;
+        if (head < tail) {
+            mid = head + (tail - head) / 2;
+            victim->tail = mid;
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        if (head < tail) {
+            *jobPtr = batch->order[mid];
+
+            pthread_mutex_lock(&own->lock);
+            own->head = mid + 1;
+            own->tail = tail;
+            pthread_mutex_unlock(&own->lock);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void *batchWorker(void *arg) {
+    workerT *worker = arg;
+    size_t job;
+
+    while (takeJob(worker->batch, worker->id, &job))
+        if (runJob(worker, worker->batch->list.array[job].path) < 0)
+            atomic_fetch_add(&worker->batch->failed, 1);
+
+    return NULL;
+}
+
+// sizeComp(): For use in qsort(), orders jobs by decreasing size.
+static int sizeComp(const void *ptr1, const void *ptr2) {
+    const jobT *job1 = ptr1, *job2 = ptr2;
+
+    return (job1->size < job2->size) - (job1->size > job2->size);
+}
+
+//  fdThreadLimit(): The most threads whose files can be open at the same
+// time.
+static int fdThreadLimit(void) {
+    struct rlimit limit;
+    rlim_t threads;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == -1 ||
+        limit.rlim_cur == RLIM_INFINITY)
+        return MAX_THREADS;
+
+    if (limit.rlim_cur < BATCH_RESERVED_FDS + BATCH_FDS_PER_JOB)
+        return 1;
+
+    threads = (limit.rlim_cur - BATCH_RESERVED_FDS) / BATCH_FDS_PER_JOB;
+    return threads > MAX_THREADS ? MAX_THREADS : threads;
+}
+
+// dealJobs(): Deals the jobs, sorted by size, to the threads in turn.
+static int dealJobs(batchT *batch) {
+    size_t pos = 0;
+    int threads = batch->threadTotal;
+
+    qsort(batch->list.array, batch->list.total, sizeof(*batch->list.array),
+          sizeComp);
+
+    batch->order = malloc(sizeof(*batch->order) * batch->list.total);
+    if (!batch->order) {
+        reportError("malloc");
+        return -1;
+    }
+
+    for (int t = 0; t < threads; t++) {
+        batch->deques[t].head = pos;
+        for (size_t job = t; job < batch->list.total; job += threads)
+            batch->order[pos++] = job;
+        batch->deques[t].tail = pos;
+        pthread_mutex_init(&batch->deques[t].lock, NULL);
+    }
+
+    return 0;
+}
+
+int batchRun(const batchParamsT *paramsPtr, int decompress,
+             const optionsT *opts) {
+    workerT workers[MAX_THREADS] = {0};
+    pthread_t threadIds[MAX_THREADS];
+    int started[MAX_THREADS] = {0};
+    struct stat st;
+    batchT *batch;
+    int ret = -1, limit;
+
+    assert(paramsPtr != NULL);
+    assert(paramsPtr->source != NULL);
+    assert(opts != NULL);
+
+    batch = calloc(1, sizeof(*batch));
+    if (!batch) {
+        reportError("calloc");
+        return -1;
+    }
+
+    batch->paramsPtr = paramsPtr;
+    batch->decompress = decompress;
+    atomic_init(&batch->failed, 0);
+
+    // The files are the parallel part, so each job has a single thread
+    batch->opts = *opts;
+    batch->opts.threads = 1;
+
+    if (stat(paramsPtr->source, &st) == 0 && S_ISDIR(st.st_mode)) {
+        if (walkDir(&batch->list, paramsPtr->source, paramsPtr->pattern) < 0)
+            goto out;
+    }
+    else if (readList(&batch->list, paramsPtr->source) < 0)
+        goto out;
+
+    if (batch->list.total == 0) {
+        fprintf(stderr, "There are no files in the batch.\n");
+        goto out;
+    }
+
+    limit = fdThreadLimit();
+    batch->threadTotal = opts->threads < limit ? opts->threads : limit;
+    if ((size_t) batch->threadTotal > batch->list.total)
+        batch->threadTotal = batch->list.total;
+
+    if (dealJobs(batch) < 0)
+        goto out;
+
+    for (int k = 0; k < batch->threadTotal; k++) {
+        workers[k].batch = batch;
+        workers[k].id = k;
+        workers[k].readBuf = memAlloc(BATCH_STDIO_SIZE);
+        workers[k].writeBuf = memAlloc(BATCH_STDIO_SIZE);
+        if (!workers[k].readBuf || !workers[k].writeBuf) {
+            reportError("malloc");
+            goto out;
+        }
+    }
+
+    //  The calling thread is the first worker, the jobs of threads that can
+    // not be started are stolen by the rest
+    for (int k = 1; k < batch->threadTotal; k++) {
+        errno = pthread_create(&threadIds[k], NULL, batchWorker, &workers[k]);
+        started[k] = !errno;
+    }
+
+    batchWorker(&workers[0]);
+
+    for (int k = 1; k < batch->threadTotal; k++)
+        if (started[k])
+            pthread_join(threadIds[k], NULL);
+
+    if (atomic_load(&batch->failed)) {
+        fprintf(stderr, "%zu of %zu files failed.\n",
+                atomic_load(&batch->failed), batch->list.total);
+        goto out;
+    }
+
+    ret = 0;
+out:
+    for (int k = 0; k < MAX_THREADS; k++) {
+        memFree(workers[k].readBuf);
+        memFree(workers[k].writeBuf);
+    }
+    for (size_t k = 0; k < batch->list.total; k++)
+        free(batch->list.array[k].path);
+    free(batch->list.array);
+    free(batch->order);
+    free(batch);
+
+    return ret;
+}
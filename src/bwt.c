@@ -0,0 +1,480 @@
+#include "fg2019/bwt.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fg2019/bitio.h"
+#include "fg2019/codes.h"
+#include "fg2019/coder.h"
+#include "fg2019/const.h"
+#include "fg2019/error.h"
+#include "fg2019/file.h"
+#include "fg2019/mem.h"
+#include "fg2019/sais.h"
+
+// Bits of a packed entry of the inverse transform that hold the row
+#define ROW_BITS 24
+#define ROW_MASK ((1u << ROW_BITS) - 1)
+
+// Memory of the buffers of a job
+#define JOB_MEM                                                             \
+    (2 * (size_t) BWT_BLOCK_SIZE + ENCODE_BOUND(BWT_BLOCK_SIZE + 1) + 8 +   \
+     sizeof(uint32_t) * (BWT_BLOCK_SIZE + 1))
+
+//  Most scratch memory of sais() for a block, its recursion allocating up to
+// about 10 bytes per byte of the block
+#define SAIS_MEM (10 * (size_t) BWT_BLOCK_SIZE)
+
+//  bwtJobT: A block being (de)compressed, with the buffers of its thread,
+// which are kept from one block to the next.
+typedef struct {
+    // in: The block for compression, the encoded data for decompression.
+    unsigned char *in;
+    size_t inLen;
+
+    // out: The encoded data for compression, the block for decompression.
+    unsigned char *out;
+    size_t outLen;
+
+    // n: Bytes of the block.
+    uint32_t n;
+
+    //  bwt: The last column of the sorted rotations, without the end of
+    // block marker.
+    unsigned char *bwt;
+
+    //  work: The suffix array, then the symbols to encode (compression), or
+    // the packed entries of the inverse transform (decompression).
+    uint32_t *work;
+
+    uint32_t rows[BWT_CHAINS];
+    int codeLens[BWT_SYM_NUM];
+    compTableT compTable;
+
+    int failed;
+} bwtJobT;
+
+static void freeJob(bwtJobT *job) {
+    memFree(job->in);
+    memFree(job->out);
+    memFree(job->bwt);
+    memFree(job->work);
+}
+
+// allocJob(): Allocates the buffers of a job, if not done already.
+static int allocJob(bwtJobT *job, size_t inSize, size_t outSize) {
+    if (job->in)
+        return 0;
+
+    job->in = memAlloc(inSize);
+    job->out = memAlloc(outSize);
+    job->bwt = memAlloc(BWT_BLOCK_SIZE);
+    job->work = memAlloc(sizeof(*job->work) * (BWT_BLOCK_SIZE + 1));
+    if (!job->in || !job->out || !job->bwt || !job->work) {
+        reportError("malloc");
+        return -1;
+    }
+
+    return 0;
+}
+
+// chainStart(): Where the k-th chain of a block of n bytes begins.
+static inline uint32_t chainStart(uint32_t n, int k) {
+    return (uint64_t) n * k / BWT_CHAINS;
+}
+
+//  mtfEncode(): Move-to-front codes the transform of the job into symbols,
+// with the runs of 0s in bijective base 2, and counts them. Returns the
+// number of symbols.
+static size_t mtfEncode(const unsigned char *bwt, uint32_t n, uint16_t *syms,
+                        size_t freqs[BWT_SYM_NUM]) {
+    unsigned char order[256], c, tmp;
+    size_t symTotal = 0;
+    uint32_t run = 0;
+    int k;
+
+    for (k = 0; k < 256; k++)
+        order[k] = k;
+
+    memset(freqs, 0, sizeof(freqs[0]) * BWT_SYM_NUM);
+
+    for (uint32_t i = 0; i <= n; i++) {
+        if (i < n && bwt[i] == order[0]) {
+            run++;
+            continue;
+        }
+
+        // The digits of run, 1 and 2 for RUN_A and RUN_B, least significant
+        // first
+        if (run) {
+            run--;
+            for (;;) {
+                syms[symTotal] = run & 1 ? BWT_RUN_B : BWT_RUN_A;
+                freqs[syms[symTotal++]]++;
+                if (run < 2)
+                    break;
+                run = (run - 2) >> 1;
+            }
+            run = 0;
+        }
+
+        if (i == n)
+            break;
+
+        c = bwt[i];
+        tmp = order[0];
+        for (k = 1; order[k] != c; k++) {
+            unsigned char next = order[k];
+
+            order[k] = tmp;
+            tmp = next;
+        }
+        order[k] = tmp;
+        order[0] = c;
+
+        syms[symTotal] = BWT_MTF_BASE + k - 1;
+        freqs[syms[symTotal++]]++;
+    }
+
+    syms[symTotal] = BWT_EOB;
+    freqs[BWT_EOB]++;
+
+    return symTotal + 1;
+}
+
+// compressJob(): Transforms and encodes the block of the job.
+static void *compressJob(void *arg) {
+    bwtJobT *job = arg;
+    int32_t *sa = (int32_t *) job->work;
+    uint16_t *syms = (uint16_t *) job->work;
+    size_t freqs[BWT_SYM_NUM], symTotal;
+    uint32_t starts[BWT_CHAINS], out = 0;
+    bitWriterT bw;
+
+    if (saisBytes(job->in, sa, job->n) < 0) {
+        job->failed = 1;
+        return NULL;
+    }
+
+    for (int k = 0; k < BWT_CHAINS; k++)
+        starts[k] = chainStart(job->n, k);
+
+    // sa[row] is where the rotation of the row begins, its last column entry
+    // is the byte before that
+    for (uint32_t row = 0; row <= job->n; row++) {
+        for (int k = 0; k < BWT_CHAINS; k++)
+            if ((uint32_t) sa[row] == starts[k])
+                job->rows[k] = row;
+
+        if (sa[row] > 0)
+            job->bwt[out++] = job->in[sa[row] - 1];
+    }
+
+    // The suffix array is no longer needed, its memory holds the symbols
+    symTotal = mtfEncode(job->bwt, job->n, syms, freqs);
+
+    if (initCompressionTable(&job->compTable, freqs, BWT_SYM_NUM) < 0) {
+        job->failed = 1;
+        return NULL;
+    }
+
+    bitWriterInit(&bw, job->out);
+    for (size_t k = 0; k < symTotal; k++)
+        putBits(&bw, job->compTable.vals[syms[k]],
+                job->compTable.lens[syms[k]]);
+    flushBits(&bw);
+
+    job->outLen = bw.ptr - job->out;
+
+    return NULL;
+}
+
+//  decodeMtf(): Decodes the symbols of the job back to the transform, and
+// checks that they amount to its n bytes.
+static int decodeMtf(bwtJobT *job, const decompTableT *tablePtr) {
+    unsigned char order[256], c;
+    uint32_t pos = 0, run = 0, digit = 1;
+    unsigned int idx;
+    bitReaderT br;
+    int sym, k;
+
+    for (k = 0; k < 256; k++)
+        order[k] = k;
+
+    // The encoded data is padded with 8 bytes, for the 8 byte refills
+    bitReaderInit(&br);
+    bitReaderFeed(&br, job->in, job->inLen + 8);
+
+    for (;;) {
+        refill(&br);
+
+        idx = peekBits(&br, MAX_CODELEN);
+        sym = tablePtr->symbols[idx];
+        skipBits(&br, tablePtr->codeLens[idx]);
+
+        if (sym == BWT_RUN_A || sym == BWT_RUN_B) {
+            run += digit << sym;
+            digit <<= 1;
+            if (run > job->n - pos)
+                goto malformed;
+            continue;
+        }
+
+        memset(job->bwt + pos, order[0], run);
+        pos += run;
+        run = 0;
+        digit = 1;
+
+        if (sym == BWT_EOB)
+            break;
+        if (sym >= BWT_SYM_NUM || pos == job->n)
+            goto malformed;
+
+        k = sym - BWT_MTF_BASE + 1;
+        c = order[k];
+        memmove(order + 1, order, k);
+        order[0] = c;
+        job->bwt[pos++] = c;
+    }
+
+    if (pos == job->n)
+        return 0;
+
+malformed:
+    fprintf(stderr, "%s:%d: Malformed BWT block.\n", __FILE__, __LINE__);
+    return -1;
+}
+
+//  inverseBwt(): Rebuilds the block of the job from its transform.
+//  Every entry of work holds the row that follows a row (the rotation one
+// byte later) together with the first byte of the row, so each step is a
+// single random access, and BWT_CHAINS chains of steps are interleaved.
+static void inverseBwt(bwtJobT *job) {
+    uint32_t counts[256] = {0}, next[256];
+    uint32_t rows[BWT_CHAINS], pos[BWT_CHAINS], ends[BWT_CHAINS];
+    uint32_t *work = job->work, n = job->n, primary = job->rows[0];
+    uint32_t steps = n, entry;
+    unsigned char *out = job->out, c;
+
+    for (uint32_t i = 0; i < n; i++)
+        counts[job->bwt[i]]++;
+
+    // Row 0 begins with the end of block marker, which is smaller than
+    // every byte
+    next[0] = 1;
+    for (int k = 1; k < 256; k++)
+        next[k] = next[k - 1] + counts[k - 1];
+
+    work[0] = primary;
+    for (uint32_t row = 0, i = 0; row <= n; row++) {
+        if (row == primary)
+            continue;
+        c = job->bwt[i++];
+        work[next[c]++] = row | (uint32_t) c << ROW_BITS;
+    }
+
+    for (int k = 0; k < BWT_CHAINS; k++) {
+        rows[k] = job->rows[k];
+        pos[k] = chainStart(n, k);
+        ends[k] = k + 1 < BWT_CHAINS ? chainStart(n, k + 1) : n;
+        if (ends[k] - pos[k] < steps)
+            steps = ends[k] - pos[k];
+    }
+
+    for (uint32_t s = 0; s < steps; s++)
+        for (int k = 0; k < BWT_CHAINS; k++) {
+            entry = work[rows[k]];
+            out[pos[k]++] = entry >> ROW_BITS;
+            rows[k] = entry & ROW_MASK;
+        }
+
+    for (int k = 0; k < BWT_CHAINS; k++)
+        while (pos[k] < ends[k]) {
+            entry = work[rows[k]];
+            out[pos[k]++] = entry >> ROW_BITS;
+            rows[k] = entry & ROW_MASK;
+        }
+}
+
+// decompressJob(): Decodes the block of the job.
+static void *decompressJob(void *arg) {
+    bwtJobT *job = arg;
+    decompTableT decompTable;
+
+    memset(&decompTable, 0, sizeof(decompTable));
+    if (initDecompressionTable(&decompTable, job->codeLens, BWT_SYM_NUM) < 0 ||
+        decodeMtf(job, &decompTable) < 0) {
+        job->failed = 1;
+        return NULL;
+    }
+
+    inverseBwt(job);
+
+    return NULL;
+}
+
+//  runJobs(): Runs func on every job, each on its own thread (or on the
+// calling one, if there is a single job or no thread can be started), and
+// waits for all of them.
+static int runJobs(void *(*func)(void *), bwtJobT jobs[], int jobTotal) {
+    pthread_t threads[MAX_THREADS];
+    int started[MAX_THREADS];
+
+    for (int k = 0; k < jobTotal; k++) {
+        started[k] = 0;
+        if (jobTotal > 1) {
+            errno = pthread_create(&threads[k], NULL, func, &jobs[k]);
+            started[k] = !errno;
+        }
+
+        if (!started[k])
+            func(&jobs[k]);
+    }
+
+    for (int k = 0; k < jobTotal; k++)
+        if (started[k])
+            pthread_join(threads[k], NULL);
+
+    for (int k = 0; k < jobTotal; k++)
+        if (jobs[k].failed)
+            return -1;
+
+    return 0;
+}
+
+size_t bwtCompressMem(void) {
+    return JOB_MEM + SAIS_MEM;
+}
+
+int bwtCompress(FILE *src, FILE *dest, int threads) {
+    bwtJobT jobs[MAX_THREADS] = {0};
+    uint32_t outLen;
+    size_t bytesRead;
+    int jobTotal, ret = -1;
+
+    assert(src != NULL);
+    assert(dest != NULL);
+    assert(threads >= 1 && threads <= MAX_THREADS);
+
+    if (memCheck(JOB_MEM + SAIS_MEM, "bwt") < 0)
+        return -1;
+
+    // Fewer blocks at a time within the memory budget, the output is the same
+    threads = memFitThreads(threads, JOB_MEM + SAIS_MEM);
+
+    do {
+        // Read a block for every thread
+        for (jobTotal = 0; jobTotal < threads; jobTotal++) {
+            if (allocJob(&jobs[jobTotal], BWT_BLOCK_SIZE,
+                         ENCODE_BOUND(BWT_BLOCK_SIZE + 1)) < 0)
+                goto out;
+
+            bytesRead = fread(jobs[jobTotal].in, 1, BWT_BLOCK_SIZE, src);
+            if (ferror(src)) {
+                reportError("fread");
+                goto out;
+            }
+            if (bytesRead == 0)
+                break;
+
+            jobs[jobTotal].n = bytesRead;
+        }
+
+        if (runJobs(compressJob, jobs, jobTotal) < 0)
+            goto out;
+
+        for (int k = 0; k < jobTotal; k++) {
+            outLen = jobs[k].outLen;
+            if (writeBytes(dest, jobs[k].rows, sizeof(jobs[k].rows)) < 0 ||
+                writeCodeLens(dest, &jobs[k].compTable, BWT_SYM_NUM) < 0 ||
+                writeBytes(dest, &outLen, sizeof(outLen)) < 0 ||
+                writeBytes(dest, jobs[k].out, outLen) < 0)
+                goto out;
+        }
+    } while (jobTotal == threads);
+
+    ret = 0;
+out:
+    for (int k = 0; k < threads; k++)
+        freeJob(&jobs[k]);
+
+    return ret;
+}
+
+// readJob(): Reads the next block of n bytes into job.
+static int readJob(FILE *src, bwtJobT *job, uint32_t n) {
+    uint32_t inLen;
+
+    job->n = n;
+
+    if (readBytes(src, job->rows, sizeof(job->rows)) < 0 ||
+        readCodeLens(src, job->codeLens, BWT_SYM_NUM) < 0 ||
+        readBytes(src, &inLen, sizeof(inLen)) < 0)
+        return -1;
+
+    for (int k = 0; k < BWT_CHAINS; k++)
+        if (job->rows[k] > n) {
+            fprintf(stderr, "%s:%d: Malformed BWT block.\n", __FILE__,
+                    __LINE__);
+            return -1;
+        }
+
+    if (inLen > ENCODE_BOUND(BWT_BLOCK_SIZE + 1)) {
+        fprintf(stderr, "%s:%d: Malformed file error, block of %lu bytes.\n",
+                __FILE__, __LINE__, (unsigned long) inLen);
+        return -1;
+    }
+
+    job->inLen = inLen;
+    if (readBytes(src, job->in, inLen) < 0)
+        return -1;
+    memset(job->in + inLen, 0, 8);
+
+    return 0;
+}
+
+int bwtDecompress(FILE *src, FILE *dest, uint64_t origSize, int threads) {
+    bwtJobT jobs[MAX_THREADS] = {0};
+    uint64_t remaining = origSize;
+    uint32_t n;
+    int jobTotal, ret = -1;
+
+    assert(src != NULL);
+    assert(dest != NULL);
+    assert(threads >= 1 && threads <= MAX_THREADS);
+
+    if (memCheck(JOB_MEM, "bwt") < 0)
+        return -1;
+
+    threads = memFitThreads(threads, JOB_MEM);
+
+    while (remaining > 0) {
+        for (jobTotal = 0; jobTotal < threads && remaining > 0; jobTotal++) {
+            if (allocJob(&jobs[jobTotal], ENCODE_BOUND(BWT_BLOCK_SIZE + 1) + 8,
+                         BWT_BLOCK_SIZE) < 0)
+                goto out;
+
+            n = remaining < BWT_BLOCK_SIZE ? remaining : BWT_BLOCK_SIZE;
+            if (readJob(src, &jobs[jobTotal], n) < 0)
+                goto out;
+            remaining -= n;
+        }
+
+        if (runJobs(decompressJob, jobs, jobTotal) < 0)
+            goto out;
+
+        for (int k = 0; k < jobTotal; k++)
+            if (writeBytes(dest, jobs[k].out, jobs[k].n) < 0)
+                goto out;
+    }
+
+    ret = 0;
+out:
+    for (int k = 0; k < threads; k++)
+        freeJob(&jobs[k]);
+
+    return ret;
+}
@@ -0,0 +1,252 @@
+#include "fg2019/checkpoint.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "fg2019/bitio.h"
+#include "fg2019/codes.h"
+#include "fg2019/coder.h"
+#include "fg2019/const.h"
+#include "fg2019/error.h"
+#include "fg2019/file.h"
+#include "fg2019/mem.h"
+
+// Size (in bytes) of the read and write buffers
+#define CKPT_BUF_SIZE (64 * 1024)
+
+// ckptT: A checkpoint, as stored in the trailer.
+typedef struct {
+    uint64_t bitOffset;
+    uint64_t pos;
+} ckptT;
+
+// ckptListT: The checkpoints gathered during compression.
+typedef struct {
+    ckptT *array;
+    size_t total;
+    size_t cap;
+} ckptListT;
+
+static int addCkpt(ckptListT *list, uint64_t bitOffset, uint64_t pos) {
+    ckptT *array;
+
+    if (list->total == list->cap) {
+        list->cap = list->cap ? 2 * list->cap : 1024;
+        array = memRealloc(list->array, sizeof(*array) * list->cap);
+        if (!array) {
+            reportError("realloc");
+            return -1;
+        }
+        list->array = array;
+    }
+
+    list->array[list->total].bitOffset = bitOffset;
+    list->array[list->total].pos = pos;
+    list->total++;
+
+    return 0;
+}
+
+// encodeCkpts(): Same as compress(), recording a checkpoint whenever the
+//  input position is a multiple of interval.
+static int encodeCkpts(FILE *src, FILE *dest, const compTableT *compTablePtr,
+                       uint64_t interval, ckptListT *list) {
+    unsigned char readBuf[CKPT_BUF_SIZE];
+    unsigned char writeBuf[ENCODE_BOUND(CKPT_BUF_SIZE)];
+    uint64_t pos = 0, bytesFlushed = 0, toRead;
+    size_t bytesRead, wLen;
+    bitWriterT bw;
+
+    bitWriterInit(&bw, writeBuf);
+
+    do {
+        //  Reads stop at the checkpoints, so the bit position of the writer
+        // is that of the checkpoint (the pending bits of bw included).
+        if (pos % interval == 0 &&
+            addCkpt(list, bytesFlushed * CHAR_BIT + bw.count, pos) < 0)
+            return -1;
+
+        toRead = interval - pos % interval;
+        if (toRead > CKPT_BUF_SIZE)
+            toRead = CKPT_BUF_SIZE;
+
+        bytesRead = fread(readBuf, 1, toRead, src);
+        if (ferror(src)) {
+            reportError("fread");
+            return -1;
+        }
+
+        encodeSyms(&bw, compTablePtr, readBuf, bytesRead);
+        pos += bytesRead;
+
+        if (feof(src))
+            encodeEOF(&bw, compTablePtr);
+
+        wLen = bw.ptr - writeBuf;
+        if (writeBytes(dest, writeBuf, wLen) < 0)
+            return -1;
+        bytesFlushed += wLen;
+        bw.ptr = writeBuf;
+    } while (!feof(src));
+
+    return 0;
+}
+
+int ckptCompress(FILE *src, FILE *dest, uint64_t interval) {
+    compTableT compTable;
+    size_t freqs[SYM_NUM];
+    ckptListT list = {0};
+    uint64_t compSize = 0, trailerHead[2];
+    int ret = -1;
+
+    assert(src != NULL);
+    assert(dest != NULL);
+
+    if (countSyms(src, freqs) < 0 ||
+        initCompressionTable(&compTable, freqs, SYM_NUM) < 0)
+        return -1;
+
+    if (fseek(src, 0, SEEK_SET) == -1) {
+        reportError("fseek");
+        return -1;
+    }
+
+    // Compute compSize in bits, then in bytes, as writeHeader() does
+    for (int k = 0; k < SYM_NUM; k++)
+        compSize += freqs[k] * compTable.lens[k];
+    compSize = (compSize + CHAR_BIT - 1) / CHAR_BIT;
+
+    if (writeCodeLens(dest, &compTable, SYM_NUM) < 0 ||
+        writeBytes(dest, &compSize, sizeof(compSize)) < 0)
+        return -1;
+
+    // Without checkpoints, there is no trailer either
+    if (interval == 0)
+        return compress(src, dest, &compTable);
+
+    if (encodeCkpts(src, dest, &compTable, interval, &list) < 0)
+        goto out;
+
+    trailerHead[0] = interval;
+    trailerHead[1] = list.total;
+    if (writeBytes(dest, trailerHead, sizeof(trailerHead)) < 0 ||
+        writeBytes(dest, list.array, sizeof(*list.array) * list.total) < 0)
+        goto out;
+
+    ret = 0;
+out:
+    memFree(list.array);
+
+    return ret;
+}
+
+// readTable(): Reads the code lengths and the compressed data size, and
+//  builds the decompression table.
+static int readTable(FILE *src, decompTableT *decompTablePtr,
+                     uint64_t *compSizePtr) {
+    int codeLens[SYM_NUM];
+
+    if (readCodeLens(src, codeLens, SYM_NUM) < 0 ||
+        readBytes(src, compSizePtr, sizeof(*compSizePtr)) < 0)
+        return -1;
+
+    memset(decompTablePtr, 0, sizeof(*decompTablePtr));
+    return initDecompressionTable(decompTablePtr, codeLens, SYM_NUM);
+}
+
+int ckptDecompress(FILE *src, FILE *dest) {
+    decompTableT decompTable;
+    uint64_t compSize;
+
+    assert(src != NULL);
+    assert(dest != NULL);
+
+    if (readTable(src, &decompTable, &compSize) < 0)
+        return -1;
+
+    // The trailer after the compressed data is not needed
+    return decompress(src, dest, &decompTable, compSize);
+}
+
+int ckptDecompressRange(FILE *src, FILE *dest, uint64_t origSize,
+                        uint64_t offset, uint64_t len) {
+    decompTableT decompTable;
+    uint64_t compSize, trailerHead[2], k;
+    off_t dataStart;
+    ckptT ckpt;
+
+    assert(src != NULL);
+    assert(dest != NULL);
+
+    if (offset >= origSize)
+        return 0;
+    if (len > origSize - offset)
+        len = origSize - offset;
+
+    if (readTable(src, &decompTable, &compSize) < 0)
+        return -1;
+
+    dataStart = ftello(src);
+    if (dataStart == -1 || fseeko(src, compSize, SEEK_CUR) == -1) {
+        reportError("fseeko");
+        return -1;
+    }
+
+    if (readBytes(src, trailerHead, sizeof(trailerHead)) < 0)
+        return -1;
+
+    //  The checkpoint of offset, or the last one if there are fewer than
+    // expected
+    if (trailerHead[0] == 0 || trailerHead[1] == 0) {
+        fprintf(stderr, "%s:%d: Malformed checkpoint trailer.\n", __FILE__,
+                __LINE__);
+        return -1;
+    }
+
+    k = offset / trailerHead[0];
+    if (k >= trailerHead[1])
+        k = trailerHead[1] - 1;
+
+    if (fseeko(src, k * sizeof(ckpt), SEEK_CUR) == -1) {
+        reportError("fseeko");
+        return -1;
+    }
+
+    if (readBytes(src, &ckpt, sizeof(ckpt)) < 0)
+        return -1;
+
+    if (ckpt.pos > offset) {
+        fprintf(stderr, "%s:%d: Malformed checkpoint.\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    if (fseeko(src, dataStart, SEEK_SET) == -1) {
+        reportError("fseeko");
+        return -1;
+    }
+
+    return decompressRange(src, dest, &decompTable, compSize, ckpt.bitOffset,
+                           offset - ckpt.pos, len);
+}
+
+int legacyDecompressRange(FILE *src, FILE *dest, uint64_t offset,
+                          uint64_t len) {
+    decompTableT decompTable;
+    int codeLens[SYM_NUM];
+    size_t compSize;
+
+    assert(src != NULL);
+    assert(dest != NULL);
+
+    if (readHeader(src, codeLens, &compSize) < 0)
+        return -1;
+
+    memset(&decompTable, 0, sizeof(decompTable));
+    if (initDecompressionTable(&decompTable, codeLens, SYM_NUM) < 0)
+        return -1;
+
+    return decompressRange(src, dest, &decompTable, compSize, 0, offset, len);
+}
@@ -0,0 +1,277 @@
+// For fopencookie()
+#define _GNU_SOURCE
+
+#include "fg2019/checksum.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "fg2019/error.h"
+#include "fg2019/mem.h"
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+// Size (in bytes) of the buffers of the hashing streams
+#define HASH_STREAM_BUF_SIZE (64 * 1024)
+
+// hashStreamT: The state of a hashing stream.
+typedef struct {
+    FILE *fptr;
+    xxh64T *statePtr;
+
+    // pos: The position of fptr.
+    // hashed: The number of bytes of fptr hashed (those before it).
+    uint64_t pos, hashed;
+} hashStreamT;
+
+static inline uint64_t rotl64(uint64_t val, int bits) {
+    return (val << bits) | (val >> (64 - bits));
+}
+
+static inline uint64_t read64(const unsigned char *ptr) {
+    uint64_t val;
+
+    memcpy(&val, ptr, sizeof(val));
+    return val;
+}
+
+static inline uint32_t read32(const unsigned char *ptr) {
+    uint32_t val;
+
+    memcpy(&val, ptr, sizeof(val));
+    return val;
+}
+
+static inline uint64_t xxhRound(uint64_t acc, uint64_t input) {
+    acc += input * PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static inline uint64_t mergeRound(uint64_t acc, uint64_t val) {
+    acc ^= xxhRound(0, val);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+// hashStripes(): Hashes the whole stripes of 32 bytes of data, one lane
+//  per 8 bytes, returns the number of bytes hashed.
+static size_t hashStripes(uint64_t lanes[4], const unsigned char *data,
+                          size_t len) {
+    uint64_t v0 = lanes[0], v1 = lanes[1], v2 = lanes[2], v3 = lanes[3];
+    size_t k;
+
+    for (k = 0; k + 32 <= len; k += 32) {
+        v0 = xxhRound(v0, read64(data + k));
+        v1 = xxhRound(v1, read64(data + k + 8));
+        v2 = xxhRound(v2, read64(data + k + 16));
+        v3 = xxhRound(v3, read64(data + k + 24));
+    }
+
+    lanes[0] = v0;
+    lanes[1] = v1;
+    lanes[2] = v2;
+    lanes[3] = v3;
+
+    return k;
+}
+
+void xxh64Init(xxh64T *statePtr) {
+    assert(statePtr != NULL);
+
+    // The seed is 0
+    statePtr->total = 0;
+    statePtr->lanes[0] = PRIME64_1 + PRIME64_2;
+    statePtr->lanes[1] = PRIME64_2;
+    statePtr->lanes[2] = 0;
+    statePtr->lanes[3] = -PRIME64_1;
+    statePtr->bufLen = 0;
+}
+
+void xxh64Update(xxh64T *statePtr, const void *data, size_t len) {
+    const unsigned char *ptr = data;
+    size_t fill;
+
+    assert(statePtr != NULL);
+
+    statePtr->total += len;
+
+    // Complete the stripe left from the last update first
+    if (statePtr->bufLen) {
+        fill = 32 - statePtr->bufLen;
+        if (fill > len)
+            fill = len;
+
+        memcpy(statePtr->buf + statePtr->bufLen, ptr, fill);
+        statePtr->bufLen += fill;
+        ptr += fill;
+        len -= fill;
+
+        if (statePtr->bufLen < 32)
+            return;
+
+        hashStripes(statePtr->lanes, statePtr->buf, 32);
+        statePtr->bufLen = 0;
+    }
+
+    fill = hashStripes(statePtr->lanes, ptr, len);
+
+    memcpy(statePtr->buf, ptr + fill, len - fill);
+    statePtr->bufLen = len - fill;
+}
+
+uint64_t xxh64Digest(const xxh64T *statePtr) {
+    const unsigned char *ptr = statePtr->buf;
+    size_t len = statePtr->bufLen;
+    uint64_t hash;
+
+    assert(statePtr != NULL);
+
+    if (statePtr->total >= 32) {
+        hash = rotl64(statePtr->lanes[0], 1) + rotl64(statePtr->lanes[1], 7) +
+               rotl64(statePtr->lanes[2], 12) + rotl64(statePtr->lanes[3], 18);
+        for (int k = 0; k < 4; k++)
+            hash = mergeRound(hash, statePtr->lanes[k]);
+    }
+    else
+        hash = PRIME64_5;
+
+    hash += statePtr->total;
+
+    for (; len >= 8; ptr += 8, len -= 8) {
+        hash ^= xxhRound(0, read64(ptr));
+        hash = rotl64(hash, 27) * PRIME64_1 + PRIME64_4;
+    }
+
+    if (len >= 4) {
+        hash ^= read32(ptr) * PRIME64_1;
+        hash = rotl64(hash, 23) * PRIME64_2 + PRIME64_3;
+        ptr += 4;
+        len -= 4;
+    }
+
+    for (; len > 0; ptr++, len--) {
+        hash ^= *ptr * PRIME64_5;
+        hash = rotl64(hash, 11) * PRIME64_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= PRIME64_3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+static ssize_t hashRead(void *cookie, char *buf, size_t size) {
+    hashStreamT *stream = cookie;
+    size_t bytesRead = fread(buf, 1, size, stream->fptr);
+
+    if (ferror(stream->fptr))
+        return -1;
+
+    // Only the bytes right after those hashed are, a byte read again after
+    // a seek is not
+    if (stream->pos <= stream->hashed &&
+        stream->hashed < stream->pos + bytesRead) {
+        xxh64Update(stream->statePtr, buf + (stream->hashed - stream->pos),
+                    stream->pos + bytesRead - stream->hashed);
+        stream->hashed = stream->pos + bytesRead;
+    }
+    stream->pos += bytesRead;
+
+    return bytesRead;
+}
+
+static int hashSeek(void *cookie, off64_t *offsetPtr, int whence) {
+    hashStreamT *stream = cookie;
+    off_t pos;
+
+    if (fseeko(stream->fptr, *offsetPtr, whence) == -1)
+        return -1;
+
+    pos = ftello(stream->fptr);
+    if (pos == -1)
+        return -1;
+
+    *offsetPtr = stream->pos = pos;
+    return 0;
+}
+
+static ssize_t hashWrite(void *cookie, const char *buf, size_t size) {
+    hashStreamT *stream = cookie;
+
+    xxh64Update(stream->statePtr, buf, size);
+
+    if (stream->fptr && fwrite(buf, 1, size, stream->fptr) < size)
+        return -1;
+
+    return size;
+}
+
+static int hashClose(void *cookie) {
+    memFree(cookie);
+    return 0;
+}
+
+// openHashStream(): Opens a hashing stream with the given functions.
+static FILE *openHashStream(FILE *fptr, xxh64T *statePtr, const char *mode,
+                            cookie_io_functions_t funcs) {
+    hashStreamT *stream = memAlloc(sizeof(*stream));
+    FILE *hashFptr;
+
+    if (!stream) {
+        reportError("malloc");
+        return NULL;
+    }
+
+    stream->fptr = fptr;
+    stream->statePtr = statePtr;
+    stream->pos = stream->hashed = 0;
+
+    // The position of src, as it might have been read from already
+    if (fptr && funcs.read) {
+        off_t pos = ftello(fptr);
+
+        if (pos == -1) {
+            reportError("ftello");
+            memFree(stream);
+            return NULL;
+        }
+        stream->pos = stream->hashed = pos;
+    }
+
+    hashFptr = fopencookie(stream, mode, funcs);
+    if (!hashFptr) {
+        reportError("fopencookie");
+        memFree(stream);
+        return NULL;
+    }
+
+    setvbuf(hashFptr, NULL, _IOFBF, HASH_STREAM_BUF_SIZE);
+
+    return hashFptr;
+}
+
+FILE *hashReader(FILE *src, xxh64T *statePtr) {
+    cookie_io_functions_t funcs = {hashRead, NULL, hashSeek, hashClose};
+
+    assert(src != NULL);
+    assert(statePtr != NULL);
+
+    return openHashStream(src, statePtr, "rb", funcs);
+}
+
+FILE *hashWriter(FILE *dest, xxh64T *statePtr) {
+    cookie_io_functions_t funcs = {NULL, hashWrite, NULL, hashClose};
+
+    assert(statePtr != NULL);
+
+    return openHashStream(dest, statePtr, "wb", funcs);
+}
@@ -0,0 +1,85 @@
+#include "fg2019/client.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "fg2019/error.h"
+
+int clientConnect(const char *sockPath) {
+    struct sockaddr_un addr;
+    int sock;
+
+    assert(sockPath != NULL);
+
+    if (strlen(sockPath) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "The socket path %s is too long.\n", sockPath);
+        return -1;
+    }
+
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1) {
+        reportError("socket");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, sockPath);
+
+    if (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+        reportError("connect");
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+int clientRequest(int sock, const serveRequestT *reqPtr, int srcFd,
+                  int destFd) {
+    int fds[2] = {srcFd, destFd};
+    int fdTotal = reqPtr->op == SERVE_OP_VERIFY ? 1 : 2;
+    char control[CMSG_SPACE(sizeof(fds))];
+    struct msghdr msg = {0};
+    struct cmsghdr *cmsg;
+    struct iovec iov;
+    int32_t status;
+    ssize_t len;
+
+    assert(reqPtr != NULL);
+
+    iov.iov_base = (void *) reqPtr;
+    iov.iov_len = sizeof(*reqPtr);
+
+    memset(control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * fdTotal);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fdTotal);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * fdTotal);
+
+    if (sendmsg(sock, &msg, MSG_NOSIGNAL) != (ssize_t) sizeof(*reqPtr)) {
+        reportError("sendmsg");
+        return -1;
+    }
+
+    len = recv(sock, &status, sizeof(status), MSG_WAITALL);
+    if (len != (ssize_t) sizeof(status)) {
+        if (len == -1)
+            reportError("recv");
+        else
+            fprintf(stderr, "The daemon closed the connection.\n");
+        return -1;
+    }
+
+    return status == 0 ? 0 : -1;
+}
@@ -0,0 +1,114 @@
+#include "fg2019/coder.h"
+
+#include <assert.h>
+#include <stdint.h>
+
+#include "fg2019/bitio.h"
+#include "fg2019/codes.h"
+#include "fg2019/const.h"
+
+void encodeSyms(bitWriterT *bw, const compTableT *compTablePtr,
+                const unsigned char *in, size_t n) {
+    const int *codeLens = compTablePtr->lens;
+    const unsigned int *codeVals = compTablePtr->vals;
+
+    assert(bw != NULL);
+    assert(compTablePtr != NULL);
+
+    //  The bits are gathered in a local copy of the writer state and
+    // stored 32 at a time, instead of a byte at a time as in putBits().
+    uint64_t acc = bw->acc;
+    int count = bw->count;
+    unsigned char *ptr = bw->ptr;
+    uint32_t word;
+
+    for (size_t k = 0; k < n; k++) {
+        acc = (acc << codeLens[in[k]]) | codeVals[in[k]];
+        count += codeLens[in[k]];
+
+        if (count >= 32) {
+            count -= 32;
+            word = acc >> count;
+            ptr[0] = word >> 24;
+            ptr[1] = word >> 16;
+            ptr[2] = word >> 8;
+            ptr[3] = word;
+            ptr += 4;
+        }
+    }
+
+    bw->acc = acc;
+    bw->count = count;
+    bw->ptr = ptr;
+
+    // Leave fewer than 8 bits pending, as putBits() does
+    putBits(bw, 0, 0);
+}
+
+void encodeEOF(bitWriterT *bw, const compTableT *compTablePtr) {
+    assert(bw != NULL);
+    assert(compTablePtr != NULL);
+
+    putBits(bw, compTablePtr->vals[EOF_VAL], compTablePtr->lens[EOF_VAL]);
+    flushBits(bw);
+}
+
+size_t decodeSyms(bitReaderT *br, const decompTableT *decompTablePtr,
+                  unsigned char *out, size_t outCap, int final,
+                  int *donePtr) {
+    const char *codeLens = decompTablePtr->codeLens;
+    const int *symbols = decompTablePtr->symbols;
+    size_t n = 0;
+    unsigned int idx;
+    int sym, len;
+
+    assert(br != NULL);
+    assert(decompTablePtr != NULL);
+    assert(donePtr != NULL);
+
+    *donePtr = 0;
+
+    //  Fast path: while at least 8 bytes of input are left, one refill
+    // provides 56 bits, enough for 4 codes of at most MAX_CODELEN bits,
+    // so no bounds checks are needed between them.
+    while (outCap - n >= 4 && br->end - br->ptr >= 8) {
+        refill(br);
+
+        for (int k = 0; k < 4; k++) {
+            idx = peekBits(br, MAX_CODELEN);
+            sym = symbols[idx];
+            skipBits(br, codeLens[idx]);
+            if (sym == EOF_VAL) {
+                *donePtr = 1;
+                return n;
+            }
+            out[n++] = sym;
+        }
+    }
+
+    //  Slow path, near the end of the piece: a code is only decoded if all
+    // of its bits are there, unless the piece is the last one, and then
+    // only while some are left, so a stream without EOF comes to an end.
+    while (n < outCap) {
+        refill(br);
+
+        idx = peekBits(br, MAX_CODELEN);
+        len = codeLens[idx];
+        if (len > br->count && (!final || br->count == 0))
+            break;
+
+        sym = symbols[idx];
+        skipBits(br, len);
+
+        // Past the end of the stream only padding bits are consumed
+        if (br->count < 0)
+            br->count = 0;
+        if (sym == EOF_VAL) {
+            *donePtr = 1;
+            break;
+        }
+        out[n++] = sym;
+    }
+
+    return n;
+}
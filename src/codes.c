@@ -1,10 +1,10 @@
 #include "fg2019/codes.h"
 
 #include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 #include "fg2019/const.h"
-#include "fg2019/error.h"
 #include "fg2019/minQueue.h"
 
 // symbolT: Contains a symbol and the prefix code corresponding to it.
@@ -15,15 +15,20 @@ typedef struct {
     int codeLen;
 } symbolT;
 
+//  nodePoolT: The nodes of a Huffman tree, taken in order from an array big
+// enough for the tree of the largest alphabet (symNum leaves, symNum - 1
+// inner nodes), so building a tree allocates nothing.
+typedef struct {
+    huffmanNodeT nodes[2 * MAX_SYM_NUM - 1];
+    int used;
+} nodePoolT;
+
 // initLeafNode(): Initalizes a leaf node of the Huffman tree.
-static inline huffmanNodeT *initLeafNode(unsigned int symbol, size_t freq) {
-    assert(freq >= 0);
+static inline huffmanNodeT *initLeafNode(nodePoolT *pool, unsigned int symbol,
+                                         size_t freq) {
+    assert(pool != NULL);
 
-    huffmanNodeT *leaf = malloc(sizeof(*leaf));
-    if (!leaf) {
-        reportError("malloc");
-        return NULL;
-    }
+    huffmanNodeT *leaf = &pool->nodes[pool->used++];
 
     leaf->symbol = symbol;
     leaf->left = leaf->right = NULL;
@@ -34,16 +39,13 @@ static inline huffmanNodeT *initLeafNode(unsigned int symbol, size_t freq) {
 
 // initInnerNode: Initializes an inner node of the Huffman tree
 //               (corresponds to a composite symbol).
-static inline huffmanNodeT *initInnerNode(huffmanNodeT *left,
+static inline huffmanNodeT *initInnerNode(nodePoolT *pool, huffmanNodeT *left,
                                           huffmanNodeT *right) {
+    assert(pool != NULL);
     assert(left != NULL);
     assert(right != NULL);
 
-    huffmanNodeT *node = malloc(sizeof(*node));
-    if (!node) {
-        reportError("malloc");
-        return NULL;
-    }
+    huffmanNodeT *node = &pool->nodes[pool->used++];
 
     node->left = left;
     node->right = right;
@@ -52,51 +54,26 @@ static inline huffmanNodeT *initInnerNode(huffmanNodeT *left,
     return node;
 }
 
-// freeHuffmanTree(): Frees the Huffman tree.
-//                Assumes that root != NULL.
-static void freeHuffmanTree(huffmanNodeT *root) {
-    assert(root != NULL);
-
-    if (root->left != NULL)
-        freeHuffmanTree(root->left);
-    if (root->right != NULL)
-        freeHuffmanTree(root->right);
-
-    free(root);
-}
-
 // initHuffmanTree(): Uses the textbook Huffman coding algorithm to initialize
 //              the Huffman tree, using the frequencies of all the symbols.
-static huffmanNodeT *initHuffmanTree(size_t freqs[SYM_NUM]) {
+//  Assumptions:
+//   > At least one symbol has freq != 0.
+static huffmanNodeT *initHuffmanTree(nodePoolT *pool, const size_t *freqs,
+                                     int symNum) {
     minQueueT minQueue;
-    huffmanNodeT **initialNodes;
-    huffmanNodeT *node1, *node2, *newNode, *huffmanRoot;
+    huffmanNodeT *initialNodes[MAX_SYM_NUM];
+    huffmanNodeT *node1, *node2;
     int nonZeroTotal = 0;
-    int k, t;
+    int k;
+
+    pool->used = 0;
 
     // Initialize the array of the initial nodes, excluding the symbols with
     //  freq = 0
     //  so that they will not waste heap operations.
-    for (k = 0; k < SYM_NUM; k++)
-        if (freqs[k] != 0)
-            nonZeroTotal++;
-
-    initialNodes = malloc(sizeof(*initialNodes) * nonZeroTotal);
-    if (!initialNodes) {
-        reportError("malloc");
-        return NULL;
-    }
-
-    for (t = 0, k = 0; k < SYM_NUM; k++) {
-        if (freqs[k]) {
-            initialNodes[t] = initLeafNode(k, freqs[k]);
-            if (!initialNodes[t]) {
-                reportError("malloc");
-                return NULL;
-            }
-            t++;
-        }
-    }
+    for (k = 0; k < symNum; k++)
+        if (freqs[k])
+            initialNodes[nonZeroTotal++] = initLeafNode(pool, k, freqs[k]);
 
     // Use the array to initialize the min queue used in the algorithm,
     // no more than nonZeroTotal positions are needed in the min queue,
@@ -106,20 +83,10 @@ static huffmanNodeT *initHuffmanTree(size_t freqs[SYM_NUM]) {
     while (minQueue.nodeTotal > 1) {
         node1 = delMin(&minQueue);
         node2 = delMin(&minQueue);
-        newNode = initInnerNode(node1, node2);
-        if (!newNode) {
-            reportError("malloc");
-            return NULL;
-        }
-        minQueueIns(&minQueue, newNode);
+        minQueueIns(&minQueue, initInnerNode(pool, node1, node2));
     }
 
-    // Remove the root from the min queue, before freeing the queue's array,
-    //  as the array is used in the minQueue, not a copy.
-    huffmanRoot = delMin(&minQueue);
-    free(initialNodes);
-
-    return huffmanRoot;
+    return delMin(&minQueue);
 }
 
 // compHuffmanLens(): Computes the Huffman code length correspoding to each
@@ -129,7 +96,7 @@ static huffmanNodeT *initHuffmanTree(size_t freqs[SYM_NUM]) {
 //   > symbols[] is sorted in such a way that symbols[k].symbol == k, where k is
 //   a
 //  symbol.
-static void compHuffmanLens(huffmanNodeT *huffmanNode, symbolT symbols[SYM_NUM],
+static void compHuffmanLens(huffmanNodeT *huffmanNode, symbolT *symbols,
                             int codeLen) {
     assert(huffmanNode != NULL);
 
@@ -180,7 +147,7 @@ static int lenThenLexComp(const void *ptr1, const void *ptr2) {
 //  Assumptions:
 //   > symbols[] is sorted by increasing codeLen.
 
-static void limitCodeLens(symbolT symbols[SYM_NUM]) {
+static void limitCodeLens(symbolT *symbols, int symNum) {
     // kraftSum: The sum of 1 / 2^codeLen that appears in Kraft's inequality.
     double kraftSum = 0;
     int k;
@@ -191,7 +158,7 @@ static void limitCodeLens(symbolT symbols[SYM_NUM]) {
     //   without
     //   using pow() from math.h
 
-    for (k = 0; k < SYM_NUM; k++) {
+    for (k = 0; k < symNum; k++) {
         if (symbols[k].codeLen) {
             if (symbols[k].codeLen > MAX_CODELEN)
                 symbols[k].codeLen = MAX_CODELEN;
@@ -200,14 +167,14 @@ static void limitCodeLens(symbolT symbols[SYM_NUM]) {
         }
     }
 
-    for (k = SYM_NUM - 1; k >= 0; k--)
+    for (k = symNum - 1; k >= 0; k--)
         while (symbols[k].codeLen && symbols[k].codeLen < MAX_CODELEN &&
                kraftSum > 1) {
             symbols[k].codeLen++;
             kraftSum -= 1 / (double) (1 << symbols[k].codeLen);
         }
 
-    for (k = 0; k < SYM_NUM; k++)
+    for (k = 0; k < symNum; k++)
         while (symbols[k].codeLen &&
                (kraftSum + 1 / (double) (1 << symbols[k].codeLen)) <= 1) {
             kraftSum += 1 / (double) (1 << symbols[k].codeLen);
@@ -225,18 +192,18 @@ static void limitCodeLens(symbolT symbols[SYM_NUM]) {
 //   to enforce the same ordering of symbols with equal lengths during
 //  compression and decompression, so
 //    that the same code values are produced).
-static void computeCodeVals(symbolT symbols[SYM_NUM]) {
-    int prevLen, prevVal = 0;
+static void computeCodeVals(symbolT *symbols, int symNum) {
+    int prevLen = 0, prevVal = 0;
     int k;
 
-    for (k = 0; k < SYM_NUM; k++)
+    for (k = 0; k < symNum; k++)
         if (symbols[k].codeLen) {
             symbols[k].codeVal = 0;
             prevLen = symbols[k].codeLen;
             break;
         }
 
-    for (k++; k < SYM_NUM; k++)
+    for (k++; k < symNum; k++)
         if (symbols[k].codeLen) {
             prevVal = symbols[k].codeVal = (prevVal + 1)
                                            << (symbols[k].codeLen - prevLen);
@@ -244,43 +211,53 @@ static void computeCodeVals(symbolT symbols[SYM_NUM]) {
         }
 }
 
-int initCompressionTable(compTableT *compTablePtr, size_t freqs[SYM_NUM]) {
-    huffmanNodeT *huffmanRoot;
-    symbolT symbols[SYM_NUM];
+int initCompressionTable(compTableT *compTablePtr, const size_t *freqs,
+                         int symNum) {
+    nodePoolT pool;
+    symbolT symbols[MAX_SYM_NUM];
+    int nonZeroTotal = 0;
     int k;
 
     assert(compTablePtr != NULL);
-
-    huffmanRoot = initHuffmanTree(freqs);
-    if (!huffmanRoot)
-        return -1;
+    assert(symNum <= MAX_SYM_NUM);
 
     // Iterate over all of the symbols and init symbols[]
-    for (k = 0; k < SYM_NUM; k++) {
+    for (k = 0; k < symNum; k++) {
         symbols[k].symbol = k;
 
         // Not computed yet, codeLen init to 0 in order to indicate
         // a symbol that does not appear in the file to be compressed.
         symbols[k].codeLen = 0;
         symbols[k].codeVal = 0;
+
+        if (freqs[k])
+            nonZeroTotal++;
     }
 
-    compHuffmanLens(huffmanRoot, symbols, 0);
+    //  A tree of a single leaf would give it a code of length 0, so the
+    // only symbol (if any) is given a code of length 1 instead.
+    if (nonZeroTotal <= 1) {
+        for (k = 0; k < symNum; k++) {
+            compTablePtr->lens[k] = (freqs[k] != 0);
+            compTablePtr->vals[k] = 0;
+        }
+
+        return 0;
+    }
 
-    // The tree is not needed anymore
-    freeHuffmanTree(huffmanRoot);
+    compHuffmanLens(initHuffmanTree(&pool, freqs, symNum), symbols, 0);
 
     // Sort symbol array by increasing code length, needed by limitCodeLens()
-    qsort(symbols, SYM_NUM, sizeof(symbols[0]), lenComp);
+    qsort(symbols, symNum, sizeof(symbols[0]), lenComp);
 
-    limitCodeLens(symbols);
+    limitCodeLens(symbols, symNum);
 
-    qsort(symbols, SYM_NUM, sizeof(symbols[0]), lenThenLexComp);
+    qsort(symbols, symNum, sizeof(symbols[0]), lenThenLexComp);
 
-    computeCodeVals(symbols);
+    computeCodeVals(symbols, symNum);
 
     // Fill the compression table
-    for (k = 0; k < SYM_NUM; k++) {
+    for (k = 0; k < symNum; k++) {
         // symbols[k].symbol is used as the index
         // and not k, because due to the above sorting
         // symbols[k].symbols != k in the general case.
@@ -291,8 +268,36 @@ int initCompressionTable(compTableT *compTablePtr, size_t freqs[SYM_NUM]) {
     return 0;
 }
 
-int initDecompressionTable(decompTableT *decompTablePtr, int codeLens[SYM_NUM]) {
-    symbolT symbols[SYM_NUM];
+int initCompressionTableFromLens(compTableT *compTablePtr,
+                                 const unsigned char *codeLens, int symNum) {
+    symbolT symbols[MAX_SYM_NUM];
+    int k;
+
+    assert(compTablePtr != NULL);
+    assert(symNum <= MAX_SYM_NUM);
+
+    for (k = 0; k < symNum; k++) {
+        symbols[k].symbol = k;
+        symbols[k].codeLen = codeLens[k];
+        symbols[k].codeVal = 0; // Not known yet
+    }
+
+    // The same ordering as in initCompressionTable(), so the same codes
+    qsort(symbols, symNum, sizeof(symbols[0]), lenThenLexComp);
+
+    computeCodeVals(symbols, symNum);
+
+    for (k = 0; k < symNum; k++) {
+        compTablePtr->lens[symbols[k].symbol] = symbols[k].codeLen;
+        compTablePtr->vals[symbols[k].symbol] = symbols[k].codeVal;
+    }
+
+    return 0;
+}
+
+int initDecompressionTable(decompTableT *decompTablePtr, const int *codeLens,
+                           int symNum) {
+    symbolT symbols[MAX_SYM_NUM];
     int k, j;
 
     // curLen: Length of the current code inserted to the table
@@ -303,9 +308,40 @@ int initDecompressionTable(decompTableT *decompTablePtr, int codeLens[SYM_NUM])
     int curLen;
     int curSym;
 
+    // kraftSum: The sum of Kraft's inequality, scaled by 2^MAX_CODELEN
+    unsigned int kraftSum = 0;
+
     assert(decompTablePtr != NULL);
+    assert(symNum >= 1 && symNum <= MAX_SYM_NUM);
+
+    //  The lengths come from the compressed file, so they are checked before
+    // any of them is used: the codes must fit in the table
+    for (k = 0; k < symNum; k++) {
+        if (codeLens[k] < 0 || codeLens[k] > MAX_CODELEN) {
+            fprintf(stderr, "%s:%d: Malformed code lengths.\n", __FILE__,
+                    __LINE__);
+            return -1;
+        }
+        if (codeLens[k])
+            kraftSum += 1u << (MAX_CODELEN - codeLens[k]);
+    }
 
-    for (k = 0; k < SYM_NUM; k++) {
+    if (kraftSum > DECOMP_SIZE) {
+        fprintf(stderr, "%s:%d: Malformed code lengths.\n", __FILE__,
+                __LINE__);
+        return -1;
+    }
+
+    //  Entries no code reaches (when the code is not complete) decode as the
+    // last symbol, the end symbol of the alphabets that have one, taking
+    // MAX_CODELEN bits, so that every entry is valid and makes progress and
+    // the decoders need no checks of their own.
+    for (j = 0; j < DECOMP_SIZE; j++) {
+        decompTablePtr->codeLens[j] = MAX_CODELEN;
+        decompTablePtr->symbols[j] = symNum - 1;
+    }
+
+    for (k = 0; k < symNum; k++) {
         symbols[k].symbol = k;
         symbols[k].codeLen = codeLens[k];
         symbols[k].codeVal = 0; // Not known yet
@@ -314,15 +350,15 @@ int initDecompressionTable(decompTableT *decompTablePtr, int codeLens[SYM_NUM])
     //  Sort symbol array by length and then lexicographically to produce the
     //  same codes values
     //  that were used in compression.
-    qsort(symbols, SYM_NUM, sizeof(symbols[0]), lenThenLexComp);
+    qsort(symbols, symNum, sizeof(symbols[0]), lenThenLexComp);
 
     // Compute code vals using the same algo as in compression
-    computeCodeVals(symbols);
+    computeCodeVals(symbols, symNum);
 
     // Fill the decompression table according to the algorithm
     // detailed here
     // https://github.com/IJzerbaard/shortarticles/blob/master/huffmantable.md
-    for (k = 0; k < SYM_NUM; k++) {
+    for (k = 0; k < symNum; k++) {
         if (symbols[k].codeLen != 0) {
             int first, last; // first and last indexes to be filled in the table
             curSym = symbols[k].symbol;
@@ -338,4 +374,4 @@ int initDecompressionTable(decompTableT *decompTablePtr, int codeLens[SYM_NUM])
     }
 
     return 0;
-}
\ No newline at end of file
+}
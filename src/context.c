@@ -0,0 +1,440 @@
+#include "fg2019/context.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fg2019/bitio.h"
+#include "fg2019/coder.h"
+#include "fg2019/codes.h"
+#include "fg2019/const.h"
+#include "fg2019/error.h"
+#include "fg2019/file.h"
+#include "fg2019/mem.h"
+
+// Size (in bytes) of the read and write buffers
+#define CTX_BUF_SIZE (64 * 1024)
+
+// Maximum number of refinement passes of the clustering
+#define CTX_ITERATIONS 16
+
+//  The symbol and the code length of an entry of a packed decoding table.
+// Packing an entry in 2 bytes (instead of the 5 of decompTableT) keeps
+// even 16 tables in 128 KiB, within the L2 cache.
+#define ENTRY_SYM_BITS 9
+#define ENTRY_SYM_MASK ((1 << ENTRY_SYM_BITS) - 1)
+
+// ctxDecTableT: Packed decoding table of a group.
+typedef struct {
+    uint16_t entries[DECOMP_SIZE];
+} ctxDecTableT;
+
+// ctxFreqsT: The symbol frequencies of every context.
+typedef size_t ctxFreqsT[CTX_NUM][SYM_NUM];
+
+// countCtxSyms(): Counts the symbols of src by context, and finds the
+//  context of the EOF symbol (the last byte).
+static int countCtxSyms(FILE *src, ctxFreqsT ctxFreqs, int *lastCtxPtr) {
+    unsigned char buffer[CTX_BUF_SIZE];
+    size_t bytesRead;
+    int prev = 0;
+
+    memset(ctxFreqs, 0, sizeof(ctxFreqsT));
+
+    do {
+        bytesRead = fread(buffer, 1, CTX_BUF_SIZE, src);
+        if (ferror(src)) {
+            reportError("fread");
+            return -1;
+        }
+
+        for (size_t k = 0; k < bytesRead; k++) {
+            ctxFreqs[prev][buffer[k]]++;
+            prev = buffer[k];
+        }
+    } while (!feof(src));
+
+    *lastCtxPtr = prev;
+
+    return 0;
+}
+
+// sumGroups(): Sums the frequencies of the contexts of every group.
+static void sumGroups(ctxFreqsT ctxFreqs, const unsigned char map[CTX_NUM],
+                      int groupTotal,
+                      size_t groupFreqs[CTX_MAX_GROUPS][SYM_NUM]) {
+    memset(groupFreqs, 0, sizeof(groupFreqs[0]) * CTX_MAX_GROUPS);
+
+    for (int c = 0; c < CTX_NUM; c++)
+        if (map[c] < groupTotal)
+            for (int s = 0; s < SYM_NUM; s++)
+                groupFreqs[map[c]][s] += ctxFreqs[c][s];
+}
+
+//  clusterContexts(): Assigns every context to one of at most groupTotal
+// groups, so that the contexts of a group have similar statistics, and
+// returns the number of groups used.
+//  It is k-means over histograms: the groups start from the most frequent
+// contexts, then every context moves to the group whose statistics
+// would code it in the fewest bits, and the statistics of the groups are
+// recomputed, until no context moves.
+static int clusterContexts(ctxFreqsT ctxFreqs, int groupTotal,
+                           unsigned char map[CTX_NUM]) {
+    size_t groupFreqs[CTX_MAX_GROUPS][SYM_NUM];
+    double bitCosts[CTX_MAX_GROUPS][SYM_NUM];
+    size_t ctxTotals[CTX_NUM], groupSize;
+    int order[CTX_NUM], renumber[CTX_MAX_GROUPS];
+    int usedTotal = 0, changed, best, k, t;
+    double cost, bestCost;
+
+    for (int c = 0; c < CTX_NUM; c++) {
+        ctxTotals[c] = 0;
+        for (int s = 0; s < SYM_NUM; s++)
+            ctxTotals[c] += ctxFreqs[c][s];
+
+        if (ctxTotals[c])
+            order[usedTotal++] = c;
+        map[c] = CTX_MAX_GROUPS; // Not assigned
+    }
+
+    if (groupTotal > usedTotal)
+        groupTotal = usedTotal;
+
+    // The seeds are the groupTotal most frequent contexts (selection sort,
+    // only the first groupTotal positions are needed)
+    for (k = 0; k < groupTotal; k++) {
+        best = k;
+        for (t = k + 1; t < usedTotal; t++)
+            if (ctxTotals[order[t]] > ctxTotals[order[best]])
+                best = t;
+
+        t = order[k];
+        order[k] = order[best];
+        order[best] = t;
+        map[order[k]] = k;
+    }
+
+    for (int iter = 0; iter < CTX_ITERATIONS; iter++) {
+        sumGroups(ctxFreqs, map, groupTotal, groupFreqs);
+
+        //  bitCosts: The ideal code length of every symbol in every group,
+        // symbols that do not appear get a small probability, so that
+        // contexts with them can still join the group.
+        for (int g = 0; g < groupTotal; g++) {
+            groupSize = 0;
+            for (int s = 0; s < SYM_NUM; s++)
+                groupSize += groupFreqs[g][s];
+
+            for (int s = 0; s < SYM_NUM; s++)
+                bitCosts[g][s] = -log2((groupFreqs[g][s] + 0.5) /
+                                       (groupSize + 0.5 * SYM_NUM));
+        }
+
+        changed = 0;
+        for (k = 0; k < usedTotal; k++) {
+            int c = order[k];
+
+            best = 0;
+            bestCost = HUGE_VAL;
+            for (int g = 0; g < groupTotal; g++) {
+                cost = 0;
+                for (int s = 0; s < SYM_NUM; s++)
+                    if (ctxFreqs[c][s])
+                        cost += ctxFreqs[c][s] * bitCosts[g][s];
+
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    best = g;
+                }
+            }
+
+            if (map[c] != best) {
+                map[c] = best;
+                changed = 1;
+            }
+        }
+
+        if (!changed)
+            break;
+    }
+
+    // Drop the groups that were left empty, and put the contexts that
+    // never appear in the first group
+    for (int g = 0; g < groupTotal; g++)
+        renumber[g] = -1;
+
+    t = 0;
+    for (k = 0; k < usedTotal; k++)
+        if (renumber[map[order[k]]] == -1)
+            renumber[map[order[k]]] = t++;
+
+    for (int c = 0; c < CTX_NUM; c++)
+        map[c] = ctxTotals[c] ? renumber[map[c]] : 0;
+
+    return t > 0 ? t : 1;
+}
+
+// ctxEncodeSyms(): Encodes n bytes of in, each one with the table of its
+//  context. *prevPtr is the context of the first byte, and it is set to
+//  the last byte.
+static void ctxEncodeSyms(bitWriterT *bw, const compTableT *ctxTables[],
+                          int *prevPtr, const unsigned char *in, size_t n) {
+    const compTableT *tablePtr;
+    int prev = *prevPtr;
+
+    for (size_t k = 0; k < n; k++) {
+        tablePtr = ctxTables[prev];
+        putBits(bw, tablePtr->vals[in[k]], tablePtr->lens[in[k]]);
+        prev = in[k];
+    }
+
+    *prevPtr = prev;
+}
+
+int ctxCompress(FILE *src, FILE *dest, int groupTotal) {
+    size_t groupFreqs[CTX_MAX_GROUPS][SYM_NUM];
+    compTableT groupTables[CTX_MAX_GROUPS];
+    const compTableT *ctxTables[CTX_NUM];
+    unsigned char map[CTX_NUM];
+    unsigned char readBuf[CTX_BUF_SIZE], writeBuf[ENCODE_BOUND(CTX_BUF_SIZE)];
+    ctxFreqsT *ctxFreqs;
+    bitWriterT bw;
+    size_t bytesRead;
+    uint64_t compSize = 0;
+    unsigned char groupByte;
+    int lastCtx, prev = 0, ret = -1;
+
+    assert(src != NULL);
+    assert(dest != NULL);
+    assert(groupTotal >= 1 && groupTotal <= CTX_MAX_GROUPS);
+
+    ctxFreqs = memAlloc(sizeof(*ctxFreqs));
+    if (!ctxFreqs) {
+        reportError("malloc");
+        return -1;
+    }
+
+    if (countCtxSyms(src, *ctxFreqs, &lastCtx) < 0)
+        goto out;
+
+    groupTotal = clusterContexts(*ctxFreqs, groupTotal, map);
+    sumGroups(*ctxFreqs, map, groupTotal, groupFreqs);
+
+    // Every group can code the EOF symbol, though only the group of the
+    // last byte will
+    for (int g = 0; g < groupTotal; g++) {
+        groupFreqs[g][EOF_VAL] = 1;
+        if (initCompressionTable(&groupTables[g], groupFreqs[g], SYM_NUM) < 0)
+            goto out;
+    }
+
+    for (int c = 0; c < CTX_NUM; c++) {
+        ctxTables[c] = &groupTables[map[c]];
+        for (int s = 0; s < SYM_NUM; s++)
+            compSize += (*ctxFreqs)[c][s] * ctxTables[c]->lens[s];
+    }
+    compSize += ctxTables[lastCtx]->lens[EOF_VAL];
+    compSize = (compSize + CHAR_BIT - 1) / CHAR_BIT;
+
+    groupByte = groupTotal;
+    if (writeBytes(dest, &groupByte, 1) < 0 ||
+        writeBytes(dest, map, CTX_NUM) < 0)
+        goto out;
+
+    for (int g = 0; g < groupTotal; g++)
+        if (writeCodeLens(dest, &groupTables[g], SYM_NUM) < 0)
+            goto out;
+
+    if (writeBytes(dest, &compSize, sizeof(compSize)) < 0)
+        goto out;
+
+    if (fseek(src, 0, SEEK_SET) == -1) {
+        reportError("fseek");
+        goto out;
+    }
+
+    bitWriterInit(&bw, writeBuf);
+
+    do {
+        bytesRead = fread(readBuf, 1, CTX_BUF_SIZE, src);
+        if (ferror(src)) {
+            reportError("fread");
+            goto out;
+        }
+
+        ctxEncodeSyms(&bw, ctxTables, &prev, readBuf, bytesRead);
+        if (feof(src))
+            encodeEOF(&bw, ctxTables[prev]);
+
+        if (writeBytes(dest, writeBuf, bw.ptr - writeBuf) < 0)
+            goto out;
+        bw.ptr = writeBuf;
+    } while (!feof(src));
+
+    ret = 0;
+out:
+    memFree(ctxFreqs);
+
+    return ret;
+}
+
+// ctxDecodeSyms(): Same as decodeSyms() (see coder.h), with the table of
+//  every symbol chosen by the symbol before it.
+static size_t ctxDecodeSyms(bitReaderT *br, const uint16_t *ctxEntries[],
+                            int *prevPtr, unsigned char *out, size_t outCap,
+                            int final, int *donePtr) {
+    size_t n = 0;
+    int entry, sym, len;
+    int prev = *prevPtr;
+
+    *donePtr = 0;
+
+    // Fast path, 4 codes per refill as in decodeSyms()
+    while (outCap - n >= 4 && br->end - br->ptr >= 8) {
+        refill(br);
+
+        for (int k = 0; k < 4; k++) {
+            entry = ctxEntries[prev][peekBits(br, MAX_CODELEN)];
+            sym = entry & ENTRY_SYM_MASK;
+            skipBits(br, entry >> ENTRY_SYM_BITS);
+            if (sym == EOF_VAL) {
+                *donePtr = 1;
+                goto out;
+            }
+            out[n++] = prev = sym;
+        }
+    }
+
+    while (n < outCap) {
+        refill(br);
+
+        entry = ctxEntries[prev][peekBits(br, MAX_CODELEN)];
+        len = entry >> ENTRY_SYM_BITS;
+        if (len > br->count && !final)
+            break;
+
+        sym = entry & ENTRY_SYM_MASK;
+        skipBits(br, len);
+        if (br->count < 0)
+            br->count = 0;
+        if (sym == EOF_VAL) {
+            *donePtr = 1;
+            break;
+        }
+        out[n++] = prev = sym;
+    }
+
+out:
+    *prevPtr = prev;
+
+    return n;
+}
+
+int ctxDecompress(FILE *src, FILE *dest, uint64_t origSize) {
+    unsigned char map[CTX_NUM];
+    unsigned char readBuf[CTX_BUF_SIZE], writeBuf[CTX_BUF_SIZE];
+    int codeLens[SYM_NUM];
+    const uint16_t *ctxEntries[CTX_NUM];
+    ctxDecTableT *groupTables;
+    decompTableT decompTable;
+    unsigned char groupByte;
+    uint64_t compSize, remaining, total = 0;
+    size_t toRead, outCap, wLen;
+    bitReaderT br;
+    int final = 0, done = 0, prev = 0, ret = -1;
+
+    assert(src != NULL);
+    assert(dest != NULL);
+
+    if (readBytes(src, &groupByte, 1) < 0 || readBytes(src, map, CTX_NUM) < 0)
+        return -1;
+
+    if (groupByte < 1 || groupByte > CTX_MAX_GROUPS) {
+        fprintf(stderr, "%s:%d: Malformed number of groups.\n", __FILE__,
+                __LINE__);
+        return -1;
+    }
+
+    for (int c = 0; c < CTX_NUM; c++)
+        if (map[c] >= groupByte) {
+            fprintf(stderr, "%s:%d: Malformed context map.\n", __FILE__,
+                    __LINE__);
+            return -1;
+        }
+
+    groupTables = memAlloc(sizeof(*groupTables) * groupByte);
+    if (!groupTables) {
+        reportError("malloc");
+        return -1;
+    }
+
+    for (int g = 0; g < groupByte; g++) {
+        if (readCodeLens(src, codeLens, SYM_NUM) < 0)
+            goto out;
+
+        memset(&decompTable, 0, sizeof(decompTable));
+        if (initDecompressionTable(&decompTable, codeLens, SYM_NUM) < 0)
+            goto out;
+
+        for (int k = 0; k < DECOMP_SIZE; k++)
+            groupTables[g].entries[k] =
+              decompTable.symbols[k] |
+              decompTable.codeLens[k] << ENTRY_SYM_BITS;
+    }
+
+    for (int c = 0; c < CTX_NUM; c++)
+        ctxEntries[c] = groupTables[map[c]].entries;
+
+    if (readBytes(src, &compSize, sizeof(compSize)) < 0)
+        goto out;
+
+    remaining = compSize;
+    bitReaderInit(&br);
+
+    while (!done) {
+        if (br.ptr == br.end && !final) {
+            toRead = remaining < CTX_BUF_SIZE ? remaining : CTX_BUF_SIZE;
+            if (readBytes(src, readBuf, toRead) < 0)
+                goto out;
+
+            remaining -= toRead;
+            final = (remaining == 0);
+            bitReaderFeed(&br, readBuf, toRead);
+        }
+
+        // One byte more than origSize allows is enough to tell a malformed
+        // file, which could otherwise decode forever
+        outCap = CTX_BUF_SIZE;
+        if (origSize - total < outCap)
+            outCap = origSize - total + 1;
+
+        wLen = ctxDecodeSyms(&br, ctxEntries, &prev, writeBuf, outCap, final,
+                             &done);
+        total += wLen;
+        if (total > origSize) {
+            fprintf(stderr, "%s:%d: Malformed file error, more than %llu "
+                            "bytes.\n",
+                    __FILE__, __LINE__, (unsigned long long) origSize);
+            goto out;
+        }
+
+        if (writeBytes(dest, writeBuf, wLen) < 0)
+            goto out;
+    }
+
+    if (total != origSize) {
+        fprintf(stderr, "%s:%d: Malformed file error, %llu bytes instead of "
+                        "%llu.\n",
+                __FILE__, __LINE__, (unsigned long long) total,
+                (unsigned long long) origSize);
+        goto out;
+    }
+
+    ret = 0;
+out:
+    memFree(groupTables);
+
+    return ret;
+}
@@ -0,0 +1,612 @@
+#include "fg2019/dedup.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "fg2019/checksum.h"
+#include "fg2019/coder.h"
+#include "fg2019/codes.h"
+#include "fg2019/const.h"
+#include "fg2019/error.h"
+#include "fg2019/file.h"
+#include "fg2019/mem.h"
+
+// Size (in bytes) of the read buffer of the chunker
+#define DEDUP_READ_SIZE (1 << 20)
+
+//  Size (in bytes) of the encoded data collected before it is written, and
+// of the read buffer of decompression
+#define DEDUP_WRITE_SIZE (256 * 1024)
+
+//  Cut masks of FastCDC: 2 bits more than the average below it, 2 bits
+// fewer above it, taken from the top of the hash, whose bits depend on
+// the most bytes.
+#define DEDUP_MASK(bits) (~(uint64_t) 0 << (64 - (bits)))
+#define DEDUP_MASK_HARD DEDUP_MASK(DEDUP_AVG_CHUNK_LOG + 2)
+#define DEDUP_MASK_EASY DEDUP_MASK(DEDUP_AVG_CHUNK_LOG - 2)
+
+// First size of the fingerprint table, a power of 2
+#define DEDUP_TABLE_SIZE 4096
+
+// fingerprintT: A unique chunk, len == 0 for an empty slot.
+typedef struct {
+    uint64_t hash;
+
+    // origOffset: Where the chunk is in the input, to check repeats.
+    uint64_t origOffset;
+
+    // uniqueOffset: Where the chunk is in the unique data.
+    uint64_t uniqueOffset;
+    uint32_t len;
+} fingerprintT;
+
+// fpTableT: Open addressing hash table of fingerprints.
+typedef struct {
+    fingerprintT *slots;
+    size_t mask, count;
+} fpTableT;
+
+// chunkT: A chunk of the input as written, see dedup.h.
+typedef struct {
+    uint32_t word;
+    uint64_t offset;
+} chunkT;
+
+// dedupEncT: The state of the first pass of compression.
+typedef struct {
+    uint64_t gear[256];
+    fpTableT table;
+    chunkT *chunks;
+    size_t chunkTotal, chunkCap;
+
+    // start: Position of src when compression began.
+    off_t start;
+    uint64_t uniqueTotal;
+    size_t freqs[SYM_NUM];
+} dedupEncT;
+
+//  initGear(): Fills the Gear table with the outputs of splitmix64, which
+// any implementation can reproduce (the decompressor does not need it).
+static void initGear(uint64_t gear[256]) {
+    uint64_t state = 0;
+
+    for (int k = 0; k < 256; k++) {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        gear[k] = z ^ (z >> 31);
+    }
+}
+
+//  cutPoint(): Returns the length of the chunk that begins buf, which holds
+// len bytes, all that is left of the input if fewer than DEDUP_MAX_CHUNK.
+static size_t cutPoint(const uint64_t gear[256], const unsigned char *buf,
+                       size_t len) {
+    size_t normal, end, k;
+    uint64_t hash = 0;
+
+    if (len <= DEDUP_MIN_CHUNK)
+        return len;
+
+    end = len < DEDUP_MAX_CHUNK ? len : DEDUP_MAX_CHUNK;
+    normal = (size_t) 1 << DEDUP_AVG_CHUNK_LOG;
+    if (normal > end)
+        normal = end;
+
+    for (k = DEDUP_MIN_CHUNK; k < normal; k++) {
+        hash = (hash << 1) + gear[buf[k]];
+        if (!(hash & DEDUP_MASK_HARD))
+            return k + 1;
+    }
+
+    for (; k < end; k++) {
+        hash = (hash << 1) + gear[buf[k]];
+        if (!(hash & DEDUP_MASK_EASY))
+            return k + 1;
+    }
+
+    return end;
+}
+
+static uint64_t chunkHash(const unsigned char *buf, size_t len) {
+    xxh64T state;
+
+    xxh64Init(&state);
+    xxh64Update(&state, buf, len);
+    return xxh64Digest(&state);
+}
+
+//  lookupSlot(): The slot of the chunk with this hash and length, or the
+// empty slot where it goes.
+static fingerprintT *lookupSlot(const fpTableT *tablePtr, uint64_t hash,
+                                uint32_t len) {
+    size_t idx = hash & tablePtr->mask;
+
+    while (tablePtr->slots[idx].len &&
+           (tablePtr->slots[idx].hash != hash ||
+            tablePtr->slots[idx].len != len))
+        idx = (idx + 1) & tablePtr->mask;
+
+    return &tablePtr->slots[idx];
+}
+
+// growTable(): Doubles the size of the table, keeping it at most half full.
+static int growTable(fpTableT *tablePtr) {
+    fpTableT table;
+
+    table.mask = tablePtr->mask * 2 + 1;
+    table.count = tablePtr->count;
+    table.slots = memCalloc(table.mask + 1, sizeof(*table.slots));
+    if (!table.slots) {
+        reportError("calloc");
+        return -1;
+    }
+
+    for (size_t k = 0; k <= tablePtr->mask; k++)
+        if (tablePtr->slots[k].len)
+            *lookupSlot(&table, tablePtr->slots[k].hash,
+                        tablePtr->slots[k].len) = tablePtr->slots[k];
+
+    memFree(tablePtr->slots);
+    *tablePtr = table;
+    return 0;
+}
+
+static int addChunk(dedupEncT *enc, uint32_t word, uint64_t offset) {
+    if (enc->chunkTotal == enc->chunkCap) {
+        size_t cap = enc->chunkCap ? 2 * enc->chunkCap : 1024;
+        chunkT *chunks = memRealloc(enc->chunks, cap * sizeof(*chunks));
+
+        if (!chunks) {
+            reportError("realloc");
+            return -1;
+        }
+        enc->chunks = chunks;
+        enc->chunkCap = cap;
+    }
+
+    enc->chunks[enc->chunkTotal].word = word;
+    enc->chunks[enc->chunkTotal].offset = offset;
+    enc->chunkTotal++;
+    return 0;
+}
+
+//  sameChunk(): Checks that the earlier chunk of a fingerprint holds the
+// bytes of buf, reading it again from src. Returns 1 if so, 0 if not, -1 on
+// errors.
+static int sameChunk(const dedupEncT *enc, FILE *src,
+                     const fingerprintT *fpPtr, const unsigned char *buf,
+                     unsigned char *tmp) {
+    off_t pos = ftello(src);
+
+    if (pos == -1) {
+        reportError("ftello");
+        return -1;
+    }
+
+    if (fseeko(src, enc->start + fpPtr->origOffset, SEEK_SET) == -1) {
+        reportError("fseeko");
+        return -1;
+    }
+
+    if (readBytes(src, tmp, fpPtr->len) < 0)
+        return -1;
+
+    if (fseeko(src, pos, SEEK_SET) == -1) {
+        reportError("fseeko");
+        return -1;
+    }
+
+    return !memcmp(tmp, buf, fpPtr->len);
+}
+
+// scanChunk(): Records a chunk of the input, as a reference if it repeats
+//  one still in the window.
+static int scanChunk(dedupEncT *enc, FILE *src, const unsigned char *buf,
+                     uint32_t len, uint64_t origOffset, unsigned char *tmp) {
+    uint64_t hash = chunkHash(buf, len);
+    fingerprintT *fpPtr = lookupSlot(&enc->table, hash, len);
+    int same;
+
+    if (fpPtr->len && enc->uniqueTotal - fpPtr->uniqueOffset <= DEDUP_WINDOW) {
+        same = sameChunk(enc, src, fpPtr, buf, tmp);
+        if (same < 0)
+            return -1;
+        if (same)
+            return addChunk(enc, len | DEDUP_REF_FLAG, fpPtr->uniqueOffset);
+    }
+
+    // A new chunk, or one too far back to be referenced, which replaces it
+    if (!fpPtr->len)
+        enc->table.count++;
+    fpPtr->hash = hash;
+    fpPtr->len = len;
+    fpPtr->origOffset = origOffset;
+    fpPtr->uniqueOffset = enc->uniqueTotal;
+
+    for (uint32_t k = 0; k < len; k++)
+        enc->freqs[buf[k]]++;
+    enc->uniqueTotal += len;
+
+    if (2 * enc->table.count > enc->table.mask && growTable(&enc->table) < 0)
+        return -1;
+
+    return addChunk(enc, len, 0);
+}
+
+// scanInput(): The first pass, which chunks the input and counts the
+//  symbols of the unique chunks.
+static int scanInput(dedupEncT *enc, FILE *src) {
+    unsigned char *buf, *tmp;
+    size_t have = 0, pos = 0, len;
+    uint64_t origOffset = 0;
+    int eof = 0, ret = -1;
+
+    buf = memAlloc(DEDUP_READ_SIZE);
+    tmp = memAlloc(DEDUP_MAX_CHUNK);
+    if (!buf || !tmp) {
+        reportError("malloc");
+        goto out;
+    }
+
+    for (;;) {
+        // Keep a whole chunk ahead, unless the input ends before
+        if (have - pos < DEDUP_MAX_CHUNK && !eof) {
+            memmove(buf, buf + pos, have - pos);
+            have -= pos;
+            pos = 0;
+
+            have += fread(buf + have, 1, DEDUP_READ_SIZE - have, src);
+            if (ferror(src)) {
+                reportError("fread");
+                goto out;
+            }
+            eof = feof(src);
+        }
+
+        if (pos == have)
+            break;
+
+        len = cutPoint(enc->gear, buf + pos, have - pos);
+        if (scanChunk(enc, src, buf + pos, len, origOffset, tmp) < 0)
+            goto out;
+
+        pos += len;
+        origOffset += len;
+    }
+
+    ret = 0;
+out:
+    memFree(buf);
+    memFree(tmp);
+    return ret;
+}
+
+// writeChunks(): Writes the chunk list.
+static int writeChunks(const dedupEncT *enc, FILE *dest) {
+    uint64_t chunkTotal = enc->chunkTotal;
+
+    if (writeBytes(dest, &chunkTotal, sizeof(chunkTotal)) < 0)
+        return -1;
+
+    for (size_t k = 0; k < enc->chunkTotal; k++) {
+        const chunkT *chunkPtr = &enc->chunks[k];
+
+        if (writeBytes(dest, &chunkPtr->word, sizeof(chunkPtr->word)) < 0)
+            return -1;
+
+        if ((chunkPtr->word & DEDUP_REF_FLAG) &&
+            writeBytes(dest, &chunkPtr->offset, sizeof(chunkPtr->offset)) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+// encodeUnique(): The second pass, which encodes the unique chunks.
+static int encodeUnique(const dedupEncT *enc, FILE *src, FILE *dest,
+                        const compTableT *compTablePtr) {
+    unsigned char *buf, *writeBuf;
+    bitWriterT bw;
+    int ret = -1;
+
+    buf = memAlloc(DEDUP_MAX_CHUNK);
+    writeBuf = memAlloc(DEDUP_WRITE_SIZE + ENCODE_BOUND(DEDUP_MAX_CHUNK));
+    if (!buf || !writeBuf) {
+        reportError("malloc");
+        goto out;
+    }
+
+    if (fseeko(src, enc->start, SEEK_SET) == -1) {
+        reportError("fseeko");
+        goto out;
+    }
+
+    bitWriterInit(&bw, writeBuf);
+
+    for (size_t k = 0; k < enc->chunkTotal; k++) {
+        uint32_t word = enc->chunks[k].word;
+        uint32_t len = word & ~DEDUP_REF_FLAG;
+
+        if (readBytes(src, buf, len) < 0)
+            goto out;
+
+        // The repeats are read past, never encoded
+        if (word & DEDUP_REF_FLAG)
+            continue;
+
+        encodeSyms(&bw, compTablePtr, buf, len);
+        if ((size_t) (bw.ptr - writeBuf) >= DEDUP_WRITE_SIZE) {
+            if (writeBytes(dest, writeBuf, bw.ptr - writeBuf) < 0)
+                goto out;
+            bw.ptr = writeBuf;
+        }
+    }
+
+    encodeEOF(&bw, compTablePtr);
+    if (writeBytes(dest, writeBuf, bw.ptr - writeBuf) < 0)
+        goto out;
+
+    ret = 0;
+out:
+    memFree(buf);
+    memFree(writeBuf);
+    return ret;
+}
+
+int dedupCompress(FILE *src, FILE *dest) {
+    dedupEncT *enc;
+    compTableT compTable;
+    uint64_t compBits = 0, compSize;
+    int ret = -1;
+
+    assert(src != NULL);
+    assert(dest != NULL);
+
+    enc = memCalloc(1, sizeof(*enc));
+    if (!enc) {
+        reportError("calloc");
+        return -1;
+    }
+
+    enc->table.mask = DEDUP_TABLE_SIZE - 1;
+    enc->table.slots = memCalloc(DEDUP_TABLE_SIZE, sizeof(*enc->table.slots));
+    if (!enc->table.slots) {
+        reportError("calloc");
+        goto out;
+    }
+
+    enc->start = ftello(src);
+    if (enc->start == -1) {
+        reportError("ftello");
+        goto out;
+    }
+
+    initGear(enc->gear);
+    if (scanInput(enc, src) < 0)
+        goto out;
+
+    enc->freqs[EOF_VAL] = 1;
+    if (initCompressionTable(&compTable, enc->freqs, SYM_NUM) < 0)
+        goto out;
+
+    for (int k = 0; k < SYM_NUM; k++)
+        compBits += (uint64_t) enc->freqs[k] * compTable.lens[k];
+    compSize = (compBits + CHAR_BIT - 1) / CHAR_BIT;
+
+    if (writeCodeLens(dest, &compTable, SYM_NUM) < 0 ||
+        writeChunks(enc, dest) < 0 ||
+        writeBytes(dest, &compSize, sizeof(compSize)) < 0)
+        goto out;
+
+    ret = encodeUnique(enc, src, dest, &compTable);
+out:
+    memFree(enc->table.slots);
+    memFree(enc->chunks);
+    memFree(enc);
+    return ret;
+}
+
+static void malformed(int line) {
+    fprintf(stderr, "%s:%d: Malformed dedup data.\n", __FILE__, line);
+}
+
+//  readChunks(): Reads the chunk list, and checks that the chunks add up to
+// origSize and that every reference is to unique data still kept. Sets
+// *uniqueTotalPtr to the size of the unique data.
+static chunkT *readChunks(FILE *src, uint64_t origSize, uint64_t *chunkTotalPtr,
+                          uint64_t *uniqueTotalPtr) {
+    uint64_t chunkTotal, total = 0, uniqueTotal = 0;
+    chunkT *chunks;
+
+    if (readBytes(src, &chunkTotal, sizeof(chunkTotal)) < 0)
+        return NULL;
+
+    // Every chunk holds a byte at least
+    if (chunkTotal > origSize) {
+        malformed(__LINE__);
+        return NULL;
+    }
+
+    chunks = memAlloc((chunkTotal ? chunkTotal : 1) * sizeof(*chunks));
+    if (!chunks) {
+        reportError("malloc");
+        return NULL;
+    }
+
+    for (uint64_t k = 0; k < chunkTotal; k++) {
+        chunkT *chunkPtr = &chunks[k];
+        uint32_t len;
+
+        if (readBytes(src, &chunkPtr->word, sizeof(chunkPtr->word)) < 0)
+            goto fail;
+
+        len = chunkPtr->word & ~DEDUP_REF_FLAG;
+        if (!len || len > DEDUP_MAX_CHUNK) {
+            malformed(__LINE__);
+            goto fail;
+        }
+
+        if (chunkPtr->word & DEDUP_REF_FLAG) {
+            if (readBytes(src, &chunkPtr->offset, sizeof(chunkPtr->offset)) <
+                0)
+                goto fail;
+
+            if (chunkPtr->offset > uniqueTotal ||
+                uniqueTotal - chunkPtr->offset < len ||
+                uniqueTotal - chunkPtr->offset > DEDUP_WINDOW) {
+                malformed(__LINE__);
+                goto fail;
+            }
+        } else
+            uniqueTotal += len;
+
+        total += len;
+    }
+
+    if (total != origSize) {
+        malformed(__LINE__);
+        goto fail;
+    }
+
+    *chunkTotalPtr = chunkTotal;
+    *uniqueTotalPtr = uniqueTotal;
+    return chunks;
+
+fail:
+    memFree(chunks);
+    return NULL;
+}
+
+// dedupDecT: The state of decompression.
+typedef struct {
+    decompTableT decompTable;
+    bitReaderT br;
+    unsigned char readBuf[DEDUP_WRITE_SIZE];
+    uint64_t remaining;
+    int final, done;
+
+    // ring: The last ringSize bytes of unique data.
+    unsigned char *ring;
+    uint64_t ringSize, uniqueNow;
+} dedupDecT;
+
+// decodeChunk(): Decodes the len bytes of the next unique chunk.
+static int decodeChunk(dedupDecT *dec, FILE *src, unsigned char *out,
+                       size_t len) {
+    size_t got = 0, n;
+
+    while (got < len) {
+        if (dec->br.ptr == dec->br.end && !dec->final) {
+            size_t toRead = dec->remaining < DEDUP_WRITE_SIZE
+                                ? dec->remaining
+                                : DEDUP_WRITE_SIZE;
+
+            if (readBytes(src, dec->readBuf, toRead) < 0)
+                return -1;
+
+            dec->remaining -= toRead;
+            dec->final = (dec->remaining == 0);
+            bitReaderFeed(&dec->br, dec->readBuf, toRead);
+        }
+
+        n = decodeSyms(&dec->br, &dec->decompTable, out + got, len - got,
+                       dec->final, &dec->done);
+        got += n;
+
+        if (got < len && (dec->done || (dec->final && !n))) {
+            malformed(__LINE__);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+//  ringCopy(): Copies len bytes between the ring, at unique data offset
+// offset, and buf, in either direction.
+static void ringCopy(dedupDecT *dec, uint64_t offset, unsigned char *buf,
+                     size_t len, int toRing) {
+    size_t pos = offset % dec->ringSize;
+    size_t first = dec->ringSize - pos < len ? dec->ringSize - pos : len;
+
+    if (toRing) {
+        memcpy(dec->ring + pos, buf, first);
+        memcpy(dec->ring, buf + first, len - first);
+    } else {
+        memcpy(buf, dec->ring + pos, first);
+        memcpy(buf + first, dec->ring, len - first);
+    }
+}
+
+int dedupDecompress(FILE *src, FILE *dest, uint64_t origSize) {
+    int codeLens[SYM_NUM];
+    uint64_t chunkTotal, uniqueTotal;
+    unsigned char *buf = NULL;
+    chunkT *chunks = NULL;
+    dedupDecT *dec;
+    int ret = -1;
+
+    assert(src != NULL);
+    assert(dest != NULL);
+
+    dec = memCalloc(1, sizeof(*dec));
+    if (!dec) {
+        reportError("calloc");
+        return -1;
+    }
+
+    if (readCodeLens(src, codeLens, SYM_NUM) < 0 ||
+        initDecompressionTable(&dec->decompTable, codeLens, SYM_NUM) < 0)
+        goto out;
+
+    chunks = readChunks(src, origSize, &chunkTotal, &uniqueTotal);
+    if (!chunks || readBytes(src, &dec->remaining, sizeof(dec->remaining)) < 0)
+        goto out;
+
+    dec->ringSize = uniqueTotal < DEDUP_WINDOW ? uniqueTotal : DEDUP_WINDOW;
+    dec->ring = memAlloc(dec->ringSize ? dec->ringSize : 1);
+    buf = memAlloc(DEDUP_MAX_CHUNK);
+    if (!dec->ring || !buf) {
+        reportError("malloc");
+        goto out;
+    }
+
+    bitReaderInit(&dec->br);
+    dec->final = (dec->remaining == 0);
+
+    for (uint64_t k = 0; k < chunkTotal; k++) {
+        uint32_t word = chunks[k].word;
+        size_t len = word & ~DEDUP_REF_FLAG;
+
+        if (word & DEDUP_REF_FLAG)
+            ringCopy(dec, chunks[k].offset, buf, len, 0);
+        else {
+            if (decodeChunk(dec, src, buf, len) < 0)
+                goto out;
+            ringCopy(dec, dec->uniqueNow, buf, len, 1);
+            dec->uniqueNow += len;
+        }
+
+        if (writeBytes(dest, buf, len) < 0)
+            goto out;
+    }
+
+    // The rest of the encoded data, up to the checksum if any
+    if (fseeko(src, dec->remaining, SEEK_CUR) == -1) {
+        reportError("fseeko");
+        goto out;
+    }
+
+    ret = 0;
+out:
+    memFree(buf);
+    memFree(chunks);
+    memFree(dec->ring);
+    memFree(dec);
+    return ret;
+}
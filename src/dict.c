@@ -0,0 +1,213 @@
+#include "fg2019/dict.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "fg2019/const.h"
+#include "fg2019/error.h"
+#include "fg2019/file.h"
+#include "fg2019/mem.h"
+
+#define DICT_MAGIC_NUM "FG19dc"
+#define DICT_MAGIC_LEN 6
+
+// Size (in bytes) of the read buffer of training
+#define DICT_BUF_SIZE (64 * 1024)
+
+// dictId(): The FNV-1a hash of the code lengths.
+static uint32_t dictId(const compTableT *compTablePtr) {
+    uint32_t hash = 2166136261u;
+
+    for (int k = 0; k < SYM_NUM; k++) {
+        hash ^= (unsigned char) compTablePtr->lens[k];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+// countSample(): Adds the symbol frequencies of a sample file to freqs.
+static int countSample(const char *path, size_t freqs[SYM_NUM]) {
+    unsigned char buf[DICT_BUF_SIZE];
+    size_t bytesRead;
+    FILE *src;
+    int ret = 0;
+
+    src = fopen(path, "rb");
+    if (!src) {
+        reportError("fopen");
+        return -1;
+    }
+
+    while ((bytesRead = fread(buf, 1, sizeof(buf), src)) > 0)
+        for (size_t k = 0; k < bytesRead; k++)
+            freqs[buf[k]]++;
+
+    if (ferror(src)) {
+        reportError("fread");
+        ret = -1;
+    }
+    fclose(src);
+
+    return ret;
+}
+
+int dictTrain(const char *dictPath, char *const samplePaths[],
+              int sampleTotal) {
+    size_t freqs[SYM_NUM] = {0};
+    compTableT compTable;
+    uint32_t id;
+    FILE *dest;
+    int ret = -1;
+
+    assert(dictPath != NULL);
+    assert(samplePaths != NULL);
+
+    for (int k = 0; k < sampleTotal; k++)
+        if (countSample(samplePaths[k], freqs) < 0)
+            return -1;
+
+    //  Every symbol gets a code, those missing from the samples the longest
+    // ones, and EOF appears once per message
+    for (int k = 0; k < SYM_NUM; k++)
+        freqs[k]++;
+    freqs[EOF_VAL] += sampleTotal;
+
+    if (initCompressionTable(&compTable, freqs, SYM_NUM) < 0)
+        return -1;
+    id = dictId(&compTable);
+
+    dest = fopen(dictPath, "wb");
+    if (!dest) {
+        reportError("fopen");
+        return -1;
+    }
+
+    if (writeBytes(dest, DICT_MAGIC_NUM, DICT_MAGIC_LEN) < 0 ||
+        writeBytes(dest, &id, sizeof(id)) < 0 ||
+        writeCodeLens(dest, &compTable, SYM_NUM) < 0)
+        goto out;
+
+    ret = 0;
+out:
+    if (fclose(dest) == EOF && ret == 0) {
+        reportError("fclose");
+        ret = -1;
+    }
+
+    return ret;
+}
+
+static void malformed(void) {
+    fprintf(stderr, "%s:%d: Malformed dictionary.\n", __FILE__, __LINE__);
+}
+
+dictT *dictLoad(const char *dictPath) {
+    char magic[DICT_MAGIC_LEN];
+    unsigned char lens[SYM_NUM];
+    int codeLens[SYM_NUM];
+    dictT *dictPtr;
+    FILE *src;
+
+    assert(dictPath != NULL);
+
+    dictPtr = memCalloc(1, sizeof(*dictPtr));
+    if (!dictPtr) {
+        reportError("calloc");
+        return NULL;
+    }
+
+    src = fopen(dictPath, "rb");
+    if (!src) {
+        reportError("fopen");
+        memFree(dictPtr);
+        return NULL;
+    }
+
+    if (readBytes(src, magic, DICT_MAGIC_LEN) < 0 ||
+        readBytes(src, &dictPtr->id, sizeof(dictPtr->id)) < 0 ||
+        readCodeLens(src, codeLens, SYM_NUM) < 0)
+        goto fail;
+
+    if (memcmp(magic, DICT_MAGIC_NUM, DICT_MAGIC_LEN)) {
+        malformed();
+        goto fail;
+    }
+
+    for (int k = 0; k < SYM_NUM; k++) {
+        if (!codeLens[k]) {
+            malformed();
+            goto fail;
+        }
+        lens[k] = codeLens[k];
+    }
+
+    if (initCompressionTableFromLens(&dictPtr->compTable, lens, SYM_NUM) < 0 ||
+        initDecompressionTable(&dictPtr->decompTable, codeLens, SYM_NUM) < 0)
+        goto fail;
+
+    if (dictId(&dictPtr->compTable) != dictPtr->id) {
+        malformed();
+        goto fail;
+    }
+
+    fclose(src);
+    return dictPtr;
+
+fail:
+    fclose(src);
+    memFree(dictPtr);
+    return NULL;
+}
+
+void dictFree(dictT *dictPtr) {
+    memFree(dictPtr);
+}
+
+int dictCompress(FILE *src, FILE *dest, const dictT *dictPtr) {
+    compTableT *compTablePtr = (compTableT *) &dictPtr->compTable;
+
+    assert(src != NULL);
+    assert(dest != NULL);
+
+    if (writeBytes(dest, &dictPtr->id, sizeof(dictPtr->id)) < 0)
+        return -1;
+
+    // compress() does not change the table
+    return compress(src, dest, compTablePtr);
+}
+
+int dictDecompress(FILE *src, FILE *dest, const dictT *dictPtr,
+                   uint64_t origSize) {
+    uint64_t size;
+    uint32_t id;
+    off_t pos;
+
+    assert(src != NULL);
+    assert(dest != NULL);
+    assert(dictPtr != NULL);
+
+    if (readBytes(src, &id, sizeof(id)) < 0)
+        return -1;
+
+    if (id != dictPtr->id) {
+        fprintf(stderr, "The file was compressed with dictionary %08x, not "
+                        "%08x.\n",
+                (unsigned int) id, (unsigned int) dictPtr->id);
+        return -1;
+    }
+
+    // The compressed data takes the rest of the file
+    pos = ftello(src);
+    if (pos == -1 || fileSize(src, &size) < 0 || size < (uint64_t) pos) {
+        reportError("ftello");
+        return -1;
+    }
+
+    //  Decoded straight from the shared table, which decompress() would
+    // copy
+    return decompressRange(src, dest, &dictPtr->decompTable, size - pos, 0, 0,
+                           origSize);
+}
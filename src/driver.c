@@ -0,0 +1,578 @@
+#include "fg2019/driver.h"
+
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fg2019/append.h"
+#include "fg2019/auto.h"
+#include "fg2019/bwt.h"
+#include "fg2019/checkpoint.h"
+#include "fg2019/checksum.h"
+#include "fg2019/codes.h"
+#include "fg2019/const.h"
+#include "fg2019/context.h"
+#include "fg2019/dedup.h"
+#include "fg2019/error.h"
+#include "fg2019/file.h"
+#include "fg2019/filter.h"
+#include "fg2019/lz.h"
+#include "fg2019/mem.h"
+#include "fg2019/pairs.h"
+#include "fg2019/pipeline.h"
+#include "fg2019/sparse.h"
+#include "fg2019/specdec.h"
+#include "fg2019/tans.h"
+
+// Size (in bytes) of the buffer of METHOD_STORE
+#define STORE_BUF_SIZE (64 * 1024)
+
+const char *const methodNames[METHOD_TOTAL] = {
+    "huffman", "lz", "order1", "tans", "bwt", "dedup", "store", "pairs"};
+
+void initOptions(optionsT *opts) {
+    assert(opts != NULL);
+
+    memset(opts, 0, sizeof(*opts));
+    opts->method = METHOD_HUFFMAN;
+    opts->lz.windowLog = LZ_DEFAULT_WINDOW_LOG;
+    opts->lz.level = LZ_DEFAULT_LEVEL;
+    opts->groups = CTX_DEFAULT_GROUPS;
+
+    // One thread per online processor
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    opts->threads = cpus < 1 ? 1 : cpus > MAX_THREADS ? MAX_THREADS : cpus;
+}
+
+// compressHuffman(): Plain Huffman coding, to a file of the original format.
+static int compressHuffman(FILE *src, FILE *dest, const optionsT *opts) {
+    // compTable: Lookup table used in compression
+    compTableT compTable;
+
+    // freqs: Array storing the number of appearances for each
+    // symbol in the original file, indexed by the symbol.
+    size_t freqs[SYM_NUM];
+
+    if (opts->pipeline) {
+        if (countSymsPipelined(src, freqs) < 0)
+            return -1;
+    }
+    else if (countSyms(src, freqs) < 0)
+        return -1;
+
+    if (initCompressionTable(&compTable, freqs, SYM_NUM) < 0)
+        return -1;
+
+    // Set file pos to the beginning after counting
+    if (fseek(src, 0, SEEK_SET) == -1)
+        return -1;
+
+    // Write the header containing information used for decompression
+    if (writeHeader(dest, &compTable, freqs) < 0)
+        return -1;
+
+    // Compress and write the data to dest
+    if (opts->pipeline)
+        return compressPipelined(src, dest, &compTable);
+
+    return compress(src, dest, &compTable);
+}
+
+// decompressHuffman(): Decompresses the rest of a file of the original
+//  format, after the magic number.
+static int decompressHuffman(FILE *src, FILE *dest, const optionsT *opts) {
+    // compSize: The size of the compressed file (excluding the header) in
+    // bytes
+    size_t compSize;
+
+    // codeLens: Array containing the length of the prefix code used for
+    // each symbol,
+    // indexed by the symbol.
+    int codeLens[SYM_NUM];
+
+    // decompTable: Lookup table used in decompression
+    decompTableT decompTable;
+
+    if (readHeader(src, codeLens, &compSize) < 0)
+        return -1;
+
+    memset(&decompTable, 0, sizeof(decompTable));
+    if (initDecompressionTable(&decompTable, codeLens, SYM_NUM) < 0)
+        return -1;
+
+    // Decompress the file and read the data to dest
+    if (opts->pipeline)
+        return decompressPipelined(src, dest, &decompTable, compSize);
+
+    //  A single stream of more than a chunk is split among the threads, if
+    // src can seek to their chunks (it is not a pipe)
+    if (opts->threads > 1 && compSize > SPEC_CHUNK_SIZE && ftello(src) != -1)
+        return specDecompress(src, dest, &decompTable, compSize,
+                              opts->threads);
+
+    return decompress(src, dest, &decompTable, compSize);
+}
+
+// compressStore(): METHOD_STORE, copies src to dest.
+static int compressStore(FILE *src, FILE *dest) {
+    unsigned char buf[STORE_BUF_SIZE];
+    size_t bytesRead;
+
+    do {
+        bytesRead = fread(buf, 1, sizeof(buf), src);
+        if (ferror(src)) {
+            reportError("fread");
+            return -1;
+        }
+
+        if (writeBytes(dest, buf, bytesRead) < 0)
+            return -1;
+    } while (!feof(src));
+
+    return 0;
+}
+
+// decompressStore(): Copies the origSize bytes of METHOD_STORE to dest.
+static int decompressStore(FILE *src, FILE *dest, uint64_t origSize) {
+    unsigned char buf[STORE_BUF_SIZE];
+    size_t len;
+
+    while (origSize > 0) {
+        len = origSize < sizeof(buf) ? origSize : sizeof(buf);
+        if (readBytes(src, buf, len) < 0 || writeBytes(dest, buf, len) < 0)
+            return -1;
+        origSize -= len;
+    }
+
+    return 0;
+}
+
+// compressMethod(): Compresses src to dest with the method, after the frame
+//  header.
+static int compressMethod(FILE *src, FILE *dest, const optionsT *opts) {
+    switch (opts->method) {
+    case METHOD_HUFFMAN:
+        if (opts->dict)
+            return dictCompress(src, dest, opts->dict);
+        return ckptCompress(src, dest, (uint64_t) opts->checkpointKiB * 1024);
+    case METHOD_LZ:
+        return lzCompress(src, dest, &opts->lz);
+    case METHOD_ORDER1:
+        return ctxCompress(src, dest, opts->groups);
+    case METHOD_TANS:
+        return tansCompress(src, dest);
+    case METHOD_BWT:
+        return bwtCompress(src, dest, opts->threads);
+    case METHOD_DEDUP:
+        return dedupCompress(src, dest);
+    case METHOD_STORE:
+        return compressStore(src, dest);
+    case METHOD_PAIRS:
+        return pairsCompress(src, dest);
+    }
+
+    return -1;
+}
+
+//  compressSrc(): Compresses src to dest, which is all of compressFile() but
+// the checksum and reading around the holes of the map, if it has extents.
+static int compressSrc(FILE *src, FILE *dest, const optionsT *opts,
+                       const sparseMapT *mapPtr) {
+    frameHeaderT frameHeader;
+    filterT filter = opts->filter;
+    FILE *filterSrc;
+    int ret;
+
+    if (filter.type == FILTER_AUTO && filterDetect(src, &filter) < 0)
+        return -1;
+
+    if (opts->method == METHOD_HUFFMAN && !opts->checkpointKiB &&
+        !opts->dict && !opts->checksum && filter.type == FILTER_NONE &&
+        !mapPtr->extentTotal)
+        return compressHuffman(src, dest, opts);
+
+    if (opts->checkpointKiB && opts->method != METHOD_HUFFMAN) {
+        fprintf(stderr, "Checkpoints are only supported by the huffman "
+                        "method.\n");
+        return -1;
+    }
+
+    if (opts->dict && (opts->method != METHOD_HUFFMAN || opts->checkpointKiB)) {
+        fprintf(stderr, "Dictionaries are only supported by the huffman "
+                        "method, without checkpoints.\n");
+        return -1;
+    }
+
+    //  The least memory of the methods that can not do with less, before
+    // anything is written
+    if ((opts->method == METHOD_LZ && memCheck(lzCompressMem(), "lz") < 0) ||
+        (opts->method == METHOD_BWT && memCheck(bwtCompressMem(), "bwt") < 0))
+        return -1;
+
+    frameHeader.method = opts->method;
+    frameHeader.flags = opts->checkpointKiB ? FRAME_FLAG_CHECKPOINTS
+                        : opts->dict        ? FRAME_FLAG_DICT
+                                            : 0;
+    if (opts->checksum)
+        frameHeader.flags |= FRAME_FLAG_CHECKSUM;
+    if (filter.type != FILTER_NONE)
+        frameHeader.flags |= FRAME_FLAG_FILTER;
+    if (mapPtr->extentTotal)
+        frameHeader.flags |= FRAME_FLAG_SPARSE;
+
+    if (fileSize(src, &frameHeader.origSize) < 0)
+        return -1;
+
+    if (writeFrameHeader(dest, &frameHeader) < 0 ||
+        (mapPtr->extentTotal && writeSparseMap(dest, mapPtr) < 0))
+        return -1;
+
+    if (filter.type == FILTER_NONE)
+        return compressMethod(src, dest, opts);
+
+    // The method reads src through a stream that filters it
+    if (writeFilter(dest, &filter) < 0)
+        return -1;
+
+    filterSrc = filterReader(src, &filter);
+    if (!filterSrc)
+        return -1;
+
+    ret = compressMethod(filterSrc, dest, opts);
+    fclose(filterSrc);
+
+    return ret;
+}
+
+//  compressData(): Compresses src, the data of the file (its extents, if it
+// is sparse), to dest, with the checksum.
+static int compressData(FILE *src, FILE *dest, const optionsT *opts,
+                        const sparseMapT *mapPtr) {
+    uint64_t size, checksum;
+    xxh64T hashState;
+    FILE *hashSrc;
+    int ret;
+
+    if (!opts->checksum)
+        return compressSrc(src, dest, opts, mapPtr);
+
+    // The method reads src through a stream that hashes it
+    xxh64Init(&hashState);
+    hashSrc = hashReader(src, &hashState);
+    if (!hashSrc)
+        return -1;
+
+    ret = compressSrc(hashSrc, dest, opts, mapPtr);
+    fclose(hashSrc);
+    if (ret < 0 || fileSize(src, &size) < 0)
+        return -1;
+
+    if (hashState.total != size) {
+        fprintf(stderr, "%s:%d: The checksum missed part of the file.\n",
+                __FILE__, __LINE__);
+        return -1;
+    }
+
+    checksum = xxh64Digest(&hashState);
+    return writeBytes(dest, &checksum, sizeof(checksum));
+}
+
+int compressFile(FILE *src, FILE *dest, const optionsT *opts) {
+    optionsT autoOpts;
+    sparseMapT map;
+    FILE *sparseSrc;
+    int ret;
+
+    assert(src != NULL);
+    assert(dest != NULL);
+    assert(opts != NULL);
+
+    // Check if the file is empty, and if it is, return
+    if (isEmpty(src))
+        return -1;
+
+    // The method and its parameters are chosen for this file only
+    if (opts->autoTarget.kind != AUTO_NONE) {
+        autoOpts = *opts;
+        if (autoSelect(src, &autoOpts) < 0)
+            return -1;
+        opts = &autoOpts;
+    }
+
+    if (sparseDetect(src, &map) < 0)
+        return -1;
+
+    if (!map.extentTotal)
+        return compressData(src, dest, opts, &map);
+
+    // The holes are never read, the method sees the extents one after another
+    sparseSrc = sparseReader(src, &map);
+    if (!sparseSrc) {
+        sparseFree(&map);
+        return -1;
+    }
+
+    ret = compressData(sparseSrc, dest, opts, &map);
+    fclose(sparseSrc);
+    sparseFree(&map);
+
+    return ret;
+}
+
+// decompressLegacy(): Decompresses the rest of a file of the original format.
+static int decompressLegacy(FILE *src, FILE *dest, const optionsT *opts) {
+    if (opts->range)
+        return legacyDecompressRange(src, dest, opts->rangeOffset,
+                                     opts->rangeLen);
+
+    return decompressHuffman(src, dest, opts);
+}
+
+// decompressMethod(): Decompresses the data of the method of a framed file.
+static int decompressMethod(FILE *src, FILE *dest, const optionsT *opts,
+                            const frameHeaderT *frameHeaderPtr) {
+    if (opts->range) {
+        if (frameHeaderPtr->method == METHOD_HUFFMAN &&
+            (frameHeaderPtr->flags & FRAME_FLAG_CHECKPOINTS))
+            return ckptDecompressRange(src, dest, frameHeaderPtr->origSize,
+                                       opts->rangeOffset, opts->rangeLen);
+
+        fprintf(stderr, "Ranges can only be decompressed from files with "
+                        "checkpoints, or of the original format.\n");
+        return -1;
+    }
+
+    switch (frameHeaderPtr->method) {
+    case METHOD_HUFFMAN:
+        if (frameHeaderPtr->flags & FRAME_FLAG_DICT)
+            return dictDecompress(src, dest, opts->dict,
+                                  frameHeaderPtr->origSize);
+        return ckptDecompress(src, dest);
+    case METHOD_LZ:
+        return lzDecompress(src, dest, frameHeaderPtr->origSize);
+    case METHOD_ORDER1:
+        return ctxDecompress(src, dest, frameHeaderPtr->origSize);
+    case METHOD_TANS:
+        return tansDecompress(src, dest, frameHeaderPtr->origSize);
+    case METHOD_BWT:
+        return bwtDecompress(src, dest, frameHeaderPtr->origSize,
+                             opts->threads);
+    case METHOD_DEDUP:
+        return dedupDecompress(src, dest, frameHeaderPtr->origSize);
+    case METHOD_STORE:
+        return decompressStore(src, dest, frameHeaderPtr->origSize);
+    case METHOD_PAIRS:
+        return pairsDecompress(src, dest, frameHeaderPtr->origSize);
+    }
+
+    fprintf(stderr, "%s:%d: Method %d is not supported in framed files.\n",
+            __FILE__, __LINE__, frameHeaderPtr->method);
+    return -1;
+}
+
+// decompressFrame(): Decompresses the rest of a framed file, after its frame
+//  header.
+static int decompressFrame(FILE *src, FILE *dest, const optionsT *opts,
+                           const frameHeaderT *frameHeaderPtr) {
+    filterT filter;
+    FILE *filterDest;
+    int ret;
+
+    if ((frameHeaderPtr->flags & FRAME_FLAG_DICT) && !opts->dict) {
+        fprintf(stderr, "The file was compressed with a dictionary, give it "
+                        "with --dict.\n");
+        return -1;
+    }
+
+    if (!(frameHeaderPtr->flags & FRAME_FLAG_FILTER))
+        return decompressMethod(src, dest, opts, frameHeaderPtr);
+
+    if (readFilter(src, &filter) < 0)
+        return -1;
+
+    if (opts->range) {
+        fprintf(stderr, "Ranges can not be decompressed from filtered "
+                        "files.\n");
+        return -1;
+    }
+
+    // The method writes through a stream that unfilters its output
+    filterDest = filterWriter(dest, &filter);
+    if (!filterDest)
+        return -1;
+
+    ret = decompressMethod(src, filterDest, opts, frameHeaderPtr);
+    if (fclose(filterDest) == EOF && ret == 0) {
+        reportError("fclose");
+        ret = -1;
+    }
+
+    return ret;
+}
+
+// checkChecksum(): Compares the checksum at the end of src with the one of
+//  the decompressed data.
+static int checkChecksum(FILE *src, const xxh64T *hashStatePtr) {
+    uint64_t checksum;
+
+    if (fseeko(src, -(off_t) sizeof(checksum), SEEK_END) == -1) {
+        reportError("fseeko");
+        return -1;
+    }
+
+    if (readBytes(src, &checksum, sizeof(checksum)) < 0)
+        return -1;
+
+    if (checksum != xxh64Digest(hashStatePtr)) {
+        fprintf(stderr, "Checksum mismatch, the file is corrupted.\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+// sparsePieceT: A sparse framed file, for decompressing ranges of its data.
+typedef struct {
+    FILE *src, *dest;
+    const optionsT *opts;
+    const frameHeaderT *frameHeaderPtr;
+
+    // dataStart: Where the data after the extents begins in src.
+    off_t dataStart;
+} sparsePieceT;
+
+//  decompressPiece(): Decompresses len bytes of the data of the extents,
+// from packed on.
+static int decompressPiece(void *arg, uint64_t packed, uint64_t len) {
+    sparsePieceT *piece = arg;
+    optionsT pieceOpts = *piece->opts;
+
+    if (fseeko(piece->src, piece->dataStart, SEEK_SET) == -1) {
+        reportError("fseeko");
+        return -1;
+    }
+
+    pieceOpts.rangeOffset = packed;
+    pieceOpts.rangeLen = len;
+    return decompressFrame(piece->src, piece->dest, &pieceOpts,
+                           piece->frameHeaderPtr);
+}
+
+//  decompressSparseRange(): Decompresses the range of a sparse framed file,
+// after its extents.
+static int decompressSparseRange(FILE *src, FILE *dest, const optionsT *opts,
+                                 const frameHeaderT *frameHeaderPtr,
+                                 const sparseMapT *mapPtr) {
+    sparsePieceT piece = {src, dest, opts, frameHeaderPtr, ftello(src)};
+
+    if (piece.dataStart == -1) {
+        reportError("ftello");
+        return -1;
+    }
+
+    return sparseRange(mapPtr, dest, opts->rangeOffset, opts->rangeLen,
+                       decompressPiece, &piece);
+}
+
+int decompressFile(FILE *src, FILE *dest, const optionsT *opts) {
+    appendIndexT index;
+    int ret;
+
+    assert(src != NULL);
+    assert(opts != NULL);
+    assert(dest != NULL || opts->verify);
+
+    // A file that was appended to is decompressed a frame at a time
+    ret = appendReadIndex(src, &index);
+    if (ret < 0)
+        return -1;
+    if (ret) {
+        ret = appendDecompress(src, dest, opts, &index);
+        appendFreeIndex(&index);
+        return ret;
+    }
+
+    return decompressSingle(src, dest, opts);
+}
+
+int decompressSingle(FILE *src, FILE *dest, const optionsT *opts) {
+    frameHeaderT frameHeader;
+    sparseMapT map = {0};
+    xxh64T hashState;
+    FILE *out = dest, *sparseDest = dest;
+    int format, hashing = 0, ret;
+
+    assert(src != NULL);
+    assert(opts != NULL);
+    assert(dest != NULL || opts->verify);
+
+    format = readMagic(src);
+    switch (format) {
+    case FORMAT_LEGACY:
+        break;
+    case FORMAT_FRAME:
+        if (readFrameHeader(src, &frameHeader) < 0)
+            return -1;
+        hashing = (frameHeader.flags & FRAME_FLAG_CHECKSUM) && !opts->range;
+        break;
+    case FORMAT_ARCHIVE:
+        fprintf(stderr, "The file is an archive, extract it with -X.\n");
+        return -1;
+    case FORMAT_STREAM:
+        fprintf(stderr, "The file is a stream, decompress it with --stream.\n");
+        return -1;
+    default:
+        return -1;
+    }
+
+    if (format == FORMAT_FRAME && (frameHeader.flags & FRAME_FLAG_SPARSE)) {
+        if (readSparseMap(src, &map, frameHeader.origSize) < 0)
+            return -1;
+
+        //  The data is written to the extents of dest, with holes between
+        // them, there is nothing to write when verifying. A range is written
+        // as it is, with zeros for the holes it overlaps
+        if (!opts->verify && !opts->range) {
+            sparseDest = sparseWriter(dest, &map);
+            if (!sparseDest) {
+                sparseFree(&map);
+                return -1;
+            }
+            out = sparseDest;
+        }
+    }
+
+    //  The method writes through a stream that hashes the decompressed data,
+    // and only hashes it when verifying
+    if (hashing || opts->verify) {
+        xxh64Init(&hashState);
+        out = hashWriter(opts->verify ? NULL : sparseDest, &hashState);
+        if (!out) {
+            ret = -1;
+            goto out;
+        }
+    }
+
+    if (format == FORMAT_LEGACY)
+        ret = decompressLegacy(src, out, opts);
+    else if ((frameHeader.flags & FRAME_FLAG_SPARSE) && opts->range)
+        ret = decompressSparseRange(src, out, opts, &frameHeader, &map);
+    else
+        ret = decompressFrame(src, out, opts, &frameHeader);
+
+    if (out != sparseDest && fclose(out) == EOF && ret == 0) {
+        reportError("fclose");
+        ret = -1;
+    }
+
+    if (ret == 0 && hashing)
+        ret = checkChecksum(src, &hashState);
+out:
+    if (sparseDest != dest && fclose(sparseDest) == EOF && ret == 0) {
+        reportError("fclose");
+        ret = -1;
+    }
+    sparseFree(&map);
+
+    return ret;
+}
@@ -1,103 +1,789 @@
+#include <ctype.h>
+#include <getopt.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
-#include "fg2019/codes.h"
+#include "fg2019/append.h"
+#include "fg2019/archive.h"
+#include "fg2019/auto.h"
+#include "fg2019/batch.h"
+#include "fg2019/checkpoint.h"
+#include "fg2019/client.h"
+#include "fg2019/const.h"
+#include "fg2019/context.h"
+#include "fg2019/dict.h"
+#include "fg2019/driver.h"
 #include "fg2019/error.h"
 #include "fg2019/file.h"
+#include "fg2019/filter.h"
+#include "fg2019/grep.h"
+#include "fg2019/lz.h"
+#include "fg2019/mem.h"
+#include "fg2019/serve.h"
+#include "fg2019/stream.h"
 
-int main(int argc, char *argv[]) {
-    FILE *src, *dest;
+// The operations that can be chosen from the command line
+enum {
+    MODE_NONE,
+    MODE_COMPRESS,
+    MODE_DECOMPRESS,
+    MODE_HELP,
+    MODE_ARCHIVE,
+    MODE_LIST,
+    MODE_EXTRACT,
+    MODE_TRAIN,
+    MODE_VERIFY,
+    MODE_SERVE,
+    MODE_GREP,
+    MODE_ESTIMATE,
+    MODE_APPEND
+};
+
+// Options without a short form
+enum { OPT_PATTERN = 256, OPT_SUFFIX, OPT_TRAIN, OPT_SERVE, OPT_CLIENT,
+       OPT_STREAM, OPT_MAX_MEMORY, OPT_HUGE_PAGES, OPT_AUTO, OPT_STATS,
+       OPT_GREP, OPT_ESTIMATE, OPT_APPEND, OPT_REUSE_CODES };
+
+static void printHelp(void) {
+    printf("To compress, run with: ./fg2019 -C [options] <source-name> "
+           "<compressed-name>.\n");
+    printf("To decompress, run with: ./fg2019 -D [options] <source-name> "
+           "<decompressed-name>.\n");
+    printf("To archive files and directories, run with: ./fg2019 -A [options] "
+           "<archive-name> <paths>...\n");
+    printf("To list an archive, run with: ./fg2019 -L <archive-name>.\n");
+    printf("To extract an archive, run with: ./fg2019 -X [options] "
+           "<archive-name> <directory> [path].\n");
+    printf("To append to a compressed file, run with: ./fg2019 --append "
+           "[options] <source-name>\n"
+           "                      <compressed-name>, which adds the source "
+           "as a new frame.\n");
+    printf("To verify compressed files, run with: ./fg2019 -T [options] "
+           "<source-names>...\n");
+    printf("To train a dictionary, run with: ./fg2019 --train "
+           "<dictionary-name> <samples>...\n");
+    printf("To (de)compress many files, run with: ./fg2019 -C|-D -B "
+           "<list-file|directory> [options].\n");
+    printf("To run the daemon, run with: ./fg2019 --serve <socket-name> "
+           "[options].\n");
+    printf("To search compressed files, run with: ./fg2019 --grep PATTERN "
+           "[--grep PATTERN]...\n"
+           "                      <source-names>..., which prints the "
+           "matching lines with\n"
+           "                      their offsets.\n");
+    printf("To estimate how well files would compress, run with: ./fg2019 "
+           "--estimate\n"
+           "                      <source-names>....\n");
+    printf("Options:\n");
+    printf("  -p, --pipeline      Read, code and write on separate "
+           "threads.\n");
+    printf("  -m, --method NAME   Compression method: huffman (default), lz, "
+           "order1, tans, bwt,\n"
+           "                      dedup, store or pairs.\n");
+    printf("  --auto speed:MBPS|ratio:X  Choose the method and its parameters "
+           "for the best ratio\n"
+           "                      at MBPS MB/s or more, or within X times "
+           "the time of the\n"
+           "                      fastest method.\n");
+    printf("  -f, --filter NAME[:W]  Filter the input first: none (default), "
+           "delta, stride\n"
+           "                      (W byte elements, 1-%d), x86 or auto.\n",
+           FILTER_MAX_WIDTH);
+    printf("  -w, --window LOG    LZ window size, 2^LOG bytes (%d-%d, "
+           "default %d).\n",
+           LZ_MIN_WINDOW_LOG, LZ_MAX_WINDOW_LOG, LZ_DEFAULT_WINDOW_LOG);
+    printf("  -l, --level N       LZ match finder effort (%d-%d, default "
+           "%d).\n",
+           LZ_MIN_LEVEL, LZ_MAX_LEVEL, LZ_DEFAULT_LEVEL);
+    printf("  -g, --groups N      Order-1 context groups (1-%d, default "
+           "%d).\n",
+           CTX_MAX_GROUPS, CTX_DEFAULT_GROUPS);
+    printf("  -t, --threads N     Threads of bwt and of Huffman decoding (1-%d, "
+           "default: one per processor).\n",
+           MAX_THREADS);
+    printf("  -k, --checkpoints KIB  Record a checkpoint every KIB KiB of "
+           "input (huffman\n"
+           "                      only, 1-%d, %d if KIB is 0), for -r.\n",
+           CKPT_MAX_KIB, CKPT_DEFAULT_KIB);
+    printf("  -r, --range OFF:LEN Decompress only LEN bytes, starting at "
+           "byte OFF.\n");
+    printf("  -c, --checksum      End the compressed file with a checksum of "
+           "the original.\n");
+    printf("  -d, --dict FILE     Use the code table of a trained dictionary "
+           "(huffman only).\n");
+    printf("  --reuse-codes       Code appended data with the code "
+           "lengths of the last\n"
+           "                      frame, if it is of the original format "
+           "(huffman only).\n");
+    printf("  --stream            Flush the output after every read of the "
+           "input, for pipes\n"
+           "                      and sockets (-C and -D only).\n");
+    printf("  --max-memory SIZE   Use at most SIZE bytes (K, M or G for KiB, "
+           "MiB or GiB) of\n"
+           "                      memory, with fewer threads and smaller "
+           "windows if need be,\n"
+           "                      and report the peak at exit.\n");
+    printf("  --huge-pages        Use transparent huge pages for big "
+           "buffers.\n");
+    printf("  --stats             Print the sizes and the speed, and what "
+           "--auto chose.\n");
+    printf("  --client SOCKET     Have the daemon at SOCKET do the work.\n");
+    printf("  -B, --batch SOURCE  (De)compress the files listed in SOURCE (- "
+           "for stdin),\n"
+           "                      or under the directory SOURCE.\n");
+    printf("  --pattern GLOB      Only the files under the directory that "
+           "match GLOB.\n");
+    printf("  -o, --out-dir DIR   Write the outputs of a batch under DIR.\n");
+    printf("  --suffix SUF        Suffix of compressed files in a batch "
+           "(default %s).\n",
+           BATCH_DEFAULT_SUFFIX);
+    printf("  -s, --solid         Archive small files in groups sharing a "
+           "code table.\n");
+}
+
+// parseInt(): Parses the integer arguement of an option, which must be
+//  within [min, max].
+static int parseInt(const char *arg, int min, int max, int *valPtr) {
+    char *end;
+    long val = strtol(arg, &end, 10);
+
+    if (*arg == '\0' || *end != '\0' || val < min || val > max) {
+        fprintf(stderr, "Invalid value %s, it should be within %d-%d.\n", arg,
+                min, max);
+        return -1;
+    }
 
-    if (argc < 4) {
-        if (!strcmp(argv[1], "-H")) {
-            printf("To compress, run with: ./fg2019 -C <source-name> "
-                   "<compressed-name>.\n");
-            printf("To decompress, run with: ./fg2019 -D <source-name> "
-                   "<decompressed-name>.\n");
+    *valPtr = val;
+    return 0;
+}
+
+// parseRange(): Parses the OFF:LEN arguement of --range.
+static int parseRange(const char *arg, optionsT *opts) {
+    char *end;
+
+    opts->rangeOffset = strtoull(arg, &end, 10);
+    if (end != arg && *end == ':') {
+        arg = end + 1;
+        opts->rangeLen = strtoull(arg, &end, 10);
+        if (end != arg && *end == '\0' && isdigit((unsigned char) *arg)) {
+            opts->range = 1;
             return 0;
         }
-        fprintf(stderr, "Not enough arguements, run with -H for help.\n");
-        return 1;
     }
 
-    // Open data source, if compression was chosen it is the file to be
-    // compressed, else a compressed file
-    src = fopen(argv[2], "rb");
-    if (!src) {
-        reportError("fopen");
-        return 1;
+    fprintf(stderr, "Invalid range, it should be OFF:LEN.\n");
+    return -1;
+}
+
+//  parseSize(): Parses the SIZE arguement of --max-memory, bytes or, with a
+// K, M or G suffix, KiB, MiB or GiB.
+static int parseSize(const char *arg, size_t *sizePtr) {
+    unsigned long long size;
+    char *end;
+    int shift = 0;
+
+    size = strtoull(arg, &end, 10);
+    if (end != arg && isdigit((unsigned char) *arg)) {
+        switch (*end) {
+        case 'K':
+            shift = 10;
+            end++;
+            break;
+        case 'M':
+            shift = 20;
+            end++;
+            break;
+        case 'G':
+            shift = 30;
+            end++;
+            break;
+        }
+
+        if (*end == '\0' && size > 0 && size <= (SIZE_MAX >> shift)) {
+            *sizePtr = (size_t) size << shift;
+            return 0;
+        }
     }
 
-    // The resulting compressed or decompressed file
-    dest = fopen(argv[3], "wb");
-    if (!src) {
-        reportError("fopen");
-        return 1;
+    fprintf(stderr, "Invalid size %s, it should be bytes, or KiB, MiB or "
+                    "GiB with K, M or G.\n",
+            arg);
+    return -1;
+}
+
+// parseAuto(): Parses the speed:MBPS or ratio:X arguement of --auto.
+static int parseAuto(const char *arg, autoTargetT *targetPtr) {
+    const char *colon = strchr(arg, ':');
+    char *end;
+
+    if (colon) {
+        targetPtr->value = strtod(colon + 1, &end);
+        if (end != colon + 1 && *end == '\0' && targetPtr->value > 0) {
+            if (!strncmp(arg, "speed:", colon - arg + 1)) {
+                targetPtr->kind = AUTO_SPEED;
+                return 0;
+            }
+            if (!strncmp(arg, "ratio:", colon - arg + 1) &&
+                targetPtr->value >= 1) {
+                targetPtr->kind = AUTO_RATIO;
+                return 0;
+            }
+        }
     }
 
-    // If compression was chosen
-    if (!strcmp(argv[1], "-C")) {
-        // compTable: Lookup table used in compression
-        compTableT compTable;
+    fprintf(stderr, "Invalid target %s, it should be speed:MBPS or ratio:X "
+                    "(X of 1 at least).\n",
+            arg);
+    return -1;
+}
 
-        // freqs: Array storing the number of appearances for each
-        // symbol in the original file, indexed by the symbol.
-        size_t freqs[SYM_NUM];
+// parseMethod(): Finds the method with the given name.
+static int parseMethod(const char *arg, int *methodPtr) {
+    for (int k = 0; k < METHOD_TOTAL; k++)
+        if (!strcmp(arg, methodNames[k])) {
+            *methodPtr = k;
+            return 0;
+        }
 
-        // Check if the file is empty, and if it is, return
-        if (isEmpty(src))
-            return 1;
+    fprintf(stderr, "Unknown method %s.\n", arg);
+    return -1;
+}
 
-        if (countSyms(src, freqs) < 0)
-            return 1;
+// parseFilter(): Parses the NAME[:WIDTH] arguement of --filter.
+static int parseFilter(const char *arg, filterT *filterPtr) {
+    const char *colon = strchr(arg, ':');
+    size_t nameLen = colon ? (size_t) (colon - arg) : strlen(arg);
 
-        if (initCompressionTable(&compTable, freqs) < 0)
-            return 1;
+    if (!strcmp(arg, "auto")) {
+        filterPtr->type = FILTER_AUTO;
+        filterPtr->width = 0;
+        return 0;
+    }
 
-        // Set file pos to the beginning after counting
-        if (fseek(src, 0, SEEK_SET) == -1)
-            return 1;
+    for (int k = 0; k < FILTER_TOTAL; k++)
+        if (strlen(filterNames[k]) == nameLen &&
+            !strncmp(arg, filterNames[k], nameLen)) {
+            filterPtr->type = k;
+            filterPtr->width = k == FILTER_DELTA ? FILTER_DEFAULT_DELTA_WIDTH
+                               : k == FILTER_STRIDE
+                                   ? FILTER_DEFAULT_STRIDE_WIDTH
+                                   : 0;
 
-        // Write the header containing information used for decompression
-        if (writeHeader(dest, &compTable, freqs) < 0)
-            return 1;
+            if (!colon)
+                return 0;
+            if (k == FILTER_DELTA || k == FILTER_STRIDE)
+                return parseInt(colon + 1, 1, FILTER_MAX_WIDTH,
+                                &filterPtr->width);
 
-        // Compress and write the data to dest
-        if (compress(src, dest, &compTable) < 0)
-            return 1;
+            fprintf(stderr, "The %s filter has no width.\n", filterNames[k]);
+            return -1;
+        }
+
+    fprintf(stderr, "Unknown filter %s.\n", arg);
+    return -1;
+}
+
+// addPattern(): Adds a pattern of --grep.
+static int addPattern(const char *arg, const char *patterns[],
+                      int *patternTotalPtr) {
+    if (*patternTotalPtr == GREP_MAX_PATTERNS) {
+        fprintf(stderr, "Too many patterns, there can be %d at most.\n",
+                GREP_MAX_PATTERNS);
+        return -1;
     }
-    // If decompression was chosen
-    else if (!strcmp(argv[1], "-D")) {
-        // compSize: The size of the compressed file (excluding the header) in
-        // bytes
-        size_t compSize;
 
-        // codeLens: Array containing the length of the prefix code used for
-        // each symbol,
-        // indexed by the symbol.
-        int codeLens[SYM_NUM];
+    if (*arg == '\0' || strlen(arg) > GREP_MAX_PATTERN_LEN) {
+        fprintf(stderr, "Invalid pattern, it should be 1-%d bytes long.\n",
+                GREP_MAX_PATTERN_LEN);
+        return -1;
+    }
 
-        // decompTable: Lookup table used in decompression
-        decompTableT decompTable;
+    patterns[(*patternTotalPtr)++] = arg;
+    return 0;
+}
 
-        if (readHeader(src, codeLens, &compSize) < 0)
-            return 1;
+// parseOptions(): Fills mode and opts from the command line, returns the
+//  index of the first non option arguement, or -1 if the command line is
+//  invalid.
+static int parseOptions(int argc, char *argv[], int *modePtr,
+                        optionsT *opts, batchParamsT *batchPtr,
+                        const char **dictPathPtr, const char **sockPathPtr,
+                        const char *patterns[], int *patternTotalPtr) {
+    static struct option longOpts[] = {
+      {"compress", no_argument, NULL, 'C'},
+      {"decompress", no_argument, NULL, 'D'},
+      {"help", no_argument, NULL, 'H'},
+      {"pipeline", no_argument, NULL, 'p'},
+      {"method", required_argument, NULL, 'm'},
+      {"filter", required_argument, NULL, 'f'},
+      {"window", required_argument, NULL, 'w'},
+      {"level", required_argument, NULL, 'l'},
+      {"groups", required_argument, NULL, 'g'},
+      {"threads", required_argument, NULL, 't'},
+      {"checkpoints", required_argument, NULL, 'k'},
+      {"range", required_argument, NULL, 'r'},
+      {"archive", no_argument, NULL, 'A'},
+      {"list", no_argument, NULL, 'L'},
+      {"extract", no_argument, NULL, 'X'},
+      {"solid", no_argument, NULL, 's'},
+      {"batch", required_argument, NULL, 'B'},
+      {"pattern", required_argument, NULL, OPT_PATTERN},
+      {"out-dir", required_argument, NULL, 'o'},
+      {"suffix", required_argument, NULL, OPT_SUFFIX},
+      {"train", no_argument, NULL, OPT_TRAIN},
+      {"dict", required_argument, NULL, 'd'},
+      {"checksum", no_argument, NULL, 'c'},
+      {"verify", no_argument, NULL, 'T'},
+      {"serve", required_argument, NULL, OPT_SERVE},
+      {"client", required_argument, NULL, OPT_CLIENT},
+      {"stream", no_argument, NULL, OPT_STREAM},
+      {"max-memory", required_argument, NULL, OPT_MAX_MEMORY},
+      {"huge-pages", no_argument, NULL, OPT_HUGE_PAGES},
+      {"auto", required_argument, NULL, OPT_AUTO},
+      {"stats", no_argument, NULL, OPT_STATS},
+      {"grep", required_argument, NULL, OPT_GREP},
+      {"estimate", no_argument, NULL, OPT_ESTIMATE},
+      {"append", no_argument, NULL, OPT_APPEND},
+      {"reuse-codes", no_argument, NULL, OPT_REUSE_CODES},
+      {NULL, 0, NULL, 0}};
+    int c;
 
-        if (initDecompressionTable(&decompTable, codeLens) < 0)
-            return 1;
+    *modePtr = MODE_NONE;
+    initOptions(opts);
+    initBatchParams(batchPtr);
+    *dictPathPtr = NULL;
+    *sockPathPtr = NULL;
+    *patternTotalPtr = 0;
 
-        // Decompress the file and read the data to dest
-        if (decompress(src, dest, decompTable, compSize) < 0)
-            return 1;
+    while ((c = getopt_long(argc, argv, "CDHALXTpscm:f:w:l:g:t:k:r:B:o:d:", longOpts,
+                            NULL)) != -1) {
+        switch (c) {
+        case 'C':
+            *modePtr = MODE_COMPRESS;
+            break;
+        case 'D':
+            *modePtr = MODE_DECOMPRESS;
+            break;
+        case 'H':
+            *modePtr = MODE_HELP;
+            break;
+        case 'A':
+            *modePtr = MODE_ARCHIVE;
+            break;
+        case 'L':
+            *modePtr = MODE_LIST;
+            break;
+        case 'X':
+            *modePtr = MODE_EXTRACT;
+            break;
+        case 'p':
+            opts->pipeline = 1;
+            break;
+        case 's':
+            opts->solid = 1;
+            break;
+        case 'B':
+            batchPtr->source = optarg;
+            break;
+        case OPT_PATTERN:
+            batchPtr->pattern = optarg;
+            break;
+        case 'o':
+            batchPtr->outDir = optarg;
+            break;
+        case OPT_SUFFIX:
+            batchPtr->suffix = optarg;
+            break;
+        case OPT_TRAIN:
+            *modePtr = MODE_TRAIN;
+            break;
+        case 'd':
+            *dictPathPtr = optarg;
+            break;
+        case 'c':
+            opts->checksum = 1;
+            break;
+        case 'T':
+            *modePtr = MODE_VERIFY;
+            opts->verify = 1;
+            break;
+        case OPT_SERVE:
+            *modePtr = MODE_SERVE;
+            *sockPathPtr = optarg;
+            break;
+        case OPT_CLIENT:
+            *sockPathPtr = optarg;
+            break;
+        case OPT_STREAM:
+            opts->stream = 1;
+            break;
+        case OPT_MAX_MEMORY:
+            if (parseSize(optarg, &opts->maxMemory) < 0)
+                return -1;
+            break;
+        case OPT_HUGE_PAGES:
+            opts->hugePages = 1;
+            break;
+        case OPT_AUTO:
+            if (parseAuto(optarg, &opts->autoTarget) < 0)
+                return -1;
+            break;
+        case OPT_STATS:
+            opts->stats = 1;
+            break;
+        case OPT_ESTIMATE:
+            *modePtr = MODE_ESTIMATE;
+            break;
+        case OPT_APPEND:
+            *modePtr = MODE_APPEND;
+            break;
+        case OPT_REUSE_CODES:
+            opts->reuseCodes = 1;
+            break;
+        case OPT_GREP:
+            *modePtr = MODE_GREP;
+            if (addPattern(optarg, patterns, patternTotalPtr) < 0)
+                return -1;
+            break;
+        case 'm':
+            if (parseMethod(optarg, &opts->method) < 0)
+                return -1;
+            break;
+        case 'f':
+            if (parseFilter(optarg, &opts->filter) < 0)
+                return -1;
+            break;
+        case 'w':
+            if (parseInt(optarg, LZ_MIN_WINDOW_LOG, LZ_MAX_WINDOW_LOG,
+                         &opts->lz.windowLog) < 0)
+                return -1;
+            break;
+        case 'l':
+            if (parseInt(optarg, LZ_MIN_LEVEL, LZ_MAX_LEVEL,
+                         &opts->lz.level) < 0)
+                return -1;
+            break;
+        case 'g':
+            if (parseInt(optarg, 1, CTX_MAX_GROUPS, &opts->groups) < 0)
+                return -1;
+            break;
+        case 't':
+            if (parseInt(optarg, 1, MAX_THREADS, &opts->threads) < 0)
+                return -1;
+            break;
+        case 'k':
+            if (parseInt(optarg, 0, CKPT_MAX_KIB, &opts->checkpointKiB) < 0)
+                return -1;
+            if (!opts->checkpointKiB)
+                opts->checkpointKiB = CKPT_DEFAULT_KIB;
+            break;
+        case 'r':
+            if (parseRange(optarg, opts) < 0)
+                return -1;
+            break;
+        default:
+            return -1;
+        }
+    }
+
+    return optind;
+}
+
+//  requestFile(): Has the daemon at sockPath (de)compress or verify src to
+// dest, instead of doing it in this process.
+static int requestFile(const char *sockPath, int mode, FILE *src, FILE *dest,
+                       const optionsT *opts, int useDict) {
+    serveRequestT req;
+    int sock, ret;
+
+    memset(&req, 0, sizeof(req));
+    req.op = mode == MODE_COMPRESS     ? SERVE_OP_COMPRESS
+             : mode == MODE_DECOMPRESS ? SERVE_OP_DECOMPRESS
+                                       : SERVE_OP_VERIFY;
+    req.method = opts->method;
+    req.pipeline = opts->pipeline;
+    req.windowLog = opts->lz.windowLog;
+    req.level = opts->lz.level;
+    req.groups = opts->groups;
+    req.checkpointKiB = opts->checkpointKiB;
+    req.checksum = opts->checksum;
+    req.filter = opts->filter.type;
+    req.filterWidth = opts->filter.width;
+    req.dict = useDict;
+    req.autoKind = opts->autoTarget.kind;
+    req.autoValue = opts->autoTarget.value;
+    req.stats = opts->stats;
+    req.range = opts->range;
+    req.rangeOffset = opts->rangeOffset;
+    req.rangeLen = opts->rangeLen;
+
+    sock = clientConnect(sockPath);
+    if (sock == -1)
+        return -1;
+
+    ret = clientRequest(sock, &req, fileno(src), dest ? fileno(dest) : -1);
+    close(sock);
+
+    return ret;
+}
+
+//  estimateFiles(): Prints what Huffman coding every file would give, and
+// whether compressing it is worth it.
+static int estimateFiles(char *const paths[], int pathTotal) {
+    estimateT est;
+    double ratio;
+    int ret = 0;
+    FILE *src;
+
+    for (int k = 0; k < pathTotal; k++) {
+        src = fopen(paths[k], "rb");
+        if (!src) {
+            reportError("fopen");
+            ret = -1;
+            continue;
+        }
+
+        if (autoEstimate(src, &est) < 0) {
+            fprintf(stderr, "%s: Estimation failed.\n", paths[k]);
+            ret = -1;
+            fclose(src);
+            continue;
+        }
+        fclose(src);
+
+        if (est.size == 0) {
+            printf("%s: empty, skip\n", paths[k]);
+            continue;
+        }
+
+        ratio = (double) est.size / est.estSize;
+        printf("%s: %llu bytes, about %llu compressed, ratio %.2f, "
+               "confidence %.2f, %s\n",
+               paths[k], (unsigned long long) est.size,
+               (unsigned long long) est.estSize, ratio, est.confidence,
+               est.compressed              ? "skip (already compressed)"
+               : ratio < AUTO_MIN_RATIO    ? "skip"
+                                           : "compress");
+    }
+
+    return ret;
+}
+
+// verifyFiles(): Decompresses every file without writing it, reporting
+//  those that fail, here or in the daemon at sockPath if it is not NULL.
+static int verifyFiles(char *const paths[], int pathTotal,
+                       const optionsT *opts, const char *sockPath,
+                       int useDict) {
+    int ret = 0, status;
+    FILE *src;
+
+    for (int k = 0; k < pathTotal; k++) {
+        src = fopen(paths[k], "rb");
+        if (!src) {
+            reportError("fopen");
+            ret = -1;
+            continue;
+        }
+
+        if (sockPath)
+            status = requestFile(sockPath, MODE_VERIFY, src, NULL, opts,
+                                 useDict);
+        else
+            status = decompressFile(src, NULL, opts);
+
+        if (status < 0) {
+            fprintf(stderr, "%s: Verification failed.\n", paths[k]);
+            ret = -1;
+        }
+        fclose(src);
+    }
+
+    return ret;
+}
+
+//  printStats(): Prints the sizes of src and dest, and how fast one became
+// the other, after a compression or decompression that started at start.
+static void printStats(FILE *src, FILE *dest, int mode,
+                       const struct timespec *startPtr) {
+    struct timespec end;
+    uint64_t srcSize, destSize, origSize;
+    double secs;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    secs = (end.tv_sec - startPtr->tv_sec) +
+           (end.tv_nsec - startPtr->tv_nsec) / 1e9;
+
+    if (fflush(dest) == EOF || fileSize(src, &srcSize) < 0 ||
+        fileSize(dest, &destSize) < 0)
+        return;
+
+    origSize = mode == MODE_COMPRESS ? srcSize : destSize;
+    fprintf(stderr, "%s %llu bytes to %llu bytes, ratio %.3f, in %.3f s, "
+                    "%.1f MB/s.\n",
+            mode == MODE_COMPRESS ? "Compressed" : "Decompressed",
+            (unsigned long long) srcSize, (unsigned long long) destSize,
+            mode == MODE_COMPRESS ? (double) srcSize / destSize
+                                  : (double) destSize / srcSize,
+            secs, origSize / (secs > 1e-9 ? secs : 1e-9) / 1e6);
+}
+
+int main(int argc, char *argv[]) {
+    struct timespec start;
+    FILE *src, *dest;
+    optionsT opts;
+    batchParamsT batch;
+    const char *dictPath, *sockPath, *patterns[GREP_MAX_PATTERNS];
+    dictT *dict = NULL;
+    int mode, argi, ret, patternTotal, status = 0;
+
+    argi = parseOptions(argc, argv, &mode, &opts, &batch, &dictPath,
+                        &sockPath, patterns, &patternTotal);
+    if (argi < 0) {
+        fprintf(stderr, "Run with -H for help.\n");
+        return 1;
     }
-    else {
+
+    if (mode == MODE_HELP) {
+        printHelp();
+        return 0;
+    }
+
+    if (mode == MODE_NONE) {
         fprintf(stderr, "This flag is not supported, run with <program-name> "
                         "-H for help.\n");
         return 1;
     }
 
+    // Before any memory of (de)compression is allocated
+    memInit(opts.maxMemory, opts.hugePages);
+    if (opts.maxMemory)
+        atexit(memReport);
+
+    //  Loaded once, its tables are shared by every file of the process (all
+    // the files of a batch, or every request of the daemon). A client only
+    // asks for the dictionary of the daemon.
+    if (dictPath && (mode == MODE_SERVE || !sockPath)) {
+        dict = dictLoad(dictPath);
+        if (!dict)
+            return 1;
+        opts.dict = dict;
+    }
+
+    switch (mode) {
+    case MODE_SERVE:
+        status = serveRun(sockPath, &opts) < 0;
+        goto out;
+    case MODE_TRAIN:
+        if (argc - argi < 2)
+            break;
+        status = dictTrain(argv[argi], argv + argi + 1, argc - argi - 1) < 0;
+        goto out;
+    case MODE_COMPRESS:
+    case MODE_DECOMPRESS:
+    case MODE_VERIFY:
+        if (batch.source) {
+            status = batchRun(&batch, mode != MODE_COMPRESS, &opts) < 0;
+            goto out;
+        }
+        if (mode == MODE_VERIFY) {
+            status = verifyFiles(argv + argi, argc - argi, &opts, sockPath,
+                                 dictPath != NULL) < 0;
+            goto out;
+        }
+        break;
+    case MODE_ARCHIVE:
+        if (argc - argi < 2)
+            break;
+        status = archiveCreate(argv[argi], argv + argi + 1, argc - argi - 1,
+                               opts.solid, opts.threads) < 0;
+        goto out;
+    case MODE_ESTIMATE:
+        if (argc - argi < 1)
+            break;
+        status = estimateFiles(argv + argi, argc - argi) < 0;
+        goto out;
+    case MODE_APPEND:
+        if (argc - argi < 2)
+            break;
+        status = appendFile(argv[argi], argv[argi + 1], &opts) < 0;
+        goto out;
+    case MODE_GREP:
+        if (argc - argi < 1)
+            break;
+        // As grep(1): 0 if a line matched, 1 if none did, 2 on errors
+        ret = grepFiles(patterns, patternTotal, argv + argi, argc - argi,
+                        &opts, stdout);
+        status = ret < 0 ? 2 : ret == 0;
+        goto out;
+    case MODE_LIST:
+        if (argc - argi < 1)
+            break;
+        status = archiveList(argv[argi], stdout) < 0;
+        goto out;
+    case MODE_EXTRACT:
+        if (argc - argi < 2)
+            break;
+        status = archiveExtract(argv[argi], argv[argi + 1],
+                                argc - argi > 2 ? argv[argi + 2] : NULL,
+                                opts.threads) < 0;
+        goto out;
+    }
+
+    if (argc - argi < 2) {
+        fprintf(stderr, "Not enough arguements, run with -H for help.\n");
+        status = 1;
+        goto out;
+    }
+
+    // Open data source, if compression was chosen it is the file to be
+    // compressed, else a compressed file
+    src = fopen(argv[argi], "rb");
+    if (!src) {
+        reportError("fopen");
+        status = 1;
+        goto out;
+    }
+
+    // The resulting compressed or decompressed file
+    dest = fopen(argv[argi + 1], "wb");
+    if (!dest) {
+        reportError("fopen");
+        status = 1;
+        goto out;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (opts.stream && mode == MODE_COMPRESS)
+        ret = streamCompressFile(src, dest);
+    else if (opts.stream)
+        ret = streamDecompressFile(src, dest);
+    else if (sockPath)
+        ret = requestFile(sockPath, mode, src, dest, &opts, dictPath != NULL);
+    else if (mode == MODE_COMPRESS)
+        ret = compressFile(src, dest, &opts);
+    else
+        ret = decompressFile(src, dest, &opts);
+
+    if (ret < 0) {
+        status = 1;
+        goto out;
+    }
+
+    if (opts.stats)
+        printStats(src, dest, mode, &start);
+
     fclose(src);
-    fclose(dest);
+    if (fclose(dest) == EOF) {
+        reportError("fclose");
+        status = 1;
+    }
+out:
+    dictFree(dict);
 
-    return 0;
+    return status;
 }
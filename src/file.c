@@ -1,43 +1,31 @@
 #include "fg2019/file.h"
 
 #include <assert.h>
+#include <errno.h>
 #include <limits.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
 
+#include "fg2019/bitio.h"
+#include "fg2019/coder.h"
 #include "fg2019/codes.h"
 #include "fg2019/const.h"
 #include "fg2019/error.h"
 
-// Magic number and length
+// Magic numbers and length
 #define MAGIC_NUM "FG2019"
+#define FRAME_MAGIC_NUM "FG19v2"
+#define ARCHIVE_MAGIC_NUM "FG19ar"
+#define STREAM_MAGIC_NUM "FG19st"
 #define MAGIC_LEN 6
 
 // Size (in bytes) of the various buffers used
 #define BUF_SIZE 1024
 
-// Shift amount used to make the MAX_CODELEN LSBs of the integer
-//  the MAX_CODELEN MSBs by left shifting, used in decoding.
-#define LOOKUP_SHIFT (INT_SIZE - MAX_CODELEN)
-
-//   The numerical value of the EOF symbol, used to simplify the
-//  decoding process, as once an EOF symbol is decoded, no more
-//  bits of the compressed file contain data of the original and
-//  decoding can stop.
-#define EOF_VAL 256
-
-// mask(): Creates and AND mask for use in decoding,
-// with the x least significant bits set to 1.
-// Assumption:
-//  > x =< INT_SIZE, a mask of bits set to 1, with
-// more bits than an int would be of no use in the
-// decoding algorithm as it is.
-static inline unsigned int mask(int x) {
-    if (x == INT_SIZE)
-        return 0xFFFFFFFF;
-
-    return (1 << x) - 1;
-}
+// Size (in bytes) of the buffers of decompressRange()
+#define RANGE_BUF_SIZE (64 * 1024)
 
 int isEmpty(FILE *fptr) {
     char c;
@@ -69,8 +57,7 @@ int isEmpty(FILE *fptr) {
 
 int countSyms(FILE *src, size_t freqs[SYM_NUM]) {
     unsigned char buffer[BUF_SIZE];
-    size_t bytesRead;
-    int k;
+    size_t bytesRead, k;
 
     assert(src != NULL);
 
@@ -113,29 +100,16 @@ int compress(FILE *src, FILE *dest, compTableT *compTablePtr) {
     //        than BUF_SIZE calls to read 1 byte).
     //
     //   writeBuf[]: Used for similar reasons to readBuf[], only for
-    //        fwrite() function calls. Must be initialized to 0,
-    //        so that OR operations involving it give the wanted results.
-    unsigned char readBuf[BUF_SIZE], writeBuf[BUF_SIZE] = {0};
-
-    // bitsRemCode: The bits of the code corresponding to the current
-    // byte of the read buffer being encoded, that need to be written to the
-    // write buffer.
-    int bitsRemCode;
-
-    // bitsRemByte: The bits remaining in the byte of the write buffer
-    //  that is currently used. Initialized to CHAR_BIT, as the first byte
-    //  will initially have all of its CHAR_BITbits unused.
-    char bitsRemByte = CHAR_BIT;
-
-    // wPos: The position of the current byte in writeBuf.
-    int wPos = 0;
-    int k;
-    size_t bytesRead, bytesWritten;
-    int *codeLens = compTablePtr->lens;
-    unsigned int *codeVals = compTablePtr->vals;
-
-    // curVal: The current code value being written to the write buffer.
-    unsigned int curVal;
+    //        fwrite() function calls. Large enough to hold the codes
+    //        of a whole readBuf[].
+    unsigned char readBuf[BUF_SIZE], writeBuf[ENCODE_BOUND(BUF_SIZE)];
+
+    //  bw: The bit writer, the bits of the last code that do not fill a
+    //  whole byte are kept in it, so only whole bytes are in writeBuf[].
+    bitWriterT bw;
+    size_t bytesRead, bytesWritten, wLen;
+
+    bitWriterInit(&bw, writeBuf);
 
     do {
         bytesRead = fread(readBuf, 1, BUF_SIZE, src);
@@ -144,77 +118,201 @@ int compress(FILE *src, FILE *dest, compTableT *compTablePtr) {
             return -1;
         }
 
-        for (k = 0; k < bytesRead; k++) {
-            bitsRemCode = codeLens[readBuf[k]];
-            curVal = codeVals[readBuf[k]];
-
-            //   While the code bits that haven't been written yet do
-            //  not fit in the current byte of the write buffer,
-            //  write as many bits as possible to fit in the byte, then
-            //  move on to the next byte of the buffer, or in the
-            //  case that the buffer is full, flush it and then begin from wPos
-            //  =
-            //  0.
-            while (bitsRemCode > bitsRemByte) {
-                writeBuf[wPos] |= curVal >> (bitsRemCode - bitsRemByte);
-                wPos++;
-                if (wPos == BUF_SIZE) {
-                    bytesWritten = fwrite(writeBuf, 1, BUF_SIZE, dest);
-                    if (bytesWritten < BUF_SIZE) {
-                        reportError("fwrite");
-                        return -1;
-                    }
-
-                    // Clear the write buffer, else OR operations will produce
-                    // garbage
-                    memset(writeBuf, 0, BUF_SIZE);
-                    wPos = 0;
-                }
-
-                // bitsRemByte bits of the code were written to the buffer,
-                // so bitsRemCode - bitsRemByte remain.
-                bitsRemCode -= bitsRemByte;
-
-                // A new byte will be used, so all of its CHAR_BIT bits are free
-                bitsRemByte = CHAR_BIT;
-            }
+        encodeSyms(&bw, compTablePtr, readBuf, bytesRead);
+
+        // If the end-of-file was reached, add the encoded EOF symbol
+        // and the padding bits of the last byte.
+        if (feof(src))
+            encodeEOF(&bw, compTablePtr);
 
-            // Write the reamining bits of the code to the current byte
-            writeBuf[wPos] |= curVal << (bitsRemByte - bitsRemCode);
-            bitsRemByte -= bitsRemCode;
+        wLen = bw.ptr - writeBuf;
+        bytesWritten = fwrite(writeBuf, 1, wLen, dest);
+        if (bytesWritten < wLen) {
+            reportError("fwrite");
+            return -1;
         }
+        bw.ptr = writeBuf;
     } while (!feof(src));
 
-    // Another loop to write the encoded EOF symbol to the file.
-    curVal = codeVals[EOF_VAL];
-    bitsRemCode = codeLens[EOF_VAL];
+    return 0;
+}
 
-    while (bitsRemCode > bitsRemByte) {
-        writeBuf[wPos] |= curVal >> (bitsRemCode - bitsRemByte);
-        wPos++;
-        if (wPos == BUF_SIZE) {
-            bytesWritten = fwrite(writeBuf, 1, BUF_SIZE, dest);
-            if (bytesWritten < BUF_SIZE) {
-                reportError("fwrite");
-                return -1;
-            }
+int writeBytes(FILE *dest, const void *buf, size_t len) {
+    assert(dest != NULL);
+
+    if (fwrite(buf, 1, len, dest) < len) {
+        reportError("fwrite");
+        return -1;
+    }
+
+    return 0;
+}
+
+int readBytes(FILE *src, void *buf, size_t len) {
+    assert(src != NULL);
 
-            memset(writeBuf, 0, BUF_SIZE);
-            wPos = 0;
+    if (fread(buf, 1, len, src) < len) {
+        if (ferror(src))
+            reportError("fread");
+        else
+            fprintf(stderr, "%s:%d: Malformed file error, less data than "
+                            "promised.\n",
+                    __FILE__, __LINE__);
+        return -1;
+    }
+
+    return 0;
+}
+
+int writeCodeLens(FILE *dest, const compTableT *compTablePtr, int symNum) {
+    unsigned char lenBuf[MAX_SYM_NUM];
+
+    assert(compTablePtr != NULL);
+    assert(symNum <= MAX_SYM_NUM);
+
+    for (int k = 0; k < symNum; k++)
+        lenBuf[k] = compTablePtr->lens[k];
+
+    return writeBytes(dest, lenBuf, symNum);
+}
+
+int readCodeLens(FILE *src, int *codeLens, int symNum) {
+    unsigned char lenBuf[MAX_SYM_NUM];
+
+    // kraftSum: The sum of Kraft's inequality, scaled by 2^MAX_CODELEN
+    // so that it is an integer.
+    unsigned int kraftSum = 0;
+
+    assert(codeLens != NULL);
+    assert(symNum <= MAX_SYM_NUM);
+
+    if (readBytes(src, lenBuf, symNum) < 0)
+        return -1;
+
+    for (int k = 0; k < symNum; k++) {
+        if (lenBuf[k] > MAX_CODELEN) {
+            fprintf(stderr, "%s:%d: Malformed code lengths.\n", __FILE__,
+                    __LINE__);
+            return -1;
         }
-        bitsRemCode -= bitsRemByte;
-        bitsRemByte = CHAR_BIT;
+
+        codeLens[k] = lenBuf[k];
+        if (lenBuf[k])
+            kraftSum += 1u << (MAX_CODELEN - lenBuf[k]);
     }
-    writeBuf[wPos] |= curVal << (bitsRemByte - bitsRemCode);
-    bitsRemByte -= bitsRemCode;
-
-    //  If wPos > 0 after the above while loop ends,
-    //  some compressed data is still in the
-    //  write buffer. In that case a last write to the
-    //  file should be performed.
-    bytesWritten = fwrite(writeBuf, 1, wPos + 1, dest);
-    if (bytesWritten < wPos + 1) {
-        reportError("fwrite");
+
+    if (kraftSum > DECOMP_SIZE) {
+        fprintf(stderr, "%s:%d: Malformed code lengths.\n", __FILE__,
+                __LINE__);
+        return -1;
+    }
+
+    return 0;
+}
+
+int fileSize(FILE *fptr, uint64_t *sizePtr) {
+    off_t pos, end;
+
+    assert(fptr != NULL);
+    assert(sizePtr != NULL);
+
+    pos = ftello(fptr);
+    if (pos == -1 || fseeko(fptr, 0, SEEK_END) == -1) {
+        reportError("fseeko");
+        return -1;
+    }
+
+    end = ftello(fptr);
+    if (end == -1 || fseeko(fptr, pos, SEEK_SET) == -1) {
+        reportError("fseeko");
+        return -1;
+    }
+
+    *sizePtr = end;
+
+    return 0;
+}
+
+int readMagic(FILE *src) {
+    char magic[MAGIC_LEN];
+
+    assert(src != NULL);
+
+    // Read MAGIC_LEN bytes, if there are not enough, the file does not adhere
+    // to
+    // the format.
+    if (fread(magic, 1, MAGIC_LEN, src) < MAGIC_LEN) {
+        if (ferror(src))
+            reportError("fread");
+        else
+            fprintf(stderr, "%s:%d: Malformed magic num error.\n", __FILE__,
+                    __LINE__);
+        return -1;
+    }
+
+    if (memcmp(magic, MAGIC_NUM, MAGIC_LEN) == 0)
+        return FORMAT_LEGACY;
+
+    if (memcmp(magic, FRAME_MAGIC_NUM, MAGIC_LEN) == 0)
+        return FORMAT_FRAME;
+
+    if (memcmp(magic, ARCHIVE_MAGIC_NUM, MAGIC_LEN) == 0)
+        return FORMAT_ARCHIVE;
+
+    if (memcmp(magic, STREAM_MAGIC_NUM, MAGIC_LEN) == 0)
+        return FORMAT_STREAM;
+
+    fprintf(stderr, "Magic number missing!\n");
+    return -1;
+}
+
+int writeStreamMagic(FILE *dest) {
+    assert(dest != NULL);
+
+    return writeBytes(dest, STREAM_MAGIC_NUM, MAGIC_LEN);
+}
+
+int writeArchiveMagic(FILE *dest) {
+    assert(dest != NULL);
+
+    return writeBytes(dest, ARCHIVE_MAGIC_NUM, MAGIC_LEN);
+}
+
+int writeFrameHeader(FILE *dest, const frameHeaderT *frameHeaderPtr) {
+    unsigned char fields[2];
+
+    assert(dest != NULL);
+    assert(frameHeaderPtr != NULL);
+
+    fields[0] = frameHeaderPtr->method;
+    fields[1] = frameHeaderPtr->flags;
+
+    if (writeBytes(dest, FRAME_MAGIC_NUM, MAGIC_LEN) < 0 ||
+        writeBytes(dest, fields, sizeof(fields)) < 0 ||
+        writeBytes(dest, &frameHeaderPtr->origSize,
+                   sizeof(frameHeaderPtr->origSize)) < 0)
+        return -1;
+
+    return 0;
+}
+
+int readFrameHeader(FILE *src, frameHeaderT *frameHeaderPtr) {
+    unsigned char fields[2];
+
+    assert(src != NULL);
+    assert(frameHeaderPtr != NULL);
+
+    if (readBytes(src, fields, sizeof(fields)) < 0 ||
+        readBytes(src, &frameHeaderPtr->origSize,
+                  sizeof(frameHeaderPtr->origSize)) < 0)
+        return -1;
+
+    frameHeaderPtr->method = fields[0];
+    frameHeaderPtr->flags = fields[1];
+
+    if (frameHeaderPtr->method >= METHOD_TOTAL) {
+        fprintf(stderr, "%s:%d: Unknown method %d.\n", __FILE__, __LINE__,
+                frameHeaderPtr->method);
         return -1;
     }
 
@@ -274,35 +372,20 @@ int readHeader(FILE *src, int codeLens[SYM_NUM], size_t *compSizePtr) {
     // compSize: Size of the compressed data in bytes.
     size_t compSize;
 
-    // readBuf: Buffer used for reading from the file, both the magic number,
-    //   and the codelengths of the SYM_NUM symbols fit into it.
-    char readBuf[SYM_NUM];
+    // readBuf: Buffer used for reading the codelengths of the SYM_NUM
+    //   symbols from the file.
+    unsigned char readBuf[SYM_NUM];
+
+    // size, pos: The size of src and the position of the compressed data.
+    uint64_t size;
+    off_t pos;
 
     assert(src != NULL);
     assert(compSizePtr != NULL);
 
-    // Read MAGIC_LEN bytes, if there are not enough, the file does not adhere
-    // to
-    // the format.
-    fread(readBuf, 1, MAGIC_LEN, src);
-    if (feof(src)) {
-        fprintf(stderr, "%s:%d: Malformed magic num error.\n", __FILE__,
-                __LINE__);
-        return -1;
-    }
-    else if (ferror(src)) {
-        reportError("fread");
-        return -1;
-    }
-
-    if (strncmp(readBuf, MAGIC_NUM, MAGIC_LEN) != 0) {
-        fprintf(stderr, "Magic number missing!\n");
-        return -1;
-    }
-
     // Read compSize from file.
     fread(&compSize, sizeof(compSize), 1, src);
-    if (feof(src)) { // Again if not enough bits, the header is malformed
+    if (feof(src)) { // If not enough bytes, the header is malformed
         fprintf(stderr, "%s:%d: Malformed header error.\n", __FILE__, __LINE__);
         return -1;
     }
@@ -327,163 +410,181 @@ int readHeader(FILE *src, int codeLens[SYM_NUM], size_t *compSizePtr) {
     for (int k = 0; k < SYM_NUM; k++)
         codeLens[k] = readBuf[k];
 
+    //  The compressed data can not be more than what is left of the file,
+    // every buffer decompression allocates is bounded by it. A pipe can not
+    // tell, decoding stops at the end of its data or at the EOF symbol.
+    pos = ftello(src);
+    if (pos == -1 && errno == ESPIPE)
+        return 0;
+    if (pos == -1) {
+        reportError("ftello");
+        return -1;
+    }
+    if (fileSize(src, &size) < 0)
+        return -1;
+
+    if (compSize > size - pos) {
+        fprintf(stderr, "%s:%d: Malformed header error, %zu bytes of "
+                        "compressed data promised, %llu left.\n",
+                __FILE__, __LINE__, compSize,
+                (unsigned long long) (size - pos));
+        return -1;
+    }
+
     return 0;
 }
 
-int decompress(FILE *src, FILE *dest, decompTableT decompTable,
+int decompress(FILE *src, FILE *dest, const decompTableT *decompTablePtr,
                size_t compSize) {
     assert(src != NULL);
     assert(dest != NULL);
+    assert(decompTablePtr != NULL);
 
     // readBuf, writeBuf: Used for the same reason as in compress()
     unsigned char readBuf[BUF_SIZE], writeBuf[BUF_SIZE];
+    size_t bytesRead, bytesWritten, toRead, wLen;
 
-    // Bits remaining in the current read buffer byte
-    char bitsRem = CHAR_BIT;
+    // remaining: Compressed bytes that have not been read yet, only those
+    //  are read, so that src is left right after the compressed data.
+    size_t remaining = compSize;
 
-    // wPos: write buffer position, rPos: read buffer positions
-    int wPos = 0, rPos;
-    size_t bytesRead, bytesWritten;
-    int readLoops = (compSize % BUF_SIZE == 0) ? (compSize / BUF_SIZE)
-                                               : (compSize / BUF_SIZE + 1);
+    //   br: The bit reader, the decoding table is indexed by its
+    //  MAX_CODELEN most significant bits (see decodeSyms() in coder.c).
+    bitReaderT br;
 
-    // decIdx: A 32bit buffer, the MAX_CODELEN most significant bits of
-    // which are used as the index of the decoding lookup table, by doing decIdx
-    // >> LOOKUP_SHIFT.
-    // Initialized to 0, in order for the first bit write using OR operations to
-    //  work correctly.
-    unsigned int decIdx = 0;
+    // final: Set when the last piece of the compressed data is fed to br.
+    // done: Set once the EOF symbol is decoded.
+    int final = 0, done = 0;
 
-    // Bits needed until all 32bits of decIdx are filled.
-    int bitsNeeded = INT_SIZE;
+    bitReaderInit(&br);
 
-    //  totalBytes: The total number of bytes that have been read, used to
-    //  detect
-    //  if the compressed data is less than that indicated by compSize.
-    size_t totalBytes = 0;
+    while (!done) {
+        // (Re)fill read buffer, once the previous piece is used up
+        if (br.ptr == br.end && !final) {
+            toRead = remaining < BUF_SIZE ? remaining : BUF_SIZE;
+            bytesRead = fread(readBuf, 1, toRead, src);
+            if (ferror(src)) {
+                reportError("fread");
+                return -1;
+            }
+            // If the end-of-file (not to be confused with the EOF symbol) is
+            //  reached before compSize bytes are read, some bytes are
+            //  missing.
+            else if (bytesRead < toRead) {
+                fprintf(stderr,
+                        "%s:%d: Malformed file error, less data than promised.\n",
+                        __FILE__, __LINE__);
+                return -1;
+            }
 
-    for (int k = 0; k < readLoops; k++) {
-        // (Re)fill read buffer
-        bytesRead = fread(readBuf, 1, BUF_SIZE, src);
-        if (ferror(src)) {
-            reportError("fread");
-            return -1;
+            remaining -= bytesRead;
+            final = (remaining == 0);
+            bitReaderFeed(&br, readBuf, bytesRead);
         }
-        // If the end-of-file (not to be confused with the EOF symbol) is
-        //  reached,
-        //  and the total number of bytes read is less than compSize, then some
-        //  bytes are missing. Else, it is just the last loop of filling the
-        //  read
-        //  buffer.
-        else if (feof(src) && (totalBytes + bytesRead < compSize)) {
-            fprintf(stderr,
-                    "%s:%d: Malformed file error, less data than promised.\n",
+
+        wLen = decodeSyms(&br, decompTablePtr, writeBuf, BUF_SIZE, final, &done);
+
+        //  The EOF symbol must end the compressed data, a malformed file
+        // may have it too early or not at all.
+        if (done ? remaining > 0 || br.ptr != br.end || br.count >= CHAR_BIT
+                 : final && wLen < BUF_SIZE) {
+            fprintf(stderr, "%s:%d: Malformed file error, the EOF symbol "
+                            "does not end the data.\n",
                     __FILE__, __LINE__);
             return -1;
         }
-        totalBytes += bytesRead;
-
-        // Reset read buffer position
-        rPos = 0;
-
-        //   The decoding table decIdx is formed using the bits read from the
-        //  file,
-        //  and should always contain sizeof(int)*CHAR_BIT bits. The number of
-        //  bits
-        //  is arbitrary, as long as it is greater than MAX_CODELEN (so that
-        //  there won't be a need to find more bits during decoding). The
-        //  requirement
-        //  for the number of bits to remain constant is to simplify the
-        //  algorithm a bit, with decIdx mimicking a bit stream.
-        //   Initially, decIdx is empty (bitsNeeded == INT_SIZE),
-        //  so it is filled with bits from the read buffer.
-        //   When the x most significant bits of decIdx are used to
-        //  decode a symbol (which is written to the write buffer), they are
-        //  consumed (removed from decIdx through left shifting by x).
-        //  Those x bits are then replenished by bits of the read buffer (as
-        //  mention, decIdx always contains sizeof(int)*CHAR_BIT bits), and
-        //  if the read buffer is out of bits, the while(1){} loop is
-        //  exited, and the read buffer is refilled.
-        while (1) {
-            // The approach to writing bits to decIdx is similar to that used
-            // in compress() for writing bits to writeBuf[wPos], but a mask is
-            //  needed because decIdx is not CHAR_BIT bits long (unlike
-            //  writeBuf[wPos]),
-            //  so if bits other than the bitsNeeded LSBs are != 0, the value of
-            //  decIdx will be wrong.
-            while (bitsNeeded > bitsRem && rPos < bytesRead) {
-                // Left shift promotes unsigned char to int
-                decIdx |= ((readBuf[rPos] << (bitsNeeded - bitsRem)) &
-                           mask(bitsNeeded));
-                rPos++;
-                bitsNeeded -= bitsRem;
-                bitsRem = CHAR_BIT;
-            }
 
-            if (rPos == bytesRead)
-                break;
+        if (wLen > 0) {
+            bytesWritten = fwrite(writeBuf, 1, wLen, dest);
+            if (bytesWritten < wLen) {
+                reportError("fwrite");
+                return -1;
+            }
+        }
+    }
 
-            decIdx |=
-              ((readBuf[rPos] >> (bitsRem - bitsNeeded)) & mask(bitsNeeded));
-            bitsRem -= bitsNeeded;
+    return 0;
+}
 
-            writeBuf[wPos] = decompTable.symbols[decIdx >> LOOKUP_SHIFT];
-            wPos++;
+int decompressRange(FILE *src, FILE *dest, const decompTableT *decompTablePtr,
+                    uint64_t compSize, uint64_t bitOffset, uint64_t skip,
+                    uint64_t len) {
+    unsigned char readBuf[RANGE_BUF_SIZE], writeBuf[RANGE_BUF_SIZE];
+    uint64_t remaining;
+    size_t toRead, outCap, wLen;
+    int final = 0, done = 0, first = 1;
+    bitReaderT br;
 
-            // If the write buffer is full, flush and reset position
-            if (wPos == BUF_SIZE) {
-                bytesWritten = fwrite(writeBuf, 1, BUF_SIZE, dest);
-                if (bytesWritten < BUF_SIZE) {
-                    reportError("fwrite");
-                    return -1;
-                }
+    assert(src != NULL);
+    assert(dest != NULL);
+    assert(decompTablePtr != NULL);
 
-                wPos = 0;
-            }
+    if (bitOffset / CHAR_BIT > compSize) {
+        fprintf(stderr, "%s:%d: Malformed bit offset.\n", __FILE__, __LINE__);
+        return -1;
+    }
 
-            bitsNeeded = decompTable.codeLens[decIdx >> LOOKUP_SHIFT];
-            decIdx <<= bitsNeeded;
-        }
+    if (fseeko(src, bitOffset / CHAR_BIT, SEEK_CUR) == -1) {
+        reportError("fseeko");
+        return -1;
     }
+    remaining = compSize - bitOffset / CHAR_BIT;
 
-    // After all of the compressed file's bits have been read,
-    //  bits stored in decIdx cannot be replenished, so the bits
-    //  remaining in decIdx are decoded into the symbols of t
-    //  he original file, until the EOF symbol is found.
-    //   Assuming the compressed file is not corrupted, the EOF
-    //  symbol should always be found.
-
-    // Check if EOF was found using its numeric value.
-    while (decompTable.symbols[decIdx >> LOOKUP_SHIFT] != EOF_VAL) {
-        writeBuf[wPos] = decompTable.symbols[decIdx >> LOOKUP_SHIFT];
-        wPos++;
-
-        if (wPos == BUF_SIZE) {
-            bytesWritten = fwrite(writeBuf, 1, BUF_SIZE, dest);
-            if (bytesWritten < BUF_SIZE) {
-                reportError("fwrite");
+    bitReaderInit(&br);
+
+    while (len > 0 && !done) {
+        if (br.ptr == br.end && !final) {
+            toRead = remaining < RANGE_BUF_SIZE ? remaining : RANGE_BUF_SIZE;
+            if (readBytes(src, readBuf, toRead) < 0)
                 return -1;
-            }
 
-            wPos = 0;
+            remaining -= toRead;
+            final = (remaining == 0);
+            bitReaderFeed(&br, readBuf, toRead);
+
+            // The first code may begin in the middle of its byte
+            if (first) {
+                refill(&br);
+                skipBits(&br, bitOffset % CHAR_BIT);
+                first = 0;
+            }
         }
 
-        // Consume the bits of decIdx needed for decoding.
-        bitsNeeded = decompTable.codeLens[decIdx >> LOOKUP_SHIFT];
-        decIdx <<= bitsNeeded;
-    }
+        // Decode the skipped bytes without writing them
+        outCap = skip ? skip : len;
+        if (outCap > RANGE_BUF_SIZE)
+            outCap = RANGE_BUF_SIZE;
 
-    // If wPos > 0 after the above while loop ends,
-    //  some data is still in the
-    //  write buffer. In that case a last write to the
-    //  file should be performed.
-    if (wPos > 0) {
-        bytesWritten = fwrite(writeBuf, 1, wPos, dest);
-        if (bytesWritten < wPos) {
-            reportError("fwrite");
+        wLen = decodeSyms(&br, decompTablePtr, writeBuf, outCap, final, &done);
+        if (!done && final && wLen < outCap) {
+            fprintf(stderr, "%s:%d: Malformed file error, no EOF symbol.\n",
+                    __FILE__, __LINE__);
             return -1;
         }
+        if (skip)
+            skip -= wLen;
+        else {
+            if (writeBytes(dest, writeBuf, wLen) < 0)
+                return -1;
+            len -= wLen;
+        }
     }
 
     return 0;
-}
\ No newline at end of file
+}
+
+int makeParents(char *path) {
+    assert(path != NULL);
+
+    for (char *ptr = path + 1; *ptr; ptr++)
+        if (*ptr == '/') {
+            *ptr = '\0';
+            if (mkdir(path, 0777) == -1 && errno != EEXIST) {
+                reportError("mkdir");
+                return -1;
+            }
+            *ptr = '/';
+        }
+
+    return 0;
+}
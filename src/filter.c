@@ -0,0 +1,465 @@
+// For fopencookie()
+#define _GNU_SOURCE
+
+#include "fg2019/filter.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "fg2019/error.h"
+#include "fg2019/file.h"
+#include "fg2019/mem.h"
+
+// Blocks looked at by filterDetect()
+#define FILTER_DETECT_BLOCKS 4
+
+//  A delta is chosen when it makes the entropy of the sample at most this
+// fraction of the unfiltered one
+#define FILTER_DETECT_GAIN 0.9
+
+const char *const filterNames[FILTER_TOTAL] = {"none", "delta", "stride",
+                                               "x86"};
+
+// The widths of delta tried by filterDetect()
+static const int detectWidths[] = {1, 2, 3, 4, 8};
+
+// filterStreamT: The state of a filtering stream.
+typedef struct {
+    FILE *fptr;
+    filterT filter;
+
+    // start: The position of fptr where the stream begins.
+    off_t start;
+
+    // pos: The position of the stream.
+    // next: The position of fptr (after start) if known, else UINT64_MAX.
+    uint64_t pos, next;
+
+    // writer: Whether the stream is written, else read.
+    int writer;
+
+    // block: The block of the stream that begins at blockStart.
+    uint64_t blockStart;
+    size_t blockLen;
+    unsigned char block[FILTER_BLOCK_SIZE], tmp[FILTER_BLOCK_SIZE];
+} filterStreamT;
+
+int checkFilter(const filterT *filterPtr) {
+    int width = filterPtr->width;
+
+    switch (filterPtr->type) {
+    case FILTER_NONE:
+    case FILTER_X86:
+        if (width == 0)
+            return 0;
+        break;
+    case FILTER_DELTA:
+    case FILTER_STRIDE:
+        if (width >= 1 && width <= FILTER_MAX_WIDTH)
+            return 0;
+        break;
+    }
+
+    fprintf(stderr, "%s:%d: Malformed filter %d of width %d.\n", __FILE__,
+            __LINE__, filterPtr->type, width);
+    return -1;
+}
+
+static void deltaEncode(unsigned char *block, size_t len, size_t width,
+                        unsigned char *tmp) {
+    if (len <= width)
+        return;
+
+    // Through tmp, so that no byte depends on one computed before
+    for (size_t k = width; k < len; k++)
+        tmp[k] = block[k] - block[k - width];
+    memcpy(block + width, tmp + width, len - width);
+}
+
+static void deltaDecode(unsigned char *block, size_t len, size_t width) {
+    for (size_t k = width; k < len; k++)
+        block[k] += block[k - width];
+}
+
+//  strideSplit(): Splits the whole records of the block into planes, the
+// bytes after them are left as they are.
+static void strideSplit(unsigned char *block, size_t len, size_t width,
+                        unsigned char *tmp) {
+    size_t records = len / width;
+
+    for (size_t plane = 0; plane < width; plane++)
+        for (size_t k = 0; k < records; k++)
+            tmp[plane * records + k] = block[k * width + plane];
+    memcpy(block, tmp, records * width);
+}
+
+static void strideJoin(unsigned char *block, size_t len, size_t width,
+                       unsigned char *tmp) {
+    size_t records = len / width;
+
+    for (size_t plane = 0; plane < width; plane++)
+        for (size_t k = 0; k < records; k++)
+            tmp[k * width + plane] = block[plane * records + k];
+    memcpy(block, tmp, records * width);
+}
+
+//  x86Convert(): Converts the targets of E8/E9 instructions, between
+// relative (to the end of the instruction) and absolute.
+//  Only targets within +-16 MiB (whose last byte is 00 or FF) are converted,
+// and they are kept within that range (25 bits, sign extended), so the same
+// instructions are found in the converted data.
+static void x86Convert(unsigned char *block, size_t len, uint64_t pos,
+                       int encode) {
+    size_t k = 0;
+
+    while (k + 5 <= len) {
+        uint32_t val, at;
+
+        if ((block[k] & 0xFE) != 0xE8 ||
+            (block[k + 4] != 0x00 && block[k + 4] != 0xFF)) {
+            k++;
+            continue;
+        }
+
+        val = block[k + 1] | (uint32_t) block[k + 2] << 8 |
+              (uint32_t) block[k + 3] << 16 | (uint32_t) block[k + 4] << 24;
+        at = (uint32_t) (pos + k + 5);
+        val = encode ? val + at : val - at;
+
+        val &= 0x01FFFFFF;
+        if (val & 0x01000000)
+            val |= 0xFE000000;
+
+        block[k + 1] = val;
+        block[k + 2] = val >> 8;
+        block[k + 3] = val >> 16;
+        block[k + 4] = val >> 24;
+        k += 5;
+    }
+}
+
+void filterBlock(const filterT *filterPtr, unsigned char *block, size_t len,
+                 uint64_t pos, unsigned char *tmp) {
+    switch (filterPtr->type) {
+    case FILTER_DELTA:
+        deltaEncode(block, len, filterPtr->width, tmp);
+        break;
+    case FILTER_STRIDE:
+        strideSplit(block, len, filterPtr->width, tmp);
+        break;
+    case FILTER_X86:
+        x86Convert(block, len, pos, 1);
+        break;
+    }
+}
+
+void unfilterBlock(const filterT *filterPtr, unsigned char *block, size_t len,
+                   uint64_t pos, unsigned char *tmp) {
+    switch (filterPtr->type) {
+    case FILTER_DELTA:
+        deltaDecode(block, len, filterPtr->width);
+        break;
+    case FILTER_STRIDE:
+        strideJoin(block, len, filterPtr->width, tmp);
+        break;
+    case FILTER_X86:
+        x86Convert(block, len, pos, 0);
+        break;
+    }
+}
+
+// entropyBits(): The order-0 entropy of the bytes counted, in bits.
+static double entropyBits(const size_t freqs[256], size_t total) {
+    double bits = 0;
+
+    for (int k = 0; k < 256; k++)
+        if (freqs[k])
+            bits += freqs[k] * log2((double) total / freqs[k]);
+
+    return bits;
+}
+
+// isX86Executable(): Checks for the header of an ELF (i386 or x86-64) or
+//  PE executable.
+static int isX86Executable(const unsigned char *buf, size_t len) {
+    if (len >= 20 && !memcmp(buf, "\x7f" "ELF", 4))
+        return (buf[18] == 3 || buf[18] == 62) && buf[19] == 0;
+
+    return len >= 64 && buf[0] == 'M' && buf[1] == 'Z';
+}
+
+int filterDetect(FILE *src, filterT *filterPtr) {
+    //  freqs[0]: The frequencies of the bytes, freqs[w + 1]: of the bytes
+    // filtered by the delta of width detectWidths[w]
+    enum { WIDTH_TOTAL = sizeof(detectWidths) / sizeof(detectWidths[0]) };
+    size_t freqs[WIDTH_TOTAL + 1][256] = {{0}};
+    unsigned char block[FILTER_BLOCK_SIZE];
+    size_t len, total = 0;
+    double bits, noneBits, bestBits;
+    off_t pos;
+
+    assert(src != NULL);
+    assert(filterPtr != NULL);
+
+    filterPtr->type = FILTER_NONE;
+    filterPtr->width = 0;
+
+    pos = ftello(src);
+    if (pos == -1) {
+        reportError("ftello");
+        return -1;
+    }
+
+    for (int b = 0; b < FILTER_DETECT_BLOCKS; b++) {
+        len = fread(block, 1, FILTER_BLOCK_SIZE, src);
+        if (ferror(src)) {
+            reportError("fread");
+            return -1;
+        }
+
+        if (b == 0 && isX86Executable(block, len)) {
+            filterPtr->type = FILTER_X86;
+            break;
+        }
+
+        // The deltas are counted as filterBlock() would make them
+        for (size_t k = 0; k < len; k++)
+            freqs[0][block[k]]++;
+        for (int w = 0; w < WIDTH_TOTAL; w++) {
+            size_t width = detectWidths[w];
+
+            for (size_t k = 0; k < len; k++) {
+                unsigned char val = block[k];
+
+                if (k >= width)
+                    val -= block[k - width];
+                freqs[w + 1][val]++;
+            }
+        }
+        total += len;
+
+        if (len < FILTER_BLOCK_SIZE)
+            break;
+    }
+
+    if (fseeko(src, pos, SEEK_SET) == -1) {
+        reportError("fseeko");
+        return -1;
+    }
+
+    if (filterPtr->type == FILTER_X86 || !total)
+        return 0;
+
+    noneBits = bestBits = entropyBits(freqs[0], total);
+    for (int w = 0; w < WIDTH_TOTAL; w++) {
+        bits = entropyBits(freqs[w + 1], total);
+        if (bits < bestBits && bits <= FILTER_DETECT_GAIN * noneBits) {
+            bestBits = bits;
+            filterPtr->type = FILTER_DELTA;
+            filterPtr->width = detectWidths[w];
+        }
+    }
+
+    return 0;
+}
+
+int writeFilter(FILE *dest, const filterT *filterPtr) {
+    unsigned char buf[2] = {filterPtr->type, filterPtr->width};
+
+    return writeBytes(dest, buf, sizeof(buf));
+}
+
+int readFilter(FILE *src, filterT *filterPtr) {
+    unsigned char buf[2];
+
+    if (readBytes(src, buf, sizeof(buf)) < 0)
+        return -1;
+
+    filterPtr->type = buf[0];
+    filterPtr->width = buf[1];
+    return checkFilter(filterPtr);
+}
+
+// loadBlock(): Reads and filters the block that holds the position of the
+//  stream, returns its length (0 at the end of the file) or -1.
+static ssize_t loadBlock(filterStreamT *stream) {
+    uint64_t blockStart = stream->pos - stream->pos % FILTER_BLOCK_SIZE;
+
+    if (stream->next != blockStart &&
+        fseeko(stream->fptr, stream->start + blockStart, SEEK_SET) == -1)
+        return -1;
+
+    stream->blockStart = blockStart;
+    stream->blockLen = fread(stream->block, 1, FILTER_BLOCK_SIZE,
+                             stream->fptr);
+    if (ferror(stream->fptr))
+        return -1;
+    stream->next = blockStart + stream->blockLen;
+
+    filterBlock(&stream->filter, stream->block, stream->blockLen, blockStart,
+                stream->tmp);
+
+    return stream->blockLen;
+}
+
+static ssize_t filterRead(void *cookie, char *buf, size_t size) {
+    filterStreamT *stream = cookie;
+    size_t done = 0, skip, len;
+    ssize_t blockLen;
+
+    while (done < size) {
+        if (stream->pos < stream->blockStart ||
+            stream->pos >= stream->blockStart + stream->blockLen) {
+            blockLen = loadBlock(stream);
+            if (blockLen == -1)
+                return -1;
+            if (stream->pos >= stream->blockStart + blockLen)
+                break;
+        }
+
+        skip = stream->pos - stream->blockStart;
+        len = stream->blockLen - skip;
+        if (len > size - done)
+            len = size - done;
+
+        memcpy(buf + done, stream->block + skip, len);
+        done += len;
+        stream->pos += len;
+    }
+
+    return done;
+}
+
+static int filterSeek(void *cookie, off64_t *offsetPtr, int whence) {
+    filterStreamT *stream = cookie;
+    off_t end;
+
+    switch (whence) {
+    case SEEK_SET:
+        stream->pos = *offsetPtr;
+        break;
+    case SEEK_CUR:
+        stream->pos += *offsetPtr;
+        break;
+    case SEEK_END:
+        // Filters keep the size of the data
+        if (fseeko(stream->fptr, 0, SEEK_END) == -1)
+            return -1;
+        end = ftello(stream->fptr);
+        if (end == -1)
+            return -1;
+        stream->next = UINT64_MAX;
+        stream->pos = end - stream->start + *offsetPtr;
+        break;
+    default:
+        return -1;
+    }
+
+    *offsetPtr = stream->pos;
+    return 0;
+}
+
+// flushBlock(): Unfilters the block written so far and writes it.
+static int flushBlock(filterStreamT *stream) {
+    unfilterBlock(&stream->filter, stream->block, stream->blockLen,
+                  stream->blockStart, stream->tmp);
+
+    if (fwrite(stream->block, 1, stream->blockLen, stream->fptr) <
+        stream->blockLen)
+        return -1;
+
+    stream->blockStart += stream->blockLen;
+    stream->blockLen = 0;
+    return 0;
+}
+
+static ssize_t filterWrite(void *cookie, const char *buf, size_t size) {
+    filterStreamT *stream = cookie;
+    size_t done = 0, len;
+
+    while (done < size) {
+        len = FILTER_BLOCK_SIZE - stream->blockLen;
+        if (len > size - done)
+            len = size - done;
+
+        memcpy(stream->block + stream->blockLen, buf + done, len);
+        stream->blockLen += len;
+        done += len;
+
+        if (stream->blockLen == FILTER_BLOCK_SIZE && flushBlock(stream) < 0)
+            return -1;
+    }
+
+    return size;
+}
+
+static int filterClose(void *cookie) {
+    filterStreamT *stream = cookie;
+    int ret = 0;
+
+    if (stream->writer && stream->blockLen &&
+        flushBlock(stream) < 0)
+        ret = -1;
+
+    memFree(stream);
+    return ret;
+}
+
+// openFilterStream(): Opens a filtering stream with the given functions.
+static FILE *openFilterStream(FILE *fptr, const filterT *filterPtr,
+                              const char *mode, cookie_io_functions_t funcs) {
+    filterStreamT *stream = memAlloc(sizeof(*stream));
+    FILE *filterFptr;
+
+    if (!stream) {
+        reportError("malloc");
+        return NULL;
+    }
+
+    stream->fptr = fptr;
+    stream->filter = *filterPtr;
+    stream->pos = stream->next = 0;
+    stream->blockStart = 0;
+    stream->blockLen = 0;
+    stream->writer = (funcs.write != NULL);
+
+    // Writers are written in order, and need not seek
+    stream->start = stream->writer ? 0 : ftello(fptr);
+    if (stream->start == -1) {
+        reportError("ftello");
+        memFree(stream);
+        return NULL;
+    }
+
+    filterFptr = fopencookie(stream, mode, funcs);
+    if (!filterFptr) {
+        reportError("fopencookie");
+        memFree(stream);
+        return NULL;
+    }
+
+    setvbuf(filterFptr, NULL, _IOFBF, FILTER_BLOCK_SIZE);
+
+    return filterFptr;
+}
+
+FILE *filterReader(FILE *src, const filterT *filterPtr) {
+    cookie_io_functions_t funcs = {filterRead, NULL, filterSeek, filterClose};
+
+    assert(src != NULL);
+    assert(filterPtr != NULL);
+
+    return openFilterStream(src, filterPtr, "rb", funcs);
+}
+
+FILE *filterWriter(FILE *dest, const filterT *filterPtr) {
+    cookie_io_functions_t funcs = {NULL, filterWrite, NULL, filterClose};
+
+    assert(dest != NULL);
+    assert(filterPtr != NULL);
+
+    return openFilterStream(dest, filterPtr, "wb", funcs);
+}
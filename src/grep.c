@@ -0,0 +1,341 @@
+// For fopencookie() and memrchr()
+#define _GNU_SOURCE
+
+#include "fg2019/grep.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "fg2019/error.h"
+#include "fg2019/mem.h"
+
+// grepStreamT: The state of the search of a decompressed file.
+typedef struct {
+    const char *const *patterns;
+    size_t lens[GREP_MAX_PATTERNS];
+    int patternTotal;
+    size_t maxLen;
+
+    // name: Printed before the matching lines, NULL for none.
+    const char *name;
+    FILE *out;
+
+    //  buf: The decompressed bytes not searched yet, from the start of a
+    // line, in cap bytes, which grow for a line longer than them.
+    unsigned char *buf;
+    size_t len, cap;
+
+    // offset: Of buf[0] in the decompressed file.
+    uint64_t offset;
+
+    //  skip: Bytes at the start of buf that were searched already, as the
+    // start of a long line without a match, so they are not searched again.
+    size_t skip;
+
+    //  printing: A long line matched and its start was printed, the rest of
+    // it is printed as it comes, up to its end of line.
+    int printing;
+
+    // failed: A write failed, the next ones fail without searching.
+    int failed;
+
+    // matches: Number of matching lines.
+    uint64_t matches;
+} grepStreamT;
+
+//  findPattern(): The first match of a pattern in buf[from, n) that is not
+// within the first skip bytes, n if there is none.
+static size_t findPattern(const grepStreamT *grep, int pattern, size_t from,
+                          size_t n) {
+    size_t len = grep->lens[pattern];
+    const unsigned char *found;
+
+    if (grep->skip >= len && from < grep->skip - len + 1)
+        from = grep->skip - len + 1;
+    if (from >= n)
+        return n;
+
+    found = memmem(grep->buf + from, n - from, grep->patterns[pattern], len);
+    return found ? (size_t) (found - grep->buf) : n;
+}
+
+//  printLine(): Prints a matching line, from buf[start, end), with its end
+// of line unless it goes on after end.
+static int printLine(grepStreamT *grep, size_t start, size_t end,
+                     int lineEnd) {
+    if (grep->name)
+        fprintf(grep->out, "%s:", grep->name);
+    fprintf(grep->out, "%llu:", (unsigned long long) (grep->offset + start));
+    fwrite(grep->buf + start, 1, end - start, grep->out);
+    if (lineEnd)
+        fputc('\n', grep->out);
+
+    if (ferror(grep->out)) {
+        reportError("fwrite");
+        return -1;
+    }
+
+    grep->matches++;
+    return 0;
+}
+
+//  searchLines(): Prints the lines of buf[0, n) that hold a pattern, n is
+// the end of a line.
+static int searchLines(grepStreamT *grep, size_t n) {
+    size_t next[GREP_MAX_PATTERNS], pos = 0, match, start, end;
+    const unsigned char *newline;
+
+    // The next match of every pattern, found again only once it is passed
+    for (int k = 0; k < grep->patternTotal; k++)
+        next[k] = findPattern(grep, k, 0, n);
+
+    while (pos < n) {
+        match = n;
+        for (int k = 0; k < grep->patternTotal; k++) {
+            if (next[k] < pos)
+                next[k] = findPattern(grep, k, pos, n);
+            if (next[k] < match)
+                match = next[k];
+        }
+
+        if (match == n)
+            break;
+
+        newline = memrchr(grep->buf + pos, '\n', match - pos);
+        start = newline ? (size_t) (newline - grep->buf) + 1 : pos;
+        newline = memchr(grep->buf + match, '\n', n - match);
+        end = newline ? (size_t) (newline - grep->buf) : n;
+
+        if (printLine(grep, start, end, 1) < 0)
+            return -1;
+
+        pos = end + 1;
+    }
+
+    return 0;
+}
+
+//  searchLong(): Searches buf, the start of a line with no end of line in
+// it yet. If it holds a pattern, it is printed and the rest of the line is
+// printed as it comes, else buf grows to hold more of the line.
+static int searchLong(grepStreamT *grep) {
+    size_t match = grep->len;
+    unsigned char *buf;
+
+    for (int k = 0; k < grep->patternTotal; k++) {
+        size_t found = findPattern(grep, k, 0, grep->len);
+
+        if (found < match)
+            match = found;
+    }
+
+    if (match < grep->len) {
+        if (printLine(grep, 0, grep->len, 0) < 0)
+            return -1;
+        grep->printing = 1;
+        grep->offset += grep->len;
+        grep->len = grep->skip = 0;
+        return 0;
+    }
+
+    // The end of buf is searched again, for the matches across it
+    grep->skip = grep->len - (grep->maxLen - 1);
+
+    buf = memRealloc(grep->buf, 2 * grep->cap);
+    if (!buf) {
+        fprintf(stderr, "A line of %llu bytes or more does not fit in the "
+                        "memory.\n",
+                (unsigned long long) grep->len);
+        return -1;
+    }
+    grep->buf = buf;
+    grep->cap *= 2;
+
+    return 0;
+}
+
+//  consume(): Searches the whole lines of the full buf, and moves what is
+// left to its start, or searches it as the start of a long line if there is
+// no end of line in it.
+static int consume(grepStreamT *grep) {
+    const unsigned char *newline = memrchr(grep->buf, '\n', grep->len);
+    size_t done;
+
+    if (!newline)
+        return searchLong(grep);
+
+    done = newline - grep->buf + 1;
+    if (searchLines(grep, done) < 0)
+        return -1;
+    grep->skip = 0;
+
+    memmove(grep->buf, grep->buf + done, grep->len - done);
+    grep->len -= done;
+    grep->offset += done;
+
+    return 0;
+}
+
+//  printRest(): Prints the bytes of size that are still part of a long line
+// that matched, up to its end of line. Returns how many they are.
+static ssize_t printRest(grepStreamT *grep, const char *buf, size_t size) {
+    const char *newline = memchr(buf, '\n', size);
+    size_t n = newline ? (size_t) (newline - buf) + 1 : size;
+
+    fwrite(buf, 1, n, grep->out);
+    if (ferror(grep->out)) {
+        reportError("fwrite");
+        return -1;
+    }
+
+    grep->offset += n;
+    grep->printing = !newline;
+
+    return n;
+}
+
+static ssize_t grepWrite(void *cookie, const char *buf, size_t size) {
+    grepStreamT *grep = cookie;
+    size_t left = size, n;
+    ssize_t printed;
+
+    if (grep->failed)
+        return -1;
+
+    while (left > 0) {
+        if (grep->printing) {
+            printed = printRest(grep, buf, left);
+            if (printed < 0) {
+                grep->failed = 1;
+                return -1;
+            }
+            buf += printed;
+            left -= printed;
+            continue;
+        }
+
+        n = grep->cap - grep->len;
+        if (n > left)
+            n = left;
+
+        memcpy(grep->buf + grep->len, buf, n);
+        grep->len += n;
+        buf += n;
+        left -= n;
+
+        if (grep->len == grep->cap && consume(grep) < 0) {
+            grep->failed = 1;
+            return -1;
+        }
+    }
+
+    return size;
+}
+
+// grepClose(): Searches the last line, which has no end of line.
+static int grepClose(void *cookie) {
+    grepStreamT *grep = cookie;
+    int ret = 0;
+
+    // A long line that matched ends with the file
+    if (grep->printing && fputc('\n', grep->out) == EOF) {
+        reportError("fputc");
+        ret = -1;
+    }
+    else if (grep->len > 0 && !grep->failed)
+        ret = searchLines(grep, grep->len);
+    grep->len = 0;
+    grep->printing = 0;
+
+    return ret;
+}
+
+// grepFile(): Searches the decompressed src.
+static int grepFile(grepStreamT *grep, FILE *src, const optionsT *opts) {
+    cookie_io_functions_t funcs = {NULL, grepWrite, NULL, grepClose};
+    FILE *dest;
+    int ret;
+
+    // Offsets are in the original file, with or without a range
+    grep->len = 0;
+    grep->offset = opts->range ? opts->rangeOffset : 0;
+    grep->skip = 0;
+    grep->printing = grep->failed = 0;
+
+    dest = fopencookie(grep, "wb", funcs);
+    if (!dest) {
+        reportError("fopencookie");
+        return -1;
+    }
+
+    // Unbuffered, the writes of the method go straight to buf
+    setvbuf(dest, NULL, _IONBF, 0);
+
+    ret = decompressFile(src, dest, opts);
+    if (fclose(dest) == EOF || grep->failed)
+        ret = -1;
+
+    return ret;
+}
+
+int grepFiles(const char *const patterns[], int patternTotal,
+              char *const paths[], int pathTotal, const optionsT *opts,
+              FILE *out) {
+    grepStreamT grep;
+    optionsT grepOpts = *opts;
+    FILE *src;
+    int ret = 0;
+
+    assert(patterns != NULL);
+    assert(patternTotal >= 1 && patternTotal <= GREP_MAX_PATTERNS);
+    assert(paths != NULL);
+    assert(opts != NULL);
+    assert(out != NULL);
+
+    grep.patterns = patterns;
+    grep.patternTotal = patternTotal;
+    grep.maxLen = 0;
+    for (int k = 0; k < patternTotal; k++) {
+        grep.lens[k] = strlen(patterns[k]);
+        assert(grep.lens[k] >= 1 && grep.lens[k] <= GREP_MAX_PATTERN_LEN);
+        if (grep.lens[k] > grep.maxLen)
+            grep.maxLen = grep.lens[k];
+    }
+
+    grep.out = out;
+    grep.matches = 0;
+    grepOpts.verify = 0;
+
+    grep.cap = GREP_BUF_SIZE;
+    grep.buf = memAlloc(grep.cap);
+    if (!grep.buf) {
+        reportError("malloc");
+        return -1;
+    }
+
+    for (int k = 0; k < pathTotal; k++) {
+        grep.name = pathTotal > 1 ? paths[k] : NULL;
+
+        src = fopen(paths[k], "rb");
+        if (!src) {
+            reportError("fopen");
+            ret = -1;
+            continue;
+        }
+
+        if (grepFile(&grep, src, &grepOpts) < 0) {
+            fprintf(stderr, "%s: Search failed.\n", paths[k]);
+            ret = -1;
+        }
+        fclose(src);
+    }
+
+    memFree(grep.buf);
+
+    if (fflush(out) == EOF) {
+        reportError("fflush");
+        return -1;
+    }
+
+    return ret < 0 ? -1 : grep.matches > 0;
+}
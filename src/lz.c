@@ -0,0 +1,596 @@
+#include "fg2019/lz.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fg2019/bitio.h"
+#include "fg2019/codes.h"
+#include "fg2019/error.h"
+#include "fg2019/file.h"
+#include "fg2019/mem.h"
+
+// Number of input bytes per block, every block gets its own codes
+#define LZ_BLOCK_SIZE (1 << 20)
+
+// Maximum number of bytes of encoded data of a block: no token takes more
+// than 8 bytes (a code and extra bits for both the length and the distance).
+#define LZ_OUT_SIZE (8 * LZ_BLOCK_SIZE + 8)
+
+// Marks an empty hash chain
+#define LZ_NIL UINT32_MAX
+
+// lzLevelT: The match finder settings of a level.
+typedef struct {
+    // chainLen: Maximum number of chain positions compared per search.
+    int chainLen;
+
+    // lazy: Check if the next position has a longer match, before
+    //  choosing a match.
+    int lazy;
+
+    // nice: A match this long ends the search.
+    int nice;
+} lzLevelT;
+
+static const lzLevelT lzLevels[LZ_MAX_LEVEL + 1] = {
+  {0, 0, 0},     {4, 0, 16},    {8, 0, 32},     {16, 0, 32},
+  {16, 1, 64},   {32, 1, 128},  {64, 1, 258},   {128, 1, 512},
+  {256, 1, 1024}, {1024, 1, LZ_MAX_MATCH}};
+
+// tokenT: A literal (len == 0, val is the byte) or a match (val is the
+//  distance).
+typedef struct {
+    uint32_t len;
+    uint32_t val;
+} tokenT;
+
+// lzEncT: State of the compressor.
+typedef struct {
+    // win: The window, the data of the current block follows the last
+    //  windowSize (or more) bytes before it.
+    unsigned char *win;
+    size_t winCap;
+
+    // dataLen: Number of bytes in win.
+    uint32_t dataLen;
+
+    // head: The last position of every hash value, prev: the previous
+    //  position with the same hash value as a position, indexed by
+    //  position & winMask.
+    uint32_t *head;
+    uint32_t *prev;
+    int hashBits;
+    uint32_t winSize, winMask;
+
+    // next: The first position not yet inserted to the hash chains.
+    uint32_t next;
+
+    const lzLevelT *levelPtr;
+
+    tokenT *tokens;
+    unsigned char *out;
+} lzEncT;
+
+// bucketCode(): Splits a value into a bucket code, which is the position
+//  of its most significant bit and the bit after it, and the rest of
+//  the bits, which are written as they are (extra bits).
+static inline int bucketCode(uint32_t val, int *extraBitsPtr,
+                             uint32_t *extraValPtr) {
+    int n;
+
+    if (val < 4) {
+        *extraBitsPtr = 0;
+        *extraValPtr = 0;
+        return val;
+    }
+
+    n = 31 - __builtin_clz(val);
+    *extraBitsPtr = n - 1;
+    *extraValPtr = val & ((1u << (n - 1)) - 1);
+
+    return 2 * n + ((val >> (n - 1)) & 1);
+}
+
+// bucketBase(): The smallest value of a bucket, the inverse of
+//  bucketCode().
+static inline uint32_t bucketBase(int code, int *extraBitsPtr) {
+    int n = code / 2;
+
+    if (code < 4) {
+        *extraBitsPtr = 0;
+        return code;
+    }
+
+    *extraBitsPtr = n - 1;
+    return (uint32_t) (2 | (code & 1)) << (n - 1);
+}
+
+static inline uint32_t load32(const unsigned char *ptr) {
+    uint32_t val;
+
+    memcpy(&val, ptr, sizeof(val));
+    return val;
+}
+
+static inline uint32_t hash4(const lzEncT *enc, const unsigned char *ptr) {
+    return (load32(ptr) * 2654435761u) >> (32 - enc->hashBits);
+}
+
+// matchLen(): Length of the common prefix of a and b, up to limit bytes.
+static inline uint32_t matchLen(const unsigned char *a, const unsigned char *b,
+                                uint32_t limit) {
+    uint32_t len = 0;
+    uint64_t x, y;
+
+    while (len + 8 <= limit) {
+        memcpy(&x, a + len, sizeof(x));
+        memcpy(&y, b + len, sizeof(y));
+        if (x != y)
+            return len + (__builtin_ctzll(x ^ y) >> 3);
+        len += 8;
+    }
+
+    while (len < limit && a[len] == b[len])
+        len++;
+
+    return len;
+}
+
+// insertUpTo(): Inserts the positions before pos to the hash chains,
+//  only positions with LZ_MIN_MATCH bytes before end can be hashed.
+static inline void insertUpTo(lzEncT *enc, uint32_t pos, uint32_t end) {
+    uint32_t h;
+
+    for (; enc->next < pos; enc->next++) {
+        if (enc->next + LZ_MIN_MATCH > end)
+            continue;
+
+        h = hash4(enc, enc->win + enc->next);
+        enc->prev[enc->next & enc->winMask] = enc->head[h];
+        enc->head[h] = enc->next;
+    }
+}
+
+// findMatch(): Searches the hash chain of pos for the longest match,
+//  returns its length (0 if there is none) and stores its distance.
+//  Assumptions:
+//   > All of the positions before pos, and not pos, are inserted.
+static uint32_t findMatch(lzEncT *enc, uint32_t pos, uint32_t end,
+                          uint32_t *distPtr) {
+    const unsigned char *win = enc->win;
+    uint32_t limit = end - pos, best = LZ_MIN_MATCH - 1, len;
+    uint32_t minPos = pos > enc->winSize ? pos - enc->winSize : 0;
+    uint32_t cand, next;
+    int chain = enc->levelPtr->chainLen;
+
+    if (limit < LZ_MIN_MATCH)
+        return 0;
+    if (limit > LZ_MAX_MATCH)
+        limit = LZ_MAX_MATCH;
+
+    cand = enc->head[hash4(enc, win + pos)];
+
+    while (cand != LZ_NIL && cand >= minPos && chain-- > 0) {
+        // Checking the byte that would make the match longer first
+        // rejects most candidates with a single comparison
+        if (win[cand + best] == win[pos + best] &&
+            load32(win + cand) == load32(win + pos)) {
+            len = matchLen(win + cand, win + pos, limit);
+            if (len > best) {
+                best = len;
+                *distPtr = pos - cand;
+                if (len >= (uint32_t) enc->levelPtr->nice || len == limit)
+                    break;
+            }
+        }
+
+        next = enc->prev[cand & enc->winMask];
+        if (next >= cand)
+            break;
+        cand = next;
+    }
+
+    return best >= LZ_MIN_MATCH ? best : 0;
+}
+
+// parseBlock(): Parses the bytes [start, end) of the window to tokens,
+//  counting the symbols of both alphabets. Returns the number of tokens.
+static size_t parseBlock(lzEncT *enc, uint32_t start, uint32_t end,
+                         size_t llFreqs[], size_t distFreqs[]) {
+    const lzLevelT *levelPtr = enc->levelPtr;
+    uint32_t pos = start, len, dist = 0, len2, dist2 = 0;
+    size_t tokenTotal = 0;
+    int extraBits;
+    uint32_t extraVal;
+
+    memset(llFreqs, 0, sizeof(llFreqs[0]) * LZ_LL_SYM_NUM);
+    memset(distFreqs, 0, sizeof(distFreqs[0]) * LZ_DIST_SYM_NUM);
+
+    while (pos < end) {
+        insertUpTo(enc, pos, end);
+        len = findMatch(enc, pos, end, &dist);
+
+        // Lazy matching: a literal followed by a longer match is better
+        while (levelPtr->lazy && len && len < (uint32_t) levelPtr->nice) {
+            insertUpTo(enc, pos + 1, end);
+            len2 = findMatch(enc, pos + 1, end, &dist2);
+            if (len2 <= len)
+                break;
+
+            enc->tokens[tokenTotal].len = 0;
+            enc->tokens[tokenTotal++].val = enc->win[pos];
+            llFreqs[enc->win[pos]]++;
+            pos++;
+            len = len2;
+            dist = dist2;
+        }
+
+        if (len) {
+            enc->tokens[tokenTotal].len = len;
+            enc->tokens[tokenTotal++].val = dist;
+            llFreqs[LZ_LEN_BASE +
+                    bucketCode(len - LZ_MIN_MATCH, &extraBits, &extraVal)]++;
+            distFreqs[bucketCode(dist - 1, &extraBits, &extraVal)]++;
+
+            //  The fast levels do not insert the positions inside long
+            // matches, which saves most of the time spent on repetitive
+            // data.
+            if (!levelPtr->lazy && len > (uint32_t) levelPtr->nice)
+                enc->next = pos + len;
+            pos += len;
+        }
+        else {
+            enc->tokens[tokenTotal].len = 0;
+            enc->tokens[tokenTotal++].val = enc->win[pos];
+            llFreqs[enc->win[pos]]++;
+            pos++;
+        }
+    }
+
+    return tokenTotal;
+}
+
+// encodeBlock(): Encodes the tokens to enc->out, returns the number of
+//  bytes written.
+static size_t encodeBlock(lzEncT *enc, size_t tokenTotal,
+                          const compTableT *llTablePtr,
+                          const compTableT *distTablePtr) {
+    bitWriterT bw;
+    int code, extraBits;
+    uint32_t extraVal;
+
+    bitWriterInit(&bw, enc->out);
+
+    for (size_t k = 0; k < tokenTotal; k++) {
+        tokenT token = enc->tokens[k];
+
+        if (token.len == 0) {
+            putBits(&bw, llTablePtr->vals[token.val],
+                    llTablePtr->lens[token.val]);
+            continue;
+        }
+
+        code = LZ_LEN_BASE +
+               bucketCode(token.len - LZ_MIN_MATCH, &extraBits, &extraVal);
+        putBits(&bw, llTablePtr->vals[code], llTablePtr->lens[code]);
+        putBits(&bw, extraVal, extraBits);
+
+        code = bucketCode(token.val - 1, &extraBits, &extraVal);
+        putBits(&bw, distTablePtr->vals[code], distTablePtr->lens[code]);
+        putBits(&bw, extraVal, extraBits);
+    }
+
+    flushBits(&bw);
+
+    return bw.ptr - enc->out;
+}
+
+// slideEncWindow(): Makes room for a new block by dropping a multiple of
+//  winSize bytes from the start of the window (so that positions keep
+//  their prev[] slots), and rebasing the hash chains.
+static void slideEncWindow(lzEncT *enc) {
+    uint32_t shift, val;
+    size_t hashSize = (size_t) 1 << enc->hashBits;
+
+    if (enc->dataLen + LZ_BLOCK_SIZE <= enc->winCap)
+        return;
+
+    shift = (enc->dataLen - enc->winSize) / enc->winSize * enc->winSize;
+    memmove(enc->win, enc->win + shift, enc->dataLen - shift);
+    enc->dataLen -= shift;
+    enc->next -= shift;
+
+    for (size_t k = 0; k < hashSize; k++) {
+        val = enc->head[k];
+        enc->head[k] = (val != LZ_NIL && val >= shift) ? val - shift : LZ_NIL;
+    }
+
+    for (size_t k = 0; k < enc->winSize; k++) {
+        val = enc->prev[k];
+        enc->prev[k] = (val != LZ_NIL && val >= shift) ? val - shift : LZ_NIL;
+    }
+}
+
+static void freeEnc(lzEncT *enc) {
+    memFree(enc->win);
+    memFree(enc->head);
+    memFree(enc->prev);
+    memFree(enc->tokens);
+    memFree(enc->out);
+}
+
+// encMem(): The memory of the encoder with a window of 2^windowLog bytes.
+static size_t encMem(int windowLog) {
+    size_t winSize = (size_t) 1 << windowLog;
+    int hashBits = windowLog + 1 > 20 ? 20 : windowLog + 1;
+
+    return 2 * winSize + LZ_BLOCK_SIZE + (sizeof(uint32_t) << hashBits) +
+           sizeof(uint32_t) * winSize + sizeof(tokenT) * LZ_BLOCK_SIZE +
+           LZ_OUT_SIZE;
+}
+
+size_t lzCompressMem(void) {
+    return encMem(LZ_MIN_WINDOW_LOG);
+}
+
+int lzCompress(FILE *src, FILE *dest, const lzParamsT *params) {
+    lzEncT enc;
+    compTableT llTable, distTable;
+    size_t llFreqs[LZ_LL_SYM_NUM], distFreqs[LZ_DIST_SYM_NUM];
+    size_t bytesRead, tokenTotal, outLen;
+    unsigned char paramBuf[2];
+    uint32_t blockLen, outLen32;
+    int windowLog, ret = -1;
+
+    assert(src != NULL);
+    assert(dest != NULL);
+    assert(params != NULL);
+
+    //  A smaller window within the memory budget, it is in the header, so
+    // the decoder needs less too
+    windowLog = params->windowLog;
+    while (windowLog > LZ_MIN_WINDOW_LOG && encMem(windowLog) > memAvail())
+        windowLog--;
+    if (memCheck(encMem(windowLog), "lz") < 0)
+        return -1;
+
+    enc.winSize = (uint32_t) 1 << windowLog;
+    enc.winMask = enc.winSize - 1;
+    enc.hashBits = windowLog + 1;
+    if (enc.hashBits > 20)
+        enc.hashBits = 20;
+    enc.levelPtr = &lzLevels[params->level];
+    enc.dataLen = enc.next = 0;
+
+    //  The window holds between winSize and 2 * winSize bytes of history
+    // after a slide, plus a block.
+    enc.winCap = 2 * (size_t) enc.winSize + LZ_BLOCK_SIZE;
+    enc.win = memAlloc(enc.winCap);
+    enc.head = memAlloc(sizeof(*enc.head) << enc.hashBits);
+    enc.prev = memAlloc(sizeof(*enc.prev) * enc.winSize);
+    enc.tokens = memAlloc(sizeof(*enc.tokens) * LZ_BLOCK_SIZE);
+    enc.out = memAlloc(LZ_OUT_SIZE);
+    if (!enc.win || !enc.head || !enc.prev || !enc.tokens || !enc.out) {
+        reportError("malloc");
+        freeEnc(&enc);
+        return -1;
+    }
+
+    memset(enc.head, 0xFF, sizeof(*enc.head) << enc.hashBits);
+    memset(enc.prev, 0xFF, sizeof(*enc.prev) * enc.winSize);
+
+    paramBuf[0] = windowLog;
+    paramBuf[1] = params->level;
+    if (writeBytes(dest, paramBuf, sizeof(paramBuf)) < 0)
+        goto out;
+
+    do {
+        slideEncWindow(&enc);
+
+        bytesRead = fread(enc.win + enc.dataLen, 1, LZ_BLOCK_SIZE, src);
+        if (ferror(src)) {
+            reportError("fread");
+            goto out;
+        }
+        if (bytesRead == 0)
+            break;
+
+        tokenTotal = parseBlock(&enc, enc.dataLen, enc.dataLen + bytesRead,
+                                llFreqs, distFreqs);
+        enc.dataLen += bytesRead;
+
+        if (initCompressionTable(&llTable, llFreqs, LZ_LL_SYM_NUM) < 0 ||
+            initCompressionTable(&distTable, distFreqs, LZ_DIST_SYM_NUM) < 0)
+            goto out;
+
+        outLen = encodeBlock(&enc, tokenTotal, &llTable, &distTable);
+
+        blockLen = bytesRead;
+        outLen32 = outLen;
+        if (writeBytes(dest, &blockLen, sizeof(blockLen)) < 0 ||
+            writeCodeLens(dest, &llTable, LZ_LL_SYM_NUM) < 0 ||
+            writeCodeLens(dest, &distTable, LZ_DIST_SYM_NUM) < 0 ||
+            writeBytes(dest, &outLen32, sizeof(outLen32)) < 0 ||
+            writeBytes(dest, enc.out, outLen) < 0)
+            goto out;
+    } while (!feof(src));
+
+    // The empty block ends the data
+    blockLen = 0;
+    if (writeBytes(dest, &blockLen, sizeof(blockLen)) < 0)
+        goto out;
+
+    ret = 0;
+out:
+    freeEnc(&enc);
+
+    return ret;
+}
+
+// decodeBlock(): Decodes blockLen bytes from br to win + start.
+static int decodeBlock(bitReaderT *br, const decompTableT *llTablePtr,
+                       const decompTableT *distTablePtr, unsigned char *win,
+                       uint32_t start, uint32_t blockLen) {
+    uint32_t pos = start, end = start + blockLen;
+    uint32_t len, dist;
+    unsigned int idx;
+    int sym, extraBits;
+
+    while (pos < end) {
+        refill(br);
+
+        idx = peekBits(br, MAX_CODELEN);
+        sym = llTablePtr->symbols[idx];
+        skipBits(br, llTablePtr->codeLens[idx]);
+
+        if (sym < LZ_LEN_BASE) {
+            win[pos++] = sym;
+            continue;
+        }
+
+        if (sym >= LZ_LL_SYM_NUM)
+            goto malformed;
+
+        len = bucketBase(sym - LZ_LEN_BASE, &extraBits) + LZ_MIN_MATCH;
+        if (extraBits)
+            len += getBits(br, extraBits);
+
+        refill(br);
+
+        idx = peekBits(br, MAX_CODELEN);
+        sym = distTablePtr->symbols[idx];
+        skipBits(br, distTablePtr->codeLens[idx]);
+        if (sym >= LZ_DIST_SYM_NUM)
+            goto malformed;
+
+        dist = bucketBase(sym, &extraBits) + 1;
+        if (extraBits)
+            dist += getBits(br, extraBits);
+
+        if (dist > pos || len > end - pos)
+            goto malformed;
+
+        // Overlapping matches repeat the last dist bytes
+        if (dist >= len)
+            memcpy(win + pos, win + pos - dist, len);
+        else
+            for (uint32_t k = 0; k < len; k++)
+                win[pos + k] = win[pos + k - dist];
+        pos += len;
+    }
+
+    return 0;
+
+malformed:
+    fprintf(stderr, "%s:%d: Malformed LZ data.\n", __FILE__, __LINE__);
+    return -1;
+}
+
+int lzDecompress(FILE *src, FILE *dest, uint64_t origSize) {
+    unsigned char paramBuf[2];
+    unsigned char *win = NULL, *in = NULL;
+    size_t winCap;
+    uint32_t winSize, dataLen = 0, blockLen, inLen, shift;
+    int llLens[LZ_LL_SYM_NUM], distLens[LZ_DIST_SYM_NUM];
+    decompTableT llTable, distTable;
+    bitReaderT br;
+    uint64_t total = 0;
+    int ret = -1;
+
+    assert(src != NULL);
+    assert(dest != NULL);
+
+    if (readBytes(src, paramBuf, sizeof(paramBuf)) < 0)
+        return -1;
+
+    if (paramBuf[0] < LZ_MIN_WINDOW_LOG || paramBuf[0] > LZ_MAX_WINDOW_LOG) {
+        fprintf(stderr, "%s:%d: Malformed LZ window size.\n", __FILE__,
+                __LINE__);
+        return -1;
+    }
+
+    winSize = (uint32_t) 1 << paramBuf[0];
+    winCap = 2 * (size_t) winSize + LZ_BLOCK_SIZE;
+    if (memCheck(winCap + LZ_OUT_SIZE + 8, "lz") < 0)
+        return -1;
+
+    // The encoded data is padded with 8 bytes, for the 8 byte refills
+    win = memAlloc(winCap);
+    in = memAlloc(LZ_OUT_SIZE + 8);
+    if (!win || !in) {
+        reportError("malloc");
+        goto out;
+    }
+
+    while (1) {
+        if (readBytes(src, &blockLen, sizeof(blockLen)) < 0)
+            goto out;
+        if (blockLen == 0)
+            break;
+
+        if (blockLen > LZ_BLOCK_SIZE) {
+            fprintf(stderr, "%s:%d: Malformed LZ block.\n", __FILE__,
+                    __LINE__);
+            goto out;
+        }
+
+        if (readCodeLens(src, llLens, LZ_LL_SYM_NUM) < 0 ||
+            readCodeLens(src, distLens, LZ_DIST_SYM_NUM) < 0)
+            goto out;
+
+        if (readBytes(src, &inLen, sizeof(inLen)) < 0)
+            goto out;
+        if (inLen > LZ_OUT_SIZE) {
+            fprintf(stderr, "%s:%d: Malformed LZ block.\n", __FILE__,
+                    __LINE__);
+            goto out;
+        }
+        if (readBytes(src, in, inLen) < 0)
+            goto out;
+        memset(in + inLen, 0, 8);
+
+        // Entries of incomplete codes are left at 0, a symbol of 0
+        // is always a valid literal
+        memset(&llTable, 0, sizeof(llTable));
+        memset(&distTable, 0, sizeof(distTable));
+        if (initDecompressionTable(&llTable, llLens, LZ_LL_SYM_NUM) < 0 ||
+            initDecompressionTable(&distTable, distLens, LZ_DIST_SYM_NUM) < 0)
+            goto out;
+
+        // Drop old history if the block does not fit, keeping at least
+        // winSize bytes, as in slideEncWindow()
+        if (dataLen + blockLen > winCap) {
+            shift = (dataLen - winSize) / winSize * winSize;
+            memmove(win, win + shift, dataLen - shift);
+            dataLen -= shift;
+        }
+
+        bitReaderInit(&br);
+        bitReaderFeed(&br, in, inLen + 8);
+        if (decodeBlock(&br, &llTable, &distTable, win, dataLen, blockLen) < 0)
+            goto out;
+
+        if (writeBytes(dest, win + dataLen, blockLen) < 0)
+            goto out;
+
+        dataLen += blockLen;
+        total += blockLen;
+    }
+
+    if (total != origSize) {
+        fprintf(stderr, "%s:%d: Malformed file error, %llu bytes instead of "
+                        "%llu.\n",
+                __FILE__, __LINE__, (unsigned long long) total,
+                (unsigned long long) origSize);
+        goto out;
+    }
+
+    ret = 0;
+out:
+    memFree(win);
+    memFree(in);
+
+    return ret;
+}
@@ -0,0 +1,218 @@
+#include "fg2019/mem.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+//  blockHeaderT: Comes before every block, for memFree() to know its size
+// and how it was allocated. Its size keeps the blocks aligned as malloc()
+// does.
+typedef struct {
+    _Alignas(16) size_t size;
+
+    // mapLen: Length of the mapping of a mapped block, 0 for malloc()
+    size_t mapLen;
+} blockHeaderT;
+
+// Bytes of a MiB, for the messages
+#define MIB ((size_t) 1 << 20)
+
+static size_t memCap = SIZE_MAX;
+static int memHugePages;
+
+// memUsed, memMax: Bytes allocated now, and at most
+static atomic_size_t memUsed, memMax;
+
+void memInit(size_t cap, int hugePages) {
+    memCap = cap ? cap : SIZE_MAX;
+    memHugePages = hugePages;
+}
+
+//  reserve(): Counts size more bytes as allocated, unless they go over the
+// budget.
+static int reserve(size_t size) {
+    size_t used = atomic_load(&memUsed), max;
+
+    do {
+        if (size > memCap - used) {
+            errno = ENOMEM;
+            return -1;
+        }
+    } while (!atomic_compare_exchange_weak(&memUsed, &used, used + size));
+
+    used += size;
+    max = atomic_load(&memMax);
+    while (used > max && !atomic_compare_exchange_weak(&memMax, &max, used))
+        ;
+
+    return 0;
+}
+
+static void release(size_t size) {
+    atomic_fetch_sub(&memUsed, size);
+}
+
+// mapBlock(): A block of its own mapping, for big blocks.
+static blockHeaderT *mapBlock(size_t total) {
+    size_t mapLen = (total + MEM_HUGE_MIN - 1) & ~(size_t) (MEM_HUGE_MIN - 1);
+    blockHeaderT *header;
+
+    header = mmap(NULL, mapLen, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (header == MAP_FAILED)
+        return NULL;
+
+    // Only advice, the block is as good without huge pages
+#ifdef MADV_HUGEPAGE
+    madvise(header, mapLen, MADV_HUGEPAGE);
+#endif
+
+    header->mapLen = mapLen;
+    return header;
+}
+
+void *memAlloc(size_t size) {
+    blockHeaderT *header;
+    size_t total = sizeof(*header) + size;
+
+    if (total < size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (reserve(size) < 0)
+        return NULL;
+
+    if (memHugePages && total >= MEM_HUGE_MIN)
+        header = mapBlock(total);
+    else {
+        header = malloc(total);
+        if (header)
+            header->mapLen = 0;
+    }
+
+    if (!header) {
+        release(size);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    header->size = size;
+    return header + 1;
+}
+
+void *memCalloc(size_t num, size_t size) {
+    void *ptr;
+
+    if (size && num > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    // Mappings are zeroed already
+    ptr = memAlloc(num * size);
+    if (ptr && ((blockHeaderT *) ptr - 1)->mapLen == 0)
+        memset(ptr, 0, num * size);
+
+    return ptr;
+}
+
+void *memRealloc(void *ptr, size_t size) {
+    blockHeaderT *header, *newHeader;
+    size_t oldSize;
+    void *newPtr;
+
+    if (!ptr)
+        return memAlloc(size);
+
+    header = (blockHeaderT *) ptr - 1;
+    oldSize = header->size;
+
+    //  Blocks from malloc() stay there, unless they grow into the size of
+    // mapped ones
+    if (header->mapLen == 0 &&
+        (!memHugePages || sizeof(*header) + size < MEM_HUGE_MIN)) {
+        if (size > oldSize && reserve(size - oldSize) < 0)
+            return NULL;
+
+        newHeader = realloc(header, sizeof(*header) + size);
+        if (!newHeader) {
+            if (size > oldSize)
+                release(size - oldSize);
+            errno = ENOMEM;
+            return NULL;
+        }
+
+        if (size < oldSize)
+            release(oldSize - size);
+        newHeader->size = size;
+        return newHeader + 1;
+    }
+
+    newPtr = memAlloc(size);
+    if (!newPtr)
+        return NULL;
+
+    memcpy(newPtr, ptr, oldSize < size ? oldSize : size);
+    memFree(ptr);
+
+    return newPtr;
+}
+
+void memFree(void *ptr) {
+    blockHeaderT *header;
+
+    if (!ptr)
+        return;
+
+    header = (blockHeaderT *) ptr - 1;
+    release(header->size);
+
+    if (header->mapLen)
+        munmap(header, header->mapLen);
+    else
+        free(header);
+}
+
+size_t memAvail(void) {
+    size_t used = atomic_load(&memUsed);
+
+    return used < memCap ? memCap - used : 0;
+}
+
+int memFitThreads(int threads, size_t perThread) {
+    size_t avail = memAvail();
+
+    if (perThread && (size_t) threads > avail / perThread)
+        threads = avail / perThread;
+
+    return threads < 1 ? 1 : threads;
+}
+
+int memCheck(size_t need, const char *name) {
+    size_t avail = memAvail();
+
+    if (need <= avail)
+        return 0;
+
+    fprintf(stderr, "%s needs at least %zu MiB of memory, %zu MiB are left "
+                    "within the budget.\n",
+            name, (need + MIB - 1) / MIB, avail / MIB);
+    errno = ENOMEM;
+    return -1;
+}
+
+size_t memPeak(void) {
+    return atomic_load(&memMax);
+}
+
+void memReport(void) {
+    fprintf(stderr, "Peak memory: %.1f MiB", memPeak() / 1048576.0);
+    if (memCap != SIZE_MAX)
+        fprintf(stderr, " of %.1f MiB", memCap / 1048576.0);
+    fprintf(stderr, ".\n");
+}
@@ -0,0 +1,442 @@
+#include "fg2019/pairs.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fg2019/bitio.h"
+#include "fg2019/coder.h"
+#include "fg2019/const.h"
+#include "fg2019/error.h"
+#include "fg2019/file.h"
+#include "fg2019/mem.h"
+
+// Size (in bytes) of the read and write buffers
+#define PAIRS_BUF_SIZE (64 * 1024)
+
+// Number of byte pairs
+#define PAIR_NUM (1 << 16)
+
+//  The bytes, their number (0 for the EOF symbol) and the code length of an
+// entry of the decoding table, which gives every symbol without a second
+// lookup for the bytes of pairs.
+#define ENTRY_COUNT_SHIFT 16
+#define ENTRY_LEN_SHIFT 20
+
+// pairsBufsT: The buffers of compression.
+typedef struct {
+    unsigned char readBuf[PAIRS_BUF_SIZE];
+
+    // syms: The symbols of readBuf, and the byte held over from before it.
+    uint16_t syms[PAIRS_BUF_SIZE + 1];
+
+    unsigned char writeBuf[ENCODE_BOUND(PAIRS_BUF_SIZE + 1)];
+} pairsBufsT;
+
+// pairCountT: A pair and the number of times it was seen.
+typedef struct {
+    size_t count;
+    unsigned int pair;
+} pairCountT;
+
+//  countPairs(): Counts the bytes and the byte pairs of src. In runs of a
+// byte, only every other pair is counted, as only those could be
+// substituted.
+static int countPairs(FILE *src, unsigned char *buf, size_t *byteCounts,
+                      size_t *pairCounts) {
+    size_t bytesRead;
+    unsigned int pair, lastPair = PAIR_NUM;
+    int prev = -1;
+
+    do {
+        bytesRead = fread(buf, 1, PAIRS_BUF_SIZE, src);
+        if (ferror(src)) {
+            reportError("fread");
+            return -1;
+        }
+
+        for (size_t k = 0; k < bytesRead; k++) {
+            byteCounts[buf[k]]++;
+            if (prev >= 0) {
+                pair = prev << CHAR_BIT | buf[k];
+                if (pair == lastPair)
+                    lastPair = PAIR_NUM;
+                else {
+                    pairCounts[pair]++;
+                    lastPair = pair;
+                }
+            }
+            prev = buf[k];
+        }
+    } while (!feof(src));
+
+    return 0;
+}
+
+// comparePairCounts(): Most frequent first, then in the order of the pairs.
+static int comparePairCounts(const void *a, const void *b) {
+    const pairCountT *first = a, *second = b;
+
+    if (first->count != second->count)
+        return first->count < second->count ? 1 : -1;
+
+    return first->pair < second->pair ? -1 : first->pair > second->pair;
+}
+
+//  choosePairs(): The PAIRS_MAX most frequent pairs, of those seen
+// PAIRS_MIN_COUNT times at least. Returns their number, or -1 on errors.
+static int choosePairs(const size_t *pairCounts, unsigned char *pairs) {
+    pairCountT *candidates;
+    size_t candidateTotal = 0;
+    int pairTotal;
+
+    candidates = memAlloc(sizeof(*candidates) * PAIR_NUM);
+    if (!candidates) {
+        reportError("malloc");
+        return -1;
+    }
+
+    for (unsigned int pair = 0; pair < PAIR_NUM; pair++)
+        if (pairCounts[pair] >= PAIRS_MIN_COUNT) {
+            candidates[candidateTotal].count = pairCounts[pair];
+            candidates[candidateTotal].pair = pair;
+            candidateTotal++;
+        }
+
+    qsort(candidates, candidateTotal, sizeof(*candidates), comparePairCounts);
+
+    pairTotal = candidateTotal < PAIRS_MAX ? candidateTotal : PAIRS_MAX;
+    for (int k = 0; k < pairTotal; k++) {
+        pairs[2 * k] = candidates[k].pair >> CHAR_BIT;
+        pairs[2 * k + 1] = candidates[k].pair;
+    }
+
+    memFree(candidates);
+
+    return pairTotal;
+}
+
+//  readSyms(): Reads a buffer of src and turns it into symbols, greedily. The
+// last byte is held over in *pendingPtr (-1 for none) until the byte after it
+// is read, and given as a symbol of its own at the end of src.
+static int readSyms(FILE *src, const uint16_t *pairTable, int *pendingPtr,
+                    pairsBufsT *bufs, size_t *symTotalPtr) {
+    size_t bytesRead, n = 0;
+    int pending = *pendingPtr;
+    uint16_t sym;
+
+    bytesRead = fread(bufs->readBuf, 1, PAIRS_BUF_SIZE, src);
+    if (ferror(src)) {
+        reportError("fread");
+        return -1;
+    }
+
+    for (size_t k = 0; k < bytesRead; k++) {
+        if (pending < 0) {
+            pending = bufs->readBuf[k];
+            continue;
+        }
+
+        sym = pairTable[pending << CHAR_BIT | bufs->readBuf[k]];
+        if (sym) {
+            bufs->syms[n++] = sym;
+            pending = -1;
+        }
+        else {
+            bufs->syms[n++] = pending;
+            pending = bufs->readBuf[k];
+        }
+    }
+
+    if (feof(src) && pending >= 0) {
+        bufs->syms[n++] = pending;
+        pending = -1;
+    }
+
+    *pendingPtr = pending;
+    *symTotalPtr = n;
+
+    return 0;
+}
+
+// codedSize(): The bytes of the symbols of freqs coded with the table.
+static uint64_t codedSize(const compTableT *compTablePtr, const size_t *freqs,
+                          int symNum) {
+    uint64_t bits = 0;
+
+    for (int s = 0; s < symNum; s++)
+        bits += freqs[s] * compTablePtr->lens[s];
+
+    return (bits + CHAR_BIT - 1) / CHAR_BIT;
+}
+
+// rewindSrc(): Goes back to the start of src, for the next pass.
+static int rewindSrc(FILE *src) {
+    if (fseek(src, 0, SEEK_SET) == -1) {
+        reportError("fseek");
+        return -1;
+    }
+
+    return 0;
+}
+
+int pairsCompress(FILE *src, FILE *dest) {
+    unsigned char pairs[2 * PAIRS_MAX], pairByte;
+    size_t byteCounts[SYM_NUM] = {0}, freqs[MAX_SYM_NUM] = {0}, symTotal;
+    compTableT compTable, byteTable;
+    pairsBufsT *bufs;
+    size_t *pairCounts;
+    uint16_t *pairTable;
+    uint64_t compSize = 0;
+    bitWriterT bw;
+    int pairTotal, symNum, pending = -1, ret = -1;
+
+    assert(src != NULL);
+    assert(dest != NULL);
+
+    bufs = memAlloc(sizeof(*bufs));
+    pairCounts = memCalloc(PAIR_NUM, sizeof(*pairCounts));
+    pairTable = memCalloc(PAIR_NUM, sizeof(*pairTable));
+    if (!bufs || !pairCounts || !pairTable) {
+        reportError("malloc");
+        goto out;
+    }
+
+    if (countPairs(src, bufs->readBuf, byteCounts, pairCounts) < 0)
+        goto out;
+
+    pairTotal = choosePairs(pairCounts, pairs);
+    if (pairTotal < 0)
+        goto out;
+
+    for (int k = 0; k < pairTotal; k++)
+        pairTable[pairs[2 * k] << CHAR_BIT | pairs[2 * k + 1]] = SYM_NUM + k;
+    symNum = SYM_NUM + pairTotal;
+
+    // The frequencies of the symbols, after the substitution
+    if (rewindSrc(src) < 0)
+        goto out;
+
+    do {
+        if (readSyms(src, pairTable, &pending, bufs, &symTotal) < 0)
+            goto out;
+
+        for (size_t k = 0; k < symTotal; k++)
+            freqs[bufs->syms[k]]++;
+    } while (!feof(src));
+
+    freqs[EOF_VAL] = 1;
+    if (initCompressionTable(&compTable, freqs, symNum) < 0)
+        goto out;
+
+    compSize = codedSize(&compTable, freqs, symNum) + 3 * pairTotal;
+
+    //  Without pairs if they do not pay for themselves (in data whose bytes
+    // are about independent, such as random or already compressed data)
+    byteCounts[EOF_VAL] = 1;
+    if (initCompressionTable(&byteTable, byteCounts, SYM_NUM) < 0)
+        goto out;
+
+    if (codedSize(&byteTable, byteCounts, SYM_NUM) <= compSize) {
+        pairTotal = 0;
+        symNum = SYM_NUM;
+        memset(pairTable, 0, PAIR_NUM * sizeof(*pairTable));
+        memcpy(freqs, byteCounts, sizeof(byteCounts));
+        compTable = byteTable;
+    }
+
+    compSize = codedSize(&compTable, freqs, symNum);
+
+    pairByte = pairTotal;
+    if (writeBytes(dest, &pairByte, 1) < 0 ||
+        writeBytes(dest, pairs, 2 * pairTotal) < 0 ||
+        writeCodeLens(dest, &compTable, symNum) < 0 ||
+        writeBytes(dest, &compSize, sizeof(compSize)) < 0)
+        goto out;
+
+    if (rewindSrc(src) < 0)
+        goto out;
+
+    bitWriterInit(&bw, bufs->writeBuf);
+
+    do {
+        if (readSyms(src, pairTable, &pending, bufs, &symTotal) < 0)
+            goto out;
+
+        for (size_t k = 0; k < symTotal; k++)
+            putBits(&bw, compTable.vals[bufs->syms[k]],
+                    compTable.lens[bufs->syms[k]]);
+        if (feof(src))
+            encodeEOF(&bw, &compTable);
+
+        if (writeBytes(dest, bufs->writeBuf, bw.ptr - bufs->writeBuf) < 0)
+            goto out;
+        bw.ptr = bufs->writeBuf;
+    } while (!feof(src));
+
+    ret = 0;
+out:
+    memFree(bufs);
+    memFree(pairCounts);
+    memFree(pairTable);
+
+    return ret;
+}
+
+//  pairsDecodeSyms(): Same as decodeSyms() (see coder.h), with a symbol
+// giving one or two bytes. Stops before a pair that does not fit in out.
+static size_t pairsDecodeSyms(bitReaderT *br, const uint32_t *entries,
+                              unsigned char *out, size_t outCap, int final,
+                              int *donePtr) {
+    size_t n = 0;
+    uint32_t entry;
+    int len, count;
+
+    *donePtr = 0;
+
+    //  Fast path, 4 codes per refill as in decodeSyms(), with both bytes of
+    // every entry stored, whatever its count
+    while (outCap - n >= 8 && br->end - br->ptr >= 8) {
+        refill(br);
+
+        for (int k = 0; k < 4; k++) {
+            entry = entries[peekBits(br, MAX_CODELEN)];
+            skipBits(br, entry >> ENTRY_LEN_SHIFT);
+            count = entry >> ENTRY_COUNT_SHIFT & 3;
+            if (!count) {
+                *donePtr = 1;
+                return n;
+            }
+
+            out[n] = entry;
+            out[n + 1] = entry >> CHAR_BIT;
+            n += count;
+        }
+    }
+
+    while (n < outCap) {
+        refill(br);
+
+        entry = entries[peekBits(br, MAX_CODELEN)];
+        len = entry >> ENTRY_LEN_SHIFT;
+        if (len > br->count && !final)
+            break;
+
+        count = entry >> ENTRY_COUNT_SHIFT & 3;
+        if ((size_t) count > outCap - n)
+            break;
+
+        skipBits(br, len);
+        if (br->count < 0)
+            br->count = 0;
+        if (!count) {
+            *donePtr = 1;
+            break;
+        }
+
+        out[n] = entry;
+        if (count == 2)
+            out[n + 1] = entry >> CHAR_BIT;
+        n += count;
+    }
+
+    return n;
+}
+
+int pairsDecompress(FILE *src, FILE *dest, uint64_t origSize) {
+    unsigned char pairs[2 * PAIRS_MAX], pairByte;
+    int codeLens[MAX_SYM_NUM];
+    uint32_t entries[DECOMP_SIZE];
+    decompTableT decompTable;
+    unsigned char *readBuf = NULL, *writeBuf = NULL;
+    uint64_t compSize, remaining, total = 0;
+    size_t toRead, outCap, wLen;
+    bitReaderT br;
+    int symNum, sym, final = 0, done = 0, ret = -1;
+
+    assert(src != NULL);
+    assert(dest != NULL);
+
+    if (readBytes(src, &pairByte, 1) < 0 ||
+        readBytes(src, pairs, 2 * pairByte) < 0)
+        return -1;
+
+    symNum = SYM_NUM + pairByte;
+    if (readCodeLens(src, codeLens, symNum) < 0)
+        return -1;
+
+    memset(&decompTable, 0, sizeof(decompTable));
+    if (initDecompressionTable(&decompTable, codeLens, symNum) < 0)
+        return -1;
+
+    for (int k = 0; k < DECOMP_SIZE; k++) {
+        sym = decompTable.symbols[k];
+        entries[k] = (uint32_t) decompTable.codeLens[k] << ENTRY_LEN_SHIFT;
+        if (sym < EOF_VAL)
+            entries[k] |= sym | 1 << ENTRY_COUNT_SHIFT;
+        else if (sym > EOF_VAL)
+            entries[k] |= pairs[2 * (sym - SYM_NUM)] |
+                          pairs[2 * (sym - SYM_NUM) + 1] << CHAR_BIT |
+                          2 << ENTRY_COUNT_SHIFT;
+    }
+
+    if (readBytes(src, &compSize, sizeof(compSize)) < 0)
+        return -1;
+
+    readBuf = memAlloc(PAIRS_BUF_SIZE);
+    writeBuf = memAlloc(PAIRS_BUF_SIZE);
+    if (!readBuf || !writeBuf) {
+        reportError("malloc");
+        goto out;
+    }
+
+    remaining = compSize;
+    bitReaderInit(&br);
+
+    while (!done) {
+        if (br.ptr == br.end && !final) {
+            toRead = remaining < PAIRS_BUF_SIZE ? remaining : PAIRS_BUF_SIZE;
+            if (readBytes(src, readBuf, toRead) < 0)
+                goto out;
+
+            remaining -= toRead;
+            final = (remaining == 0);
+            bitReaderFeed(&br, readBuf, toRead);
+        }
+
+        //  Two bytes more than origSize allows are enough to tell a malformed
+        // file, which could otherwise decode forever, and leave room for a
+        // pair
+        outCap = PAIRS_BUF_SIZE;
+        if (origSize - total < outCap - 1)
+            outCap = origSize - total + 2;
+
+        wLen = pairsDecodeSyms(&br, entries, writeBuf, outCap, final, &done);
+        total += wLen;
+        if (total > origSize) {
+            fprintf(stderr, "%s:%d: Malformed file error, more than %llu "
+                            "bytes.\n",
+                    __FILE__, __LINE__, (unsigned long long) origSize);
+            goto out;
+        }
+
+        if (writeBytes(dest, writeBuf, wLen) < 0)
+            goto out;
+    }
+
+    if (total != origSize) {
+        fprintf(stderr, "%s:%d: Malformed file error, %llu bytes instead of "
+                        "%llu.\n",
+                __FILE__, __LINE__, (unsigned long long) total,
+                (unsigned long long) origSize);
+        goto out;
+    }
+
+    ret = 0;
+out:
+    memFree(readBuf);
+    memFree(writeBuf);
+
+    return ret;
+}
@@ -0,0 +1,437 @@
+#include "fg2019/pipeline.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "fg2019/bitio.h"
+#include "fg2019/coder.h"
+#include "fg2019/codes.h"
+#include "fg2019/const.h"
+#include "fg2019/error.h"
+#include "fg2019/ring.h"
+
+// Size (in bytes) of the buffers passed between stages
+#define PIPE_BUF_SIZE (64 * 1024)
+
+// Number of buffers of every link, the more of them, the more a fast stage
+// can get ahead of a slow one before waiting.
+#define PIPE_BUF_TOTAL 8
+
+// Number of times an empty ring is polled before yielding the CPU.
+#define SPIN_LIMIT 64
+
+// Maximum number of stages of a pipeline.
+#define MAX_STAGES 4
+
+// pipelineT: State shared by all of the stages of a pipeline.
+typedef struct {
+    // failed: Set by a stage that failed, so that the others stop
+    //  waiting for buffers that will never arrive.
+    _Atomic int failed;
+} pipelineT;
+
+// stageT: The arguements of a stage thread, only the ones relevant to the
+//  stage are used.
+typedef struct {
+    pipelineT *pipe;
+    FILE *file;
+
+    // in, out: The links to the previous and the next stage.
+    pipeLinkT *in;
+    pipeLinkT *out;
+
+    // limit: Bytes to be read by the reader (SIZE_MAX for all of them).
+    size_t limit;
+
+    size_t *freqs;
+    const compTableT *compTablePtr;
+    const decompTableT *decompTablePtr;
+} stageT;
+
+typedef void *(*stageFuncT)(void *);
+
+static inline void fail(pipelineT *pipe) {
+    atomic_store(&pipe->failed, 1);
+}
+
+// waitPop(): Pops a buffer from the ring, waiting until there is one.
+//  Returns NULL if a stage of the pipeline failed in the meantime.
+static pipeBufT *waitPop(ringT *ringPtr, pipelineT *pipe) {
+    pipeBufT *buf;
+    int spins = 0;
+
+    while (!(buf = ringPop(ringPtr))) {
+        if (atomic_load_explicit(&pipe->failed, memory_order_relaxed))
+            return NULL;
+
+        if (++spins >= SPIN_LIMIT) {
+            sched_yield();
+            spins = 0;
+        }
+    }
+
+    return buf;
+}
+
+// readerStage(): Reads stage->limit bytes (or until the end-of-file) to
+//  the buffers of the out link.
+static void *readerStage(void *arg) {
+    stageT *stage = arg;
+    pipeBufT *buf;
+    size_t remaining = stage->limit, toRead;
+    int last;
+
+    do {
+        buf = waitPop(&stage->out->freeRing, stage->pipe);
+        if (!buf)
+            return NULL;
+
+        toRead = stage->out->bufSize < remaining ? stage->out->bufSize
+                                                 : remaining;
+        buf->len = fread(buf->data, 1, toRead, stage->file);
+        if (ferror(stage->file)) {
+            reportError("fread");
+            fail(stage->pipe);
+            return NULL;
+        }
+
+        // A limited read must find all of the bytes it was promised
+        if (stage->limit != SIZE_MAX && buf->len < toRead) {
+            fprintf(stderr,
+                    "%s:%d: Malformed file error, less data than promised.\n",
+                    __FILE__, __LINE__);
+            fail(stage->pipe);
+            return NULL;
+        }
+
+        remaining -= buf->len;
+        last = buf->last = (remaining == 0 || feof(stage->file));
+        ringPush(&stage->out->fullRing, buf);
+    } while (!last);
+
+    return NULL;
+}
+
+// histStage(): Counts the symbols of the buffers of the in link.
+static void *histStage(void *arg) {
+    stageT *stage = arg;
+    size_t *freqs = stage->freqs;
+    pipeBufT *buf;
+    int last;
+
+    memset(freqs, 0, sizeof(freqs[0]) * SYM_NUM);
+
+    do {
+        buf = waitPop(&stage->in->fullRing, stage->pipe);
+        if (!buf)
+            return NULL;
+
+        for (size_t k = 0; k < buf->len; k++)
+            freqs[buf->data[k]]++;
+
+        last = buf->last;
+        ringPush(&stage->in->freeRing, buf);
+    } while (!last);
+
+    // The special EOF symbol appears once, as in countSyms()
+    freqs[EOF_VAL] = 1;
+
+    return NULL;
+}
+
+// encodeStage(): Encodes the buffers of the in link to the buffers
+//  of the out link, ending the stream with the EOF symbol.
+static void *encodeStage(void *arg) {
+    stageT *stage = arg;
+    size_t cap = stage->out->bufSize;
+    pipeBufT *in, *out;
+    bitWriterT bw;
+    size_t pos, room, chunk;
+    int last;
+
+    out = waitPop(&stage->out->freeRing, stage->pipe);
+    if (!out)
+        return NULL;
+    bitWriterInit(&bw, out->data);
+
+    do {
+        in = waitPop(&stage->in->fullRing, stage->pipe);
+        if (!in)
+            return NULL;
+
+        pos = 0;
+        while (pos < in->len) {
+            //  chunk: The number of symbols that surely fit in the room
+            // left, see ENCODE_BOUND().
+            room = cap - (bw.ptr - out->data);
+            chunk = room > 2 ? (room - 2) * CHAR_BIT / MAX_CODELEN : 0;
+
+            if (chunk == 0) {
+                out->len = bw.ptr - out->data;
+                out->last = 0;
+                ringPush(&stage->out->fullRing, out);
+
+                out = waitPop(&stage->out->freeRing, stage->pipe);
+                if (!out)
+                    return NULL;
+                bw.ptr = out->data;
+                continue;
+            }
+
+            if (chunk > in->len - pos)
+                chunk = in->len - pos;
+
+            encodeSyms(&bw, stage->compTablePtr, in->data + pos, chunk);
+            pos += chunk;
+        }
+
+        last = in->last;
+        ringPush(&stage->in->freeRing, in);
+    } while (!last);
+
+    if (cap - (bw.ptr - out->data) < ENCODE_BOUND(1)) {
+        out->len = bw.ptr - out->data;
+        out->last = 0;
+        ringPush(&stage->out->fullRing, out);
+
+        out = waitPop(&stage->out->freeRing, stage->pipe);
+        if (!out)
+            return NULL;
+        bw.ptr = out->data;
+    }
+
+    encodeEOF(&bw, stage->compTablePtr);
+    out->len = bw.ptr - out->data;
+    out->last = 1;
+    ringPush(&stage->out->fullRing, out);
+
+    return NULL;
+}
+
+// decodeStage(): Decodes the buffers of the in link to the buffers of
+//  the out link, until the EOF symbol is found.
+static void *decodeStage(void *arg) {
+    stageT *stage = arg;
+    size_t cap = stage->out->bufSize;
+    pipeBufT *in, *out;
+    bitReaderT br;
+    int last = 0, done = 0;
+
+    out = waitPop(&stage->out->freeRing, stage->pipe);
+    if (!out)
+        return NULL;
+    out->len = 0;
+    bitReaderInit(&br);
+
+    while (!done) {
+        in = waitPop(&stage->in->fullRing, stage->pipe);
+        if (!in)
+            return NULL;
+
+        last = in->last;
+        bitReaderFeed(&br, in->data, in->len);
+
+        //  decodeSyms() returns either when the output buffer is full,
+        // when the EOF symbol is found, or when the input buffer is used
+        // up (never for the last one).
+        while (1) {
+            out->len += decodeSyms(&br, stage->decompTablePtr,
+                                   out->data + out->len, cap - out->len,
+                                   last, &done);
+            if (done || out->len < cap)
+                break;
+
+            out->last = 0;
+            ringPush(&stage->out->fullRing, out);
+
+            out = waitPop(&stage->out->freeRing, stage->pipe);
+            if (!out)
+                return NULL;
+            out->len = 0;
+        }
+
+        ringPush(&stage->in->freeRing, in);
+
+        // The last buffer used up without the EOF symbol
+        if (last && !done) {
+            fprintf(stderr, "%s:%d: Malformed file error, no EOF symbol.\n",
+                    __FILE__, __LINE__);
+            fail(stage->pipe);
+            return NULL;
+        }
+    }
+
+    // Let the reader finish, even if the EOF symbol came early
+    while (!last) {
+        in = waitPop(&stage->in->fullRing, stage->pipe);
+        if (!in)
+            return NULL;
+
+        last = in->last;
+        ringPush(&stage->in->freeRing, in);
+    }
+
+    out->last = 1;
+    ringPush(&stage->out->fullRing, out);
+
+    return NULL;
+}
+
+// writerStage(): Writes the buffers of the in link to the file.
+static void *writerStage(void *arg) {
+    stageT *stage = arg;
+    pipeBufT *buf;
+    size_t written;
+    int last;
+
+    do {
+        buf = waitPop(&stage->in->fullRing, stage->pipe);
+        if (!buf)
+            return NULL;
+
+        written = fwrite(buf->data, 1, buf->len, stage->file);
+        if (written < buf->len) {
+            reportError("fwrite");
+            fail(stage->pipe);
+            return NULL;
+        }
+
+        last = buf->last;
+        ringPush(&stage->in->freeRing, buf);
+    } while (!last);
+
+    return NULL;
+}
+
+// runStages(): Runs every stage on its own thread and waits for all of
+//  them to finish.
+static int runStages(pipelineT *pipe, stageFuncT funcs[], stageT stages[],
+                     int stageTotal) {
+    pthread_t threads[MAX_STAGES];
+    int started;
+
+    assert(stageTotal <= MAX_STAGES);
+
+    for (started = 0; started < stageTotal; started++) {
+        errno = pthread_create(&threads[started], NULL, funcs[started],
+                               &stages[started]);
+        if (errno) {
+            reportError("pthread_create");
+            fail(pipe);
+            break;
+        }
+    }
+
+    for (int k = 0; k < started; k++)
+        pthread_join(threads[k], NULL);
+
+    return atomic_load(&pipe->failed) ? -1 : 0;
+}
+
+int countSymsPipelined(FILE *src, size_t freqs[SYM_NUM]) {
+    pipelineT pipe;
+    pipeLinkT link;
+    stageT stages[2] = {0};
+    stageFuncT funcs[2] = {readerStage, histStage};
+    int ret;
+
+    assert(src != NULL);
+
+    if (pipeLinkInit(&link, PIPE_BUF_TOTAL, PIPE_BUF_SIZE) < 0)
+        return -1;
+    atomic_init(&pipe.failed, 0);
+
+    stages[0].pipe = stages[1].pipe = &pipe;
+    stages[0].file = src;
+    stages[0].limit = SIZE_MAX;
+    stages[0].out = stages[1].in = &link;
+    stages[1].freqs = freqs;
+
+    ret = runStages(&pipe, funcs, stages, 2);
+
+    pipeLinkFree(&link);
+
+    return ret;
+}
+
+int compressPipelined(FILE *src, FILE *dest, const compTableT *compTablePtr) {
+    pipelineT pipe;
+    pipeLinkT links[2];
+    stageT stages[3] = {0};
+    stageFuncT funcs[3] = {readerStage, encodeStage, writerStage};
+    int ret;
+
+    assert(src != NULL);
+    assert(dest != NULL);
+    assert(compTablePtr != NULL);
+
+    if (pipeLinkInit(&links[0], PIPE_BUF_TOTAL, PIPE_BUF_SIZE) < 0)
+        return -1;
+    if (pipeLinkInit(&links[1], PIPE_BUF_TOTAL, PIPE_BUF_SIZE) < 0) {
+        pipeLinkFree(&links[0]);
+        return -1;
+    }
+    atomic_init(&pipe.failed, 0);
+
+    for (int k = 0; k < 3; k++)
+        stages[k].pipe = &pipe;
+
+    stages[0].file = src;
+    stages[0].limit = SIZE_MAX;
+    stages[0].out = stages[1].in = &links[0];
+    stages[1].compTablePtr = compTablePtr;
+    stages[1].out = stages[2].in = &links[1];
+    stages[2].file = dest;
+
+    ret = runStages(&pipe, funcs, stages, 3);
+
+    pipeLinkFree(&links[0]);
+    pipeLinkFree(&links[1]);
+
+    return ret;
+}
+
+int decompressPipelined(FILE *src, FILE *dest,
+                        const decompTableT *decompTablePtr, size_t compSize) {
+    pipelineT pipe;
+    pipeLinkT links[2];
+    stageT stages[3] = {0};
+    stageFuncT funcs[3] = {readerStage, decodeStage, writerStage};
+    int ret;
+
+    assert(src != NULL);
+    assert(dest != NULL);
+    assert(decompTablePtr != NULL);
+
+    if (pipeLinkInit(&links[0], PIPE_BUF_TOTAL, PIPE_BUF_SIZE) < 0)
+        return -1;
+    if (pipeLinkInit(&links[1], PIPE_BUF_TOTAL, PIPE_BUF_SIZE) < 0) {
+        pipeLinkFree(&links[0]);
+        return -1;
+    }
+    atomic_init(&pipe.failed, 0);
+
+    for (int k = 0; k < 3; k++)
+        stages[k].pipe = &pipe;
+
+    // Only the compressed data is read, so that src is left right after it
+    stages[0].file = src;
+    stages[0].limit = compSize;
+    stages[0].out = stages[1].in = &links[0];
+    stages[1].decompTablePtr = decompTablePtr;
+    stages[1].out = stages[2].in = &links[1];
+    stages[2].file = dest;
+
+    ret = runStages(&pipe, funcs, stages, 3);
+
+    pipeLinkFree(&links[0]);
+    pipeLinkFree(&links[1]);
+
+    return ret;
+}
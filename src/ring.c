@@ -0,0 +1,86 @@
+#include "fg2019/ring.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "fg2019/error.h"
+#include "fg2019/mem.h"
+
+int ringInit(ringT *ringPtr, size_t capacity) {
+    size_t size = 1;
+
+    assert(ringPtr != NULL);
+    assert(capacity > 0);
+
+    // Round the capacity up to a power of two, so that positions can be
+    // wrapped with a mask
+    while (size < capacity)
+        size <<= 1;
+
+    ringPtr->slots = memAlloc(sizeof(*ringPtr->slots) * size);
+    if (!ringPtr->slots) {
+        reportError("malloc");
+        return -1;
+    }
+
+    ringPtr->mask = size - 1;
+    atomic_init(&ringPtr->head, 0);
+    atomic_init(&ringPtr->tail, 0);
+
+    return 0;
+}
+
+void ringFree(ringT *ringPtr) {
+    assert(ringPtr != NULL);
+
+    memFree(ringPtr->slots);
+    ringPtr->slots = NULL;
+}
+
+int pipeLinkInit(pipeLinkT *linkPtr, int bufTotal, size_t bufSize) {
+    assert(linkPtr != NULL);
+    assert(bufTotal > 0);
+    assert(bufSize > 0);
+
+    linkPtr->bufSize = bufSize;
+    linkPtr->bufs = memAlloc(sizeof(*linkPtr->bufs) * bufTotal);
+    linkPtr->mem = memAlloc(bufSize * bufTotal);
+    if (!linkPtr->bufs || !linkPtr->mem) {
+        reportError("malloc");
+        memFree(linkPtr->bufs);
+        memFree(linkPtr->mem);
+        return -1;
+    }
+
+    if (ringInit(&linkPtr->freeRing, bufTotal) < 0) {
+        memFree(linkPtr->bufs);
+        memFree(linkPtr->mem);
+        return -1;
+    }
+
+    if (ringInit(&linkPtr->fullRing, bufTotal) < 0) {
+        ringFree(&linkPtr->freeRing);
+        memFree(linkPtr->bufs);
+        memFree(linkPtr->mem);
+        return -1;
+    }
+
+    // All of the buffers are free initially
+    for (int k = 0; k < bufTotal; k++) {
+        linkPtr->bufs[k].data = linkPtr->mem + k * bufSize;
+        linkPtr->bufs[k].len = 0;
+        linkPtr->bufs[k].last = 0;
+        ringPush(&linkPtr->freeRing, &linkPtr->bufs[k]);
+    }
+
+    return 0;
+}
+
+void pipeLinkFree(pipeLinkT *linkPtr) {
+    assert(linkPtr != NULL);
+
+    ringFree(&linkPtr->freeRing);
+    ringFree(&linkPtr->fullRing);
+    memFree(linkPtr->bufs);
+    memFree(linkPtr->mem);
+}
@@ -0,0 +1,192 @@
+#include "fg2019/sais.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fg2019/error.h"
+#include "fg2019/mem.h"
+
+//  saisTextT: A string to be sorted, either the bytes given to saisBytes()
+// (as values 1 to 256, with the sentinel 0 appended) or the names of the
+// LMS substrings of the level above, which already end with their unique
+// smallest name 0.
+typedef struct {
+    const unsigned char *bytes;
+    const int32_t *ints;
+    int32_t n;
+} saisTextT;
+
+static inline int32_t chr(const saisTextT *textPtr, int32_t i) {
+    if (textPtr->bytes)
+        return i == textPtr->n - 1 ? 0 : textPtr->bytes[i] + 1;
+    return textPtr->ints[i];
+}
+
+// isLMS(): Whether the suffix at i is S type and the one before it L type.
+static inline int isLMS(const unsigned char *types, int32_t i) {
+    return i > 0 && types[i] && !types[i - 1];
+}
+
+// getBuckets(): Finds where the bucket of every character begins (or ends),
+//  from the number of times it appears.
+static void getBuckets(const int32_t *counts, int32_t *buckets,
+                       int32_t alphaSize, int ends) {
+    int32_t sum = 0;
+
+    for (int32_t c = 0; c < alphaSize; c++) {
+        sum += counts[c];
+        buckets[c] = ends ? sum : sum - counts[c];
+    }
+}
+
+// induceSort(): Induces the order of the L type suffixes from the sorted
+//  LMS suffixes in sa, then of the S type ones from the L type ones.
+static void induceSort(const saisTextT *textPtr, const unsigned char *types,
+                       int32_t *sa, const int32_t *counts, int32_t *buckets,
+                       int32_t alphaSize) {
+    int32_t n = textPtr->n, j;
+
+    getBuckets(counts, buckets, alphaSize, 0);
+    for (int32_t i = 0; i < n; i++) {
+        j = sa[i] - 1;
+        if (j >= 0 && !types[j])
+            sa[buckets[chr(textPtr, j)]++] = j;
+    }
+
+    getBuckets(counts, buckets, alphaSize, 1);
+    for (int32_t i = n - 1; i >= 0; i--) {
+        j = sa[i] - 1;
+        if (j >= 0 && types[j])
+            sa[--buckets[chr(textPtr, j)]] = j;
+    }
+}
+
+// sais(): Sorts the suffixes of the text, whose characters are within
+//  [0, alphaSize), ending with a unique 0.
+static int sais(const saisTextT *textPtr, int32_t *sa, int32_t alphaSize) {
+    int32_t n = textPtr->n, lmsTotal = 0, name = 0, prev = -1, pos, j;
+    unsigned char *types;
+    int32_t *counts, *buckets;
+    saisTextT subText;
+    int diff, ret = -1;
+
+    types = memAlloc(n);
+    counts = memCalloc(alphaSize, sizeof(*counts));
+    buckets = memAlloc(sizeof(*buckets) * alphaSize);
+    if (!types || !counts || !buckets) {
+        reportError("malloc");
+        goto out;
+    }
+
+    for (int32_t i = 0; i < n; i++)
+        counts[chr(textPtr, i)]++;
+
+    // types: 1 for S type suffixes (smaller than the next one), 0 for L
+    types[n - 1] = 1;
+    for (int32_t i = n - 2; i >= 0; i--)
+        types[i] = chr(textPtr, i) < chr(textPtr, i + 1) ||
+                   (chr(textPtr, i) == chr(textPtr, i + 1) && types[i + 1]);
+
+    // Stage 1: Sort the LMS substrings, by placing the LMS suffixes at the
+    // ends of their buckets and inducing
+    getBuckets(counts, buckets, alphaSize, 1);
+    for (int32_t i = 0; i < n; i++)
+        sa[i] = -1;
+    for (int32_t i = 1; i < n; i++)
+        if (isLMS(types, i))
+            sa[--buckets[chr(textPtr, i)]] = i;
+
+    induceSort(textPtr, types, sa, counts, buckets, alphaSize);
+
+    for (int32_t i = 0; i < n; i++)
+        if (isLMS(types, sa[i]))
+            sa[lmsTotal++] = sa[i];
+
+    // Name the LMS substrings by their order, equal substrings get equal
+    // names, and store the names in the second half of sa by position
+    for (int32_t i = lmsTotal; i < n; i++)
+        sa[i] = -1;
+
+    for (int32_t i = 0; i < lmsTotal; i++) {
+        pos = sa[i];
+        diff = 0;
+        for (int32_t d = 0; d < n; d++)
+            if (prev == -1 || chr(textPtr, pos + d) != chr(textPtr, prev + d) ||
+                types[pos + d] != types[prev + d]) {
+                diff = 1;
+                break;
+            }
+            else if (d > 0 && (isLMS(types, pos + d) || isLMS(types, prev + d)))
+                break;
+
+        if (diff) {
+            name++;
+            prev = pos;
+        }
+        sa[lmsTotal + pos / 2] = name - 1;
+    }
+
+    for (int32_t i = n - 1, j = n - 1; i >= lmsTotal; i--)
+        if (sa[i] >= 0)
+            sa[j--] = sa[i];
+
+    // Stage 2: Sort the LMS suffixes, recursing if some names repeat
+    subText.bytes = NULL;
+    subText.ints = sa + n - lmsTotal;
+    subText.n = lmsTotal;
+
+    if (name < lmsTotal) {
+        if (sais(&subText, sa, name) < 0)
+            goto out;
+    }
+    else
+        for (int32_t i = 0; i < lmsTotal; i++)
+            sa[subText.ints[i]] = i;
+
+    // Stage 3: Place the sorted LMS suffixes at the ends of their buckets,
+    // and induce the rest from them
+    {
+        int32_t *lmsPos = sa + n - lmsTotal;
+
+        j = 0;
+        for (int32_t i = 1; i < n; i++)
+            if (isLMS(types, i))
+                lmsPos[j++] = i;
+        for (int32_t i = 0; i < lmsTotal; i++)
+            sa[i] = lmsPos[sa[i]];
+    }
+
+    for (int32_t i = lmsTotal; i < n; i++)
+        sa[i] = -1;
+
+    getBuckets(counts, buckets, alphaSize, 1);
+    for (int32_t i = lmsTotal - 1; i >= 0; i--) {
+        j = sa[i];
+        sa[i] = -1;
+        sa[--buckets[chr(textPtr, j)]] = j;
+    }
+
+    induceSort(textPtr, types, sa, counts, buckets, alphaSize);
+
+    ret = 0;
+out:
+    memFree(types);
+    memFree(counts);
+    memFree(buckets);
+
+    return ret;
+}
+
+int saisBytes(const unsigned char *text, int32_t *sa, int32_t n) {
+    saisTextT textObj;
+
+    assert(text != NULL);
+    assert(sa != NULL);
+
+    textObj.bytes = text;
+    textObj.ints = NULL;
+    textObj.n = n + 1;
+
+    return sais(&textObj, sa, 257);
+}
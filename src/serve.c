@@ -0,0 +1,341 @@
+#include "fg2019/serve.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "fg2019/checkpoint.h"
+#include "fg2019/client.h"
+#include "fg2019/const.h"
+#include "fg2019/context.h"
+#include "fg2019/error.h"
+#include "fg2019/file.h"
+#include "fg2019/filter.h"
+#include "fg2019/lz.h"
+#include "fg2019/mem.h"
+
+// Size (in bytes) of each of the stdio buffers of a thread
+#define SERVE_STDIO_SIZE (256 * 1024)
+
+// Connections waiting to be accepted
+#define SERVE_BACKLOG 128
+
+// serverT: A thread of the pool and the buffers its requests reuse.
+typedef struct {
+    int listenSock;
+    const optionsT *opts;
+    char *readBuf, *writeBuf;
+} serverT;
+
+//  recvRequest(): Receives a request and the descriptors attached to it.
+// Returns 0 at the end of the connection (or when it is idle), -1 on errors,
+// else the number of descriptors.
+static int recvRequest(int sock, serveRequestT *reqPtr, int fds[2]) {
+    char control[CMSG_SPACE(2 * sizeof(int))];
+    struct msghdr msg = {0};
+    struct cmsghdr *cmsg;
+    struct iovec iov;
+    ssize_t len, rest;
+    int fdTotal = 0;
+
+    iov.iov_base = reqPtr;
+    iov.iov_len = sizeof(*reqPtr);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    len = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    if (len <= 0) {
+        // An idle connection ends as a closed one
+        if (len == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 0;
+        if (len == -1)
+            reportError("recvmsg");
+        return len;
+    }
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            int count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+
+            for (int k = 0; k < count; k++) {
+                int fd;
+
+                memcpy(&fd, CMSG_DATA(cmsg) + k * sizeof(int), sizeof(int));
+                if (fdTotal < 2)
+                    fds[fdTotal++] = fd;
+                else
+                    close(fd);
+            }
+        }
+
+    // The descriptors come with the first byte, the rest may come later
+    if (len < (ssize_t) sizeof(*reqPtr)) {
+        rest = recv(sock, (char *) reqPtr + len, sizeof(*reqPtr) - len,
+                    MSG_WAITALL);
+        if (rest != (ssize_t) sizeof(*reqPtr) - len) {
+            for (int k = 0; k < fdTotal; k++)
+                close(fds[k]);
+            fprintf(stderr, "%s:%d: Malformed request.\n", __FILE__,
+                    __LINE__);
+            return -1;
+        }
+    }
+
+    if (fdTotal != (reqPtr->op == SERVE_OP_VERIFY ? 1 : 2)) {
+        for (int k = 0; k < fdTotal; k++)
+            close(fds[k]);
+        fprintf(stderr, "%s:%d: Malformed request, %d descriptors.\n",
+                __FILE__, __LINE__, fdTotal);
+        return -1;
+    }
+
+    return fdTotal;
+}
+
+// requestOptions(): The options of a request, checked as the command line
+//  options are.
+static int requestOptions(const serverT *server, const serveRequestT *reqPtr,
+                          optionsT *opts) {
+    *opts = *server->opts;
+
+    if (reqPtr->op < 0 || reqPtr->op >= SERVE_OP_TOTAL ||
+        reqPtr->method < 0 || reqPtr->method >= METHOD_TOTAL ||
+        reqPtr->windowLog < LZ_MIN_WINDOW_LOG ||
+        reqPtr->windowLog > LZ_MAX_WINDOW_LOG ||
+        reqPtr->level < LZ_MIN_LEVEL || reqPtr->level > LZ_MAX_LEVEL ||
+        reqPtr->groups < 1 || reqPtr->groups > CTX_MAX_GROUPS ||
+        reqPtr->checkpointKiB < 0 || reqPtr->checkpointKiB > CKPT_MAX_KIB ||
+        reqPtr->autoKind < AUTO_NONE || reqPtr->autoKind > AUTO_RATIO ||
+        (reqPtr->autoKind != AUTO_NONE && !(reqPtr->autoValue > 0))) {
+        fprintf(stderr, "%s:%d: Malformed request options.\n", __FILE__,
+                __LINE__);
+        return -1;
+    }
+
+    if (reqPtr->filter != FILTER_AUTO) {
+        filterT filter = {reqPtr->filter, reqPtr->filterWidth};
+
+        if (checkFilter(&filter) < 0)
+            return -1;
+    }
+
+    if (reqPtr->dict && !server->opts->dict) {
+        fprintf(stderr, "A request asked for a dictionary, but the daemon "
+                        "has none.\n");
+        return -1;
+    }
+
+    opts->method = reqPtr->method;
+    opts->pipeline = reqPtr->pipeline != 0;
+    opts->lz.windowLog = reqPtr->windowLog;
+    opts->lz.level = reqPtr->level;
+    opts->groups = reqPtr->groups;
+    opts->checkpointKiB = reqPtr->checkpointKiB;
+    opts->checksum = reqPtr->checksum != 0;
+    opts->filter.type = reqPtr->filter;
+    opts->filter.width = reqPtr->filterWidth;
+    opts->verify = reqPtr->op == SERVE_OP_VERIFY;
+    opts->autoTarget.kind = reqPtr->autoKind;
+    opts->autoTarget.value = reqPtr->autoValue;
+    opts->stats = reqPtr->stats != 0;
+    opts->range = reqPtr->range != 0 && reqPtr->op != SERVE_OP_COMPRESS;
+    opts->rangeOffset = reqPtr->rangeOffset;
+    opts->rangeLen = reqPtr->rangeLen;
+    if (!reqPtr->dict)
+        opts->dict = NULL;
+
+    // Requests are served at the same time, each on a single thread
+    opts->threads = 1;
+
+    return 0;
+}
+
+//  serveRequest(): Runs a request on the descriptors passed with it, which
+// are closed afterwards.
+static int serveRequest(serverT *server, const serveRequestT *reqPtr,
+                        int fds[2]) {
+    FILE *src, *dest = NULL;
+    optionsT opts;
+    int ret = -1;
+
+    src = fdopen(fds[0], "rb");
+    if (!src) {
+        reportError("fdopen");
+        close(fds[0]);
+        if (reqPtr->op != SERVE_OP_VERIFY)
+            close(fds[1]);
+        return -1;
+    }
+    setvbuf(src, server->readBuf, _IOFBF, SERVE_STDIO_SIZE);
+
+    if (reqPtr->op != SERVE_OP_VERIFY) {
+        dest = fdopen(fds[1], "wb");
+        if (!dest) {
+            reportError("fdopen");
+            close(fds[1]);
+            goto out;
+        }
+        setvbuf(dest, server->writeBuf, _IOFBF, SERVE_STDIO_SIZE);
+    }
+
+    if (requestOptions(server, reqPtr, &opts) < 0)
+        goto out;
+
+    if (reqPtr->op == SERVE_OP_COMPRESS)
+        ret = compressFile(src, dest, &opts);
+    else
+        ret = decompressFile(src, dest, &opts);
+
+out:
+    fclose(src);
+    if (dest && fclose(dest) == EOF && ret == 0) {
+        reportError("fclose");
+        ret = -1;
+    }
+
+    return ret;
+}
+
+static void serveConnection(serverT *server, int sock) {
+    struct timeval idle = {SERVE_IDLE_SECS, 0};
+    serveRequestT req;
+    int32_t status;
+    int fds[2];
+
+    // An idle client gives its thread back to the pool
+    if (setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &idle, sizeof(idle)) == -1) {
+        reportError("setsockopt");
+        close(sock);
+        return;
+    }
+
+    while (recvRequest(sock, &req, fds) > 0) {
+        status = serveRequest(server, &req, fds);
+        if (send(sock, &status, sizeof(status), MSG_NOSIGNAL) !=
+            sizeof(status))
+            break;
+    }
+
+    close(sock);
+}
+
+static void *serverThread(void *arg) {
+    serverT *server = arg;
+    int sock;
+
+    for (;;) {
+        sock = accept(server->listenSock, NULL, NULL);
+        if (sock == -1) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            reportError("accept");
+            break;
+        }
+
+        serveConnection(server, sock);
+    }
+
+    return NULL;
+}
+
+// listenAt(): Creates the listening socket, replacing a stale socket left
+//  at sockPath.
+static int listenAt(const char *sockPath) {
+    struct sockaddr_un addr;
+    struct stat st;
+    int sock;
+
+    if (strlen(sockPath) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "The socket path %s is too long.\n", sockPath);
+        return -1;
+    }
+
+    if (lstat(sockPath, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(sockPath);
+
+    sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock == -1) {
+        reportError("socket");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, sockPath);
+
+    if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+        reportError("bind");
+        close(sock);
+        return -1;
+    }
+
+    if (listen(sock, SERVE_BACKLOG) == -1) {
+        reportError("listen");
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+int serveRun(const char *sockPath, const optionsT *opts) {
+    serverT servers[MAX_THREADS] = {0};
+    pthread_t threadIds[MAX_THREADS];
+    int started[MAX_THREADS] = {0};
+    int listenSock, ret = -1;
+
+    assert(sockPath != NULL);
+    assert(opts != NULL);
+    assert(opts->threads >= 1 && opts->threads <= MAX_THREADS);
+
+    // A client that goes away must not stop the daemon
+    signal(SIGPIPE, SIG_IGN);
+
+    listenSock = listenAt(sockPath);
+    if (listenSock == -1)
+        return -1;
+
+    for (int k = 0; k < opts->threads; k++) {
+        servers[k].listenSock = listenSock;
+        servers[k].opts = opts;
+        servers[k].readBuf = memAlloc(SERVE_STDIO_SIZE);
+        servers[k].writeBuf = memAlloc(SERVE_STDIO_SIZE);
+        if (!servers[k].readBuf || !servers[k].writeBuf) {
+            reportError("malloc");
+            goto out;
+        }
+    }
+
+    // The calling thread is the first one of the pool
+    for (int k = 1; k < opts->threads; k++) {
+        errno = pthread_create(&threadIds[k], NULL, serverThread, &servers[k]);
+        started[k] = !errno;
+    }
+
+    serverThread(&servers[0]);
+
+    for (int k = 1; k < opts->threads; k++)
+        if (started[k])
+            pthread_join(threadIds[k], NULL);
+
+out:
+    close(listenSock);
+    for (int k = 0; k < opts->threads; k++) {
+        memFree(servers[k].readBuf);
+        memFree(servers[k].writeBuf);
+    }
+
+    return ret;
+}
@@ -0,0 +1,516 @@
+// For fopencookie(), SEEK_DATA and SEEK_HOLE
+#define _GNU_SOURCE
+
+#include "fg2019/sparse.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "fg2019/error.h"
+#include "fg2019/file.h"
+#include "fg2019/mem.h"
+
+// Size (in bytes) of the buffers of the streams
+#define SPARSE_BUF_SIZE (64 * 1024)
+
+// sparseStreamT: The state of a sparse stream.
+typedef struct {
+    FILE *fptr;
+    const sparseMapT *mapPtr;
+
+    // pos: Position in the data of the extents.
+    uint64_t pos;
+
+    //  next: For readers, the position in the data of the extents that the
+    // file is at, UINT64_MAX if not known.
+    uint64_t next;
+
+    //  base: For writers, the position of the file the output begins at,
+    // and filePos: the offset from base it is written up to.
+    off_t base;
+    uint64_t filePos;
+
+    // seekable: The holes of writers are seeked over, instead of written.
+    int seekable;
+    int writer;
+} sparseStreamT;
+
+// addExtent(): Adds an extent after the last one of the map.
+static int addExtent(sparseMapT *mapPtr, uint64_t offset, uint64_t len) {
+    sparseExtentT *extents;
+
+    if (mapPtr->extentTotal == mapPtr->extentCap) {
+        mapPtr->extentCap = mapPtr->extentCap ? 2 * mapPtr->extentCap : 16;
+        extents = memRealloc(mapPtr->extents,
+                             sizeof(*extents) * mapPtr->extentCap);
+        if (!extents) {
+            reportError("realloc");
+            return -1;
+        }
+        mapPtr->extents = extents;
+    }
+
+    mapPtr->extents[mapPtr->extentTotal].offset = offset;
+    mapPtr->extents[mapPtr->extentTotal].len = len;
+    mapPtr->extentTotal++;
+
+    return 0;
+}
+
+// packExtents(): Finds where every extent begins in the data the method sees.
+static void packExtents(sparseMapT *mapPtr) {
+    mapPtr->dataSize = 0;
+
+    for (size_t k = 0; k < mapPtr->extentTotal; k++) {
+        mapPtr->extents[k].packed = mapPtr->dataSize;
+        mapPtr->dataSize += mapPtr->extents[k].len;
+    }
+}
+
+//  findExtents(): Adds the extents of the file of fd, of size bytes, to the
+// map. Returns 1 if the file system can not tell where the holes are.
+static int findExtents(int fd, off_t size, sparseMapT *mapPtr) {
+    sparseExtentT *last;
+    off_t data = 0, hole;
+
+    while (data < size) {
+        data = lseek(fd, data, SEEK_DATA);
+        if (data == -1 && errno == ENXIO) // A hole up to the end
+            break;
+
+        hole = data == -1 ? -1 : lseek(fd, data, SEEK_HOLE);
+        if (hole == -1)
+            return errno == EINVAL || errno == ENXIO ? 1 : -1;
+        if (hole > size)
+            hole = size;
+
+        // The holes too short to skip stay in the extents
+        last = mapPtr->extentTotal
+                   ? &mapPtr->extents[mapPtr->extentTotal - 1]
+                   : NULL;
+        if (last &&
+            (uint64_t) data - (last->offset + last->len) < SPARSE_MIN_HOLE)
+            last->len = hole - last->offset;
+        else if (!mapPtr->extentTotal && data < SPARSE_MIN_HOLE) {
+            if (addExtent(mapPtr, 0, hole) < 0)
+                return -1;
+        }
+        else if (addExtent(mapPtr, data, hole - data) < 0)
+            return -1;
+
+        data = hole;
+    }
+
+    if (mapPtr->extentTotal) {
+        last = &mapPtr->extents[mapPtr->extentTotal - 1];
+        if ((uint64_t) size - (last->offset + last->len) < SPARSE_MIN_HOLE)
+            last->len = size - last->offset;
+    }
+
+    //  Methods need some data, a file that is all a hole keeps its last
+    // byte
+    else if (size > 0 && addExtent(mapPtr, size - 1, 1) < 0)
+        return -1;
+
+    return 0;
+}
+
+int sparseDetect(FILE *src, sparseMapT *mapPtr) {
+    struct stat st;
+    int fd, ret;
+    off_t pos;
+
+    assert(src != NULL);
+    assert(mapPtr != NULL);
+
+    memset(mapPtr, 0, sizeof(*mapPtr));
+
+    // Streams of other streams, pipes and devices are read as they are
+    fd = fileno(src);
+    if (fd == -1 || fstat(fd, &st) == -1 || !S_ISREG(st.st_mode))
+        return 0;
+
+    // The position of the descriptor, which may be past that of src
+    pos = lseek(fd, 0, SEEK_CUR);
+    if (pos == -1)
+        return 0;
+
+    ret = findExtents(fd, st.st_size, mapPtr);
+    if (ret < 0)
+        reportError("lseek");
+
+    if (lseek(fd, pos, SEEK_SET) == -1 && ret >= 0) {
+        reportError("lseek");
+        ret = -1;
+    }
+
+    // Without holes worth skipping, the file is compressed as usual
+    if (ret != 0 || (mapPtr->extentTotal == 1 &&
+                     mapPtr->extents[0].len == (uint64_t) st.st_size)) {
+        sparseFree(mapPtr);
+        return ret < 0 ? -1 : 0;
+    }
+
+    mapPtr->size = st.st_size;
+    packExtents(mapPtr);
+
+    return 0;
+}
+
+void sparseFree(sparseMapT *mapPtr) {
+    assert(mapPtr != NULL);
+
+    memFree(mapPtr->extents);
+    memset(mapPtr, 0, sizeof(*mapPtr));
+}
+
+int writeSparseMap(FILE *dest, const sparseMapT *mapPtr) {
+    uint64_t extentTotal = mapPtr->extentTotal;
+
+    assert(dest != NULL);
+    assert(mapPtr != NULL);
+
+    if (writeBytes(dest, &mapPtr->size, sizeof(mapPtr->size)) < 0 ||
+        writeBytes(dest, &extentTotal, sizeof(extentTotal)) < 0)
+        return -1;
+
+    for (size_t k = 0; k < mapPtr->extentTotal; k++)
+        if (writeBytes(dest, &mapPtr->extents[k].offset,
+                       sizeof(mapPtr->extents[k].offset)) < 0 ||
+            writeBytes(dest, &mapPtr->extents[k].len,
+                       sizeof(mapPtr->extents[k].len)) < 0)
+            return -1;
+
+    return 0;
+}
+
+int readSparseMap(FILE *src, sparseMapT *mapPtr, uint64_t dataSize) {
+    uint64_t extentTotal, offset, len, end = 0;
+
+    assert(src != NULL);
+    assert(mapPtr != NULL);
+
+    memset(mapPtr, 0, sizeof(*mapPtr));
+
+    if (readBytes(src, &mapPtr->size, sizeof(mapPtr->size)) < 0 ||
+        readBytes(src, &extentTotal, sizeof(extentTotal)) < 0)
+        return -1;
+
+    if (extentTotal == 0) {
+        fprintf(stderr, "%s:%d: Malformed sparse map.\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    //  The extents are grown as they are read, so a bad count runs into the
+    // end of the file before it allocates much
+    for (uint64_t k = 0; k < extentTotal; k++) {
+        if (readBytes(src, &offset, sizeof(offset)) < 0 ||
+            readBytes(src, &len, sizeof(len)) < 0)
+            goto fail;
+
+        // In order, apart, and within the file
+        if (len == 0 || offset < end || offset > mapPtr->size ||
+            len > mapPtr->size - offset) {
+            fprintf(stderr, "%s:%d: Malformed sparse map.\n", __FILE__,
+                    __LINE__);
+            goto fail;
+        }
+
+        if (addExtent(mapPtr, offset, len) < 0)
+            goto fail;
+        end = offset + len;
+    }
+
+    packExtents(mapPtr);
+    if (mapPtr->dataSize != dataSize) {
+        fprintf(stderr, "%s:%d: Malformed sparse map, its extents do not "
+                        "hold the data.\n",
+                __FILE__, __LINE__);
+        goto fail;
+    }
+
+    return 0;
+fail:
+    sparseFree(mapPtr);
+    return -1;
+}
+
+// findExtent(): The extent that holds position pos of the data.
+static const sparseExtentT *findExtent(const sparseMapT *mapPtr,
+                                       uint64_t pos) {
+    size_t low = 0, high = mapPtr->extentTotal - 1, mid;
+
+    while (low < high) {
+        mid = low + (high - low + 1) / 2;
+        if (mapPtr->extents[mid].packed <= pos)
+            low = mid;
+        else
+            high = mid - 1;
+    }
+
+    return &mapPtr->extents[low];
+}
+
+static ssize_t sparseRead(void *cookie, char *buf, size_t size) {
+    sparseStreamT *stream = cookie;
+    const sparseExtentT *extent;
+    size_t done = 0, len, got;
+    uint64_t skip;
+
+    while (done < size && stream->pos < stream->mapPtr->dataSize) {
+        extent = findExtent(stream->mapPtr, stream->pos);
+        skip = stream->pos - extent->packed;
+        len = extent->len - skip < size - done ? extent->len - skip
+                                               : size - done;
+
+        if (stream->next != stream->pos &&
+            fseeko(stream->fptr, extent->offset + skip, SEEK_SET) == -1)
+            return -1;
+
+        got = fread(buf + done, 1, len, stream->fptr);
+        if (ferror(stream->fptr))
+            return -1;
+
+        done += got;
+        stream->pos += got;
+
+        // The file shrank
+        if (got < len) {
+            stream->next = UINT64_MAX;
+            break;
+        }
+
+        // The next extent is somewhere else in the file
+        stream->next = skip + got < extent->len ? stream->pos : UINT64_MAX;
+    }
+
+    return done;
+}
+
+static int sparseSeek(void *cookie, off64_t *offsetPtr, int whence) {
+    sparseStreamT *stream = cookie;
+
+    switch (whence) {
+    case SEEK_SET:
+        stream->pos = *offsetPtr;
+        break;
+    case SEEK_CUR:
+        stream->pos += *offsetPtr;
+        break;
+    case SEEK_END:
+        stream->pos = stream->mapPtr->dataSize + *offsetPtr;
+        break;
+    default:
+        return -1;
+    }
+
+    stream->next = UINT64_MAX;
+    *offsetPtr = stream->pos;
+    return 0;
+}
+
+// writeZeros(): Writes len zeros, the holes of outputs that can not seek.
+static int writeZeros(FILE *fptr, uint64_t len) {
+    static const char zeros[4096];
+    size_t chunk;
+
+    while (len > 0) {
+        chunk = len < sizeof(zeros) ? len : sizeof(zeros);
+        if (fwrite(zeros, 1, chunk, fptr) < chunk)
+            return -1;
+        len -= chunk;
+    }
+
+    return 0;
+}
+
+//  skipTo(): Moves the output of a writer to the offset, over a hole.
+static int skipTo(sparseStreamT *stream, uint64_t offset) {
+    if (stream->seekable) {
+        if (fseeko(stream->fptr, stream->base + offset, SEEK_SET) == -1)
+            return -1;
+    }
+    else if (writeZeros(stream->fptr, offset - stream->filePos) < 0)
+        return -1;
+
+    stream->filePos = offset;
+    return 0;
+}
+
+int sparseRange(const sparseMapT *mapPtr, FILE *dest, uint64_t offset,
+                uint64_t len, sparseRangeFnT rangeFn, void *arg) {
+    const sparseExtentT *extent;
+    uint64_t pos = offset, end, n;
+
+    assert(mapPtr != NULL);
+    assert(dest != NULL);
+    assert(rangeFn != NULL);
+
+    if (offset >= mapPtr->size)
+        return 0;
+    if (len > mapPtr->size - offset)
+        len = mapPtr->size - offset;
+    end = offset + len;
+
+    for (size_t k = 0; k < mapPtr->extentTotal && pos < end; k++) {
+        extent = &mapPtr->extents[k];
+        if (extent->offset + extent->len <= pos)
+            continue;
+
+        // The hole before the extent
+        if (extent->offset > pos) {
+            n = (extent->offset < end ? extent->offset : end) - pos;
+            if (writeZeros(dest, n) < 0) {
+                reportError("fwrite");
+                return -1;
+            }
+            pos += n;
+            if (pos == end)
+                break;
+        }
+
+        n = (extent->offset + extent->len < end ? extent->offset + extent->len
+                                                 : end) -
+            pos;
+        if (rangeFn(arg, extent->packed + (pos - extent->offset), n) < 0)
+            return -1;
+        pos += n;
+    }
+
+    // The hole at the end of the file
+    if (pos < end && writeZeros(dest, end - pos) < 0) {
+        reportError("fwrite");
+        return -1;
+    }
+
+    return 0;
+}
+
+static ssize_t sparseWrite(void *cookie, const char *buf, size_t size) {
+    sparseStreamT *stream = cookie;
+    const sparseExtentT *extent;
+    size_t done = 0, len;
+    uint64_t skip;
+
+    while (done < size) {
+        if (stream->pos >= stream->mapPtr->dataSize)
+            return -1;
+
+        extent = findExtent(stream->mapPtr, stream->pos);
+        skip = stream->pos - extent->packed;
+        len = extent->len - skip < size - done ? extent->len - skip
+                                               : size - done;
+
+        if (extent->offset + skip != stream->filePos &&
+            skipTo(stream, extent->offset + skip) < 0)
+            return -1;
+
+        if (fwrite(buf + done, 1, len, stream->fptr) < len)
+            return -1;
+
+        done += len;
+        stream->pos += len;
+        stream->filePos += len;
+    }
+
+    return size;
+}
+
+static int sparseClose(void *cookie) {
+    sparseStreamT *stream = cookie;
+    uint64_t size = stream->mapPtr->size;
+    int ret = 0;
+
+    // The hole at the end, if any
+    if (stream->writer && stream->filePos < size) {
+        if (!stream->seekable)
+            ret = writeZeros(stream->fptr, size - stream->filePos);
+        else if (fflush(stream->fptr) == EOF ||
+                 ftruncate(fileno(stream->fptr), stream->base + size) == -1 ||
+                 fseeko(stream->fptr, stream->base + size, SEEK_SET) == -1)
+            ret = -1;
+    }
+
+    memFree(stream);
+    return ret;
+}
+
+//  initWriter(): Holes are seeked over in regular files, which are cut at
+// the start of the output first, so no old data shows through them.
+static int initWriter(sparseStreamT *stream) {
+    struct stat st;
+    int fd = fileno(stream->fptr);
+
+    if (fd == -1 || fstat(fd, &st) == -1 || !S_ISREG(st.st_mode))
+        return 0;
+
+    stream->base = ftello(stream->fptr);
+    if (stream->base == -1 || fflush(stream->fptr) == EOF ||
+        ftruncate(fd, stream->base) == -1) {
+        reportError("ftruncate");
+        return -1;
+    }
+
+    stream->seekable = 1;
+    return 0;
+}
+
+// openSparseStream(): Opens a sparse stream with the given functions.
+static FILE *openSparseStream(FILE *fptr, const sparseMapT *mapPtr,
+                              const char *mode, cookie_io_functions_t funcs) {
+    sparseStreamT *stream = memAlloc(sizeof(*stream));
+    FILE *sparseFptr;
+
+    if (!stream) {
+        reportError("malloc");
+        return NULL;
+    }
+
+    stream->fptr = fptr;
+    stream->mapPtr = mapPtr;
+    stream->pos = stream->filePos = 0;
+    stream->next = UINT64_MAX;
+    stream->base = 0;
+    stream->seekable = 0;
+    stream->writer = (funcs.write != NULL);
+
+    if (stream->writer && initWriter(stream) < 0) {
+        memFree(stream);
+        return NULL;
+    }
+
+    sparseFptr = fopencookie(stream, mode, funcs);
+    if (!sparseFptr) {
+        reportError("fopencookie");
+        memFree(stream);
+        return NULL;
+    }
+
+    setvbuf(sparseFptr, NULL, _IOFBF, SPARSE_BUF_SIZE);
+
+    return sparseFptr;
+}
+
+FILE *sparseReader(FILE *src, const sparseMapT *mapPtr) {
+    cookie_io_functions_t funcs = {sparseRead, NULL, sparseSeek, sparseClose};
+
+    assert(src != NULL);
+    assert(mapPtr != NULL);
+    assert(mapPtr->extentTotal > 0);
+
+    return openSparseStream(src, mapPtr, "r", funcs);
+}
+
+FILE *sparseWriter(FILE *dest, const sparseMapT *mapPtr) {
+    cookie_io_functions_t funcs = {NULL, sparseWrite, NULL, sparseClose};
+
+    assert(dest != NULL);
+    assert(mapPtr != NULL);
+    assert(mapPtr->extentTotal > 0);
+
+    return openSparseStream(dest, mapPtr, "w", funcs);
+}
@@ -0,0 +1,317 @@
+#include "fg2019/specdec.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "fg2019/bitio.h"
+#include "fg2019/const.h"
+#include "fg2019/error.h"
+#include "fg2019/file.h"
+#include "fg2019/mem.h"
+
+//  Code boundaries recorded by the thread of a chunk, resynchronization
+// takes a few dozen codes, the rest of the chunk is decoded serially in
+// the rare case that it takes more.
+#define SYNC_MARKS 4096
+
+//  Bytes read past the end of a round, for the last code of the round and
+// the 8 byte loads.
+#define ROUND_SLACK 16
+
+// Size (in bytes) of the buffer of the serially decoded bytes
+#define SERIAL_BUF_SIZE (64 * 1024)
+
+// chunkT: A chunk of a round and the speculative decoding of its thread.
+typedef struct {
+    const decompTableT *tablePtr;
+
+    // buf: The compressed data of the round.
+    const unsigned char *buf;
+
+    // startBit, endBit: The bits of the chunk within buf.
+    uint64_t startBit, endBit;
+
+    // out: The decoded bytes.
+    unsigned char *out;
+    size_t outTotal;
+
+    // exitBit: The first code boundary at or after endBit, or the end of
+    //  the EOF symbol.
+    uint64_t exitBit;
+
+    //  marks: Where the first codes begin, the code at marks[j] produced
+    // out[j].
+    uint32_t marks[SYNC_MARKS];
+    int markTotal;
+
+    // eof: Decoding stopped at the EOF symbol, after outTotal bytes.
+    int eof;
+} chunkT;
+
+// specT: The state of the stitching of the chunks.
+typedef struct {
+    const decompTableT *tablePtr;
+    FILE *dest;
+    unsigned char serialBuf[SERIAL_BUF_SIZE];
+    size_t serialTotal;
+    int done;
+} specT;
+
+// peekAt(): The MAX_CODELEN bits of buf that begin at bit pos.
+static inline unsigned int peekAt(const unsigned char *buf, uint64_t pos) {
+    return (loadBE64(buf + (pos >> 3)) << (pos & 7)) >> (64 - MAX_CODELEN);
+}
+
+// decodeChunk(): Decodes a chunk from its first bit, whether or not a code
+//  begins there.
+static void *decodeChunk(void *arg) {
+    chunkT *chunk = arg;
+    const char *codeLens = chunk->tablePtr->codeLens;
+    const int *symbols = chunk->tablePtr->symbols;
+    uint64_t pos = chunk->startBit, end = chunk->endBit;
+    unsigned char *out = chunk->out;
+    unsigned int idx;
+    size_t n = 0;
+    int len, sym;
+
+    chunk->eof = 0;
+
+    while (pos < end) {
+        idx = peekAt(chunk->buf, pos);
+        len = codeLens[idx];
+        sym = symbols[idx];
+
+        if (n < SYNC_MARKS)
+            chunk->marks[n] = pos;
+
+        if (sym == EOF_VAL) {
+            chunk->eof = 1;
+            pos += len;
+            break;
+        }
+
+        out[n++] = sym;
+        pos += len;
+    }
+
+    // The boundary of the EOF symbol counts, it tells that the stream ends
+    // there
+    chunk->markTotal = n + chunk->eof;
+    if (chunk->markTotal > SYNC_MARKS)
+        chunk->markTotal = SYNC_MARKS;
+
+    chunk->outTotal = n;
+    chunk->exitBit = pos;
+
+    return NULL;
+}
+
+static int flushSerial(specT *spec) {
+    if (writeBytes(spec->dest, spec->serialBuf, spec->serialTotal) < 0)
+        return -1;
+
+    spec->serialTotal = 0;
+    return 0;
+}
+
+static int malformed(void) {
+    fprintf(stderr, "%s:%d: Malformed file error, the EOF symbol does not "
+                    "end the data.\n",
+            __FILE__, __LINE__);
+    return -1;
+}
+
+//  stitchChunk(): Continues the true decoding, which is at bit *posPtr, into
+// the chunk: serially until it meets a code boundary of the thread of the
+// chunk, then with the output of the thread. Sets *posPtr to where the
+// chunk ends.
+static int stitchChunk(specT *spec, const chunkT *chunk, uint64_t *posPtr) {
+    const char *codeLens = spec->tablePtr->codeLens;
+    const int *symbols = spec->tablePtr->symbols;
+    uint64_t pos = *posPtr;
+    unsigned int idx;
+    int j = 0, len, sym;
+
+    for (;;) {
+        while (j < chunk->markTotal && chunk->marks[j] < pos)
+            j++;
+
+        if (j < chunk->markTotal && chunk->marks[j] == pos)
+            break;
+
+        // Never met, the whole chunk was decoded serially
+        if (pos >= chunk->endBit) {
+            *posPtr = pos;
+            return 0;
+        }
+
+        idx = peekAt(chunk->buf, pos);
+        len = codeLens[idx];
+        sym = symbols[idx];
+
+        if (sym == EOF_VAL) {
+            spec->done = 1;
+            *posPtr = pos + len;
+            return flushSerial(spec);
+        }
+
+        if (spec->serialTotal == SERIAL_BUF_SIZE && flushSerial(spec) < 0)
+            return -1;
+        spec->serialBuf[spec->serialTotal++] = sym;
+        pos += len;
+    }
+
+    // In sync from out[j] on
+    if (flushSerial(spec) < 0 ||
+        writeBytes(spec->dest, chunk->out + j, chunk->outTotal - j) < 0)
+        return -1;
+
+    spec->done = chunk->eof;
+    *posPtr = chunk->exitBit;
+
+    return 0;
+}
+
+// minCodeLen(): The length of the shortest code of the table.
+static int minCodeLen(const decompTableT *decompTablePtr) {
+    int minLen = MAX_CODELEN;
+
+    for (int k = 0; k < DECOMP_SIZE; k++)
+        if (decompTablePtr->codeLens[k] > 0 &&
+            decompTablePtr->codeLens[k] < minLen)
+            minLen = decompTablePtr->codeLens[k];
+
+    return minLen;
+}
+
+int specDecompress(FILE *src, FILE *dest, const decompTableT *decompTablePtr,
+                   size_t compSize, int threads) {
+    chunkT *chunks;
+    specT *spec;
+    pthread_t threadIds[MAX_THREADS];
+    int started[MAX_THREADS];
+    unsigned char *buf;
+    size_t roundSize, outCap, bufLen;
+    uint64_t roundStart = 0, pos = 0, dataLeft, chunkEnd;
+    off_t dataStart;
+    int chunkTotal, ret = -1;
+
+    assert(src != NULL);
+    assert(dest != NULL);
+    assert(decompTablePtr != NULL);
+    assert(threads >= 1 && threads <= MAX_THREADS);
+
+    // A chunk decodes at most one byte per bit of the shortest code
+    outCap = (SPEC_CHUNK_SIZE + ROUND_SLACK) * CHAR_BIT /
+               minCodeLen(decompTablePtr) +
+             1;
+
+    //  Fewer chunks a round within the memory budget, each thread needs its
+    // chunk and the output of it
+    threads = memFitThreads(threads, SPEC_CHUNK_SIZE + outCap);
+    roundSize = (size_t) threads * SPEC_CHUNK_SIZE;
+
+    chunks = memCalloc(threads, sizeof(*chunks));
+    spec = memAlloc(sizeof(*spec));
+    buf = memAlloc(roundSize + ROUND_SLACK + 8);
+    if (!chunks || !spec || !buf) {
+        reportError("malloc");
+        goto out;
+    }
+
+    for (int k = 0; k < threads; k++) {
+        chunks[k].out = memAlloc(outCap);
+        if (!chunks[k].out) {
+            reportError("malloc");
+            goto out;
+        }
+        chunks[k].tablePtr = decompTablePtr;
+        chunks[k].buf = buf;
+    }
+
+    spec->tablePtr = decompTablePtr;
+    spec->dest = dest;
+    spec->serialTotal = 0;
+    spec->done = 0;
+
+    dataStart = ftello(src);
+    if (dataStart == -1) {
+        reportError("ftello");
+        goto out;
+    }
+
+    while (!spec->done) {
+        //  The round begins at the byte of the code where the last one
+        // ended, pos being its first bit within that byte
+        dataLeft = compSize - roundStart;
+        if (dataLeft == 0) {
+            malformed();
+            goto out;
+        }
+
+        bufLen = dataLeft < roundSize + ROUND_SLACK ? dataLeft
+                                                     : roundSize + ROUND_SLACK;
+        if (fseeko(src, dataStart + roundStart, SEEK_SET) == -1) {
+            reportError("fseeko");
+            goto out;
+        }
+        if (readBytes(src, buf, bufLen) < 0)
+            goto out;
+        memset(buf + bufLen, 0, 8);
+
+        if (dataLeft > roundSize)
+            dataLeft = roundSize;
+        chunkTotal = (dataLeft + SPEC_CHUNK_SIZE - 1) / SPEC_CHUNK_SIZE;
+
+        for (int k = 0; k < chunkTotal; k++) {
+            chunkEnd = (uint64_t) (k + 1) * SPEC_CHUNK_SIZE;
+            chunks[k].startBit =
+              k ? (uint64_t) k * SPEC_CHUNK_SIZE * CHAR_BIT : pos;
+            chunks[k].endBit =
+              (chunkEnd < dataLeft ? chunkEnd : dataLeft) * CHAR_BIT;
+
+            started[k] = 0;
+            if (chunkTotal > 1) {
+                errno = pthread_create(&threadIds[k], NULL, decodeChunk,
+                                       &chunks[k]);
+                started[k] = !errno;
+            }
+            if (!started[k])
+                decodeChunk(&chunks[k]);
+        }
+
+        for (int k = 0; k < chunkTotal; k++)
+            if (started[k])
+                pthread_join(threadIds[k], NULL);
+
+        for (int k = 0; k < chunkTotal && !spec->done; k++)
+            if (stitchChunk(spec, &chunks[k], &pos) < 0)
+                goto out;
+
+        roundStart += pos / CHAR_BIT;
+        pos %= CHAR_BIT;
+    }
+
+    // Only the padding of its last byte may follow the EOF symbol
+    if (roundStart + (pos + CHAR_BIT - 1) / CHAR_BIT != compSize) {
+        malformed();
+        goto out;
+    }
+
+    ret = 0;
+out:
+    if (chunks)
+        for (int k = 0; k < threads; k++)
+            memFree(chunks[k].out);
+    memFree(chunks);
+    memFree(spec);
+    memFree(buf);
+
+    return ret;
+}
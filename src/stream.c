@@ -0,0 +1,286 @@
+#include "fg2019/stream.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "fg2019/error.h"
+#include "fg2019/file.h"
+#include "fg2019/mem.h"
+
+// Size (in bytes) of the reads of streamCompressFile() and
+// streamDecompressFile()
+#define STREAM_BUF_SIZE (64 * 1024)
+
+// initModel(): Starts with every symbol equally likely.
+static int initModel(streamModelT *modelPtr) {
+    for (int k = 0; k < SYM_NUM; k++)
+        modelPtr->freqs[k] = 1;
+    modelPtr->total = SYM_NUM;
+    modelPtr->sinceBuild = 0;
+
+    return initCompressionTable(&modelPtr->compTable, modelPtr->freqs,
+                                SYM_NUM);
+}
+
+// countBytes(): Adds n bytes of the current segment to the statistics.
+static void countBytes(streamModelT *modelPtr, const unsigned char *buf,
+                       size_t n) {
+    for (size_t k = 0; k < n; k++)
+        modelPtr->freqs[buf[k]]++;
+    modelPtr->total += n;
+    modelPtr->sinceBuild += n;
+}
+
+//  endSegment(): Counts the flush, and builds the code of the next segment
+// if enough has been seen since the last one. Sets *builtPtr if it did.
+static int endSegment(streamModelT *modelPtr, int *builtPtr) {
+    *builtPtr = 0;
+
+    modelPtr->freqs[EOF_VAL]++;
+    modelPtr->total++;
+
+    if (modelPtr->sinceBuild < STREAM_REBUILD_BYTES)
+        return 0;
+
+    // Halving keeps every symbol at 1 at least, so all of them have a code
+    if (modelPtr->total > STREAM_HISTORY) {
+        modelPtr->total = 0;
+        for (int k = 0; k < SYM_NUM; k++) {
+            modelPtr->freqs[k] = (modelPtr->freqs[k] + 1) / 2;
+            modelPtr->total += modelPtr->freqs[k];
+        }
+    }
+
+    modelPtr->sinceBuild = 0;
+    *builtPtr = 1;
+    return initCompressionTable(&modelPtr->compTable, modelPtr->freqs,
+                                SYM_NUM);
+}
+
+int streamEncInit(streamEncT *enc) {
+    assert(enc != NULL);
+
+    bitWriterInit(&enc->bw, NULL);
+    return initModel(&enc->model);
+}
+
+size_t streamEncode(streamEncT *enc, const unsigned char *in, size_t n,
+                    unsigned char *out) {
+    assert(enc != NULL);
+
+    // The pending bits are kept, only the output moves
+    enc->bw.ptr = out;
+    encodeSyms(&enc->bw, &enc->model.compTable, in, n);
+    countBytes(&enc->model, in, n);
+
+    return enc->bw.ptr - out;
+}
+
+int streamFlush(streamEncT *enc, unsigned char *out, size_t *outLenPtr) {
+    int built;
+
+    assert(enc != NULL);
+    assert(outLenPtr != NULL);
+
+    enc->bw.ptr = out;
+    encodeEOF(&enc->bw, &enc->model.compTable);
+    *outLenPtr = enc->bw.ptr - out;
+
+    return endSegment(&enc->model, &built);
+}
+
+// buildDecompTable(): The decoding table of the code of the model.
+static int buildDecompTable(streamDecT *dec) {
+    int codeLens[SYM_NUM];
+
+    for (int k = 0; k < SYM_NUM; k++)
+        codeLens[k] = dec->model.compTable.lens[k];
+
+    return initDecompressionTable(&dec->decompTable, codeLens, SYM_NUM);
+}
+
+int streamDecInit(streamDecT *dec) {
+    assert(dec != NULL);
+
+    bitReaderInit(&dec->br);
+    dec->midSegment = 0;
+
+    if (initModel(&dec->model) < 0)
+        return -1;
+
+    return buildDecompTable(dec);
+}
+
+int streamDecode(streamDecT *dec, const unsigned char *in, size_t n,
+                 unsigned char *out, size_t *outLenPtr) {
+    size_t outCap = STREAM_DECODE_BOUND(n), total = 0, decoded;
+    int done, built;
+
+    assert(dec != NULL);
+    assert(outLenPtr != NULL);
+
+    bitReaderFeed(&dec->br, in, n);
+
+    for (;;) {
+        decoded = decodeSyms(&dec->br, &dec->decompTable, out + total,
+                             outCap - total, 0, &done);
+        countBytes(&dec->model, out + total, decoded);
+        total += decoded;
+
+        if (!done) {
+            // All of in is in br, waiting for the rest of the stream
+            dec->midSegment = (dec->br.count > 0 || decoded > 0 ||
+                               dec->midSegment);
+            break;
+        }
+
+        //  The rest of the byte of the flush is padding, br only holds
+        // whole bytes of the segments after it
+        skipBits(&dec->br, dec->br.count % CHAR_BIT);
+        dec->midSegment = 0;
+
+        if (endSegment(&dec->model, &built) < 0 ||
+            (built && buildDecompTable(dec) < 0))
+            return -1;
+    }
+
+    *outLenPtr = total;
+    return 0;
+}
+
+int streamDecEnd(const streamDecT *dec) {
+    assert(dec != NULL);
+
+    if (dec->midSegment) {
+        fprintf(stderr, "%s:%d: Malformed stream, it ends in the middle of "
+                        "a segment.\n",
+                __FILE__, __LINE__);
+        return -1;
+    }
+
+    return 0;
+}
+
+// readSome(): Reads what is there of fd, up to len bytes, waiting for a
+//  byte at least. Returns 0 at the end of the file, -1 on errors.
+static ssize_t readSome(int fd, unsigned char *buf, size_t len) {
+    ssize_t bytesRead;
+
+    do
+        bytesRead = read(fd, buf, len);
+    while (bytesRead == -1 && errno == EINTR);
+
+    if (bytesRead == -1)
+        reportError("read");
+
+    return bytesRead;
+}
+
+// writeNow(): Writes len bytes to dest, and flushes it.
+static int writeNow(FILE *dest, const unsigned char *buf, size_t len) {
+    if (writeBytes(dest, buf, len) < 0)
+        return -1;
+
+    if (fflush(dest) == EOF) {
+        reportError("fflush");
+        return -1;
+    }
+
+    return 0;
+}
+
+int streamCompressFile(FILE *src, FILE *dest) {
+    unsigned char *readBuf, *writeBuf;
+    streamEncT *enc;
+    size_t outLen, flushLen;
+    ssize_t bytesRead;
+    int ret = -1;
+
+    assert(src != NULL);
+    assert(dest != NULL);
+
+    readBuf = memAlloc(STREAM_BUF_SIZE);
+    writeBuf = memAlloc(ENCODE_BOUND(STREAM_BUF_SIZE) + ENCODE_BOUND(1));
+    enc = memAlloc(sizeof(*enc));
+    if (!readBuf || !writeBuf || !enc) {
+        reportError("malloc");
+        goto out;
+    }
+
+    if (streamEncInit(enc) < 0 || writeStreamMagic(dest) < 0)
+        goto out;
+
+    if (fflush(dest) == EOF) {
+        reportError("fflush");
+        goto out;
+    }
+
+    // src is read directly, so that a read returns what has arrived
+    while ((bytesRead = readSome(fileno(src), readBuf, STREAM_BUF_SIZE)) > 0) {
+        outLen = streamEncode(enc, readBuf, bytesRead, writeBuf);
+        if (streamFlush(enc, writeBuf + outLen, &flushLen) < 0 ||
+            writeNow(dest, writeBuf, outLen + flushLen) < 0)
+            goto out;
+    }
+
+    if (bytesRead == 0)
+        ret = 0;
+out:
+    memFree(readBuf);
+    memFree(writeBuf);
+    memFree(enc);
+
+    return ret;
+}
+
+int streamDecompressFile(FILE *src, FILE *dest) {
+    unsigned char *readBuf, *writeBuf;
+    streamDecT *dec;
+    size_t outLen;
+    ssize_t bytesRead;
+    int ret = -1;
+
+    assert(src != NULL);
+    assert(dest != NULL);
+
+    // Unbuffered, the magic number is read without reading ahead of it
+    setvbuf(src, NULL, _IONBF, 0);
+
+    readBuf = memAlloc(STREAM_BUF_SIZE);
+    writeBuf = memAlloc(STREAM_DECODE_BOUND(STREAM_BUF_SIZE));
+    dec = memAlloc(sizeof(*dec));
+    if (!readBuf || !writeBuf || !dec) {
+        reportError("malloc");
+        goto out;
+    }
+
+    switch (readMagic(src)) {
+    case FORMAT_STREAM:
+        break;
+    case -1:
+        goto out;
+    default:
+        fprintf(stderr, "The file is not a stream, decompress it without "
+                        "--stream.\n");
+        goto out;
+    }
+
+    if (streamDecInit(dec) < 0)
+        goto out;
+
+    while ((bytesRead = readSome(fileno(src), readBuf, STREAM_BUF_SIZE)) > 0)
+        if (streamDecode(dec, readBuf, bytesRead, writeBuf, &outLen) < 0 ||
+            writeNow(dest, writeBuf, outLen) < 0)
+            goto out;
+
+    if (bytesRead == 0)
+        ret = streamDecEnd(dec);
+out:
+    memFree(readBuf);
+    memFree(writeBuf);
+    memFree(dec);
+
+    return ret;
+}
@@ -0,0 +1,487 @@
+#include "fg2019/tans.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fg2019/bitio.h"
+#include "fg2019/const.h"
+#include "fg2019/error.h"
+#include "fg2019/file.h"
+#include "fg2019/mem.h"
+
+// Number of symbols, tANS codes whole bytes (the frame header gives the
+// size, so no EOF symbol is needed)
+#define TANS_SYM_NUM 256
+
+// Most bits written for a symbol, and the size of an encoded block
+#define TANS_MAX_BITS TANS_TABLE_LOG
+#define TANS_OUT_SIZE                                                        \
+    ((TANS_BLOCK_SIZE * (size_t) TANS_MAX_BITS + TANS_TABLE_LOG + 1) /       \
+       CHAR_BIT +                                                            \
+     8)
+
+// tansSymT: How the encoder codes a symbol.
+typedef struct {
+    // start: Where the states of the symbol begin in tansEncTableT.states.
+    int start;
+
+    int norm;
+
+    //  maxBits: Bits written for the symbol from a state >= thresh, one bit
+    // less from a smaller state.
+    int maxBits;
+    uint32_t thresh;
+} tansSymT;
+
+// tansEncTableT: Encoding table, the state after coding a symbol is
+//  states[start + (x >> bits) - norm], x being the state before.
+typedef struct {
+    tansSymT syms[TANS_SYM_NUM];
+    uint16_t states[TANS_TABLE_SIZE];
+} tansEncTableT;
+
+// tansDecEntryT: What the decoder does in a state: output sym, then move
+//  to state base + the next nbBits bits.
+typedef struct {
+    uint16_t base;
+    uint8_t sym;
+    uint8_t nbBits;
+} tansDecEntryT;
+
+typedef struct {
+    tansDecEntryT entries[TANS_TABLE_SIZE];
+} tansDecTableT;
+
+// backReaderT: A bit reader going from the end of the data to its
+//  beginning, the bits of acc are right aligned, so that the last bits of
+//  the stream are the LSBs.
+typedef struct {
+    const unsigned char *start;
+    const unsigned char *ptr;
+    uint64_t acc;
+    int count;
+} backReaderT;
+
+// highBit(): The position of the MSB of val.
+//  Assumptions:
+//   > val > 0
+static inline int highBit(uint32_t val) {
+    return 31 - __builtin_clz(val);
+}
+
+// normalizeFreqs(): Scales freqs to norms that add up to TANS_TABLE_SIZE,
+//  keeping every symbol that appears at 1 or more.
+//  The rounding error is spread one step at a time, each time to the
+// symbol where it costs the fewest bits.
+static void normalizeFreqs(const size_t freqs[TANS_SYM_NUM],
+                           int norms[TANS_SYM_NUM]) {
+    uint64_t total = 0;
+    int sum = 0, best;
+    double gain, bestGain;
+
+    for (int s = 0; s < TANS_SYM_NUM; s++)
+        total += freqs[s];
+
+    for (int s = 0; s < TANS_SYM_NUM; s++) {
+        norms[s] = 0;
+        if (freqs[s]) {
+            norms[s] = (freqs[s] * TANS_TABLE_SIZE + total / 2) / total;
+            if (norms[s] == 0)
+                norms[s] = 1;
+        }
+        sum += norms[s];
+    }
+
+    while (sum > TANS_TABLE_SIZE) {
+        best = -1;
+        bestGain = HUGE_VAL;
+        for (int s = 0; s < TANS_SYM_NUM; s++)
+            if (norms[s] > 1) {
+                gain = freqs[s] * log2((double) norms[s] / (norms[s] - 1));
+                if (gain < bestGain) {
+                    bestGain = gain;
+                    best = s;
+                }
+            }
+        norms[best]--;
+        sum--;
+    }
+
+    while (sum < TANS_TABLE_SIZE) {
+        best = -1;
+        bestGain = -1;
+        for (int s = 0; s < TANS_SYM_NUM; s++)
+            if (norms[s]) {
+                gain = freqs[s] * log2((double) (norms[s] + 1) / norms[s]);
+                if (gain > bestGain) {
+                    bestGain = gain;
+                    best = s;
+                }
+            }
+        norms[best]++;
+        sum++;
+    }
+}
+
+//  spreadSyms(): Lays out the norms[s] states of every symbol over the
+// table, scattered so that the states of a symbol are spaced evenly.
+static void spreadSyms(const int norms[TANS_SYM_NUM],
+                       uint8_t spread[TANS_TABLE_SIZE]) {
+    // step: Odd, so that it visits every position of the table
+    const int step = (TANS_TABLE_SIZE >> 1) + (TANS_TABLE_SIZE >> 3) + 3;
+    int pos = 0;
+
+    for (int s = 0; s < TANS_SYM_NUM; s++)
+        for (int k = 0; k < norms[s]; k++) {
+            spread[pos] = s;
+            pos = (pos + step) & (TANS_TABLE_SIZE - 1);
+        }
+}
+
+static void initEncTable(tansEncTableT *tablePtr,
+                         const int norms[TANS_SYM_NUM]) {
+    uint8_t spread[TANS_TABLE_SIZE];
+    int next[TANS_SYM_NUM], start = 0, bits;
+
+    spreadSyms(norms, spread);
+
+    for (int s = 0; s < TANS_SYM_NUM; s++) {
+        tansSymT *symPtr = &tablePtr->syms[s];
+
+        // maxBits: The fewest bits that bring every state below
+        // 2 * norm, the states below thresh need one bit less
+        bits = 0;
+        if (norms[s])
+            while ((norms[s] << bits) < TANS_TABLE_SIZE)
+                bits++;
+
+        symPtr->start = next[s] = start;
+        symPtr->norm = norms[s];
+        symPtr->maxBits = bits;
+        symPtr->thresh = (uint32_t) norms[s] << bits;
+        start += norms[s];
+    }
+
+    // The states of every symbol, in the order they are in the table
+    for (int u = 0; u < TANS_TABLE_SIZE; u++)
+        tablePtr->states[next[spread[u]]++] = TANS_TABLE_SIZE + u;
+}
+
+static void initDecTable(tansDecTableT *tablePtr,
+                         const int norms[TANS_SYM_NUM]) {
+    uint8_t spread[TANS_TABLE_SIZE];
+    uint32_t next[TANS_SYM_NUM];
+    uint32_t x;
+    int bits;
+
+    spreadSyms(norms, spread);
+
+    for (int s = 0; s < TANS_SYM_NUM; s++)
+        next[s] = norms[s];
+
+    //  The k-th state of symbol s was reached by the encoder from the states
+    // x with x >> bits == norms[s] + k, which the decoder goes back to.
+    for (int u = 0; u < TANS_TABLE_SIZE; u++) {
+        x = next[spread[u]]++;
+        bits = TANS_TABLE_LOG - highBit(x);
+
+        tablePtr->entries[u].sym = spread[u];
+        tablePtr->entries[u].nbBits = bits;
+        tablePtr->entries[u].base = (x << bits) - TANS_TABLE_SIZE;
+    }
+}
+
+static int writeNorms(FILE *dest, const int norms[TANS_SYM_NUM]) {
+    unsigned char buffer[2 * TANS_SYM_NUM];
+    size_t len = 0;
+
+    for (int s = 0; s < TANS_SYM_NUM; s++) {
+        if (norms[s] < 0x80)
+            buffer[len++] = norms[s];
+        else {
+            buffer[len++] = 0x80 | (norms[s] & 0x7F);
+            buffer[len++] = norms[s] >> 7;
+        }
+    }
+
+    return writeBytes(dest, buffer, len);
+}
+
+static int readNorms(FILE *src, int norms[TANS_SYM_NUM]) {
+    unsigned char byte;
+    int sum = 0;
+
+    for (int s = 0; s < TANS_SYM_NUM; s++) {
+        if (readBytes(src, &byte, 1) < 0)
+            return -1;
+
+        norms[s] = byte & 0x7F;
+        if (byte & 0x80) {
+            if (readBytes(src, &byte, 1) < 0)
+                return -1;
+            norms[s] |= byte << 7;
+        }
+        sum += norms[s];
+    }
+
+    if (sum != TANS_TABLE_SIZE) {
+        fprintf(stderr, "%s:%d: Malformed file error, the frequencies add up "
+                        "to %d.\n",
+                __FILE__, __LINE__, sum);
+        return -1;
+    }
+
+    return 0;
+}
+
+//  encodeBlock(): Encodes the n bytes of in to out, and returns the number
+// of bytes written.
+static size_t encodeBlock(const tansEncTableT *tablePtr,
+                          const unsigned char *in, size_t n,
+                          unsigned char *out) {
+    const tansSymT *symPtr;
+    bitWriterT bw;
+    uint32_t x = TANS_TABLE_SIZE;
+    int bits;
+
+    //  The bits are gathered in a local copy of the writer state and stored
+    // 32 at a time, as in encodeSyms().
+    uint64_t acc = 0;
+    int count = 0;
+    unsigned char *ptr = out;
+    uint32_t word;
+
+    for (size_t k = n; k-- > 0;) {
+        symPtr = &tablePtr->syms[in[k]];
+        bits = symPtr->maxBits - (x < symPtr->thresh);
+
+        acc = (acc << bits) | (x & ((1u << bits) - 1));
+        count += bits;
+        x = tablePtr->states[symPtr->start + (x >> bits) - symPtr->norm];
+
+        if (count >= 32) {
+            count -= 32;
+            word = acc >> count;
+            ptr[0] = word >> 24;
+            ptr[1] = word >> 16;
+            ptr[2] = word >> 8;
+            ptr[3] = word;
+            ptr += 4;
+        }
+    }
+
+    bw.acc = acc;
+    bw.count = count;
+    bw.ptr = ptr;
+    putBits(&bw, 0, 0);
+
+    // The final state, then the 1 bit that marks where the padding begins
+    putBits(&bw, x - TANS_TABLE_SIZE, TANS_TABLE_LOG);
+    putBits(&bw, 1, 1);
+    flushBits(&bw);
+
+    return bw.ptr - out;
+}
+
+// backRefill(): Fills acc with at least 56 bits, or with whatever is left.
+static inline void backRefill(backReaderT *br) {
+    int bytes;
+
+    if (br->ptr - br->start >= 8) {
+        bytes = (63 - br->count) >> 3;
+        br->acc |= (loadBE64(br->ptr - 8) & (((uint64_t) 1 << (8 * bytes)) - 1))
+                   << br->count;
+        br->ptr -= bytes;
+        br->count += 8 * bytes;
+        return;
+    }
+
+    while (br->count <= 56 && br->ptr > br->start) {
+        br->acc |= (uint64_t) *--br->ptr << br->count;
+        br->count += 8;
+    }
+}
+
+static inline uint32_t backGetBits(backReaderT *br, int len) {
+    uint32_t val = br->acc & (((uint64_t) 1 << len) - 1);
+
+    br->acc >>= len;
+    br->count -= len;
+    return val;
+}
+
+//  decodeBlock(): Decodes the n bytes of a block from the inLen bytes of
+// in, checking that the whole stream is used and that it leads back to the
+// initial state of the encoder.
+static int decodeBlock(const tansDecTableT *tablePtr, const unsigned char *in,
+                       size_t inLen, unsigned char *out, size_t n) {
+    const tansDecEntryT *entries = tablePtr->entries;
+    const tansDecEntryT *entryPtr;
+    backReaderT br;
+    uint32_t state;
+    size_t k = 0;
+
+    if (inLen == 0 || in[inLen - 1] == 0)
+        goto malformed;
+
+    br.start = in;
+    br.ptr = in + inLen;
+    br.acc = 0;
+    br.count = 0;
+    backRefill(&br);
+
+    // Drop the padding and the 1 bit before it
+    backGetBits(&br, __builtin_ctz(in[inLen - 1]) + 1);
+    state = backGetBits(&br, TANS_TABLE_LOG);
+
+    // Fast path, 4 symbols (at most 4 * TANS_MAX_BITS bits) per refill
+    while (n - k >= 4 && br.ptr - br.start >= 8) {
+        backRefill(&br);
+
+        for (int j = 0; j < 4; j++) {
+            entryPtr = &entries[state];
+            out[k++] = entryPtr->sym;
+            state = entryPtr->base + backGetBits(&br, entryPtr->nbBits);
+        }
+    }
+
+    for (; k < n; k++) {
+        backRefill(&br);
+
+        entryPtr = &entries[state];
+        out[k] = entryPtr->sym;
+        state = entryPtr->base + backGetBits(&br, entryPtr->nbBits);
+        if (br.count < 0)
+            goto malformed;
+    }
+
+    if (state == 0 && br.count == 0 && br.ptr == br.start)
+        return 0;
+
+malformed:
+    fprintf(stderr, "%s:%d: Malformed file error, bad tANS block.\n",
+            __FILE__, __LINE__);
+    return -1;
+}
+
+int tansCompress(FILE *src, FILE *dest) {
+    size_t freqs[SYM_NUM];
+    int norms[TANS_SYM_NUM];
+    tansEncTableT *tablePtr;
+    unsigned char *in, *out;
+    size_t bytesRead;
+    uint32_t outLen;
+    int ret = -1;
+
+    assert(src != NULL);
+    assert(dest != NULL);
+
+    tablePtr = memAlloc(sizeof(*tablePtr));
+    in = memAlloc(TANS_BLOCK_SIZE);
+    out = memAlloc(TANS_OUT_SIZE);
+    if (!tablePtr || !in || !out) {
+        reportError("malloc");
+        goto out;
+    }
+
+    // The EOF symbol of countSyms() is left out
+    if (countSyms(src, freqs) < 0)
+        goto out;
+
+    normalizeFreqs(freqs, norms);
+    initEncTable(tablePtr, norms);
+
+    if (fseek(src, 0, SEEK_SET) == -1) {
+        reportError("fseek");
+        goto out;
+    }
+
+    if (writeNorms(dest, norms) < 0)
+        goto out;
+
+    for (;;) {
+        bytesRead = fread(in, 1, TANS_BLOCK_SIZE, src);
+        if (ferror(src)) {
+            reportError("fread");
+            goto out;
+        }
+        if (bytesRead == 0)
+            break;
+
+        outLen = encodeBlock(tablePtr, in, bytesRead, out);
+        if (writeBytes(dest, &outLen, sizeof(outLen)) < 0 ||
+            writeBytes(dest, out, outLen) < 0)
+            goto out;
+    }
+
+    ret = 0;
+out:
+    memFree(tablePtr);
+    memFree(in);
+    memFree(out);
+
+    return ret;
+}
+
+int tansDecompress(FILE *src, FILE *dest, uint64_t origSize) {
+    int norms[TANS_SYM_NUM];
+    tansDecTableT *tablePtr;
+    unsigned char *in, *out;
+    uint64_t remaining = origSize;
+    uint32_t inLen;
+    size_t blockLen;
+    int ret = -1;
+
+    assert(src != NULL);
+    assert(dest != NULL);
+
+    tablePtr = memAlloc(sizeof(*tablePtr));
+    in = memAlloc(TANS_OUT_SIZE);
+    out = memAlloc(TANS_BLOCK_SIZE);
+    if (!tablePtr || !in || !out) {
+        reportError("malloc");
+        goto out;
+    }
+
+    if (readNorms(src, norms) < 0)
+        goto out;
+
+    initDecTable(tablePtr, norms);
+
+    while (remaining > 0) {
+        blockLen =
+          remaining < TANS_BLOCK_SIZE ? remaining : TANS_BLOCK_SIZE;
+
+        if (readBytes(src, &inLen, sizeof(inLen)) < 0)
+            goto out;
+
+        if (inLen > TANS_OUT_SIZE) {
+            fprintf(stderr, "%s:%d: Malformed file error, block of %lu "
+                            "bytes.\n",
+                    __FILE__, __LINE__, (unsigned long) inLen);
+            goto out;
+        }
+
+        if (readBytes(src, in, inLen) < 0)
+            goto out;
+
+        if (decodeBlock(tablePtr, in, inLen, out, blockLen) < 0)
+            goto out;
+
+        if (writeBytes(dest, out, blockLen) < 0)
+            goto out;
+
+        remaining -= blockLen;
+    }
+
+    ret = 0;
+out:
+    memFree(tablePtr);
+    memFree(in);
+    memFree(out);
+
+    return ret;
+}
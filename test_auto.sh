@@ -0,0 +1,33 @@
+#!/bin/bash
+
+# Compress the file $1 with --auto for speed targets, from one only store
+# meets to one nothing meets, and check the choice printed by --stats:
+# the smallest output of the trials at the target speed or faster, or the
+# fastest trial if none is
+status=0
+
+for target in 1 10 100 1000 1000000; do
+  ./fg2019 -C --auto speed:$target --stats $1 comp 2>log
+
+  # The fields of a trial line (indented): its ratio, then its speed
+  if ! awk -v target=$target '
+    /^  [a-z].* MB\/s/ {
+      for (k = 1; k <= NF; k++)
+        if ($k == "ratio") { ratio = $(k + 1); speed = $(k + 2) }
+      if (speed > fastest) { fastest = speed; fastestRatio = ratio }
+      if (speed >= target && ratio > bestRatio) bestRatio = ratio
+      if (/<- chosen/) chosen = ratio
+    }
+    END {
+      want = bestRatio > 0 ? bestRatio : fastestRatio
+      exit chosen == want ? 0 : 1
+    }' log; then
+    >&2 echo "speed:$target chose the wrong trial"
+    status=1
+  fi
+done
+
+if [ $status -eq 0 ]; then
+  >&2 echo "same"
+fi
+exit $status